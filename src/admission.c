@@ -0,0 +1,384 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "admission.h"
+#include "sysinfo.h"
+
+#define GST_CAT_DEFAULT multisource_launch_debug
+
+#define CALIBRATION_GROUP "calibration"
+/* Runs shorter than this do not give a meaningful calibration */
+#define CALIBRATION_MIN_DURATION (30 * G_USEC_PER_SEC)
+
+typedef struct
+{
+  gchar *codec;
+  gint width;
+  gint height;
+  gdouble fps;
+} BranchEstimate;
+
+gboolean
+admission_parse_policy (const gchar * str,
+    GstMultiSourceAdmissionPolicy * policy)
+{
+  if (!g_strcmp0 (str, "off"))
+    *policy = ADMISSION_POLICY_OFF;
+  else if (!g_strcmp0 (str, "reject"))
+    *policy = ADMISSION_POLICY_REJECT;
+  else if (!g_strcmp0 (str, "queue"))
+    *policy = ADMISSION_POLICY_QUEUE;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+/* Measure the idle cores since the previous sample and the memory
+ * available right now, within the limits of the cgroup of the process. The
+ * commitments are reset as the branches they were made for are now part of
+ * the measure. */
+static void
+sample_capacity (GstMultiSourceAdmission * admission)
+{
+  const GstMultiSourceConfig *config = admission->config;
+  gint64 wall = g_get_monotonic_time ();
+  gint64 cpu = sysinfo_get_process_cpu_time ();
+  guint64 total = 0, idle = 0;
+  guint64 usage;
+
+  if (sysinfo_read_cpu_times (&total, &idle)
+      && total > admission->last_total) {
+    admission->idle_cores = (gdouble) (idle - admission->last_idle) /
+        (total - admission->last_total) * g_get_num_processors ();
+    admission->last_total = total;
+    admission->last_idle = idle;
+  }
+  /* A CPU quota can be exhausted while the host is idle */
+  if (wall > admission->last_wall) {
+    gdouble used = (gdouble) (cpu - admission->last_cpu) /
+        (wall - admission->last_wall);
+
+    admission->idle_cores =
+        MIN (admission->idle_cores, MAX (config->cpus - used, 0.0));
+    admission->last_wall = wall;
+    admission->last_cpu = cpu;
+  }
+
+  admission->available_memory = sysinfo_read_available_memory ();
+  if (config->memory_limit != G_MAXUINT64) {
+    usage = sysinfo_read_cgroup_memory_usage ();
+    admission->available_memory = MIN (admission->available_memory,
+        config->memory_limit - MIN (usage, config->memory_limit));
+  }
+  admission->committed_cores = 0.0;
+  admission->committed_memory = 0;
+}
+
+/* Resolution, codec and frame rate of a branch, from the stream once it has
+ * been seen, then from the branch settings, then from the cache. */
+static void
+estimate_branch (GstMultiSourceAdmission * admission,
+    GstMultiSourceBranch * branch, BranchEstimate * estimate)
+{
+  const gchar *codec;
+
+  memset (estimate, 0, sizeof (BranchEstimate));
+
+  g_mutex_lock (&branch->gop.lock);
+  if (branch->gop.codec) {
+    estimate->codec = g_strdup (branch->gop.codec);
+    estimate->width = branch->gop.width;
+    estimate->height = branch->gop.height;
+    if (branch->gop.fps_d > 0)
+      estimate->fps = (gdouble) branch->gop.fps_n / branch->gop.fps_d;
+  }
+  g_mutex_unlock (&branch->gop.lock);
+  if (estimate->codec)
+    return;
+
+  codec = gst_structure_get_string (branch->options, "codec");
+  if (codec) {
+    /* Short names such as "h264" are expanded to their caps name */
+    if (strchr (codec, '/'))
+      estimate->codec = g_strdup (codec);
+    else if (!strcmp (codec, "jpeg"))
+      estimate->codec = g_strdup ("image/jpeg");
+    else
+      estimate->codec = g_strdup_printf ("video/x-%s", codec);
+    gst_structure_get_int (branch->options, "width", &estimate->width);
+    gst_structure_get_int (branch->options, "height", &estimate->height);
+    if (!gst_structure_get_double (branch->options, "fps", &estimate->fps)) {
+      gint fps;
+
+      if (gst_structure_get_int (branch->options, "fps", &fps))
+        estimate->fps = fps;
+    }
+    return;
+  }
+
+  if (admission->cache
+      && g_key_file_has_group (admission->cache, branch->uri)) {
+    estimate->codec =
+        g_key_file_get_string (admission->cache, branch->uri, "codec", NULL);
+    estimate->width =
+        g_key_file_get_integer (admission->cache, branch->uri, "width", NULL);
+    estimate->height =
+        g_key_file_get_integer (admission->cache, branch->uri, "height", NULL);
+    estimate->fps =
+        g_key_file_get_double (admission->cache, branch->uri, "fps", NULL);
+  }
+}
+
+/* Check that the host can take the branch. Returns the reason it cannot, or
+ * NULL and the resources it will need. */
+static gchar *
+check_capacity (GstMultiSourceAdmission * admission,
+    GstMultiSourceBranch * branch, gdouble * cores, guint64 * memory)
+{
+  BranchEstimate estimate;
+  gdouble available;
+  gchar *reason = NULL;
+
+  estimate_branch (admission, branch, &estimate);
+  *cores = gop_estimate_cost (estimate.codec, estimate.width, estimate.height,
+      estimate.fps) * admission->cores_per_unit;
+  *memory = (guint64) (estimate.width > 0 ? estimate.width : 1920) *
+      (estimate.height > 0 ? estimate.height : 1080) * 3 / 2 *
+      ADMISSION_FRAMES;
+
+  available = admission->idle_cores - admission->committed_cores -
+      ADMISSION_HEADROOM * admission->config->cpus;
+  if (*cores > available)
+    reason = g_strdup_printf ("needs %.2f cores for %s %dx%d@%.0f, %.2f left",
+        *cores, estimate.codec ? estimate.codec : "unknown codec",
+        estimate.width, estimate.height, estimate.fps, MAX (available, 0.0));
+  else if (admission->available_memory != G_MAXUINT64
+      && *memory + admission->committed_memory > admission->available_memory)
+    reason = g_strdup_printf ("needs %" G_GUINT64_FORMAT " MB of memory, %"
+        G_GUINT64_FORMAT " MB left", *memory >> 20,
+        (admission->available_memory - MIN (admission->committed_memory,
+                admission->available_memory)) >> 20);
+  g_free (estimate.codec);
+
+  return reason;
+}
+
+GstMultiSourceAdmission *
+admission_new (GstMultiSourceAdmissionPolicy policy,
+    const GstMultiSourceConfig * config, const gchar * cache_path)
+{
+  GstMultiSourceAdmission *admission = g_new0 (GstMultiSourceAdmission, 1);
+  GError *err = NULL;
+
+  admission->policy = policy;
+  admission->config = config;
+  admission->cores_per_unit = ADMISSION_DEFAULT_CORES_PER_UNIT;
+  g_queue_init (&admission->queued);
+
+  if (cache_path) {
+    admission->cache_path = g_strdup (cache_path);
+    admission->cache = g_key_file_new ();
+    if (!g_key_file_load_from_file (admission->cache, cache_path,
+            G_KEY_FILE_NONE, &err)) {
+      GST_DEBUG ("No usable cost cache %s: %s", cache_path, err->message);
+      g_clear_error (&err);
+    } else if (g_key_file_has_key (admission->cache, CALIBRATION_GROUP,
+            "cores-per-unit", NULL)) {
+      admission->cores_per_unit = g_key_file_get_double (admission->cache,
+          CALIBRATION_GROUP, "cores-per-unit", NULL);
+    }
+  }
+
+  /* A first short sample gives the idle cores before any branch runs */
+  if (policy != ADMISSION_POLICY_OFF) {
+    sysinfo_read_cpu_times (&admission->last_total, &admission->last_idle);
+    admission->last_wall = g_get_monotonic_time ();
+    admission->last_cpu = sysinfo_get_process_cpu_time ();
+    g_usleep (100 * 1000);
+    sample_capacity (admission);
+  }
+
+  admission->start_wall = g_get_monotonic_time ();
+  admission->start_cpu = sysinfo_get_process_cpu_time ();
+
+  return admission;
+}
+
+void
+admission_free (GstMultiSourceAdmission * admission)
+{
+  if (admission->source_id)
+    g_source_remove (admission->source_id);
+  g_queue_clear (&admission->queued);
+  if (admission->cache)
+    g_key_file_free (admission->cache);
+  g_free (admission->cache_path);
+  g_free (admission);
+}
+
+GstMultiSourceAdmissionResult
+admission_check (GstMultiSourceAdmission * admission,
+    GstMultiSourceBranch * branch)
+{
+  gdouble cores = 0.0;
+  guint64 memory = 0;
+  gchar *reason;
+
+  if (admission->policy == ADMISSION_POLICY_OFF)
+    return ADMISSION_ACCEPTED;
+
+  /* Keep the queue ordered, nothing goes before an already queued branch */
+  if (admission->policy == ADMISSION_POLICY_QUEUE
+      && !g_queue_is_empty (&admission->queued))
+    reason = g_strdup ("earlier branches are waiting");
+  else
+    reason = check_capacity (admission, branch, &cores, &memory);
+
+  if (!reason) {
+    admission->committed_cores += cores;
+    admission->committed_memory += memory;
+    admission->accepted++;
+    GST_INFO ("Admitting branch %u (%.2f cores, %" G_GUINT64_FORMAT " MB)",
+        branch->id, cores, memory >> 20);
+    return ADMISSION_ACCEPTED;
+  }
+
+  if (admission->policy == ADMISSION_POLICY_REJECT) {
+    PRINT ("admission: rejecting branch %s: %s", branch->uri, reason);
+    admission->rejected++;
+    g_free (reason);
+    return ADMISSION_REJECTED;
+  }
+
+  PRINT ("admission: queuing branch %u %s: %s", branch->id, branch->uri,
+      reason);
+  g_queue_push_tail (&admission->queued, branch);
+  gate_request (&branch->gate, GATE_OWNER_ADMISSION, GATE_LEVEL_PAUSED);
+  g_free (reason);
+
+  return ADMISSION_QUEUED;
+}
+
+static gboolean
+admission_tick (gpointer user_data)
+{
+  GstMultiSourceAdmission *admission = user_data;
+  GstMultiSourceBranch *branch;
+  gdouble cores;
+  guint64 memory;
+  gchar *reason;
+
+  sample_capacity (admission);
+
+  while ((branch = g_queue_peek_head (&admission->queued))) {
+    reason = check_capacity (admission, branch, &cores, &memory);
+    if (reason) {
+      GST_DEBUG ("Branch %u still waiting: %s", branch->id, reason);
+      g_free (reason);
+      break;
+    }
+    g_queue_pop_head (&admission->queued);
+    admission->committed_cores += cores;
+    admission->committed_memory += memory;
+    admission->accepted++;
+    gate_request (&branch->gate, GATE_OWNER_ADMISSION, GATE_LEVEL_FULL);
+    PRINT ("admission: starting queued branch %u %s", branch->id,
+        branch->uri);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Queued branches are connected but not decoded. They are admitted in
+ * order as soon as a new sample shows enough capacity. */
+void
+admission_start (GstMultiSourceAdmission * admission)
+{
+  if (admission->policy == ADMISSION_POLICY_QUEUE && !admission->source_id)
+    admission->source_id =
+        g_timeout_add (ADMISSION_INTERVAL, admission_tick, admission);
+}
+
+/* Store what was learnt about the branches and the cost of a decoding unit
+ * on this host for the next run. */
+void
+admission_save (GstMultiSourceAdmission * admission, GPtrArray * branches)
+{
+  GError *err = NULL;
+  gdouble total_cost = 0.0;
+  gint64 wall;
+  guint i;
+
+  if (!admission->cache)
+    return;
+
+  for (i = 0; i < branches->len; i++) {
+    GstMultiSourceBranch *branch = g_ptr_array_index (branches, i);
+    GstMultiSourceGop *gop = &branch->gop;
+
+    if (gate_get_level (&branch->gate) == GATE_LEVEL_FULL)
+      total_cost += gop_get_cost (gop);
+
+    g_mutex_lock (&gop->lock);
+    if (gop->codec) {
+      g_key_file_set_string (admission->cache, branch->uri, "codec",
+          gop->codec);
+      g_key_file_set_integer (admission->cache, branch->uri, "width",
+          gop->width);
+      g_key_file_set_integer (admission->cache, branch->uri, "height",
+          gop->height);
+      g_key_file_set_double (admission->cache, branch->uri, "fps",
+          gop->framerate > 0.0 ? gop->framerate : gop->fps_d > 0 ?
+          (gdouble) gop->fps_n / gop->fps_d : 0.0);
+    }
+    g_mutex_unlock (&gop->lock);
+  }
+
+  wall = g_get_monotonic_time () - admission->start_wall;
+  if (wall >= CALIBRATION_MIN_DURATION && total_cost > 0.0) {
+    gdouble cores = (gdouble) (sysinfo_get_process_cpu_time () -
+        admission->start_cpu) / wall;
+
+    g_key_file_set_double (admission->cache, CALIBRATION_GROUP,
+        "cores-per-unit", cores / total_cost);
+  }
+
+  if (!g_key_file_save_to_file (admission->cache, admission->cache_path,
+          &err)) {
+    GST_WARNING ("Unable to save the cost cache %s: %s",
+        admission->cache_path, err->message);
+    g_clear_error (&err);
+  }
+}
+
+GstStructure *
+admission_get_stats (GstMultiSourceAdmission * admission)
+{
+  return gst_structure_new ("admission",
+      "idle-cores", G_TYPE_DOUBLE, admission->idle_cores,
+      "available-memory", G_TYPE_UINT64, admission->available_memory,
+      "cores-per-unit", G_TYPE_DOUBLE, admission->cores_per_unit,
+      "accepted", G_TYPE_UINT, admission->accepted,
+      "rejected", G_TYPE_UINT, admission->rejected,
+      "queued", G_TYPE_UINT, admission->queued.length, NULL);
+}
@@ -0,0 +1,94 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_ADMISSION_H__
+#define __GST_MULTI_SOURCE_ADMISSION_H__
+
+#include <gst/gst.h>
+
+#include "branch.h"
+
+G_BEGIN_DECLS
+
+#define ADMISSION_INTERVAL 5000
+/* CPU cores needed by a 1080p30 H.264 branch until it has been measured */
+#define ADMISSION_DEFAULT_CORES_PER_UNIT 0.3
+/* Share of the cores kept free for the rest of the process */
+#define ADMISSION_HEADROOM 0.1
+/* Decoded frames a branch keeps in flight in its pools and queues */
+#define ADMISSION_FRAMES 12
+
+typedef enum
+{
+  ADMISSION_POLICY_OFF,
+  ADMISSION_POLICY_REJECT,
+  ADMISSION_POLICY_QUEUE,
+} GstMultiSourceAdmissionPolicy;
+
+typedef enum
+{
+  ADMISSION_ACCEPTED,
+  ADMISSION_REJECTED,
+  ADMISSION_QUEUED,
+} GstMultiSourceAdmissionResult;
+
+typedef struct _GstMultiSourceAdmission
+{
+  GstMultiSourceAdmissionPolicy policy;
+  const GstMultiSourceConfig *config;
+  gchar *cache_path;
+  GKeyFile *cache;
+  gdouble cores_per_unit;
+
+  /* capacity measured on the host */
+  guint64 last_total;
+  guint64 last_idle;
+  gint64 last_wall;
+  gint64 last_cpu;
+  gdouble idle_cores;
+  guint64 available_memory;
+
+  /* resources promised to the branches admitted since the last sample */
+  gdouble committed_cores;
+  guint64 committed_memory;
+
+  GQueue queued;
+  guint source_id;
+  gint64 start_wall;
+  gint64 start_cpu;
+  guint accepted;
+  guint rejected;
+} GstMultiSourceAdmission;
+
+gboolean admission_parse_policy (const gchar * str,
+    GstMultiSourceAdmissionPolicy * policy);
+GstMultiSourceAdmission *admission_new (GstMultiSourceAdmissionPolicy policy,
+    const GstMultiSourceConfig * config, const gchar * cache_path);
+void admission_free (GstMultiSourceAdmission * admission);
+GstMultiSourceAdmissionResult admission_check (GstMultiSourceAdmission *
+    admission, GstMultiSourceBranch * branch);
+void admission_start (GstMultiSourceAdmission * admission);
+void admission_save (GstMultiSourceAdmission * admission,
+    GPtrArray * branches);
+GstStructure *admission_get_stats (GstMultiSourceAdmission * admission);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_ADMISSION_H__ */
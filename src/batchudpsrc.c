@@ -0,0 +1,475 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-batchudpsrc
+ *
+ * Receive UDP datagrams in batches: a single recvmmsg call fills up to
+ * batch buffers, which are pushed downstream as one buffer list. The
+ * buffers come from a pool and are mapped ahead, so receiving at a high
+ * packet rate costs a system call per batch rather than per packet.
+ *
+ * It has the address, port, buffer-size and caps properties of udpsrc,
+ * the rest of udpsrc is not supported.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "multisource.h"
+#include "batchudpsrc.h"
+
+#define GST_CAT_DEFAULT multisource_launch_debug
+
+enum
+{
+  PROP_0,
+  PROP_ADDRESS,
+  PROP_PORT,
+  PROP_BUFFER_SIZE,
+  PROP_BATCH,
+  PROP_MTU,
+  PROP_CAPS,
+  PROP_RECV_STATS,
+};
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+G_DEFINE_TYPE (GstMultiSourceBatchUdpSrc, batch_udp_src, GST_TYPE_PUSH_SRC);
+
+/* Ask for a large socket receive buffer, so that bursts are not dropped
+ * while the streaming thread is busy. Forcing it above rmem_max needs
+ * CAP_NET_ADMIN. */
+static void
+set_buffer_size (GstMultiSourceBatchUdpSrc * self)
+{
+  gint size = 0;
+
+  if (!g_socket_set_option (self->socket, SOL_SOCKET, SO_RCVBUFFORCE,
+          self->buffer_size, NULL))
+    g_socket_set_option (self->socket, SOL_SOCKET, SO_RCVBUF,
+        self->buffer_size, NULL);
+
+  /* Linux reports twice the size asked for */
+  if (g_socket_get_option (self->socket, SOL_SOCKET, SO_RCVBUF, &size, NULL)
+      && size / 2 < self->buffer_size)
+    GST_WARNING_OBJECT (self, "Receive buffer limited to %d bytes instead of "
+        "%d, raise net.core.rmem_max", size / 2, self->buffer_size);
+}
+
+static gboolean
+batch_udp_src_start (GstBaseSrc * src)
+{
+  GstMultiSourceBatchUdpSrc *self = GST_MULTI_SOURCE_BATCH_UDP_SRC (src);
+  GInetAddress *addr;
+  GSocketAddress *bind_addr;
+  GstStructure *config;
+  GError *err = NULL;
+
+  addr = g_inet_address_new_from_string (self->address);
+  if (!addr) {
+    GST_ELEMENT_ERROR (self, RESOURCE, SETTINGS,
+        ("Invalid address \"%s\".", self->address), (NULL));
+    return FALSE;
+  }
+
+  self->socket = g_socket_new (g_inet_address_get_family (addr),
+      G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, &err);
+  if (!self->socket)
+    goto error;
+  if (self->buffer_size > 0)
+    set_buffer_size (self);
+
+  bind_addr = g_inet_socket_address_new (addr, self->port);
+  if (!g_socket_bind (self->socket, bind_addr, TRUE, &err)) {
+    g_object_unref (bind_addr);
+    goto error;
+  }
+  g_object_unref (bind_addr);
+  if (g_inet_address_get_is_multicast (addr)
+      && !g_socket_join_multicast_group (self->socket, addr, FALSE, NULL,
+          &err))
+    goto error;
+  g_object_unref (addr);
+
+  self->pool = gst_buffer_pool_new ();
+  config = gst_buffer_pool_get_config (self->pool);
+  gst_buffer_pool_config_set_params (config, NULL, self->mtu, self->batch, 0);
+  gst_buffer_pool_set_config (self->pool, config);
+  gst_buffer_pool_set_active (self->pool, TRUE);
+
+  self->slots = g_new0 (GstBuffer *, self->batch);
+  self->maps = g_new0 (GstMapInfo, self->batch);
+  self->msgs = g_new0 (struct mmsghdr, self->batch);
+  self->iov = g_new0 (struct iovec, self->batch);
+
+  return TRUE;
+
+error:
+  GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ,
+      ("Could not receive on %s:%u.", self->address, self->port),
+      ("%s", err->message));
+  g_clear_error (&err);
+  g_clear_object (&self->socket);
+  g_object_unref (addr);
+  return FALSE;
+}
+
+static gboolean
+batch_udp_src_stop (GstBaseSrc * src)
+{
+  GstMultiSourceBatchUdpSrc *self = GST_MULTI_SOURCE_BATCH_UDP_SRC (src);
+  guint i;
+
+  for (i = 0; self->slots && i < self->batch; i++) {
+    if (self->slots[i]) {
+      gst_buffer_unmap (self->slots[i], &self->maps[i]);
+      gst_buffer_unref (self->slots[i]);
+    }
+  }
+  g_clear_pointer (&self->slots, g_free);
+  g_clear_pointer (&self->maps, g_free);
+  g_clear_pointer (&self->msgs, g_free);
+  g_clear_pointer (&self->iov, g_free);
+  if (self->pool) {
+    gst_buffer_pool_set_active (self->pool, FALSE);
+    gst_clear_object (&self->pool);
+  }
+  if (self->socket) {
+    g_socket_close (self->socket, NULL);
+    g_clear_object (&self->socket);
+  }
+
+  return TRUE;
+}
+
+/* Map a buffer for every slot used by the previous batch */
+static GstFlowReturn
+refill (GstMultiSourceBatchUdpSrc * self)
+{
+  GstFlowReturn ret;
+  guint i;
+
+  for (i = 0; i < self->batch; i++) {
+    if (self->slots[i])
+      continue;
+    ret = gst_buffer_pool_acquire_buffer (self->pool, &self->slots[i], NULL);
+    if (ret != GST_FLOW_OK)
+      return ret;
+    gst_buffer_map (self->slots[i], &self->maps[i], GST_MAP_WRITE);
+    self->iov[i].iov_base = self->maps[i].data;
+    self->iov[i].iov_len = self->maps[i].size;
+    self->msgs[i].msg_hdr.msg_iov = &self->iov[i];
+    self->msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  return GST_FLOW_OK;
+}
+
+static GstClockTime
+get_running_time (GstMultiSourceBatchUdpSrc * self)
+{
+  GstClock *clock = gst_element_get_clock (GST_ELEMENT (self));
+  GstClockTime now;
+
+  if (!clock)
+    return GST_CLOCK_TIME_NONE;
+  now = gst_clock_get_time (clock) - gst_element_get_base_time (GST_ELEMENT
+      (self));
+  gst_object_unref (clock);
+
+  return now;
+}
+
+static GstFlowReturn
+batch_udp_src_create (GstPushSrc * src, GstBuffer ** buffer)
+{
+  GstMultiSourceBatchUdpSrc *self = GST_MULTI_SOURCE_BATCH_UDP_SRC (src);
+  GstBufferList *list;
+  GstFlowReturn ret;
+  GError *err = NULL;
+  GstClockTime now;
+  guint truncated;
+  gint i, n;
+
+again:
+  if ((ret = refill (self)) != GST_FLOW_OK)
+    return ret;
+
+  do {
+    if (!g_socket_condition_wait (self->socket, G_IO_IN, self->cancellable,
+            &err)) {
+      if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        g_clear_error (&err);
+        return GST_FLOW_FLUSHING;
+      }
+      GST_ELEMENT_ERROR (self, RESOURCE, READ, (NULL),
+          ("Could not wait for data: %s", err->message));
+      g_clear_error (&err);
+      return GST_FLOW_ERROR;
+    }
+    n = recvmmsg (g_socket_get_fd (self->socket), self->msgs, self->batch,
+        MSG_DONTWAIT, NULL);
+    if (n < 0 && errno != EAGAIN && errno != EINTR) {
+      GST_ELEMENT_ERROR (self, RESOURCE, READ, (NULL),
+          ("Could not receive: %s", g_strerror (errno)));
+      return GST_FLOW_ERROR;
+    }
+  } while (n <= 0);
+
+  now = get_running_time (self);
+  truncated = 0;
+  list = gst_buffer_list_new_sized (n);
+  for (i = 0; i < n; i++) {
+    GstBuffer *buf = self->slots[i];
+
+    gst_buffer_unmap (buf, &self->maps[i]);
+    self->slots[i] = NULL;
+    if (self->msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+      truncated++;
+      gst_buffer_unref (buf);
+      continue;
+    }
+    gst_buffer_resize (buf, 0, self->msgs[i].msg_len);
+    GST_BUFFER_DTS (buf) = now;
+    gst_buffer_list_add (list, buf);
+  }
+
+  GST_OBJECT_LOCK (self);
+  self->packets += n - truncated;
+  self->truncated += truncated;
+  self->batches++;
+  GST_OBJECT_UNLOCK (self);
+
+  if (gst_buffer_list_length (list) == 0) {
+    gst_buffer_list_unref (list);
+    goto again;
+  }
+
+  gst_base_src_submit_buffer_list (GST_BASE_SRC (src), list);
+  *buffer = NULL;
+
+  return GST_FLOW_OK;
+}
+
+static GstCaps *
+batch_udp_src_get_caps (GstBaseSrc * src, GstCaps * filter)
+{
+  GstMultiSourceBatchUdpSrc *self = GST_MULTI_SOURCE_BATCH_UDP_SRC (src);
+  GstCaps *caps;
+
+  GST_OBJECT_LOCK (self);
+  caps = self->caps ? gst_caps_ref (self->caps) : gst_caps_new_any ();
+  GST_OBJECT_UNLOCK (self);
+
+  if (filter) {
+    GstCaps *intersection = gst_caps_intersect_full (filter, caps,
+        GST_CAPS_INTERSECT_FIRST);
+
+    gst_caps_unref (caps);
+    caps = intersection;
+  }
+
+  return caps;
+}
+
+static gboolean
+batch_udp_src_unlock (GstBaseSrc * src)
+{
+  GstMultiSourceBatchUdpSrc *self = GST_MULTI_SOURCE_BATCH_UDP_SRC (src);
+
+  g_cancellable_cancel (self->cancellable);
+
+  return TRUE;
+}
+
+static gboolean
+batch_udp_src_unlock_stop (GstBaseSrc * src)
+{
+  GstMultiSourceBatchUdpSrc *self = GST_MULTI_SOURCE_BATCH_UDP_SRC (src);
+
+  g_cancellable_reset (self->cancellable);
+
+  return TRUE;
+}
+
+static void
+batch_udp_src_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMultiSourceBatchUdpSrc *self = GST_MULTI_SOURCE_BATCH_UDP_SRC (object);
+
+  switch (prop_id) {
+    case PROP_ADDRESS:
+      g_free (self->address);
+      self->address = g_value_dup_string (value);
+      break;
+    case PROP_PORT:
+      self->port = g_value_get_int (value);
+      break;
+    case PROP_BUFFER_SIZE:
+      self->buffer_size = g_value_get_int (value);
+      break;
+    case PROP_BATCH:
+      self->batch = g_value_get_uint (value);
+      break;
+    case PROP_MTU:
+      self->mtu = g_value_get_uint (value);
+      break;
+    case PROP_CAPS:
+      GST_OBJECT_LOCK (self);
+      gst_caps_replace (&self->caps, (GstCaps *) gst_value_get_caps (value));
+      GST_OBJECT_UNLOCK (self);
+      gst_pad_mark_reconfigure (GST_BASE_SRC_PAD (self));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+batch_udp_src_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstMultiSourceBatchUdpSrc *self = GST_MULTI_SOURCE_BATCH_UDP_SRC (object);
+
+  switch (prop_id) {
+    case PROP_ADDRESS:
+      g_value_set_string (value, self->address);
+      break;
+    case PROP_PORT:
+      g_value_set_int (value, self->port);
+      break;
+    case PROP_BUFFER_SIZE:
+      g_value_set_int (value, self->buffer_size);
+      break;
+    case PROP_BATCH:
+      g_value_set_uint (value, self->batch);
+      break;
+    case PROP_MTU:
+      g_value_set_uint (value, self->mtu);
+      break;
+    case PROP_CAPS:
+      GST_OBJECT_LOCK (self);
+      gst_value_set_caps (value, self->caps);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_RECV_STATS:
+      GST_OBJECT_LOCK (self);
+      g_value_take_boxed (value, gst_structure_new ("batchudpsrc",
+              "packets", G_TYPE_UINT64, self->packets,
+              "batches", G_TYPE_UINT64, self->batches,
+              "truncated", G_TYPE_UINT64, self->truncated, NULL));
+      GST_OBJECT_UNLOCK (self);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+batch_udp_src_finalize (GObject * object)
+{
+  GstMultiSourceBatchUdpSrc *self = GST_MULTI_SOURCE_BATCH_UDP_SRC (object);
+
+  g_free (self->address);
+  gst_clear_caps (&self->caps);
+  g_object_unref (self->cancellable);
+
+  G_OBJECT_CLASS (batch_udp_src_parent_class)->finalize (object);
+}
+
+static void
+batch_udp_src_class_init (GstMultiSourceBatchUdpSrcClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS (klass);
+  GstPushSrcClass *pushsrc_class = GST_PUSH_SRC_CLASS (klass);
+
+  gobject_class->set_property = batch_udp_src_set_property;
+  gobject_class->get_property = batch_udp_src_get_property;
+  gobject_class->finalize = batch_udp_src_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_ADDRESS,
+      g_param_spec_string ("address", "Address",
+          "Address to receive on, joined when multicast",
+          BATCH_UDP_SRC_DEFAULT_ADDRESS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PORT,
+      g_param_spec_int ("port", "Port", "Port to receive on", 0, G_MAXUINT16,
+          BATCH_UDP_SRC_DEFAULT_PORT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_BUFFER_SIZE,
+      g_param_spec_int ("buffer-size", "Buffer size",
+          "Socket receive buffer size (0 = system default)", 0, G_MAXINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_BATCH,
+      g_param_spec_uint ("batch", "Batch",
+          "Datagrams received with a single system call", 1, 1024,
+          BATCH_UDP_SRC_DEFAULT_BATCH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MTU,
+      g_param_spec_uint ("mtu", "MTU",
+          "Largest datagram received, larger ones are dropped", 64,
+          G_MAXUINT16 + 1, BATCH_UDP_SRC_DEFAULT_MTU,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_CAPS,
+      g_param_spec_boxed ("caps", "Caps", "Caps of the received data",
+          GST_TYPE_CAPS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_RECV_STATS,
+      g_param_spec_boxed ("recv-stats", "Receive statistics",
+          "Packets, batches and truncated datagrams received",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+  gst_element_class_set_static_metadata (element_class,
+      "Batch UDP Source", "Source/Network",
+      "Receive UDP datagrams in batches with recvmmsg",
+      "gst-multisource-launch");
+
+  basesrc_class->start = batch_udp_src_start;
+  basesrc_class->stop = batch_udp_src_stop;
+  basesrc_class->get_caps = batch_udp_src_get_caps;
+  basesrc_class->unlock = batch_udp_src_unlock;
+  basesrc_class->unlock_stop = batch_udp_src_unlock_stop;
+  pushsrc_class->create = batch_udp_src_create;
+}
+
+static void
+batch_udp_src_init (GstMultiSourceBatchUdpSrc * self)
+{
+  self->address = g_strdup (BATCH_UDP_SRC_DEFAULT_ADDRESS);
+  self->port = BATCH_UDP_SRC_DEFAULT_PORT;
+  self->batch = BATCH_UDP_SRC_DEFAULT_BATCH;
+  self->mtu = BATCH_UDP_SRC_DEFAULT_MTU;
+  self->cancellable = g_cancellable_new ();
+  gst_base_src_set_live (GST_BASE_SRC (self), TRUE);
+  gst_base_src_set_format (GST_BASE_SRC (self), GST_FORMAT_TIME);
+}
@@ -0,0 +1,77 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_BATCH_UDP_SRC_H__
+#define __GST_MULTI_SOURCE_BATCH_UDP_SRC_H__
+
+#include <gio/gio.h>
+#include <gst/gst.h>
+#include <gst/base/gstpushsrc.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MULTI_SOURCE_BATCH_UDP_SRC (batch_udp_src_get_type ())
+#define GST_MULTI_SOURCE_BATCH_UDP_SRC(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_MULTI_SOURCE_BATCH_UDP_SRC, \
+        GstMultiSourceBatchUdpSrc))
+
+#define BATCH_UDP_SRC_DEFAULT_ADDRESS "0.0.0.0"
+#define BATCH_UDP_SRC_DEFAULT_PORT 5004
+#define BATCH_UDP_SRC_DEFAULT_BATCH 32
+/* Size of the buffers received into, larger datagrams are dropped */
+#define BATCH_UDP_SRC_DEFAULT_MTU 2048
+
+typedef struct _GstMultiSourceBatchUdpSrc
+{
+  GstPushSrc parent;
+
+  /* properties */
+  gchar *address;
+  guint port;
+  gint buffer_size;
+  guint batch;
+  guint mtu;
+  GstCaps *caps;
+
+  GSocket *socket;
+  GCancellable *cancellable;
+  GstBufferPool *pool;
+  /* buffers mapped and ready to receive the next batch */
+  GstBuffer **slots;
+  GstMapInfo *maps;
+  struct mmsghdr *msgs;
+  struct iovec *iov;
+
+  /* statistics, protected by the object lock */
+  guint64 packets;
+  guint64 batches;
+  guint64 truncated;
+} GstMultiSourceBatchUdpSrc;
+
+typedef struct _GstMultiSourceBatchUdpSrcClass
+{
+  GstPushSrcClass parent_class;
+} GstMultiSourceBatchUdpSrcClass;
+
+GType batch_udp_src_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_BATCH_UDP_SRC_H__ */
@@ -0,0 +1,986 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <gst/video/video.h>
+#include <gst/audio/audio.h>
+
+#include "branch.h"
+
+#define GST_CAT_DEFAULT multisource_launch_debug
+
+/* State attached to each decoded output pad of a branch */
+typedef struct
+{
+  GstMultiSourceBranch *branch;
+  gboolean have_caps;
+  gboolean is_video;
+  gboolean check_health;
+  GstVideoInfo vinfo;
+  gboolean is_audio;
+  gboolean meter;
+  GstAudioInfo ainfo;
+} DecodedPad;
+
+/* State attached to each input of the multiqueues of a branch */
+typedef struct
+{
+  GstMultiSourceBranch *branch;
+  gboolean dropping;
+} QueuePad;
+
+/* What each priority class gets: the nice value of its streaming threads,
+ * the least amount of data decodebin3 queues and the threads of its
+ * decoders, 0 letting the decoder use every CPU granted to the process.
+ * The queue time and decoder threads are only set when the branch names
+ * its class. Background
+ * branches absorb the contention so that critical ones keep their full
+ * frame rate. */
+static const struct
+{
+  const gchar *name;
+  gint nice;
+  GstClockTime queue_time;
+  gint decoder_threads;
+} priority_classes[] = {
+  [BRANCH_PRIORITY_BACKGROUND] = {"background", 10, 1 * GST_SECOND, 1},
+  [BRANCH_PRIORITY_NORMAL] = {"normal", 0, 2 * GST_SECOND, -1},
+  [BRANCH_PRIORITY_CRITICAL] = {"critical", -5, 4 * GST_SECOND, 0},
+};
+
+const gchar *
+branch_priority_get_name (GstMultiSourcePriority priority)
+{
+  return priority_classes[priority].name;
+}
+
+/* The priority setting takes a class name or its rank */
+static GstMultiSourcePriority
+parse_priority (const GstStructure * options)
+{
+  const gchar *name = gst_structure_get_string (options, "priority");
+  gint rank;
+  guint i;
+
+  if (name) {
+    for (i = 0; i < G_N_ELEMENTS (priority_classes); i++) {
+      if (!strcmp (name, priority_classes[i].name))
+        return i;
+    }
+    GST_WARNING ("Unknown priority class %s", name);
+  } else if (gst_structure_get_int (options, "priority", &rank)) {
+    return CLAMP (rank, BRANCH_PRIORITY_BACKGROUND, BRANCH_PRIORITY_CRITICAL);
+  }
+
+  return BRANCH_PRIORITY_NORMAL;
+}
+
+static GstMultiSourceOverflow
+parse_overflow (const GstStructure * options, GstMultiSourceOverflow def)
+{
+  const gchar *name = gst_structure_get_string (options, "overflow");
+  GstMultiSourceOverflow overflow;
+
+  if (!name)
+    return def;
+  if (!quota_parse_overflow (name, &overflow)) {
+    GST_WARNING ("Unknown overflow policy %s", name);
+    return def;
+  }
+
+  return overflow;
+}
+
+/* Parse the "key=value" settings following the URI of a branch
+ * description. */
+static GstStructure *
+parse_options (gchar ** tokens)
+{
+  GstStructure *options;
+  gchar *joined, *str;
+
+  joined = g_strjoinv (", ", tokens);
+  str = g_strdup_printf ("options%s%s", *joined ? ", " : "", joined);
+  options = gst_structure_from_string (str, NULL);
+  if (!options) {
+    GST_WARNING ("Ignoring invalid branch options \"%s\"", joined);
+    options = gst_structure_new_empty ("options");
+  }
+  g_free (str);
+  g_free (joined);
+
+  return options;
+}
+
+/* A branch is described by its URI optionally followed by space separated
+ * settings, e.g. "rtsp://camera/stream priority=critical". */
+GstMultiSourceBranch *
+branch_new (guint id, const gchar * desc, const GstMultiSourceConfig * config)
+{
+  GstMultiSourceBranch *branch = g_new0 (GstMultiSourceBranch, 1);
+  gchar **tokens = g_strsplit_set (desc, " \t", -1);
+  GPtrArray *settings = g_ptr_array_new ();
+  gchar **token;
+
+  for (token = tokens; *token; token++) {
+    if (**token == '\0')
+      continue;
+    if (!branch->uri)
+      branch->uri = g_strdup (*token);
+    else
+      g_ptr_array_add (settings, *token);
+  }
+  g_ptr_array_add (settings, NULL);
+  if (!branch->uri)
+    branch->uri = g_strdup ("");
+
+  branch->id = id;
+  branch->config = config;
+  g_mutex_init (&branch->lock);
+  branch->queues = g_ptr_array_new_with_free_func (gst_object_unref);
+  branch->options = parse_options ((gchar **) settings->pdata);
+  branch->priority = parse_priority (branch->options);
+  if (!gst_structure_get_boolean (branch->options, "on-demand",
+          &branch->on_demand))
+    branch->on_demand = config->on_demand;
+  g_ptr_array_free (settings, TRUE);
+  g_strfreev (tokens);
+
+  /* "cam.sdp", or "udp://239.1.1.1:5004 sdp=cam.sdp" to receive the
+   * stream somewhere else than the SDP says. Only local SDP files, a
+   * path or a file:// URI, are read here, the other schemes stay with
+   * urisourcebin. */
+  if (gst_structure_has_field (branch->options, "sdp"))
+    branch->sdp = g_strdup (gst_structure_get_string (branch->options,
+            "sdp"));
+  else if (g_str_has_suffix (branch->uri, ".sdp")
+      && gst_uri_has_protocol (branch->uri, "file"))
+    branch->sdp = g_filename_from_uri (branch->uri, NULL, NULL);
+  else if (g_str_has_suffix (branch->uri, ".sdp")
+      && !gst_uri_is_valid (branch->uri))
+    branch->sdp = g_strdup (branch->uri);
+
+  health_init (&branch->health, config->health_timeout);
+  silence_init (&branch->silence, config->silence_threshold,
+      SILENCE_DEFAULT_HOLD);
+  gop_init (&branch->gop, config->max_key_interval);
+  gate_init (&branch->gate);
+  /* The GOP is what lets a branch decoded on demand, or entering the
+   * rotation window, start right away */
+  gopcache_init (&branch->gop_cache, config->gop_cache_bytes ?
+      config->gop_cache_bytes : branch->on_demand || (config->rotate
+          && branch->priority == BRANCH_PRIORITY_BACKGROUND) ?
+      GOPCACHE_DEFAULT_BYTES : 0);
+  history_init (&branch->history, config->clip_preroll);
+  quota_init (&branch->quota, parse_overflow (branch->options,
+          config->overflow));
+
+  return branch;
+}
+
+void
+branch_free (GstMultiSourceBranch * branch)
+{
+  if (branch->source)
+    gst_object_unref (branch->source);
+  if (branch->decoder)
+    gst_object_unref (branch->decoder);
+  health_clear (&branch->health);
+  silence_clear (&branch->silence);
+  gop_clear (&branch->gop);
+  gate_clear (&branch->gate);
+  gopcache_clear (&branch->gop_cache);
+  history_clear (&branch->history);
+  quota_clear (&branch->quota);
+  gst_structure_free (branch->options);
+  g_ptr_array_free (branch->queues, TRUE);
+  g_mutex_clear (&branch->lock);
+  g_free (branch->sdp);
+  g_free (branch->uri);
+  g_free (branch);
+}
+
+/* An SDP branch sets up its RTP receive chain itself rather than having
+ * urisourcebin and decodebin3 find sdpdemux. Its source exposes a pad per
+ * media, each linked to its own decodebin3 input once attached. */
+static gchar *
+get_sdp_description (GstMultiSourceBranch * branch)
+{
+  static const gchar *settings[] = { "buffer-size", "batch", "latency" };
+  GString *desc = g_string_new (NULL);
+  guint i;
+  gint value;
+
+  g_string_append_printf (desc, "rtpsdpsrc name=src%u location=\"%s\"",
+      branch->id, branch->sdp);
+  if (gst_uri_has_protocol (branch->uri, "udp"))
+    g_string_append_printf (desc, " uri=%s", branch->uri);
+  for (i = 0; i < G_N_ELEMENTS (settings); i++)
+    if (gst_structure_get_int (branch->options, settings[i], &value))
+      g_string_append_printf (desc, " %s=%d", settings[i], value);
+  g_string_append_printf (desc, " decodebin3 name=dec%u", branch->id);
+
+  return g_string_free (desc, FALSE);
+}
+
+gchar *
+branch_get_description (GstMultiSourceBranch * branch)
+{
+  if (branch->sdp)
+    return get_sdp_description (branch);
+
+  return g_strdup_printf ("urisourcebin name=src%u uri=%s ! decodebin3 name=dec%u",
+      branch->id, branch->uri, branch->id);
+}
+
+/* Post a statistics snapshot as an element message on the bus */
+static void
+post_stats (GstMultiSourceBranch * branch, const gchar * name,
+    GstStructure * s)
+{
+  gst_structure_set_name (s, name);
+  gst_structure_set (s, "branch", G_TYPE_UINT, branch->id, NULL);
+  gst_element_post_message (branch->decoder,
+      gst_message_new_element (GST_OBJECT_CAST (branch->decoder), s));
+}
+
+/* Only claim the first pad of a kind for a branch */
+static gboolean
+claim_pad (GstPad ** owner, GstPad * pad)
+{
+  return g_atomic_pointer_compare_and_exchange (owner, NULL, pad)
+      || g_atomic_pointer_get (owner) == pad;
+}
+
+static void
+decoded_pad_set_caps (DecodedPad * dpad, GstPad * pad, GstCaps * caps)
+{
+  GstMultiSourceBranch *branch = dpad->branch;
+  GstStructure *s = gst_caps_get_structure (caps, 0);
+
+  dpad->have_caps = TRUE;
+  g_atomic_int_set (&branch->decoded, TRUE);
+  dpad->is_video = gst_structure_has_name (s, "video/x-raw")
+      && gst_video_info_from_caps (&dpad->vinfo, caps);
+  dpad->check_health = dpad->is_video && branch->config->health_check
+      && claim_pad (&branch->health_pad, pad);
+  dpad->is_audio = gst_structure_has_name (s, "audio/x-raw")
+      && gst_audio_info_from_caps (&dpad->ainfo, caps);
+  dpad->meter = dpad->is_audio && branch->config->audio_level
+      && claim_pad (&branch->level_pad, pad);
+}
+
+/* Replace a silent buffer by a GAP event so the muxer and the sink have
+ * nothing to process for it. */
+static GstPadProbeReturn
+suppress_buffer (GstPad * pad, GstBuffer * buffer)
+{
+  if (!GST_BUFFER_PTS_IS_VALID (buffer))
+    return GST_PAD_PROBE_OK;
+
+  gst_pad_push_event (pad, gst_event_new_gap (GST_BUFFER_PTS (buffer),
+          GST_BUFFER_DURATION (buffer)));
+
+  return GST_PAD_PROBE_DROP;
+}
+
+/* Replace a buffer dropped by the gate by a GAP event covering it, so that a
+ * muxer collecting all its pads, such as multipartmux, keeps going without
+ * the branch rather than waiting for it. */
+static GstPadProbeReturn
+drop_as_gap (GstPad * pad, GstBuffer * buffer)
+{
+  GstClockTime ts = GST_BUFFER_PTS_IS_VALID (buffer) ?
+      GST_BUFFER_PTS (buffer) : GST_BUFFER_DTS (buffer);
+
+  if (GST_CLOCK_TIME_IS_VALID (ts))
+    gst_pad_push_event (pad, gst_event_new_gap (ts,
+            GST_BUFFER_DURATION (buffer)));
+
+  return GST_PAD_PROBE_DROP;
+}
+
+static GstPadProbeReturn
+decoded_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  DecodedPad *dpad = user_data;
+  GstMultiSourceBranch *branch = dpad->branch;
+  GstVideoFrame frame;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_CAPS) {
+      GstCaps *caps;
+
+      gst_event_parse_caps (event, &caps);
+      decoded_pad_set_caps (dpad, pad, caps);
+    }
+    return GST_PAD_PROBE_OK;
+  }
+
+  /* The caps event may have been sent before the probe was installed */
+  if (!dpad->have_caps) {
+    GstCaps *caps = gst_pad_get_current_caps (pad);
+
+    if (!caps)
+      return GST_PAD_PROBE_OK;
+    decoded_pad_set_caps (dpad, pad, caps);
+    gst_caps_unref (caps);
+  }
+
+  if (dpad->is_video && gate_drop_decoded (&branch->gate))
+    return drop_as_gap (pad, GST_PAD_PROBE_INFO_BUFFER (info));
+
+  if (dpad->check_health) {
+    /* Mapping a system memory frame for reading does not copy it */
+    if (gst_video_frame_map (&frame, &dpad->vinfo,
+            GST_PAD_PROBE_INFO_BUFFER (info), GST_MAP_READ)) {
+      GstMultiSourceHealthChange changed =
+          health_check_frame (&branch->health, &frame);
+
+      gst_video_frame_unmap (&frame);
+      if (changed != HEALTH_CHANGED_NONE)
+        post_stats (branch, "multisource-health",
+            health_get_stats (&branch->health));
+    }
+  } else if (dpad->meter) {
+    gboolean changed;
+    GstMultiSourceSilenceResult res = silence_process (&branch->silence,
+        &dpad->ainfo, GST_PAD_PROBE_INFO_BUFFER (info), &changed);
+
+    if (changed)
+      post_stats (branch, "multisource-level",
+          silence_get_stats (&branch->silence));
+    if (res == SILENCE_SUPPRESS && branch->config->suppress_silence)
+      return suppress_buffer (pad, GST_PAD_PROBE_INFO_BUFFER (info));
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+decoder_pad_added (GstElement * decoder, GstPad * pad,
+    GstMultiSourceBranch * branch)
+{
+  DecodedPad *dpad;
+
+  if (GST_PAD_DIRECTION (pad) != GST_PAD_SRC)
+    return;
+
+  GST_DEBUG ("Branch %u exposed decoded pad %s", branch->id,
+      GST_PAD_NAME (pad));
+  dpad = g_new0 (DecodedPad, 1);
+  dpad->branch = branch;
+  gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      decoded_probe, dpad, g_free);
+}
+
+/* Decode the GOP cached so far without showing it, so that the decoder has
+ * its references for the current frame instead of waiting for the next
+ * keyframe. */
+static gboolean
+replay_gop (GstMultiSourceBranch * branch, GstPad * pad)
+{
+  GList *frames = gopcache_get_frames (&branch->gop_cache), *l;
+
+  if (!frames)
+    return FALSE;
+
+  GST_DEBUG ("Branch %u replaying %u cached frames", branch->id,
+      g_list_length (frames));
+  branch->replaying = TRUE;
+  for (l = frames; l; l = l->next) {
+    GstBuffer *buffer = gst_buffer_make_writable (l->data);
+
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DECODE_ONLY);
+    if (l == frames)
+      GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+    gst_pad_push (pad, buffer);
+  }
+  branch->replaying = FALSE;
+  g_list_free (frames);
+  gate_resume (&branch->gate);
+
+  return TRUE;
+}
+
+static GstPadProbeReturn
+compressed_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstMultiSourceBranch *branch = user_data;
+  GstBuffer *buffer;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+    GstStructure *s;
+    GstCaps *caps;
+    gboolean systemstream = FALSE;
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP
+        && g_atomic_pointer_get (&branch->parser_pad) == pad) {
+      gopcache_flush (&branch->gop_cache);
+      history_flush (&branch->history);
+    }
+    if ((GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP
+            || GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT)
+        && g_atomic_pointer_get (&branch->parser_pad) == pad)
+      gop_flush (&branch->gop);
+    if (GST_EVENT_TYPE (event) != GST_EVENT_CAPS)
+      return GST_PAD_PROBE_OK;
+
+    gst_event_parse_caps (event, &caps);
+    s = gst_caps_get_structure (caps, 0);
+    gst_structure_get_boolean (s, "systemstream", &systemstream);
+    /* Only the elementary video stream of the branch is analyzed */
+    if (systemstream || !(g_str_has_prefix (gst_structure_get_name (s),
+                "video/") || gst_structure_has_name (s, "image/jpeg"))
+        || !claim_pad (&branch->parser_pad, pad))
+      return GST_PAD_PROBE_REMOVE;
+
+    gop_set_caps (&branch->gop, caps);
+    gopcache_flush (&branch->gop_cache);
+    history_set_caps (&branch->history, caps);
+    return GST_PAD_PROBE_OK;
+  }
+
+  if (g_atomic_pointer_get (&branch->parser_pad) != pad || branch->replaying)
+    return GST_PAD_PROBE_OK;
+
+  buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  if (gop_process (&branch->gop, buffer))
+    post_stats (branch, "multisource-gop", gop_get_stats (&branch->gop));
+  gopcache_push (&branch->gop_cache, buffer);
+  history_push (&branch->history, buffer);
+
+  if (gate_drop_compressed (&branch->gate, buffer)) {
+    /* A frame that is not droppable in a decoded level is only dropped while
+     * waiting for a keyframe: the gate was just opened again. */
+    if (gate_get_level (&branch->gate) <= GATE_LEVEL_REDUCED
+        && !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DROPPABLE)
+        && replay_gop (branch, pad))
+      return GST_PAD_PROBE_OK;
+    /* The decoder forwards the GAP event down to the muxer. A branch held
+     * since it started, waiting for admission, has no muxer pad to keep
+     * going and its decoder no caps to send the event with. */
+    if (!g_atomic_int_get (&branch->decoded))
+      return GST_PAD_PROBE_DROP;
+    return drop_as_gap (pad, buffer);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Answer the allocation query of a video decoder ourselves: forward it
+ * downstream, then put the frame allocator first and hand it a pool sharing
+ * its frames with the other branches. */
+static GstPadProbeReturn
+allocation_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstMultiSourceBranch *branch = user_data;
+  const GstMultiSourceConfig *config = branch->config;
+  GstQuery *query = GST_PAD_PROBE_INFO_QUERY (info);
+  GstAllocationParams params;
+  GstCapsFeatures *features;
+  GstVideoInfo vinfo;
+  GstCaps *caps;
+  GstPad *peer;
+  gboolean answered;
+
+  if (GST_QUERY_TYPE (query) != GST_QUERY_ALLOCATION)
+    return GST_PAD_PROBE_OK;
+
+  gst_query_parse_allocation (query, &caps, NULL);
+  if (!caps || !gst_video_info_from_caps (&vinfo, caps))
+    return GST_PAD_PROBE_OK;
+  /* Only frames in system memory, not GL textures or DMABufs */
+  features = gst_caps_get_features (caps, 0);
+  if (features && !gst_caps_features_is_equal (features,
+          GST_CAPS_FEATURES_MEMORY_SYSTEM_MEMORY))
+    return GST_PAD_PROBE_OK;
+
+  /* Ask the peer directly, gst_pad_peer_query would run this probe again */
+  peer = gst_pad_get_peer (pad);
+  if (!peer)
+    return GST_PAD_PROBE_OK;
+  answered = gst_pad_query (peer, query);
+  gst_object_unref (peer);
+  if (!answered)
+    return GST_PAD_PROBE_DROP;
+
+  if (config->frame_allocator) {
+    gst_allocation_params_init (&params);
+    if (gst_query_get_n_allocation_params (query) > 0) {
+      gst_query_parse_nth_allocation_param (query, 0, NULL, &params);
+      gst_query_set_nth_allocation_param (query, 0, config->frame_allocator,
+          &params);
+    } else {
+      gst_query_add_allocation_param (query, config->frame_allocator,
+          &params);
+    }
+  }
+
+  if (config->frame_pools) {
+    GstBufferPool *pool = pools_new_branch_pool (config->frame_pools,
+        branch->id);
+    guint size = GST_VIDEO_INFO_SIZE (&vinfo), min = 0;
+
+    if (gst_query_get_n_allocation_pools (query) > 0) {
+      gst_query_parse_nth_allocation_pool (query, 0, NULL, &size, &min, NULL);
+      gst_query_set_nth_allocation_pool (query, 0, pool, size, min, 0);
+    } else {
+      gst_query_add_allocation_pool (query, pool, size, min, 0);
+    }
+    gst_object_unref (pool);
+  }
+
+  GST_DEBUG ("Branch %u decoder %s allocating its frames", branch->id,
+      GST_ELEMENT_NAME (GST_PAD_PARENT (pad)));
+
+  return GST_PAD_PROBE_HANDLED;
+}
+
+static gboolean
+has_property (gpointer object, const gchar * name)
+{
+  return g_object_class_find_property (G_OBJECT_GET_CLASS (object),
+      name) != NULL;
+}
+
+static void
+configure_queue (GstMultiSourceBranch * branch, GstElement * queue)
+{
+  guint64 quota = quota_get_limit (&branch->quota);
+
+  /* decodebin3 runs its multiqueue with use-interleave, which recomputes
+   * max-size-time from the interleave it measures between the streams.
+   * The class time is set as the floor of that, which lasts, and as the
+   * limit until the interleave is known. */
+  if (gst_structure_has_field (branch->options, "priority")) {
+    guint64 queue_time = priority_classes[branch->priority].queue_time;
+
+    g_object_set (queue, "max-size-time", queue_time, NULL);
+    if (has_property (queue, "min-interleave-time"))
+      g_object_set (queue, "min-interleave-time", queue_time, NULL);
+  }
+  /* The quota covers every stream of the branch, it also bounds each one */
+  if (quota)
+    g_object_set (queue, "max-size-bytes", (guint) MIN (quota, G_MAXUINT),
+        NULL);
+}
+
+/* Hold the data entering a queue of the branch to its quota, only needed
+ * when the overflow policy drops data rather than blocking upstream. The
+ * queue levels are sampled by the budget tick, not walked per buffer. */
+static GstPadProbeReturn
+queue_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  QueuePad *qpad = user_data;
+  GstMultiSourceBranch *branch = qpad->branch;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  gboolean was_dropping = qpad->dropping;
+
+  if (!quota_admit (&branch->quota, buffer, &qpad->dropping)) {
+    if (!was_dropping)
+      post_stats (branch, "multisource-overflow",
+          quota_get_stats (&branch->quota));
+    return GST_PAD_PROBE_DROP;
+  }
+
+  if (was_dropping) {
+    buffer = gst_buffer_make_writable (buffer);
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+    GST_PAD_PROBE_INFO_DATA (info) = buffer;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+queue_pad_added (GstElement * queue, GstPad * pad,
+    GstMultiSourceBranch * branch)
+{
+  QueuePad *qpad;
+
+  if (GST_PAD_DIRECTION (pad) != GST_PAD_SINK)
+    return;
+
+  qpad = g_new0 (QueuePad, 1);
+  qpad->branch = branch;
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, queue_probe, qpad,
+      g_free);
+}
+
+/* Apply the priority class of the branch to the queues and decoders
+ * plugged by decodebin3, and probe the output of its parsers to see the
+ * compressed frames right before they are decoded. */
+static void
+configure_element (GstMultiSourceBranch * branch, GstElement * element)
+{
+  GstElementFactory *factory = gst_element_get_factory (element);
+  const gchar *klass;
+  GstPad *pad;
+
+  if (!factory)
+    return;
+
+  if (!strcmp (GST_OBJECT_NAME (factory), "multiqueue")) {
+    configure_queue (branch, element);
+    if (branch->quota.overflow == QUOTA_OVERFLOW_DROP)
+      g_signal_connect (element, "pad-added", G_CALLBACK (queue_pad_added),
+          branch);
+    g_mutex_lock (&branch->lock);
+    g_ptr_array_add (branch->queues, gst_object_ref (element));
+    g_mutex_unlock (&branch->lock);
+    return;
+  }
+
+  klass = gst_element_factory_get_metadata (factory,
+      GST_ELEMENT_METADATA_KLASS);
+  if (!klass)
+    return;
+
+  if (strstr (klass, "Decoder")) {
+    if (gst_structure_has_field (branch->options, "priority")
+        && has_property (element, "max-threads")) {
+      gint threads = priority_classes[branch->priority].decoder_threads;
+
+      /* Sized from the CPUs granted to the process, not the host cores */
+      if (threads == 0)
+        threads = MAX (1, (gint) branch->config->cpus);
+      else if (threads < 0)
+        threads = MAX (1, (gint) branch->config->cpus / 4);
+      g_object_set (element, "max-threads", threads, NULL);
+    }
+    if ((branch->config->frame_allocator || branch->config->frame_pools)
+        && strstr (klass, "Video")
+        && (pad = gst_element_get_static_pad (element, "src"))) {
+      gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM |
+          GST_PAD_PROBE_TYPE_PUSH, allocation_probe, branch, NULL);
+      gst_object_unref (pad);
+    }
+    return;
+  }
+
+  if (!strstr (klass, "Parser"))
+    return;
+
+  pad = gst_element_get_static_pad (element, "src");
+  if (!pad)
+    return;
+
+  GST_DEBUG ("Branch %u analyzing the output of %s", branch->id,
+      GST_ELEMENT_NAME (element));
+  gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      compressed_probe, branch, NULL);
+  gst_object_unref (pad);
+}
+
+static void
+decoder_element_added (GstBin * bin, GstBin * sub_bin, GstElement * element,
+    GstMultiSourceBranch * branch)
+{
+  configure_element (branch, element);
+}
+
+static void
+configure_existing_element (const GValue * item, gpointer user_data)
+{
+  configure_element (user_data, g_value_get_object (item));
+}
+
+static GstElement *
+get_branch_element (GstBin * pipeline, const gchar * prefix, guint id)
+{
+  gchar *name = g_strdup_printf ("%s%u", prefix, id);
+  GstElement *element = gst_bin_get_by_name (pipeline, name);
+
+  if (!element)
+    GST_WARNING ("Unable to find element %s in the pipeline", name);
+  g_free (name);
+
+  return element;
+}
+
+/* A file branch with "follow=true" keeps reading a file still being
+ * recorded rather than ending at its current size. */
+static void
+source_setup (GstElement * bin, GstElement * source, gpointer user_data)
+{
+  GstMultiSourceBranch *branch = user_data;
+  gboolean follow;
+
+  if (gst_structure_get_boolean (branch->options, "follow", &follow)
+      && g_object_class_find_property (G_OBJECT_GET_CLASS (source), "follow"))
+    g_object_set (source, "follow", follow, NULL);
+}
+
+static void
+sdp_source_pad_added (GstElement * source, GstPad * pad, gpointer user_data)
+{
+  GstMultiSourceBranch *branch = user_data;
+  GstPad *sink = gst_element_get_static_pad (branch->decoder, "sink");
+
+  /* The first media goes to the always sink pad of decodebin3 */
+  if (sink && gst_pad_is_linked (sink))
+    gst_clear_object (&sink);
+  if (!sink)
+    sink = gst_element_request_pad (branch->decoder,
+        gst_element_get_pad_template (branch->decoder, "sink_%u"), NULL,
+        NULL);
+
+  if (!sink) {
+    GST_WARNING ("Branch %u decoder has no input left for %s", branch->id,
+        GST_PAD_NAME (pad));
+    return;
+  }
+  if (gst_pad_link (pad, sink) != GST_PAD_LINK_OK) {
+    GST_WARNING ("Branch %u could not link %s to its decoder", branch->id,
+        GST_PAD_NAME (pad));
+    if (GST_PAD_TEMPLATE_PRESENCE (GST_PAD_PAD_TEMPLATE (sink)) ==
+        GST_PAD_REQUEST)
+      gst_element_release_request_pad (branch->decoder, sink);
+  }
+  gst_object_unref (sink);
+}
+
+static void
+sdp_source_pad_removed (GstElement * source, GstPad * pad,
+    gpointer user_data)
+{
+  GstMultiSourceBranch *branch = user_data;
+  GstPad *sink = gst_pad_get_peer (pad);
+
+  if (!sink)
+    return;
+  gst_pad_unlink (pad, sink);
+  if (GST_PAD_TEMPLATE_PRESENCE (GST_PAD_PAD_TEMPLATE (sink)) ==
+      GST_PAD_REQUEST)
+    gst_element_release_request_pad (branch->decoder, sink);
+  gst_object_unref (sink);
+}
+
+/* Look up the branch elements once the pipeline has been created and hook
+ * the per branch probes. */
+gboolean
+branch_attach (GstMultiSourceBranch * branch, GstBin * pipeline)
+{
+  GstIterator *it;
+
+  branch->source = get_branch_element (pipeline, "src", branch->id);
+  branch->decoder = get_branch_element (pipeline, "dec", branch->id);
+  if (!branch->source || !branch->decoder)
+    return FALSE;
+
+  if (!branch->sdp) {
+    g_signal_connect (branch->source, "source-setup",
+        G_CALLBACK (source_setup), branch);
+  } else {
+    g_signal_connect (branch->source, "pad-added",
+        G_CALLBACK (sdp_source_pad_added), branch);
+    g_signal_connect (branch->source, "pad-removed",
+        G_CALLBACK (sdp_source_pad_removed), branch);
+  }
+  g_signal_connect (branch->decoder, "pad-added",
+      G_CALLBACK (decoder_pad_added), branch);
+  g_signal_connect (branch->decoder, "deep-element-added",
+      G_CALLBACK (decoder_element_added), branch);
+
+  /* decodebin3 creates its multiqueue before being added to the pipeline */
+  it = gst_bin_iterate_recurse (GST_BIN (branch->decoder));
+  gst_iterator_foreach (it, configure_existing_element, branch);
+  gst_iterator_free (it);
+
+  return TRUE;
+}
+
+gboolean
+branch_owns_object (GstMultiSourceBranch * branch, GstObject * object)
+{
+  return (branch->source
+      && gst_object_has_as_ancestor (object, GST_OBJECT (branch->source)))
+      || (branch->decoder
+      && gst_object_has_as_ancestor (object, GST_OBJECT (branch->decoder)));
+}
+
+/* Re-apply the resource limits after they changed */
+void
+branch_apply_limits (GstMultiSourceBranch * branch)
+{
+  guint i;
+
+  g_mutex_lock (&branch->lock);
+  for (i = 0; i < branch->queues->len; i++)
+    configure_queue (branch, g_ptr_array_index (branch->queues, i));
+  g_mutex_unlock (&branch->lock);
+}
+
+static void
+add_pad_level (const GValue * item, gpointer user_data)
+{
+  GstPad *pad = g_value_get_object (item);
+  guint64 *level = user_data;
+  guint bytes = 0;
+
+  /* Multiqueue pads report their level since GStreamer 1.18 */
+  if (has_property (pad, "current-level-bytes")) {
+    g_object_get (pad, "current-level-bytes", &bytes, NULL);
+    *level += bytes;
+  }
+}
+
+/* Bytes held by the queues of the branch */
+guint64
+branch_get_queue_level (GstMultiSourceBranch * branch)
+{
+  guint64 level = 0;
+  guint i;
+
+  g_mutex_lock (&branch->lock);
+  for (i = 0; i < branch->queues->len; i++) {
+    GstIterator *it =
+        gst_element_iterate_sink_pads (g_ptr_array_index (branch->queues, i));
+
+    while (gst_iterator_foreach (it, add_pad_level, &level) ==
+        GST_ITERATOR_RESYNC) {
+      gst_iterator_resync (it);
+      level = 0;
+    }
+    gst_iterator_free (it);
+  }
+  g_mutex_unlock (&branch->lock);
+
+  quota_update_level (&branch->quota, level);
+
+  return level;
+}
+
+/* Change how much the queues of the branch may hold */
+void
+branch_set_queue_quota (GstMultiSourceBranch * branch, guint64 quota)
+{
+  if (quota == quota_get_limit (&branch->quota))
+    return;
+
+  quota_set_limit (&branch->quota, quota);
+  branch_apply_limits (branch);
+}
+
+/* Called from a streaming thread of the branch when it starts */
+void
+branch_enter_thread (GstMultiSourceBranch * branch)
+{
+#ifdef __linux__
+  pid_t tid = syscall (SYS_gettid);
+  gint nice = priority_classes[branch->priority].nice;
+
+  /* Raising the priority needs CAP_SYS_NICE, lowering it always works */
+  if (setpriority (PRIO_PROCESS, tid, nice) < 0)
+    GST_DEBUG ("Unable to set the nice value of thread %d to %d", tid, nice);
+  else
+    GST_DEBUG ("Branch %u thread %d running at nice %d", branch->id, tid,
+        nice);
+#endif
+}
+
+/* Write the compressed video of the branch around an event, ago before
+ * the last frame received, to a file of its own. */
+gboolean
+branch_export_clip (GstMultiSourceBranch * branch, GstClockTime ago)
+{
+  GDateTime *now = g_date_time_new_now_local ();
+  gchar *date = g_date_time_format (now, "%Y%m%d-%H%M%S");
+  gchar *name = g_strdup_printf ("branch%u-%s.%s", branch->id, date,
+      clip_get_extension (branch->config->clip_muxer));
+  gchar *location = g_build_filename (branch->config->clip_dir, name, NULL);
+  gboolean res;
+
+  res = history_export (&branch->history, ago, branch->config->clip_postroll,
+      branch->config->clip_muxer, location);
+
+  g_free (location);
+  g_free (name);
+  g_free (date);
+  g_date_time_unref (now);
+
+  return res;
+}
+
+GstStructure *
+branch_get_stats (GstMultiSourceBranch * branch)
+{
+  GstStructure *s = gst_structure_new ("branch",
+      "id", G_TYPE_UINT, branch->id, "uri", G_TYPE_STRING, branch->uri, NULL);
+  GstStructure *gop = gop_get_stats (&branch->gop);
+  GstStructure *gate = gate_get_stats (&branch->gate);
+  GstStructure *quota = quota_get_stats (&branch->quota);
+  GstStructure *gop_cache = gopcache_get_stats (&branch->gop_cache);
+
+  gst_structure_set (s, "priority", G_TYPE_STRING,
+      branch_priority_get_name (branch->priority),
+      "cost", G_TYPE_DOUBLE, gop_get_cost (&branch->gop),
+      "gop", GST_TYPE_STRUCTURE, gop, "gate", GST_TYPE_STRUCTURE, gate,
+      "quota", GST_TYPE_STRUCTURE, quota,
+      "gop-cache", GST_TYPE_STRUCTURE, gop_cache, NULL);
+  gst_structure_free (gop_cache);
+  gst_structure_free (gop);
+  gst_structure_free (gate);
+  gst_structure_free (quota);
+
+  if (branch->config->health_check) {
+    GstStructure *health = health_get_stats (&branch->health);
+
+    gst_structure_set (s, "health", GST_TYPE_STRUCTURE, health, NULL);
+    gst_structure_free (health);
+  }
+  if (branch->config->audio_level) {
+    GstStructure *silence = silence_get_stats (&branch->silence);
+
+    gst_structure_set (s, "silence", GST_TYPE_STRUCTURE, silence, NULL);
+    gst_structure_free (silence);
+  }
+  if (branch->config->clip_preroll) {
+    GstStructure *history = history_get_stats (&branch->history);
+
+    gst_structure_set (s, "history", GST_TYPE_STRUCTURE, history, NULL);
+    gst_structure_free (history);
+  }
+
+  return s;
+}
+
+void
+branch_print_stats (GstMultiSourceBranch * branch)
+{
+  GstStructure *s = branch_get_stats (branch);
+  gchar *str = gst_structure_to_string (s);
+
+  PRINT ("%s", str);
+  g_free (str);
+  gst_structure_free (s);
+}
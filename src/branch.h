@@ -0,0 +1,103 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_BRANCH_H__
+#define __GST_MULTI_SOURCE_BRANCH_H__
+
+#include <gst/gst.h>
+
+#include "multisource.h"
+#include "health.h"
+#include "silence.h"
+#include "gop.h"
+#include "gate.h"
+#include "gopcache.h"
+#include "quota.h"
+#include "history.h"
+
+G_BEGIN_DECLS
+
+/* Priority classes, in the order the governor degrades them */
+typedef enum
+{
+  BRANCH_PRIORITY_BACKGROUND,
+  BRANCH_PRIORITY_NORMAL,
+  BRANCH_PRIORITY_CRITICAL,
+} GstMultiSourcePriority;
+
+typedef struct _GstMultiSourceBranch
+{
+  guint id;
+  gchar *uri;
+  /* SDP file of a branch receiving RTP directly, NULL otherwise */
+  gchar *sdp;
+  const GstMultiSourceConfig *config;
+  GstStructure *options;
+  GstMultiSourcePriority priority;
+  /* only decoded while a consumer asks for it */
+  gboolean on_demand;
+
+  GstElement *source;
+  GstElement *decoder;
+
+  GMutex lock;
+  /* multiqueues plugged in the branch, protected by lock */
+  GPtrArray *queues;
+  GstMultiSourceQuota quota;
+
+  /* first decoded video pad, the only one checked for health */
+  GstPad *health_pad;
+  GstMultiSourceHealth health;
+
+  /* first decoded audio pad, the only one metered */
+  GstPad *level_pad;
+  GstMultiSourceSilence silence;
+
+  /* output of the first video parser, the compressed side of the branch */
+  GstPad *parser_pad;
+  GstMultiSourceGop gop;
+  GstMultiSourceGate gate;
+  GstMultiSourceGopCache gop_cache;
+  GstMultiSourceHistory history;
+  /* streaming thread only */
+  gboolean replaying;
+  /* set once a decoded pad got caps, and so may be linked to the muxer */
+  gint decoded;
+} GstMultiSourceBranch;
+
+GstMultiSourceBranch *branch_new (guint id, const gchar * desc,
+    const GstMultiSourceConfig * config);
+void branch_free (GstMultiSourceBranch * branch);
+gchar *branch_get_description (GstMultiSourceBranch * branch);
+gboolean branch_attach (GstMultiSourceBranch * branch, GstBin * pipeline);
+const gchar *branch_priority_get_name (GstMultiSourcePriority priority);
+gboolean branch_owns_object (GstMultiSourceBranch * branch,
+    GstObject * object);
+void branch_enter_thread (GstMultiSourceBranch * branch);
+void branch_apply_limits (GstMultiSourceBranch * branch);
+guint64 branch_get_queue_level (GstMultiSourceBranch * branch);
+void branch_set_queue_quota (GstMultiSourceBranch * branch, guint64 quota);
+gboolean branch_export_clip (GstMultiSourceBranch * branch, GstClockTime ago);
+GstStructure *branch_get_stats (GstMultiSourceBranch * branch);
+void branch_print_stats (GstMultiSourceBranch * branch);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_BRANCH_H__ */
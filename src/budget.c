@@ -0,0 +1,104 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "budget.h"
+
+/* Split the memory ceiling between the branches. Half of it is reserved,
+ * each branch being guaranteed an equal part, the other half is elastic:
+ * a branch keeps what it already buffers beyond its reserve and gets an
+ * equal part of what is left. A bursty branch can thus borrow idle memory
+ * but never more than the others could still claim, and the quotas always
+ * add up to the ceiling. */
+void
+budget_update (GstMultiSourceBudget * budget)
+{
+  guint64 ceiling = budget->config->memory_ceiling;
+  guint n = budget->branches->len;
+  guint64 *levels, reserve, elastic, borrowed = 0;
+  guint i;
+
+  if (n == 0)
+    return;
+
+  levels = g_new (guint64, n);
+  budget->used = 0;
+  for (i = 0; i < n; i++) {
+    levels[i] = branch_get_queue_level (g_ptr_array_index (budget->branches,
+            i));
+    budget->used += levels[i];
+  }
+  budget->peak = MAX (budget->peak, budget->used);
+
+  reserve = ceiling / 2 / n;
+  for (i = 0; i < n; i++)
+    borrowed += levels[i] > reserve ? levels[i] - reserve : 0;
+  elastic = ceiling / 2 > borrowed ? (ceiling / 2 - borrowed) / n : 0;
+
+  for (i = 0; i < n; i++) {
+    GstMultiSourceBranch *branch = g_ptr_array_index (budget->branches, i);
+    guint64 quota = 0;
+
+    if (ceiling)
+      quota = reserve + elastic +
+          (levels[i] > reserve ? levels[i] - reserve : 0);
+    branch_set_queue_quota (branch, quota);
+  }
+  g_free (levels);
+}
+
+static gboolean
+budget_tick (gpointer user_data)
+{
+  budget_update (user_data);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Keep the data buffered by the queues of all the branches under the
+ * memory ceiling of the configuration. */
+GstMultiSourceBudget *
+budget_new (GPtrArray * branches, const GstMultiSourceConfig * config)
+{
+  GstMultiSourceBudget *budget = g_new0 (GstMultiSourceBudget, 1);
+
+  budget->branches = branches;
+  budget->config = config;
+  budget_update (budget);
+  budget->source_id = g_timeout_add (BUDGET_INTERVAL, budget_tick, budget);
+
+  return budget;
+}
+
+void
+budget_free (GstMultiSourceBudget * budget)
+{
+  if (budget->source_id)
+    g_source_remove (budget->source_id);
+  g_free (budget);
+}
+
+GstStructure *
+budget_get_stats (GstMultiSourceBudget * budget)
+{
+  return gst_structure_new ("budget",
+      "ceiling", G_TYPE_UINT64, budget->config->memory_ceiling,
+      "used", G_TYPE_UINT64, budget->used,
+      "peak", G_TYPE_UINT64, budget->peak, NULL);
+}
@@ -0,0 +1,50 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_BUDGET_H__
+#define __GST_MULTI_SOURCE_BUDGET_H__
+
+#include <gst/gst.h>
+
+#include "branch.h"
+
+G_BEGIN_DECLS
+
+#define BUDGET_INTERVAL 500
+
+typedef struct _GstMultiSourceBudget
+{
+  GPtrArray *branches;
+  const GstMultiSourceConfig *config;
+  guint source_id;
+
+  guint64 used;
+  guint64 peak;
+} GstMultiSourceBudget;
+
+GstMultiSourceBudget *budget_new (GPtrArray * branches,
+    const GstMultiSourceConfig * config);
+void budget_free (GstMultiSourceBudget * budget);
+void budget_update (GstMultiSourceBudget * budget);
+GstStructure *budget_get_stats (GstMultiSourceBudget * budget);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_BUDGET_H__ */
@@ -0,0 +1,99 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "chunkformat.h"
+
+void
+chunk_write_file_header (guint8 * data)
+{
+  memset (data, 0, CHUNK_FILE_HEADER_SIZE);
+  memcpy (data, CHUNK_FILE_MAGIC, 4);
+  GST_WRITE_UINT32_LE (data + 4, CHUNK_FILE_VERSION);
+  GST_WRITE_UINT32_LE (data + 8, CHUNK_ALIGN);
+}
+
+gboolean
+chunk_check_file_header (const guint8 * data, gsize size)
+{
+  return size >= CHUNK_FILE_HEADER_SIZE
+      && memcmp (data, CHUNK_FILE_MAGIC, 4) == 0
+      && GST_READ_UINT32_LE (data + 4) == CHUNK_FILE_VERSION
+      && GST_READ_UINT32_LE (data + 8) == CHUNK_ALIGN;
+}
+
+void
+chunk_write_header (guint8 * data, const GstMultiSourceChunkHeader * header)
+{
+  memcpy (data, CHUNK_MAGIC, 4);
+  GST_WRITE_UINT16_LE (data + 4, header->type);
+  GST_WRITE_UINT16_LE (data + 6, header->flags);
+  GST_WRITE_UINT32_LE (data + 8, header->stream);
+  GST_WRITE_UINT32_LE (data + 12, header->size);
+  GST_WRITE_UINT64_LE (data + 16, header->pts);
+  GST_WRITE_UINT64_LE (data + 24, header->dts);
+}
+
+gboolean
+chunk_read_header (const guint8 * data, GstMultiSourceChunkHeader * header)
+{
+  if (memcmp (data, CHUNK_MAGIC, 4) != 0)
+    return FALSE;
+
+  header->type = GST_READ_UINT16_LE (data + 4);
+  header->flags = GST_READ_UINT16_LE (data + 6);
+  header->stream = GST_READ_UINT32_LE (data + 8);
+  header->size = GST_READ_UINT32_LE (data + 12);
+  header->pts = GST_READ_UINT64_LE (data + 16);
+  header->dts = GST_READ_UINT64_LE (data + 24);
+
+  return TRUE;
+}
+
+/* Size of a chunk with its header and padding */
+guint64
+chunk_get_size (guint32 payload_size)
+{
+  return GST_ROUND_UP_N ((guint64) CHUNK_HEADER_SIZE + payload_size,
+      CHUNK_ALIGN);
+}
+
+void
+chunk_write_trailer (guint8 * data, guint64 last_index)
+{
+  memcpy (data, CHUNK_TRAILER_MAGIC, 4);
+  GST_WRITE_UINT32_LE (data + 4, 0);
+  GST_WRITE_UINT64_LE (data + 8, last_index);
+}
+
+/* The offset of the last index chunk of a finished file, CHUNK_NO_INDEX
+ * when it is not finished or has no index. */
+guint64
+chunk_read_trailer (const guint8 * data, gsize size)
+{
+  const guint8 *trailer = data + size - CHUNK_TRAILER_SIZE;
+
+  if (size < CHUNK_FILE_HEADER_SIZE + CHUNK_TRAILER_SIZE
+      || memcmp (trailer, CHUNK_TRAILER_MAGIC, 4) != 0)
+    return CHUNK_NO_INDEX;
+
+  return GST_READ_UINT64_LE (trailer + 8);
+}
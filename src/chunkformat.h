@@ -0,0 +1,96 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_CHUNK_FORMAT_H__
+#define __GST_MULTI_SOURCE_CHUNK_FORMAT_H__
+
+#include <gst/gst.h>
+
+#include "keyindex.h"
+
+G_BEGIN_DECLS
+
+/* The chunk container written by chunkmux, all little endian:
+ *
+ *   file header: "MSCF" | version (u32) | alignment (u32) | reserved
+ *   chunks, each at an aligned offset:
+ *     "MSCK" | type (u16) | flags (u16) | stream (u32) | size (u32)
+ *     | pts (u64) | dts (u64), then size bytes of payload and padding
+ *   the pts and dts being running times, shared by all the streams
+ *   trailer, once finished: "MSCT" | reserved (u32) | last index (u64)
+ *
+ * A CAPS chunk carries the caps of its stream as a string and comes before
+ * its data. An INDEX chunk carries the offset of the previous index chunk,
+ * the number of entries and reserved (u64, u32, u32), followed by the
+ * keyframes since the previous one, as keyindex.h entries. A finished
+ * file repeats the caps chunks of all its streams between the last index
+ * chunk and the trailer, so a reader of a finished file finds everything
+ * from the trailer: the streams after the last index chunk, the keyframes
+ * by following the index chunks back. For a file still being written, the
+ * fixed size headers let it skip from chunk to chunk. */
+#define CHUNK_FILE_MAGIC "MSCF"
+#define CHUNK_MAGIC "MSCK"
+#define CHUNK_TRAILER_MAGIC "MSCT"
+#define CHUNK_FILE_VERSION 1
+#define CHUNK_FILE_HEADER_SIZE 32
+#define CHUNK_HEADER_SIZE 32
+#define CHUNK_TRAILER_SIZE 16
+#define CHUNK_INDEX_PREFIX_SIZE 16
+/* Payloads start right after their header, at this alignment */
+#define CHUNK_ALIGN 32
+#define CHUNK_NO_INDEX G_MAXUINT64
+
+typedef enum
+{
+  CHUNK_TYPE_DATA,
+  CHUNK_TYPE_CAPS,
+  CHUNK_TYPE_INDEX,
+} GstMultiSourceChunkType;
+
+typedef enum
+{
+  CHUNK_FLAG_KEYFRAME = (1 << 0),
+  CHUNK_FLAG_DISCONT = (1 << 1),
+  CHUNK_FLAG_HEADER = (1 << 2),
+} GstMultiSourceChunkFlags;
+
+typedef struct
+{
+  GstMultiSourceChunkType type;
+  GstMultiSourceChunkFlags flags;
+  guint32 stream;
+  guint32 size;
+  GstClockTime pts;
+  GstClockTime dts;
+} GstMultiSourceChunkHeader;
+
+void chunk_write_file_header (guint8 * data);
+gboolean chunk_check_file_header (const guint8 * data, gsize size);
+void chunk_write_header (guint8 * data,
+    const GstMultiSourceChunkHeader * header);
+gboolean chunk_read_header (const guint8 * data,
+    GstMultiSourceChunkHeader * header);
+guint64 chunk_get_size (guint32 payload_size);
+void chunk_write_trailer (guint8 * data, guint64 last_index);
+guint64 chunk_read_trailer (const guint8 * data, gsize size);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_CHUNK_FORMAT_H__ */
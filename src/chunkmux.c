@@ -0,0 +1,557 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-chunkmux
+ *
+ * Write any number of streams to the chunk container described in
+ * chunkformat.h. Every buffer becomes one chunk as soon as it is received:
+ * there is no interleaving by time to wait for, whatever the number of
+ * streams, and the payload memory is passed along without copy. The
+ * timestamps are written as running times, so the streams share one
+ * timeline whatever their segments. The keyframes of the video streams are
+ * indexed in index chunks written every index-interval and when finishing.
+ *
+ * gst-multisource-launch -m chunkmux --sink "recordsink location=out.msc" ...
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "multisource.h"
+#include "chunkformat.h"
+#include "chunkmux.h"
+
+#define GST_CAT_DEFAULT multisource_launch_debug
+
+enum
+{
+  PROP_0,
+  PROP_INDEX_INTERVAL,
+  PROP_STATS,
+};
+
+typedef struct
+{
+  guint32 stream;
+  gboolean video;
+  gboolean eos;
+  GstSegment segment;
+  /* repeated when finishing, protected by the stream lock */
+  gchar *caps;
+} ChunkMuxPad;
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink_%u",
+    GST_PAD_SINK, GST_PAD_REQUEST, GST_STATIC_CAPS_ANY);
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC, GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-multisource-chunks"));
+
+static const guint8 padding[CHUNK_ALIGN] = { 0, };
+
+G_DEFINE_TYPE (GstMultiSourceChunkMux, chunk_mux, GST_TYPE_ELEMENT);
+
+/* Start the output with its events and the file header. Called with the
+ * stream lock. */
+static GstFlowReturn
+start (GstMultiSourceChunkMux * self)
+{
+  GstSegment segment;
+  GstBuffer *buffer;
+  GstCaps *caps;
+  GstMapInfo map;
+  gchar *stream_id;
+
+  if (self->started)
+    return GST_FLOW_OK;
+  self->started = TRUE;
+
+  stream_id = gst_pad_create_stream_id (self->srcpad, GST_ELEMENT (self),
+      NULL);
+  gst_pad_push_event (self->srcpad, gst_event_new_stream_start (stream_id));
+  g_free (stream_id);
+  caps = gst_static_pad_template_get_caps (&src_template);
+  gst_pad_push_event (self->srcpad, gst_event_new_caps (caps));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  gst_pad_push_event (self->srcpad, gst_event_new_segment (&segment));
+
+  buffer = gst_buffer_new_allocate (NULL, CHUNK_FILE_HEADER_SIZE, NULL);
+  gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+  chunk_write_file_header (map.data);
+  gst_buffer_unmap (buffer, &map);
+  GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_HEADER);
+  GST_BUFFER_OFFSET (buffer) = 0;
+  g_mutex_lock (&self->lock);
+  self->offset = CHUNK_FILE_HEADER_SIZE;
+  g_mutex_unlock (&self->lock);
+
+  return gst_pad_push (self->srcpad, buffer);
+}
+
+/* Push a chunk made of its header, the payload memory of the buffer and
+ * the padding. Called with the stream lock. */
+static GstFlowReturn
+push_chunk (GstMultiSourceChunkMux * self, GstMultiSourceChunkHeader * header,
+    GstBuffer * payload)
+{
+  GstBuffer *buffer = gst_buffer_new_allocate (NULL, CHUNK_HEADER_SIZE, NULL);
+  guint64 size = chunk_get_size (header->size);
+  GstMapInfo map;
+
+  gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+  chunk_write_header (map.data, header);
+  gst_buffer_unmap (buffer, &map);
+
+  if (payload)
+    buffer = gst_buffer_append (buffer, payload);
+  if (size > CHUNK_HEADER_SIZE + header->size)
+    gst_buffer_append_memory (buffer,
+        gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY, (gpointer) padding,
+            CHUNK_ALIGN, 0, size - CHUNK_HEADER_SIZE - header->size, NULL,
+            NULL));
+
+  GST_BUFFER_PTS (buffer) = header->pts;
+  GST_BUFFER_DTS (buffer) = header->dts;
+  if (!(header->flags & CHUNK_FLAG_KEYFRAME))
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  g_mutex_lock (&self->lock);
+  GST_BUFFER_OFFSET (buffer) = self->offset;
+  self->offset += size;
+  self->chunks++;
+  g_mutex_unlock (&self->lock);
+
+  return gst_pad_push (self->srcpad, buffer);
+}
+
+/* Write the keyframes received since the last index chunk. Called with the
+ * stream lock. */
+static GstFlowReturn
+push_index (GstMultiSourceChunkMux * self, GstClockTime pts)
+{
+  GstMultiSourceChunkHeader header = { CHUNK_TYPE_INDEX, 0, 0, 0, pts,
+    GST_CLOCK_TIME_NONE
+  };
+  guint n = self->index->len / KEY_INDEX_ENTRY_SIZE;
+  guint8 prefix[CHUNK_INDEX_PREFIX_SIZE];
+  GstBuffer *payload;
+  guint64 offset;
+  GstFlowReturn ret;
+
+  g_mutex_lock (&self->lock);
+  offset = self->offset;
+  self->index_chunks++;
+  g_mutex_unlock (&self->lock);
+
+  GST_WRITE_UINT64_LE (prefix, self->last_index);
+  GST_WRITE_UINT32_LE (prefix + 8, n);
+  GST_WRITE_UINT32_LE (prefix + 12, 0);
+  g_byte_array_prepend (self->index, prefix, sizeof (prefix));
+  header.size = self->index->len;
+  payload = gst_buffer_new_wrapped (g_byte_array_free (self->index, FALSE),
+      header.size);
+  self->index = g_byte_array_new ();
+
+  ret = push_chunk (self, &header, payload);
+  self->last_index = offset;
+  self->last_index_pts = pts;
+
+  return ret;
+}
+
+/* Called with the stream lock */
+static GstFlowReturn
+push_caps (GstMultiSourceChunkMux * self, guint32 stream, const gchar * caps)
+{
+  GstMultiSourceChunkHeader header = { CHUNK_TYPE_CAPS, CHUNK_FLAG_HEADER,
+    stream, strlen (caps) + 1, GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE
+  };
+
+  return push_chunk (self, &header, gst_buffer_new_wrapped (g_strdup (caps),
+          header.size));
+}
+
+/* Close the container with a last index, the caps of every stream and the
+ * trailer pointing to the index. Called with the stream lock. */
+static GstFlowReturn
+finish (GstMultiSourceChunkMux * self)
+{
+  GstBuffer *buffer;
+  GstMapInfo map;
+  GstFlowReturn ret;
+  GList *streams = NULL, *l;
+
+  ret = start (self);
+  if (ret == GST_FLOW_OK)
+    ret = push_index (self, self->last_index_pts);
+
+  GST_OBJECT_LOCK (self);
+  for (l = GST_ELEMENT (self)->sinkpads; l; l = l->next)
+    streams = g_list_prepend (streams, gst_pad_get_element_private (l->data));
+  GST_OBJECT_UNLOCK (self);
+  for (l = streams; l && ret == GST_FLOW_OK; l = l->next) {
+    ChunkMuxPad *mpad = l->data;
+
+    if (mpad->caps)
+      ret = push_caps (self, mpad->stream, mpad->caps);
+  }
+  g_list_free (streams);
+  if (ret != GST_FLOW_OK)
+    return ret;
+
+  buffer = gst_buffer_new_allocate (NULL, CHUNK_TRAILER_SIZE, NULL);
+  gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+  chunk_write_trailer (map.data, self->last_index);
+  gst_buffer_unmap (buffer, &map);
+  g_mutex_lock (&self->lock);
+  GST_BUFFER_OFFSET (buffer) = self->offset;
+  self->offset += CHUNK_TRAILER_SIZE;
+  g_mutex_unlock (&self->lock);
+  self->finished = TRUE;
+
+  return gst_pad_push (self->srcpad, buffer);
+}
+
+static GstFlowReturn
+chunk_mux_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  GstMultiSourceChunkMux *self = GST_MULTI_SOURCE_CHUNK_MUX (parent);
+  ChunkMuxPad *mpad = gst_pad_get_element_private (pad);
+  GstMultiSourceChunkHeader header = { CHUNK_TYPE_DATA, 0, mpad->stream,
+    gst_buffer_get_size (buffer),
+    gst_segment_to_running_time (&mpad->segment, GST_FORMAT_TIME,
+        GST_BUFFER_PTS (buffer)),
+    gst_segment_to_running_time (&mpad->segment, GST_FORMAT_TIME,
+        GST_BUFFER_DTS (buffer))
+  };
+  GstFlowReturn ret;
+
+  if (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+    header.flags |= CHUNK_FLAG_KEYFRAME;
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DISCONT))
+    header.flags |= CHUNK_FLAG_DISCONT;
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_HEADER))
+    header.flags |= CHUNK_FLAG_HEADER;
+
+  GST_PAD_STREAM_LOCK (self->srcpad);
+  if (self->finished) {
+    GST_PAD_STREAM_UNLOCK (self->srcpad);
+    gst_buffer_unref (buffer);
+    return GST_FLOW_EOS;
+  }
+  ret = start (self);
+  if (ret == GST_FLOW_OK && self->index_interval
+      && self->index->len && GST_CLOCK_TIME_IS_VALID (header.pts)
+      && GST_CLOCK_TIME_IS_VALID (self->last_index_pts)
+      && header.pts >= self->last_index_pts + self->index_interval)
+    ret = push_index (self, header.pts);
+  if (ret != GST_FLOW_OK) {
+    GST_PAD_STREAM_UNLOCK (self->srcpad);
+    gst_buffer_unref (buffer);
+    return ret;
+  }
+
+  if (mpad->video && (header.flags & CHUNK_FLAG_KEYFRAME)
+      && !(header.flags & CHUNK_FLAG_HEADER)
+      && GST_CLOCK_TIME_IS_VALID (header.pts)) {
+    GstMultiSourceKeyEntry entry = { 0, header.pts, mpad->stream, 0 };
+
+    g_mutex_lock (&self->lock);
+    entry.offset = self->offset;
+    g_mutex_unlock (&self->lock);
+
+    g_byte_array_set_size (self->index,
+        self->index->len + KEY_INDEX_ENTRY_SIZE);
+    key_index_write_entry (self->index->data + self->index->len -
+        KEY_INDEX_ENTRY_SIZE, &entry);
+    if (!GST_CLOCK_TIME_IS_VALID (self->last_index_pts))
+      self->last_index_pts = header.pts;
+  }
+  ret = push_chunk (self, &header, buffer);
+  GST_PAD_STREAM_UNLOCK (self->srcpad);
+
+  return ret;
+}
+
+static gboolean
+chunk_mux_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  GstMultiSourceChunkMux *self = GST_MULTI_SOURCE_CHUNK_MUX (parent);
+  ChunkMuxPad *mpad = gst_pad_get_element_private (pad);
+  gboolean res = TRUE;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:
+    {
+      GstCaps *caps;
+      const gchar *name;
+
+      gst_event_parse_caps (event, &caps);
+      name = gst_structure_get_name (gst_caps_get_structure (caps, 0));
+      mpad->video = g_str_has_prefix (name, "video/")
+          || g_str_has_prefix (name, "image/");
+
+      GST_PAD_STREAM_LOCK (self->srcpad);
+      g_free (mpad->caps);
+      mpad->caps = gst_caps_to_string (caps);
+      if (!self->finished && start (self) == GST_FLOW_OK)
+        res = push_caps (self, mpad->stream, mpad->caps) == GST_FLOW_OK;
+      GST_PAD_STREAM_UNLOCK (self->srcpad);
+      gst_event_unref (event);
+      break;
+    }
+    case GST_EVENT_EOS:
+    {
+      gboolean all_eos;
+
+      g_mutex_lock (&self->lock);
+      if (!mpad->eos) {
+        mpad->eos = TRUE;
+        self->n_eos++;
+      }
+      all_eos = self->n_eos == GST_ELEMENT (self)->numsinkpads;
+      g_mutex_unlock (&self->lock);
+
+      GST_PAD_STREAM_LOCK (self->srcpad);
+      if (all_eos && !self->finished) {
+        finish (self);
+        gst_pad_push_event (self->srcpad, gst_event_new_eos ());
+      }
+      GST_PAD_STREAM_UNLOCK (self->srcpad);
+      gst_event_unref (event);
+      break;
+    }
+    case GST_EVENT_SEGMENT:
+      /* kept to turn the timestamps of the pad into running times */
+      gst_event_copy_segment (event, &mpad->segment);
+      if (mpad->segment.format != GST_FORMAT_TIME)
+        gst_segment_init (&mpad->segment, GST_FORMAT_TIME);
+      gst_event_unref (event);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      gst_segment_init (&mpad->segment, GST_FORMAT_TIME);
+      gst_event_unref (event);
+      break;
+    case GST_EVENT_STREAM_START:
+    case GST_EVENT_GAP:
+    case GST_EVENT_FLUSH_START:
+      /* the output is one stream of bytes, whatever its inputs do */
+      gst_event_unref (event);
+      break;
+    default:
+      res = gst_pad_event_default (pad, parent, event);
+      break;
+  }
+
+  return res;
+}
+
+static GstPad *
+chunk_mux_request_new_pad (GstElement * element, GstPadTemplate * templ,
+    const gchar * name, const GstCaps * caps)
+{
+  GstMultiSourceChunkMux *self = GST_MULTI_SOURCE_CHUNK_MUX (element);
+  ChunkMuxPad *mpad = g_new0 (ChunkMuxPad, 1);
+  gchar *pad_name;
+  GstPad *pad;
+
+  g_mutex_lock (&self->lock);
+  if (name && sscanf (name, "sink_%u", &mpad->stream) == 1)
+    self->next_stream = MAX (self->next_stream, mpad->stream + 1);
+  else
+    mpad->stream = self->next_stream++;
+  g_mutex_unlock (&self->lock);
+
+  gst_segment_init (&mpad->segment, GST_FORMAT_TIME);
+  pad_name = g_strdup_printf ("sink_%u", mpad->stream);
+  pad = gst_pad_new_from_template (templ, pad_name);
+  g_free (pad_name);
+  gst_pad_set_element_private (pad, mpad);
+  gst_pad_set_chain_function (pad, chunk_mux_chain);
+  gst_pad_set_event_function (pad, chunk_mux_sink_event);
+  GST_PAD_SET_ACCEPT_TEMPLATE (pad);
+  gst_pad_set_active (pad, TRUE);
+  if (!gst_element_add_pad (element, pad)) {
+    g_free (mpad);
+    return NULL;
+  }
+
+  return pad;
+}
+
+static void
+chunk_mux_release_pad (GstElement * element, GstPad * pad)
+{
+  GstMultiSourceChunkMux *self = GST_MULTI_SOURCE_CHUNK_MUX (element);
+  ChunkMuxPad *mpad = gst_pad_get_element_private (pad);
+
+  g_mutex_lock (&self->lock);
+  if (mpad->eos)
+    self->n_eos--;
+  g_mutex_unlock (&self->lock);
+
+  gst_pad_set_element_private (pad, NULL);
+  g_free (mpad->caps);
+  g_free (mpad);
+  gst_element_remove_pad (element, pad);
+}
+
+static void
+reset (GstMultiSourceChunkMux * self)
+{
+  GstIterator *it = gst_element_iterate_sink_pads (GST_ELEMENT (self));
+  GValue item = G_VALUE_INIT;
+
+  while (gst_iterator_next (it, &item) == GST_ITERATOR_OK) {
+    ChunkMuxPad *mpad = gst_pad_get_element_private (g_value_get_object
+        (&item));
+
+    mpad->eos = FALSE;
+    g_value_reset (&item);
+  }
+  g_value_unset (&item);
+  gst_iterator_free (it);
+
+  GST_PAD_STREAM_LOCK (self->srcpad);
+  self->started = FALSE;
+  self->finished = FALSE;
+  g_byte_array_set_size (self->index, 0);
+  self->last_index = CHUNK_NO_INDEX;
+  self->last_index_pts = GST_CLOCK_TIME_NONE;
+  GST_PAD_STREAM_UNLOCK (self->srcpad);
+
+  g_mutex_lock (&self->lock);
+  self->n_eos = 0;
+  self->offset = 0;
+  g_mutex_unlock (&self->lock);
+}
+
+static GstStateChangeReturn
+chunk_mux_change_state (GstElement * element, GstStateChange transition)
+{
+  GstMultiSourceChunkMux *self = GST_MULTI_SOURCE_CHUNK_MUX (element);
+  GstStateChangeReturn ret;
+
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED)
+    reset (self);
+
+  ret = GST_ELEMENT_CLASS (chunk_mux_parent_class)->change_state (element,
+      transition);
+
+  return ret;
+}
+
+static void
+chunk_mux_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMultiSourceChunkMux *self = GST_MULTI_SOURCE_CHUNK_MUX (object);
+
+  switch (prop_id) {
+    case PROP_INDEX_INTERVAL:
+      self->index_interval = g_value_get_uint64 (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+chunk_mux_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstMultiSourceChunkMux *self = GST_MULTI_SOURCE_CHUNK_MUX (object);
+
+  switch (prop_id) {
+    case PROP_INDEX_INTERVAL:
+      g_value_set_uint64 (value, self->index_interval);
+      break;
+    case PROP_STATS:
+      g_mutex_lock (&self->lock);
+      g_value_take_boxed (value, gst_structure_new ("chunkmux",
+              "chunks", G_TYPE_UINT64, self->chunks,
+              "index-chunks", G_TYPE_UINT64, self->index_chunks,
+              "bytes", G_TYPE_UINT64, self->offset, NULL));
+      g_mutex_unlock (&self->lock);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+chunk_mux_finalize (GObject * object)
+{
+  GstMultiSourceChunkMux *self = GST_MULTI_SOURCE_CHUNK_MUX (object);
+
+  g_byte_array_unref (self->index);
+  g_mutex_clear (&self->lock);
+
+  G_OBJECT_CLASS (chunk_mux_parent_class)->finalize (object);
+}
+
+static void
+chunk_mux_class_init (GstMultiSourceChunkMuxClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  gobject_class->set_property = chunk_mux_set_property;
+  gobject_class->get_property = chunk_mux_get_property;
+  gobject_class->finalize = chunk_mux_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_INDEX_INTERVAL,
+      g_param_spec_uint64 ("index-interval", "Index interval",
+          "Time between two index chunks, 0 to only index when finishing", 0,
+          G_MAXUINT64, CHUNK_MUX_DEFAULT_INDEX_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Chunks and bytes written", GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &sink_template);
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+  gst_element_class_set_static_metadata (element_class,
+      "Chunk container muxer", "Codec/Muxer",
+      "Write many streams to an indexed chunk container",
+      "gst-multisource-launch");
+
+  element_class->request_new_pad = chunk_mux_request_new_pad;
+  element_class->release_pad = chunk_mux_release_pad;
+  element_class->change_state = chunk_mux_change_state;
+}
+
+static void
+chunk_mux_init (GstMultiSourceChunkMux * self)
+{
+  self->srcpad = gst_pad_new_from_static_template (&src_template, "src");
+  gst_pad_use_fixed_caps (self->srcpad);
+  gst_element_add_pad (GST_ELEMENT (self), self->srcpad);
+
+  g_mutex_init (&self->lock);
+  self->index = g_byte_array_new ();
+  self->index_interval = CHUNK_MUX_DEFAULT_INDEX_INTERVAL;
+  self->last_index = CHUNK_NO_INDEX;
+  self->last_index_pts = GST_CLOCK_TIME_NONE;
+}
@@ -0,0 +1,71 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_CHUNK_MUX_H__
+#define __GST_MULTI_SOURCE_CHUNK_MUX_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MULTI_SOURCE_CHUNK_MUX (chunk_mux_get_type ())
+#define GST_MULTI_SOURCE_CHUNK_MUX(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+    GST_TYPE_MULTI_SOURCE_CHUNK_MUX, GstMultiSourceChunkMux))
+
+#define CHUNK_MUX_DEFAULT_INDEX_INTERVAL (10 * GST_SECOND)
+
+typedef struct _GstMultiSourceChunkMux
+{
+  GstElement parent;
+
+  GstPad *srcpad;
+  /* properties */
+  GstClockTime index_interval;
+
+  /* The stream lock of srcpad serializes the chunks of all the sink pads
+   * and protects the output state. lock, never held while pushing, covers
+   * the pads and the statistics. */
+  gboolean started;
+  gboolean finished;
+  /* keyframes since the last index chunk, keyindex.h entries */
+  GByteArray *index;
+  guint64 last_index;
+  GstClockTime last_index_pts;
+
+  GMutex lock;
+  guint next_stream;
+  guint n_eos;
+
+  /* statistics, protected by lock */
+  guint64 offset;
+  guint64 chunks;
+  guint64 index_chunks;
+} GstMultiSourceChunkMux;
+
+typedef struct _GstMultiSourceChunkMuxClass
+{
+  GstElementClass parent_class;
+} GstMultiSourceChunkMuxClass;
+
+GType chunk_mux_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_CHUNK_MUX_H__ */
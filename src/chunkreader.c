@@ -0,0 +1,372 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "chunkreader.h"
+
+struct _GstMultiSourceChunkReader
+{
+  GMappedFile *file;
+  const guint8 *data;
+  /* end of the chunks, before the trailer if any */
+  gsize size;
+  gboolean finished;
+  /* GstCaps indexed by stream id, NULL for the unknown ones */
+  GPtrArray *caps;
+  GArray *video;
+  /* keyindex.h entries in file order */
+  GByteArray *keyframes;
+};
+
+/* Read the header of the chunk at offset, checking that it fits */
+static gboolean
+read_chunk (GstMultiSourceChunkReader * reader, guint64 offset,
+    GstMultiSourceChunkHeader * header)
+{
+  return offset + CHUNK_HEADER_SIZE <= reader->size
+      && chunk_read_header (reader->data + offset, header)
+      && offset + CHUNK_HEADER_SIZE + header->size <= reader->size;
+}
+
+static void
+caps_free (GstCaps * caps)
+{
+  if (caps)
+    gst_caps_unref (caps);
+}
+
+static void
+add_caps (GstMultiSourceChunkReader * reader,
+    const GstMultiSourceChunkHeader * header, guint64 offset)
+{
+  gchar *str;
+
+  if (header->size == 0)
+    return;
+  if (header->stream >= reader->caps->len)
+    g_ptr_array_set_size (reader->caps, header->stream + 1);
+
+  str = g_strndup ((const gchar *) reader->data + offset + CHUNK_HEADER_SIZE,
+      header->size);
+  if (!g_ptr_array_index (reader->caps, header->stream)) {
+    GstCaps *caps = gst_caps_from_string (str);
+    const gchar *name;
+
+    g_ptr_array_index (reader->caps, header->stream) = caps;
+    if (caps && !gst_caps_is_empty (caps) && !gst_caps_is_any (caps)) {
+      name = gst_structure_get_name (gst_caps_get_structure (caps, 0));
+      if (header->stream >= reader->video->len)
+        g_array_set_size (reader->video, header->stream + 1);
+      g_array_index (reader->video, gboolean, header->stream) =
+          g_str_has_prefix (name, "video/") || g_str_has_prefix (name,
+          "image/");
+    }
+  }
+  g_free (str);
+}
+
+gboolean
+chunk_reader_is_video (GstMultiSourceChunkReader * reader, guint32 stream)
+{
+  return stream < reader->video->len
+      && g_array_index (reader->video, gboolean, stream);
+}
+
+/* A finished file: the caps follow the last index chunk, which leads back
+ * to the others. */
+static gboolean
+load_index (GstMultiSourceChunkReader * reader, guint64 last_index)
+{
+  GstMultiSourceChunkHeader header;
+  GList *chunks = NULL, *l;
+  guint64 offset;
+
+  if (!read_chunk (reader, last_index, &header))
+    return FALSE;
+  for (offset = last_index + chunk_get_size (header.size);
+      read_chunk (reader, offset, &header);
+      offset += chunk_get_size (header.size))
+    if (header.type == CHUNK_TYPE_CAPS)
+      add_caps (reader, &header, offset);
+
+  /* Each index chunk points to an earlier one */
+  for (offset = last_index; offset != CHUNK_NO_INDEX;) {
+    const guint8 *index = reader->data + offset + CHUNK_HEADER_SIZE;
+    guint64 previous;
+
+    if (!read_chunk (reader, offset, &header)
+        || header.type != CHUNK_TYPE_INDEX
+        || header.size < CHUNK_INDEX_PREFIX_SIZE
+        || header.size < CHUNK_INDEX_PREFIX_SIZE + (guint64)
+        GST_READ_UINT32_LE (index + 8) * KEY_INDEX_ENTRY_SIZE
+        || ((previous = GST_READ_UINT64_LE (index)) != CHUNK_NO_INDEX
+            && previous >= offset)) {
+      g_list_free (chunks);
+      return FALSE;
+    }
+    chunks = g_list_prepend (chunks, (gpointer) index);
+    offset = previous;
+  }
+
+  for (l = chunks; l; l = l->next) {
+    const guint8 *index = l->data;
+    guint32 n = GST_READ_UINT32_LE (index + 8);
+
+    g_byte_array_append (reader->keyframes, index + CHUNK_INDEX_PREFIX_SIZE,
+        n * KEY_INDEX_ENTRY_SIZE);
+  }
+  g_list_free (chunks);
+
+  return TRUE;
+}
+
+/* A file still being written, or cut: walk every header. The last chunk
+ * may be incomplete, the chunks end with the last complete one. */
+static void
+scan (GstMultiSourceChunkReader * reader)
+{
+  GstMultiSourceChunkHeader header;
+  guint64 offset;
+
+  for (offset = CHUNK_FILE_HEADER_SIZE; read_chunk (reader, offset, &header);
+      offset += chunk_get_size (header.size)) {
+    if (header.type == CHUNK_TYPE_CAPS) {
+      add_caps (reader, &header, offset);
+    } else if (header.type == CHUNK_TYPE_DATA
+        && (header.flags & CHUNK_FLAG_KEYFRAME)
+        && !(header.flags & CHUNK_FLAG_HEADER)
+        && GST_CLOCK_TIME_IS_VALID (header.pts)
+        && chunk_reader_is_video (reader, header.stream)) {
+      GstMultiSourceKeyEntry entry = { offset, header.pts, header.stream, 0 };
+
+      g_byte_array_set_size (reader->keyframes,
+          reader->keyframes->len + KEY_INDEX_ENTRY_SIZE);
+      key_index_write_entry (reader->keyframes->data +
+          reader->keyframes->len - KEY_INDEX_ENTRY_SIZE, &entry);
+    }
+  }
+  reader->size = MIN (reader->size, offset);
+}
+
+GstMultiSourceChunkReader *
+chunk_reader_open (const gchar * location, GError ** error)
+{
+  GstMultiSourceChunkReader *reader;
+  GMappedFile *file;
+  const guint8 *data;
+  gsize size;
+  guint64 last_index;
+
+  file = g_mapped_file_new (location, FALSE, error);
+  if (!file)
+    return NULL;
+
+  data = (const guint8 *) g_mapped_file_get_contents (file);
+  size = g_mapped_file_get_length (file);
+  if (!chunk_check_file_header (data, size)) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+        "\"%s\" is not a chunk container", location);
+    g_mapped_file_unref (file);
+    return NULL;
+  }
+
+  reader = g_new0 (GstMultiSourceChunkReader, 1);
+  reader->file = file;
+  reader->data = data;
+  reader->size = size;
+  reader->caps = g_ptr_array_new_with_free_func ((GDestroyNotify) caps_free);
+  reader->video = g_array_new (FALSE, TRUE, sizeof (gboolean));
+  reader->keyframes = g_byte_array_new ();
+
+  last_index = chunk_read_trailer (data, size);
+  if (last_index != CHUNK_NO_INDEX) {
+    reader->size = size - CHUNK_TRAILER_SIZE;
+    reader->finished = load_index (reader, last_index);
+  }
+  if (!reader->finished) {
+    g_ptr_array_set_size (reader->caps, 0);
+    g_array_set_size (reader->video, 0);
+    g_byte_array_set_size (reader->keyframes, 0);
+    reader->size = size;
+    scan (reader);
+  }
+#ifdef MADV_SEQUENTIAL
+  /* The chunks are read in order from there on */
+  madvise ((gpointer) data, size, MADV_SEQUENTIAL);
+#endif
+
+  return reader;
+}
+
+void
+chunk_reader_close (GstMultiSourceChunkReader * reader)
+{
+  g_ptr_array_free (reader->caps, TRUE);
+  g_array_free (reader->video, TRUE);
+  g_byte_array_unref (reader->keyframes);
+  g_mapped_file_unref (reader->file);
+  g_free (reader);
+}
+
+guint
+chunk_reader_get_n_streams (GstMultiSourceChunkReader * reader)
+{
+  return reader->caps->len;
+}
+
+/* The caps of a stream, NULL if it has none. No reference is returned. */
+GstCaps *
+chunk_reader_get_caps (GstMultiSourceChunkReader * reader, guint32 stream)
+{
+  return stream < reader->caps->len ? g_ptr_array_index (reader->caps,
+      stream) : NULL;
+}
+
+gsize
+chunk_reader_get_n_keyframes (GstMultiSourceChunkReader * reader)
+{
+  return reader->keyframes->len / KEY_INDEX_ENTRY_SIZE;
+}
+
+gboolean
+chunk_reader_is_finished (GstMultiSourceChunkReader * reader)
+{
+  return reader->finished;
+}
+
+const guint8 *
+chunk_reader_get_data (GstMultiSourceChunkReader * reader, guint64 offset)
+{
+  return reader->data + offset;
+}
+
+/* Wrap part of the mapping in a read only memory, which keeps the file
+ * mapped for as long as it is used. */
+GstMemory *
+chunk_reader_wrap (GstMultiSourceChunkReader * reader, guint64 offset,
+    gsize size)
+{
+  return gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY,
+      (gpointer) (reader->data + offset), size, 0, size,
+      g_mapped_file_ref (reader->file),
+      (GDestroyNotify) g_mapped_file_unref);
+}
+
+/* Prepare to walk the chunks of a stream, or of all of them with
+ * KEY_INDEX_STREAM_ANY, from start to stop. The walk begins at the
+ * keyframe before start of the video streams that are read, and each of
+ * them is returned from its first keyframe on. */
+void
+chunk_reader_range_init (GstMultiSourceChunkReader * reader,
+    GstMultiSourceChunkRange * range, guint32 stream, GstClockTime start,
+    GstClockTime stop)
+{
+  guint32 i;
+
+  range->stream = stream;
+  range->start = start;
+  range->stop = stop;
+  range->offset = reader->size;
+  range->started = g_array_new (FALSE, TRUE, sizeof (gboolean));
+  g_array_set_size (range->started, reader->caps->len);
+  range->done = g_array_new (FALSE, TRUE, sizeof (gboolean));
+  g_array_set_size (range->done, reader->caps->len);
+  range->n_streams = stream == KEY_INDEX_STREAM_ANY ? reader->caps->len :
+      stream < reader->caps->len;
+  range->n_done = 0;
+
+  for (i = 0; i < reader->caps->len; i++) {
+    GstMultiSourceKeyEntry entry;
+
+    if (stream != KEY_INDEX_STREAM_ANY && i != stream)
+      continue;
+    if (!chunk_reader_is_video (reader, i))
+      g_array_index (range->started, gboolean, i) = TRUE;
+    else if (key_index_search (reader->keyframes->data,
+            chunk_reader_get_n_keyframes (reader), start, i, &entry))
+      range->offset = MIN (range->offset, entry.offset);
+    else
+      range->offset = CHUNK_FILE_HEADER_SIZE;
+  }
+  if (range->offset == reader->size)
+    range->offset = CHUNK_FILE_HEADER_SIZE;
+}
+
+/* The next data chunk of the range, the offset of its payload in offset.
+ * The chunks are compared with the range by decoding time, which only
+ * grows within a stream, both being running times. Returns FALSE at the
+ * end of the range, once every stream read is past it. */
+gboolean
+chunk_reader_range_next (GstMultiSourceChunkReader * reader,
+    GstMultiSourceChunkRange * range, GstMultiSourceChunkHeader * header,
+    guint64 * offset)
+{
+  while (read_chunk (reader, range->offset, header)) {
+    guint64 chunk = range->offset;
+    GstClockTime time;
+    gboolean *started, *done;
+
+    range->offset += chunk_get_size (header->size);
+    if (header->type != CHUNK_TYPE_DATA || (range->stream !=
+            KEY_INDEX_STREAM_ANY && header->stream != range->stream)
+        || header->stream >= range->started->len)
+      continue;
+
+    time = GST_CLOCK_TIME_IS_VALID (header->dts) ? header->dts : header->pts;
+    if (GST_CLOCK_TIME_IS_VALID (range->stop) && GST_CLOCK_TIME_IS_VALID (time)
+        && time > range->stop) {
+      done = &g_array_index (range->done, gboolean, header->stream);
+      if (!*done && time > range->stop + CHUNK_READER_STOP_MARGIN) {
+        *done = TRUE;
+        if (++range->n_done == range->n_streams)
+          return FALSE;
+      }
+      continue;
+    }
+
+    started = &g_array_index (range->started, gboolean, header->stream);
+    if (!*started && (header->flags & CHUNK_FLAG_KEYFRAME))
+      *started = TRUE;
+    if (!*started || (!chunk_reader_is_video (reader, header->stream)
+            && GST_CLOCK_TIME_IS_VALID (header->pts)
+            && header->pts < range->start))
+      continue;
+
+    *offset = chunk + CHUNK_HEADER_SIZE;
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+void
+chunk_reader_range_clear (GstMultiSourceChunkRange * range)
+{
+  if (range->started)
+    g_array_free (range->started, TRUE);
+  range->started = NULL;
+  if (range->done)
+    g_array_free (range->done, TRUE);
+  range->done = NULL;
+}
@@ -0,0 +1,76 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_CHUNK_READER_H__
+#define __GST_MULTI_SOURCE_CHUNK_READER_H__
+
+#include <gst/gst.h>
+
+#include "chunkformat.h"
+
+G_BEGIN_DECLS
+
+/* How far past the end of a time range chunks are still looked at, the
+ * muxer writing them in arrival order rather than by time */
+#define CHUNK_READER_STOP_MARGIN GST_SECOND
+
+typedef struct _GstMultiSourceChunkReader GstMultiSourceChunkReader;
+
+/* Walks the chunks of some streams over a time range */
+typedef struct
+{
+  guint32 stream;
+  GstClockTime start;
+  GstClockTime stop;
+  guint64 offset;
+  /* streams that reached a keyframe, and those past the end of the range
+   * by more than the margin, indexed by stream id */
+  GArray *started;
+  GArray *done;
+  guint n_streams;
+  guint n_done;
+} GstMultiSourceChunkRange;
+
+GstMultiSourceChunkReader *chunk_reader_open (const gchar * location,
+    GError ** error);
+void chunk_reader_close (GstMultiSourceChunkReader * reader);
+guint chunk_reader_get_n_streams (GstMultiSourceChunkReader * reader);
+GstCaps *chunk_reader_get_caps (GstMultiSourceChunkReader * reader,
+    guint32 stream);
+gboolean chunk_reader_is_video (GstMultiSourceChunkReader * reader,
+    guint32 stream);
+gsize chunk_reader_get_n_keyframes (GstMultiSourceChunkReader * reader);
+gboolean chunk_reader_is_finished (GstMultiSourceChunkReader * reader);
+const guint8 *chunk_reader_get_data (GstMultiSourceChunkReader * reader,
+    guint64 offset);
+GstMemory *chunk_reader_wrap (GstMultiSourceChunkReader * reader,
+    guint64 offset, gsize size);
+
+void chunk_reader_range_init (GstMultiSourceChunkReader * reader,
+    GstMultiSourceChunkRange * range, guint32 stream, GstClockTime start,
+    GstClockTime stop);
+gboolean chunk_reader_range_next (GstMultiSourceChunkReader * reader,
+    GstMultiSourceChunkRange * range, GstMultiSourceChunkHeader * header,
+    guint64 * offset);
+void chunk_reader_range_clear (GstMultiSourceChunkRange * range);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_CHUNK_READER_H__ */
@@ -0,0 +1,353 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-chunksrc
+ *
+ * Read the streams of a chunk container written by chunkmux, one source
+ * pad per stream. The file is mapped and the payloads are pushed as read
+ * only memories of the mapping, without copy. stream selects a single
+ * stream, start and stop a time range, found through the keyframe index.
+ *
+ * gst-launch-1.0 chunksrc location=out.msc stream=3 ! h264parse ! ...
+ */
+
+#include "multisource.h"
+#include "chunksrc.h"
+
+#define GST_CAT_DEFAULT multisource_launch_debug
+
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_STREAM,
+  PROP_START,
+  PROP_STOP,
+};
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src_%u",
+    GST_PAD_SRC, GST_PAD_SOMETIMES, GST_STATIC_CAPS_ANY);
+
+G_DEFINE_TYPE (GstMultiSourceChunkSrc, chunk_src, GST_TYPE_ELEMENT);
+
+static void
+pad_unref (GstPad * pad)
+{
+  if (pad)
+    gst_object_unref (pad);
+}
+
+static void
+push_eos (GstMultiSourceChunkSrc * self)
+{
+  guint i;
+
+  for (i = 0; i < self->pads->len; i++) {
+    GstPad *pad = g_ptr_array_index (self->pads, i);
+
+    if (pad)
+      gst_pad_push_event (pad, gst_event_new_eos ());
+  }
+}
+
+static void
+chunk_src_loop (gpointer user_data)
+{
+  GstMultiSourceChunkSrc *self = user_data;
+  GstMultiSourceChunkHeader header;
+  GstBuffer *buffer;
+  GstFlowReturn ret;
+  guint64 offset;
+  GstPad *pad;
+
+  if (!chunk_reader_range_next (self->reader, &self->range, &header,
+          &offset)) {
+    push_eos (self);
+    gst_task_pause (self->task);
+    return;
+  }
+  pad = g_ptr_array_index (self->pads, header.stream);
+  if (!pad)
+    return;
+
+  buffer = gst_buffer_new ();
+  gst_buffer_append_memory (buffer, chunk_reader_wrap (self->reader, offset,
+          header.size));
+  GST_BUFFER_PTS (buffer) = header.pts;
+  GST_BUFFER_DTS (buffer) = header.dts;
+  GST_BUFFER_OFFSET (buffer) = offset;
+  if (!(header.flags & CHUNK_FLAG_KEYFRAME))
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  if (header.flags & CHUNK_FLAG_DISCONT)
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+  if (header.flags & CHUNK_FLAG_HEADER)
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_HEADER);
+
+  ret = gst_flow_combiner_update_pad_flow (self->flow_combiner, pad,
+      gst_pad_push (pad, buffer));
+  if (ret != GST_FLOW_OK) {
+    GST_DEBUG_OBJECT (self, "Pausing: %s", gst_flow_get_name (ret));
+    if (ret == GST_FLOW_EOS)
+      push_eos (self);
+    else if (ret == GST_FLOW_NOT_LINKED || ret < GST_FLOW_EOS)
+      GST_ELEMENT_FLOW_ERROR (self, ret);
+    gst_task_pause (self->task);
+  }
+}
+
+/* A pad per stream read, with its events ready to go with the first
+ * buffer. */
+static gboolean
+add_pads (GstMultiSourceChunkSrc * self)
+{
+  GstSegment segment;
+  guint n_pads = 0;
+  guint32 i;
+
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  segment.start = self->start;
+  segment.stop = self->stop;
+  segment.time = self->start;
+
+  for (i = 0; i < chunk_reader_get_n_streams (self->reader); i++) {
+    GstCaps *caps = chunk_reader_get_caps (self->reader, i);
+    gchar *name, *stream_id;
+    GstPad *pad;
+
+    if (!caps || (self->stream >= 0 && i != (guint32) self->stream))
+      continue;
+
+    name = g_strdup_printf ("src_%u", i);
+    pad = gst_pad_new_from_static_template (&src_template, name);
+    g_free (name);
+    gst_pad_use_fixed_caps (pad);
+    gst_pad_set_active (pad, TRUE);
+
+    stream_id = gst_pad_create_stream_id_printf (pad, GST_ELEMENT (self),
+        "%u", i);
+    gst_pad_store_sticky_event (pad, gst_event_new_stream_start (stream_id));
+    g_free (stream_id);
+    gst_pad_store_sticky_event (pad, gst_event_new_caps (caps));
+    gst_pad_store_sticky_event (pad, gst_event_new_segment (&segment));
+
+    g_ptr_array_index (self->pads, i) = gst_object_ref (pad);
+    gst_flow_combiner_add_pad (self->flow_combiner, pad);
+    gst_element_add_pad (GST_ELEMENT (self), pad);
+    n_pads++;
+  }
+  gst_element_no_more_pads (GST_ELEMENT (self));
+
+  return n_pads > 0;
+}
+
+static gboolean
+open_file (GstMultiSourceChunkSrc * self)
+{
+  GError *err = NULL;
+
+  if (!self->location) {
+    GST_ELEMENT_ERROR (self, RESOURCE, NOT_FOUND,
+        ("No file name specified for reading."), (NULL));
+    return FALSE;
+  }
+  self->reader = chunk_reader_open (self->location, &err);
+  if (!self->reader) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ, (NULL), ("%s",
+            err->message));
+    g_error_free (err);
+    return FALSE;
+  }
+
+  g_ptr_array_set_size (self->pads,
+      chunk_reader_get_n_streams (self->reader));
+  if (!add_pads (self)) {
+    GST_ELEMENT_ERROR (self, STREAM, DEMUX, (NULL),
+        ("No stream %d in \"%s\"", self->stream, self->location));
+    return FALSE;
+  }
+  chunk_reader_range_init (self->reader, &self->range,
+      self->stream >= 0 ? (guint32) self->stream : KEY_INDEX_STREAM_ANY,
+      self->start, self->stop);
+
+  return gst_task_start (self->task);
+}
+
+static void
+close_file (GstMultiSourceChunkSrc * self)
+{
+  guint i;
+
+  gst_task_stop (self->task);
+  g_rec_mutex_lock (&self->task_lock);
+  g_rec_mutex_unlock (&self->task_lock);
+  gst_task_join (self->task);
+
+  for (i = 0; i < self->pads->len; i++) {
+    GstPad *pad = g_ptr_array_index (self->pads, i);
+
+    if (pad) {
+      gst_flow_combiner_remove_pad (self->flow_combiner, pad);
+      gst_element_remove_pad (GST_ELEMENT (self), pad);
+    }
+  }
+  g_ptr_array_set_size (self->pads, 0);
+
+  if (self->reader) {
+    chunk_reader_range_clear (&self->range);
+    chunk_reader_close (self->reader);
+    self->reader = NULL;
+  }
+}
+
+static GstStateChangeReturn
+chunk_src_change_state (GstElement * element, GstStateChange transition)
+{
+  GstMultiSourceChunkSrc *self = GST_MULTI_SOURCE_CHUNK_SRC (element);
+  GstStateChangeReturn ret;
+
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED && !open_file (self)) {
+    close_file (self);
+    return GST_STATE_CHANGE_FAILURE;
+  }
+
+  ret = GST_ELEMENT_CLASS (chunk_src_parent_class)->change_state (element,
+      transition);
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY)
+    close_file (self);
+
+  return ret;
+}
+
+static void
+chunk_src_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMultiSourceChunkSrc *self = GST_MULTI_SOURCE_CHUNK_SRC (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_free (self->location);
+      self->location = g_value_dup_string (value);
+      break;
+    case PROP_STREAM:
+      self->stream = g_value_get_int (value);
+      break;
+    case PROP_START:
+      self->start = g_value_get_uint64 (value);
+      break;
+    case PROP_STOP:
+      self->stop = g_value_get_uint64 (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+chunk_src_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstMultiSourceChunkSrc *self = GST_MULTI_SOURCE_CHUNK_SRC (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_value_set_string (value, self->location);
+      break;
+    case PROP_STREAM:
+      g_value_set_int (value, self->stream);
+      break;
+    case PROP_START:
+      g_value_set_uint64 (value, self->start);
+      break;
+    case PROP_STOP:
+      g_value_set_uint64 (value, self->stop);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+chunk_src_finalize (GObject * object)
+{
+  GstMultiSourceChunkSrc *self = GST_MULTI_SOURCE_CHUNK_SRC (object);
+
+  gst_object_unref (self->task);
+  g_rec_mutex_clear (&self->task_lock);
+  gst_flow_combiner_free (self->flow_combiner);
+  g_ptr_array_free (self->pads, TRUE);
+  g_free (self->location);
+
+  G_OBJECT_CLASS (chunk_src_parent_class)->finalize (object);
+}
+
+static void
+chunk_src_class_init (GstMultiSourceChunkSrcClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  gobject_class->set_property = chunk_src_set_property;
+  gobject_class->get_property = chunk_src_get_property;
+  gobject_class->finalize = chunk_src_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_LOCATION,
+      g_param_spec_string ("location", "File Location",
+          "Location of the chunk container to read", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_STREAM,
+      g_param_spec_int ("stream", "Stream",
+          "Only read this stream, -1 for all of them", -1, G_MAXINT, -1,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_START,
+      g_param_spec_uint64 ("start", "Start",
+          "Time to start reading from", 0, G_MAXUINT64, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_STOP,
+      g_param_spec_uint64 ("stop", "Stop",
+          "Time to stop reading at, -1 for the end", 0, G_MAXUINT64,
+          GST_CLOCK_TIME_NONE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+  gst_element_class_set_static_metadata (element_class,
+      "Chunk container source", "Source/File/Demuxer",
+      "Read the streams of a chunk container from a mapping of the file",
+      "gst-multisource-launch");
+
+  element_class->change_state = chunk_src_change_state;
+}
+
+static void
+chunk_src_init (GstMultiSourceChunkSrc * self)
+{
+  self->stream = -1;
+  self->stop = GST_CLOCK_TIME_NONE;
+  self->pads = g_ptr_array_new_with_free_func ((GDestroyNotify) pad_unref);
+  self->flow_combiner = gst_flow_combiner_new ();
+  g_rec_mutex_init (&self->task_lock);
+  self->task = gst_task_new (chunk_src_loop, self, NULL);
+  gst_task_set_lock (self->task, &self->task_lock);
+
+  GST_OBJECT_FLAG_SET (self, GST_ELEMENT_FLAG_SOURCE);
+}
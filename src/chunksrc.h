@@ -0,0 +1,63 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_CHUNK_SRC_H__
+#define __GST_MULTI_SOURCE_CHUNK_SRC_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstflowcombiner.h>
+
+#include "chunkreader.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MULTI_SOURCE_CHUNK_SRC (chunk_src_get_type ())
+#define GST_MULTI_SOURCE_CHUNK_SRC(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+    GST_TYPE_MULTI_SOURCE_CHUNK_SRC, GstMultiSourceChunkSrc))
+
+typedef struct _GstMultiSourceChunkSrc
+{
+  GstElement parent;
+
+  /* properties */
+  gchar *location;
+  gint stream;
+  GstClockTime start;
+  GstClockTime stop;
+
+  GstMultiSourceChunkReader *reader;
+  GstMultiSourceChunkRange range;
+  /* source pads indexed by stream id, NULL for the streams not read */
+  GPtrArray *pads;
+  GstFlowCombiner *flow_combiner;
+  GstTask *task;
+  GRecMutex task_lock;
+} GstMultiSourceChunkSrc;
+
+typedef struct _GstMultiSourceChunkSrcClass
+{
+  GstElementClass parent_class;
+} GstMultiSourceChunkSrcClass;
+
+GType chunk_src_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_CHUNK_SRC_H__ */
@@ -0,0 +1,202 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include <gst/app/gstappsrc.h>
+
+#include "multisource.h"
+#include "clip.h"
+
+#define GST_CAT_DEFAULT multisource_launch_debug
+
+struct _GstMultiSourceClip
+{
+  gint refcount;
+  GstElement *pipeline;
+  GstAppSrc *src;
+  gchar *location;
+  /* subtracted from the timestamps so that the clip starts at 0 */
+  GstClockTime base;
+  GstClockTime end;
+};
+
+static const struct
+{
+  const gchar *muxer;
+  const gchar *extension;
+} extensions[] = {
+  {"matroskamux", "mkv"},
+  {"webmmux", "webm"},
+  {"mp4mux", "mp4"},
+  {"qtmux", "mov"},
+  {"mpegtsmux", "ts"},
+  {"flvmux", "flv"},
+  {"avimux", "avi"},
+};
+
+/* File extension for what the muxer, possibly followed by properties,
+ * writes. */
+const gchar *
+clip_get_extension (const gchar * muxer)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (extensions); i++)
+    if (g_str_has_prefix (muxer, extensions[i].muxer))
+      return extensions[i].extension;
+
+  return "bin";
+}
+
+static void
+clip_unref (GstMultiSourceClip * clip)
+{
+  if (!g_atomic_int_dec_and_test (&clip->refcount))
+    return;
+
+  gst_element_set_state (clip->pipeline, GST_STATE_NULL);
+  gst_object_unref (clip->pipeline);
+  g_free (clip->location);
+  g_free (clip);
+}
+
+static gboolean
+clip_bus_cb (GstBus * bus, GstMessage * message, gpointer user_data)
+{
+  GstMultiSourceClip *clip = user_data;
+  GError *err;
+
+  switch (GST_MESSAGE_TYPE (message)) {
+    case GST_MESSAGE_EOS:
+      PRINT ("Clip %s written", clip->location);
+      break;
+    case GST_MESSAGE_ERROR:
+      gst_message_parse_error (message, &err, NULL);
+      PRINT ("Clip %s failed: %s", clip->location, err->message);
+      g_error_free (err);
+      break;
+    default:
+      return G_SOURCE_CONTINUE;
+  }
+
+  gst_element_set_state (clip->pipeline, GST_STATE_NULL);
+  return G_SOURCE_REMOVE;
+}
+
+/* Parser for the streams whose muxers want them in a given alignment or
+ * stream format, NULL when the frames can go to the muxer as they are */
+static const gchar *
+get_parser (GstCaps * caps)
+{
+  const gchar *name = gst_structure_get_name (gst_caps_get_structure (caps,
+          0));
+
+  if (!strcmp (name, "video/x-h264"))
+    return "h264parse";
+  if (!strcmp (name, "video/x-h265"))
+    return "h265parse";
+
+  return NULL;
+}
+
+/* Build appsrc [! parser] ! muxer ! filesink. The decoding timestamp of the
+ * first frame, a keyframe, is the lowest of the clip. */
+GstMultiSourceClip *
+clip_new (GstCaps * caps, GstBuffer * first, GstClockTime end,
+    const gchar * muxer, const gchar * location)
+{
+  GstMultiSourceClip *clip;
+  GstElement *pipeline, *src, *parser = NULL, *mux, *sink;
+  const gchar *parser_name = get_parser (caps);
+  GstBus *bus;
+  GError *err = NULL;
+
+  mux = gst_parse_launch (muxer, &err);
+  if (!mux) {
+    GST_WARNING ("Unable to create the clip muxer %s: %s", muxer,
+        err->message);
+    g_error_free (err);
+    return NULL;
+  }
+  g_clear_error (&err);
+
+  pipeline = gst_pipeline_new ("clip");
+  src = gst_element_factory_make ("appsrc", NULL);
+  sink = gst_element_factory_make ("filesink", NULL);
+  gst_bin_add_many (GST_BIN (pipeline), src, mux, sink, NULL);
+  if (parser_name && (parser = gst_element_factory_make (parser_name, NULL)))
+    gst_bin_add (GST_BIN (pipeline), parser);
+  g_object_set (src, "caps", caps, "format", GST_FORMAT_TIME, "max-bytes",
+      (guint64) 0, NULL);
+  g_object_set (sink, "location", location, NULL);
+  if (!(parser ? gst_element_link_many (src, parser, mux, sink, NULL) :
+          gst_element_link_many (src, mux, sink, NULL))
+      || gst_element_set_state (pipeline, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_FAILURE) {
+    GST_WARNING ("Unable to start writing the clip %s", location);
+    gst_element_set_state (pipeline, GST_STATE_NULL);
+    gst_object_unref (pipeline);
+    return NULL;
+  }
+
+  clip = g_new0 (GstMultiSourceClip, 1);
+  /* one reference for the history feeding it, one for the bus watch */
+  clip->refcount = 2;
+  clip->pipeline = pipeline;
+  clip->src = GST_APP_SRC (src);
+  clip->location = g_strdup (location);
+  clip->base = GST_BUFFER_DTS_IS_VALID (first) ? GST_BUFFER_DTS (first) :
+      GST_BUFFER_PTS (first);
+  clip->end = end;
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  gst_bus_add_watch_full (bus, G_PRIORITY_DEFAULT, clip_bus_cb, clip,
+      (GDestroyNotify) clip_unref);
+  gst_object_unref (bus);
+
+  PRINT ("Writing clip %s", location);
+
+  return clip;
+}
+
+/* Hand a frame to the clip, returns FALSE once past its end. */
+gboolean
+clip_push (GstMultiSourceClip * clip, GstBuffer * buffer)
+{
+  GstBuffer *copy;
+
+  if (GST_BUFFER_PTS (buffer) > clip->end)
+    return FALSE;
+
+  copy = gst_buffer_copy (buffer);
+  GST_BUFFER_PTS (copy) -= MIN (clip->base, GST_BUFFER_PTS (copy));
+  if (GST_BUFFER_DTS_IS_VALID (copy))
+    GST_BUFFER_DTS (copy) -= MIN (clip->base, GST_BUFFER_DTS (copy));
+
+  return gst_app_src_push_buffer (clip->src, copy) == GST_FLOW_OK;
+}
+
+void
+clip_finish (GstMultiSourceClip * clip)
+{
+  gst_app_src_end_of_stream (clip->src);
+  clip_unref (clip);
+}
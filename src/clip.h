@@ -0,0 +1,44 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_CLIP_H__
+#define __GST_MULTI_SOURCE_CLIP_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define CLIP_DEFAULT_MUXER "matroskamux"
+#define CLIP_DEFAULT_PREROLL (10 * GST_SECOND)
+#define CLIP_DEFAULT_POSTROLL (10 * GST_SECOND)
+
+/* A clip is written by its own pipeline, fed the compressed frames of a
+ * branch, so that neither its muxer nor its file can hold the branch. */
+typedef struct _GstMultiSourceClip GstMultiSourceClip;
+
+const gchar *clip_get_extension (const gchar * muxer);
+GstMultiSourceClip *clip_new (GstCaps * caps, GstBuffer * first,
+    GstClockTime end, const gchar * muxer, const gchar * location);
+gboolean clip_push (GstMultiSourceClip * clip, GstBuffer * buffer);
+void clip_finish (GstMultiSourceClip * clip);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_CLIP_H__ */
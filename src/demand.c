@@ -0,0 +1,169 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "demand.h"
+
+typedef struct
+{
+  GstMultiSourceDemand *demand;
+  GstMultiSourceBranch *branch;
+  guint consumers;
+  guint timeout_id;
+} DemandEntry;
+
+static void
+entry_free (DemandEntry * entry)
+{
+  if (entry->timeout_id)
+    g_source_remove (entry->timeout_id);
+  g_free (entry);
+}
+
+static DemandEntry *
+find_entry (GstMultiSourceDemand * demand, guint id)
+{
+  guint i;
+
+  for (i = 0; i < demand->entries->len; i++) {
+    DemandEntry *entry = g_ptr_array_index (demand->entries, i);
+
+    if (entry->branch->id == id)
+      return entry;
+  }
+
+  return NULL;
+}
+
+static gboolean
+detach_cb (gpointer user_data)
+{
+  DemandEntry *entry = user_data;
+
+  entry->timeout_id = 0;
+  gate_request (&entry->branch->gate, GATE_OWNER_DEMAND, GATE_LEVEL_PAUSED);
+  entry->demand->detaches++;
+  PRINT ("demand: no consumer left, branch %u back to compressed only",
+      entry->branch->id);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* A consumer wants the decoded output of the branch. Returns FALSE when
+ * the branch is not decoded on demand. */
+gboolean
+demand_watch (GstMultiSourceDemand * demand, guint id)
+{
+  DemandEntry *entry = find_entry (demand, id);
+
+  if (!entry)
+    return FALSE;
+
+  if (entry->timeout_id) {
+    g_source_remove (entry->timeout_id);
+    entry->timeout_id = 0;
+  }
+  entry->consumers++;
+  if (gate_request (&entry->branch->gate, GATE_OWNER_DEMAND,
+          GATE_LEVEL_FULL)) {
+    demand->attaches++;
+    PRINT ("demand: decoding branch %u", id);
+  }
+
+  return TRUE;
+}
+
+/* A consumer is gone, the branch stops being decoded once it has had none
+ * for the timeout. */
+gboolean
+demand_unwatch (GstMultiSourceDemand * demand, guint id)
+{
+  DemandEntry *entry = find_entry (demand, id);
+
+  if (!entry || entry->consumers == 0)
+    return FALSE;
+
+  if (--entry->consumers == 0)
+    entry->timeout_id = g_timeout_add (GST_TIME_AS_MSECONDS (demand->timeout),
+        detach_cb, entry);
+
+  return TRUE;
+}
+
+/* Keep the on-demand branches compressed: their parsers run and their GOP
+ * is retained but nothing is decoded until a consumer asks for it. Returns
+ * NULL when no branch is on demand, leaving every branch decoded. */
+GstMultiSourceDemand *
+demand_new (GPtrArray * branches, GstClockTime timeout)
+{
+  GstMultiSourceDemand *demand = g_new0 (GstMultiSourceDemand, 1);
+  guint i;
+
+  demand->timeout = timeout;
+  demand->entries = g_ptr_array_new_with_free_func ((GDestroyNotify)
+      entry_free);
+
+  for (i = 0; i < branches->len; i++) {
+    GstMultiSourceBranch *branch = g_ptr_array_index (branches, i);
+    DemandEntry *entry;
+
+    if (!branch->on_demand)
+      continue;
+
+    entry = g_new0 (DemandEntry, 1);
+    entry->demand = demand;
+    entry->branch = branch;
+    g_ptr_array_add (demand->entries, entry);
+    gate_request (&branch->gate, GATE_OWNER_DEMAND, GATE_LEVEL_PAUSED);
+  }
+
+  if (demand->entries->len == 0) {
+    demand_free (demand);
+    return NULL;
+  }
+
+  return demand;
+}
+
+void
+demand_free (GstMultiSourceDemand * demand)
+{
+  g_ptr_array_free (demand->entries, TRUE);
+  g_free (demand);
+}
+
+GstStructure *
+demand_get_stats (GstMultiSourceDemand * demand)
+{
+  guint watched = 0, i;
+
+  for (i = 0; i < demand->entries->len; i++) {
+    DemandEntry *entry = g_ptr_array_index (demand->entries, i);
+
+    if (entry->consumers > 0 || entry->timeout_id)
+      watched++;
+  }
+
+  return gst_structure_new ("demand",
+      "branches", G_TYPE_UINT, demand->entries->len,
+      "decoded", G_TYPE_UINT, watched,
+      "timeout", G_TYPE_UINT64, demand->timeout,
+      "attaches", G_TYPE_UINT64, demand->attaches,
+      "detaches", G_TYPE_UINT64, demand->detaches, NULL);
+}
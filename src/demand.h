@@ -0,0 +1,50 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_DEMAND_H__
+#define __GST_MULTI_SOURCE_DEMAND_H__
+
+#include <gst/gst.h>
+
+#include "branch.h"
+
+G_BEGIN_DECLS
+
+#define DEMAND_DEFAULT_TIMEOUT (10 * GST_SECOND)
+
+typedef struct _GstMultiSourceDemand
+{
+  GstClockTime timeout;
+  /* one DemandEntry per on-demand branch */
+  GPtrArray *entries;
+
+  guint64 attaches;
+  guint64 detaches;
+} GstMultiSourceDemand;
+
+GstMultiSourceDemand *demand_new (GPtrArray * branches, GstClockTime timeout);
+void demand_free (GstMultiSourceDemand * demand);
+gboolean demand_watch (GstMultiSourceDemand * demand, guint id);
+gboolean demand_unwatch (GstMultiSourceDemand * demand, guint id);
+GstStructure *demand_get_stats (GstMultiSourceDemand * demand);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_DEMAND_H__ */
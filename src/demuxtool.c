@@ -0,0 +1,267 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * gst-multisource-demux: list the streams of a chunk container written by
+ * chunkmux, or extract some of them over a time range, without decoding:
+ *
+ * gst-multisource-demux --stream=3 --start=3600 --stop=3660 -o cam3.msc out.msc
+ * gst-multisource-demux --stream=3 --raw -o cam3.h264 out.msc
+ *
+ * The chunks are copied from a mapping of the file as they are, into a new
+ * chunk container with its own index, or as the bare payloads with --raw.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunkreader.h"
+
+#define DEMUX_TOOL_BUFFER_SIZE (4 * 1024 * 1024)
+
+typedef struct
+{
+  FILE *file;
+  guint64 offset;
+  GByteArray *index;
+} Output;
+
+static gboolean
+write_data (Output * out, const guint8 * data, gsize size)
+{
+  out->offset += size;
+  return fwrite (data, 1, size, out->file) == size;
+}
+
+static gboolean
+write_chunk (Output * out, GstMultiSourceChunkHeader * header,
+    const guint8 * payload)
+{
+  static const guint8 padding[CHUNK_ALIGN] = { 0, };
+  guint8 data[CHUNK_HEADER_SIZE];
+  gsize pad = chunk_get_size (header->size) - CHUNK_HEADER_SIZE -
+      header->size;
+
+  chunk_write_header (data, header);
+
+  return write_data (out, data, CHUNK_HEADER_SIZE)
+      && write_data (out, payload, header->size)
+      && write_data (out, padding, pad);
+}
+
+static gboolean
+write_caps (Output * out, GstMultiSourceChunkReader * reader, gint stream)
+{
+  guint32 i;
+
+  for (i = 0; i < chunk_reader_get_n_streams (reader); i++) {
+    GstCaps *caps = chunk_reader_get_caps (reader, i);
+    GstMultiSourceChunkHeader header = { CHUNK_TYPE_CAPS, CHUNK_FLAG_HEADER,
+      i, 0, GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE
+    };
+    gchar *str;
+    gboolean res;
+
+    if (!caps || (stream >= 0 && i != (guint32) stream))
+      continue;
+
+    str = gst_caps_to_string (caps);
+    header.size = strlen (str) + 1;
+    res = write_chunk (out, &header, (const guint8 *) str);
+    g_free (str);
+    if (!res)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* The whole index at the end, then the caps again and the trailer, the
+ * way chunkmux finishes a file. */
+static gboolean
+write_end (Output * out, GstMultiSourceChunkReader * reader, gint stream)
+{
+  GstMultiSourceChunkHeader header = { CHUNK_TYPE_INDEX, 0, 0, 0,
+    GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE
+  };
+  guint8 prefix[CHUNK_INDEX_PREFIX_SIZE];
+  guint8 trailer[CHUNK_TRAILER_SIZE];
+  guint64 index = out->offset;
+
+  GST_WRITE_UINT64_LE (prefix, CHUNK_NO_INDEX);
+  GST_WRITE_UINT32_LE (prefix + 8, out->index->len / KEY_INDEX_ENTRY_SIZE);
+  GST_WRITE_UINT32_LE (prefix + 12, 0);
+  g_byte_array_prepend (out->index, prefix, sizeof (prefix));
+  header.size = out->index->len;
+  chunk_write_trailer (trailer, index);
+
+  return write_chunk (out, &header, out->index->data)
+      && write_caps (out, reader, stream)
+      && write_data (out, trailer, CHUNK_TRAILER_SIZE);
+}
+
+static void
+list_streams (GstMultiSourceChunkReader * reader)
+{
+  guint32 i;
+
+  g_print ("%s, %" G_GSIZE_FORMAT " keyframes indexed\n",
+      chunk_reader_is_finished (reader) ? "finished" : "not finished",
+      chunk_reader_get_n_keyframes (reader));
+  for (i = 0; i < chunk_reader_get_n_streams (reader); i++) {
+    GstCaps *caps = chunk_reader_get_caps (reader, i);
+    gchar *str;
+
+    if (!caps)
+      continue;
+    str = gst_caps_to_string (caps);
+    g_print ("%u: %s\n", i, str);
+    g_free (str);
+  }
+}
+
+int
+main (int argc, char **argv)
+{
+  int res = EXIT_SUCCESS;
+  GError *err = NULL;
+  GOptionContext *ctx;
+  GstMultiSourceChunkReader *reader;
+  GstMultiSourceChunkRange range;
+  GstMultiSourceChunkHeader header;
+  Output out = { NULL, 0, NULL };
+  gboolean list = FALSE;
+  gboolean raw = FALSE;
+  gint stream = -1;
+  gdouble start = 0.0;
+  gdouble stop = -1.0;
+  gchar *output = NULL;
+  guint64 offset;
+  gboolean ok = TRUE;
+
+  GOptionEntry options[] = {
+    {"list", 'l', 0, G_OPTION_ARG_NONE, &list,
+        ("List the streams"), NULL}
+    ,
+    {"stream", 0, 0, G_OPTION_ARG_INT, &stream,
+        ("Only extract this stream (default: all)"), "ID"}
+    ,
+    {"start", 0, 0, G_OPTION_ARG_DOUBLE, &start,
+        ("Time to extract from, in seconds"), "SECONDS"}
+    ,
+    {"stop", 0, 0, G_OPTION_ARG_DOUBLE, &stop,
+        ("Time to extract to, in seconds (default: the end)"), "SECONDS"}
+    ,
+    {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+        ("File to extract to"), "FILE"}
+    ,
+    {"raw", 0, 0, G_OPTION_ARG_NONE, &raw,
+        ("Write the payloads of a single stream only"), NULL}
+    ,
+    {NULL}
+  };
+
+  ctx = g_option_context_new ("FILE");
+  g_option_context_add_main_entries (ctx, options, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err) || argc != 2
+      || (!list && !output) || (raw && stream < 0)) {
+    g_printerr ("%s\n", err ? err->message :
+        "Expecting a file, and --list, or --output with --stream for --raw");
+    g_clear_error (&err);
+    g_option_context_free (ctx);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free (ctx);
+
+  reader = chunk_reader_open (argv[1], &err);
+  if (!reader) {
+    g_printerr ("%s\n", err->message);
+    g_error_free (err);
+    g_free (output);
+    return EXIT_FAILURE;
+  }
+
+  if (list) {
+    list_streams (reader);
+    goto done;
+  }
+
+  out.file = fopen (output, "wb");
+  if (!out.file) {
+    g_printerr ("Could not open %s: %s\n", output, g_strerror (errno));
+    res = EXIT_FAILURE;
+    goto done;
+  }
+  setvbuf (out.file, NULL, _IOFBF, DEMUX_TOOL_BUFFER_SIZE);
+  out.index = g_byte_array_new ();
+
+  if (!raw) {
+    guint8 file_header[CHUNK_FILE_HEADER_SIZE];
+
+    chunk_write_file_header (file_header);
+    ok = write_data (&out, file_header, CHUNK_FILE_HEADER_SIZE)
+        && write_caps (&out, reader, stream);
+  }
+
+  chunk_reader_range_init (reader, &range,
+      stream >= 0 ? (guint32) stream : KEY_INDEX_STREAM_ANY,
+      start * GST_SECOND, stop < 0.0 ? GST_CLOCK_TIME_NONE : stop * GST_SECOND);
+  while (ok && chunk_reader_range_next (reader, &range, &header, &offset)) {
+    const guint8 *payload = chunk_reader_get_data (reader, offset);
+
+    if (raw) {
+      ok = write_data (&out, payload, header.size);
+      continue;
+    }
+    if ((header.flags & CHUNK_FLAG_KEYFRAME)
+        && !(header.flags & CHUNK_FLAG_HEADER)
+        && GST_CLOCK_TIME_IS_VALID (header.pts)
+        && chunk_reader_is_video (reader, header.stream)) {
+      GstMultiSourceKeyEntry entry = { out.offset, header.pts, header.stream,
+        0
+      };
+
+      g_byte_array_set_size (out.index, out.index->len + KEY_INDEX_ENTRY_SIZE);
+      key_index_write_entry (out.index->data + out.index->len -
+          KEY_INDEX_ENTRY_SIZE, &entry);
+    }
+    ok = write_chunk (&out, &header, payload);
+  }
+  chunk_reader_range_clear (&range);
+
+  if (ok && !raw)
+    ok = write_end (&out, reader, stream);
+  if (fclose (out.file) != 0)
+    ok = FALSE;
+  if (!ok) {
+    g_printerr ("Could not write %s: %s\n", output, g_strerror (errno));
+    res = EXIT_FAILURE;
+  }
+  g_byte_array_unref (out.index);
+
+done:
+  chunk_reader_close (reader);
+  g_free (output);
+
+  return res;
+}
@@ -0,0 +1,179 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "gate.h"
+
+const gchar *
+gate_level_get_name (GstMultiSourceGateLevel level)
+{
+  switch (level) {
+    case GATE_LEVEL_FULL:
+      return "full";
+    case GATE_LEVEL_REDUCED:
+      return "reduced";
+    case GATE_LEVEL_KEYFRAMES:
+      return "keyframes";
+    case GATE_LEVEL_PAUSED:
+      return "paused";
+  }
+
+  return "unknown";
+}
+
+void
+gate_init (GstMultiSourceGate * gate)
+{
+  memset (gate, 0, sizeof (GstMultiSourceGate));
+  g_mutex_init (&gate->lock);
+}
+
+void
+gate_clear (GstMultiSourceGate * gate)
+{
+  g_mutex_clear (&gate->lock);
+}
+
+/* Returns TRUE when the effective level of the branch changed */
+gboolean
+gate_request (GstMultiSourceGate * gate, GstMultiSourceGateOwner owner,
+    GstMultiSourceGateLevel level)
+{
+  GstMultiSourceGateLevel effective = GATE_LEVEL_FULL;
+  gboolean changed;
+  guint i;
+
+  g_mutex_lock (&gate->lock);
+  gate->requested[owner] = level;
+  for (i = 0; i < GATE_OWNER_LAST; i++)
+    effective = MAX (effective, gate->requested[i]);
+  changed = effective != g_atomic_int_get (&gate->level);
+  if (changed)
+    gate->changes++;
+  g_atomic_int_set (&gate->level, effective);
+  g_mutex_unlock (&gate->lock);
+
+  return changed;
+}
+
+GstMultiSourceGateLevel
+gate_get_requested (GstMultiSourceGate * gate, GstMultiSourceGateOwner owner)
+{
+  GstMultiSourceGateLevel level;
+
+  g_mutex_lock (&gate->lock);
+  level = gate->requested[owner];
+  g_mutex_unlock (&gate->lock);
+
+  return level;
+}
+
+GstMultiSourceGateLevel
+gate_get_level (GstMultiSourceGate * gate)
+{
+  return g_atomic_int_get (&gate->level);
+}
+
+/* Called on every compressed frame before the decoder. Once a frame has been
+ * dropped the decoder is missing references, so frames are dropped until
+ * the next keyframe whatever the level. */
+gboolean
+gate_drop_compressed (GstMultiSourceGate * gate, GstBuffer * buffer)
+{
+  GstMultiSourceGateLevel level = g_atomic_int_get (&gate->level);
+  gboolean keyframe =
+      !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  gboolean drop;
+
+  if (keyframe)
+    gate->need_keyframe = FALSE;
+
+  switch (level) {
+    case GATE_LEVEL_FULL:
+      drop = gate->need_keyframe;
+      break;
+    case GATE_LEVEL_REDUCED:
+      /* Frames nothing refers to can go without breaking the stream */
+      drop = gate->need_keyframe
+          || GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DROPPABLE);
+      break;
+    case GATE_LEVEL_KEYFRAMES:
+      drop = !keyframe;
+      break;
+    case GATE_LEVEL_PAUSED:
+    default:
+      drop = TRUE;
+      break;
+  }
+
+  if (drop) {
+    if (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DROPPABLE))
+      gate->need_keyframe = TRUE;
+    g_mutex_lock (&gate->lock);
+    gate->dropped++;
+    g_mutex_unlock (&gate->lock);
+  }
+
+  return drop;
+}
+
+/* The decoder got its references back some other way than the next
+ * keyframe, stop waiting for it. */
+void
+gate_resume (GstMultiSourceGate * gate)
+{
+  gate->need_keyframe = FALSE;
+}
+
+/* Called on every decoded video frame, halves the output rate when the
+ * branch is reduced. */
+gboolean
+gate_drop_decoded (GstMultiSourceGate * gate)
+{
+  if (g_atomic_int_get (&gate->level) != GATE_LEVEL_REDUCED)
+    return FALSE;
+
+  if ((gate->decoded++ & 1) == 0)
+    return FALSE;
+
+  g_mutex_lock (&gate->lock);
+  gate->decimated++;
+  g_mutex_unlock (&gate->lock);
+
+  return TRUE;
+}
+
+GstStructure *
+gate_get_stats (GstMultiSourceGate * gate)
+{
+  GstStructure *s;
+
+  g_mutex_lock (&gate->lock);
+  s = gst_structure_new ("gate",
+      "level", G_TYPE_STRING,
+      gate_level_get_name (g_atomic_int_get (&gate->level)),
+      "dropped", G_TYPE_UINT64, gate->dropped,
+      "decimated", G_TYPE_UINT64, gate->decimated,
+      "changes", G_TYPE_UINT, gate->changes, NULL);
+  g_mutex_unlock (&gate->lock);
+
+  return s;
+}
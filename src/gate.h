@@ -0,0 +1,79 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_GATE_H__
+#define __GST_MULTI_SOURCE_GATE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* How much of a branch gets decoded, from everything to nothing */
+typedef enum
+{
+  GATE_LEVEL_FULL,
+  GATE_LEVEL_REDUCED,
+  GATE_LEVEL_KEYFRAMES,
+  GATE_LEVEL_PAUSED,
+} GstMultiSourceGateLevel;
+
+/* Each owner requests its own level, the most degraded one wins */
+typedef enum
+{
+  GATE_OWNER_GOVERNOR,
+  GATE_OWNER_ADMISSION,
+  GATE_OWNER_ROTATION,
+  GATE_OWNER_DEMAND,
+  GATE_OWNER_LAST
+} GstMultiSourceGateOwner;
+
+typedef struct _GstMultiSourceGate
+{
+  GMutex lock;
+  GstMultiSourceGateLevel requested[GATE_OWNER_LAST];
+  gint level;
+
+  /* streaming thread only */
+  gboolean need_keyframe;
+  guint decoded;
+
+  /* statistics, protected by lock */
+  guint64 dropped;
+  guint64 decimated;
+  guint changes;
+} GstMultiSourceGate;
+
+const gchar *gate_level_get_name (GstMultiSourceGateLevel level);
+
+void gate_init (GstMultiSourceGate * gate);
+void gate_clear (GstMultiSourceGate * gate);
+gboolean gate_request (GstMultiSourceGate * gate,
+    GstMultiSourceGateOwner owner, GstMultiSourceGateLevel level);
+GstMultiSourceGateLevel gate_get_requested (GstMultiSourceGate * gate,
+    GstMultiSourceGateOwner owner);
+GstMultiSourceGateLevel gate_get_level (GstMultiSourceGate * gate);
+gboolean gate_drop_compressed (GstMultiSourceGate * gate, GstBuffer * buffer);
+gboolean gate_drop_decoded (GstMultiSourceGate * gate);
+void gate_resume (GstMultiSourceGate * gate);
+GstStructure *gate_get_stats (GstMultiSourceGate * gate);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_GATE_H__ */
@@ -0,0 +1,246 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "gop.h"
+
+#define GOP_WINDOW GST_SECOND
+
+/* Relative decoding cost of the codecs, H.264 being the reference */
+static const struct
+{
+  const gchar *codec;
+  gdouble weight;
+} codec_weights[] = {
+  {"video/x-h264", 1.0},
+  {"video/x-h265", 1.6},
+  {"video/x-vp8", 0.9},
+  {"video/x-vp9", 1.4},
+  {"video/x-av1", 2.0},
+  {"video/mpeg", 0.5},
+  {"image/jpeg", 0.6},
+};
+
+/* Pixel rate of a 1080p30 stream, which costs 1.0 */
+#define REFERENCE_PIXEL_RATE (1920.0 * 1080.0 * 30.0)
+
+void
+gop_init (GstMultiSourceGop * gop, GstClockTime max_key_interval)
+{
+  memset (gop, 0, sizeof (GstMultiSourceGop));
+  g_mutex_init (&gop->lock);
+  gop->max_key_interval = max_key_interval;
+  gop->window_start = GST_CLOCK_TIME_NONE;
+  gop->last_key = GST_CLOCK_TIME_NONE;
+  gop->key_interval = GST_CLOCK_TIME_NONE;
+}
+
+void
+gop_clear (GstMultiSourceGop * gop)
+{
+  g_free (gop->codec);
+  g_mutex_clear (&gop->lock);
+}
+
+void
+gop_set_caps (GstMultiSourceGop * gop, GstCaps * caps)
+{
+  GstStructure *s = gst_caps_get_structure (caps, 0);
+
+  g_mutex_lock (&gop->lock);
+  g_free (gop->codec);
+  gop->codec = g_strdup (gst_structure_get_name (s));
+  gst_structure_get_int (s, "width", &gop->width);
+  gst_structure_get_int (s, "height", &gop->height);
+  gst_structure_get_fraction (s, "framerate", &gop->fps_n, &gop->fps_d);
+  g_mutex_unlock (&gop->lock);
+}
+
+/* Forget the timing of the stream after a flush or a new segment, its
+ * timestamps may go back */
+void
+gop_flush (GstMultiSourceGop * gop)
+{
+  gop->window_start = GST_CLOCK_TIME_NONE;
+  gop->window_bytes = 0;
+  gop->window_frames = 0;
+  gop->last_key = GST_CLOCK_TIME_NONE;
+  gop->frames_since_key = 0;
+}
+
+/* Account one compressed frame. Returns TRUE when the stream starts or
+ * stops exceeding the maximum keyframe interval. */
+gboolean
+gop_process (GstMultiSourceGop * gop, GstBuffer * buffer)
+{
+  gsize size = gst_buffer_get_size (buffer);
+  gboolean keyframe =
+      !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  GstClockTime ts = GST_BUFFER_DTS_OR_PTS (buffer);
+  GstClockTime key_interval = GST_CLOCK_TIME_NONE;
+  guint64 bitrate = 0;
+  gdouble framerate = 0.0;
+  gboolean misconfigured, changed;
+  guint gop_length = 0;
+
+  /* Live streams without timestamps are measured against the wall clock */
+  if (!GST_CLOCK_TIME_IS_VALID (ts))
+    ts = gst_util_get_timestamp ();
+
+  if (!GST_CLOCK_TIME_IS_VALID (gop->window_start) || ts < gop->window_start)
+    gop->window_start = ts;
+  gop->window_bytes += size;
+  gop->window_frames++;
+  if (ts - gop->window_start >= GOP_WINDOW) {
+    bitrate = gst_util_uint64_scale (gop->window_bytes * 8, GST_SECOND,
+        ts - gop->window_start);
+    framerate = (gdouble) gop->window_frames * GST_SECOND /
+        (ts - gop->window_start);
+    gop->window_start = ts;
+    gop->window_bytes = 0;
+    gop->window_frames = 0;
+  }
+
+  if (keyframe) {
+    if (GST_CLOCK_TIME_IS_VALID (gop->last_key) && ts > gop->last_key) {
+      key_interval = ts - gop->last_key;
+      gop_length = gop->frames_since_key;
+    }
+    gop->last_key = ts;
+    gop->frames_since_key = 0;
+  }
+  gop->frames_since_key++;
+
+  g_mutex_lock (&gop->lock);
+  gop->frames++;
+  if (keyframe) {
+    gop->keyframes++;
+    gop->key_bytes += size;
+  } else {
+    gop->delta_bytes += size;
+  }
+  gop->max_size = MAX (gop->max_size, size);
+  gop->histogram[MIN (g_bit_storage (size), GOP_HISTOGRAM_SIZE - 1)]++;
+  if (bitrate) {
+    gop->bitrate = bitrate;
+    gop->framerate = framerate;
+  }
+  if (GST_CLOCK_TIME_IS_VALID (key_interval)) {
+    gop->key_interval = key_interval;
+    gop->gop_length = gop_length;
+  }
+  /* Also flag streams that have not sent a keyframe for too long */
+  misconfigured = GST_CLOCK_TIME_IS_VALID (gop->last_key)
+      && ((ts >= gop->last_key && ts - gop->last_key > gop->max_key_interval)
+      || (GST_CLOCK_TIME_IS_VALID (gop->key_interval)
+          && gop->key_interval > gop->max_key_interval));
+  changed = misconfigured != gop->misconfigured;
+  gop->misconfigured = misconfigured;
+  g_mutex_unlock (&gop->lock);
+
+  return changed;
+}
+
+/* Estimated decoding cost relative to a 1080p30 H.264 stream. Unknown
+ * values are assumed to be the reference ones. */
+gdouble
+gop_estimate_cost (const gchar * codec, gint width, gint height, gdouble fps)
+{
+  gdouble weight = 1.0;
+  guint i;
+
+  for (i = 0; codec && i < G_N_ELEMENTS (codec_weights); i++) {
+    if (!strcmp (codec, codec_weights[i].codec))
+      weight = codec_weights[i].weight;
+  }
+  if (width <= 0 || height <= 0) {
+    width = 1920;
+    height = 1080;
+  }
+  if (fps <= 0.0)
+    fps = 30.0;
+
+  return weight * width * height * fps / REFERENCE_PIXEL_RATE;
+}
+
+/* Decoding cost of the stream from its caps and measured frame rate */
+gdouble
+gop_get_cost (GstMultiSourceGop * gop)
+{
+  gdouble fps = 0.0, cost;
+
+  g_mutex_lock (&gop->lock);
+  if (gop->framerate > 0.0)
+    fps = gop->framerate;
+  else if (gop->fps_n > 0 && gop->fps_d > 0)
+    fps = (gdouble) gop->fps_n / gop->fps_d;
+  cost = gop_estimate_cost (gop->codec, gop->width, gop->height, fps);
+  g_mutex_unlock (&gop->lock);
+
+  return cost;
+}
+
+/* Upper bound of the histogram bucket holding the given percentile */
+static guint64
+get_size_percentile (GstMultiSourceGop * gop, guint percent)
+{
+  guint64 target = (gop->frames * percent + 99) / 100;
+  guint64 count = 0;
+  guint i;
+
+  for (i = 0; i < GOP_HISTOGRAM_SIZE; i++) {
+    count += gop->histogram[i];
+    if (count >= target && count > 0)
+      return (G_GUINT64_CONSTANT (1) << i) - 1;
+  }
+
+  return gop->max_size;
+}
+
+GstStructure *
+gop_get_stats (GstMultiSourceGop * gop)
+{
+  GstStructure *s;
+  guint64 deltas;
+
+  g_mutex_lock (&gop->lock);
+  deltas = gop->frames - gop->keyframes;
+  s = gst_structure_new ("gop",
+      "codec", G_TYPE_STRING, gop->codec,
+      "width", G_TYPE_INT, gop->width,
+      "height", G_TYPE_INT, gop->height,
+      "frames", G_TYPE_UINT64, gop->frames,
+      "keyframes", G_TYPE_UINT64, gop->keyframes,
+      "bitrate", G_TYPE_UINT64, gop->bitrate,
+      "framerate", G_TYPE_DOUBLE, gop->framerate,
+      "gop-length", G_TYPE_UINT, gop->gop_length,
+      "keyframe-interval", G_TYPE_UINT64, gop->key_interval,
+      "key-size-avg", G_TYPE_UINT64,
+      gop->keyframes ? gop->key_bytes / gop->keyframes : 0,
+      "delta-size-avg", G_TYPE_UINT64, deltas ? gop->delta_bytes / deltas : 0,
+      "size-p50", G_TYPE_UINT64, get_size_percentile (gop, 50),
+      "size-p95", G_TYPE_UINT64, get_size_percentile (gop, 95),
+      "size-max", G_TYPE_UINT64, gop->max_size,
+      "misconfigured", G_TYPE_BOOLEAN, gop->misconfigured, NULL);
+  g_mutex_unlock (&gop->lock);
+
+  return s;
+}
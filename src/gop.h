@@ -0,0 +1,76 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_GOP_H__
+#define __GST_MULTI_SOURCE_GOP_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GOP_DEFAULT_MAX_KEY_INTERVAL (5 * GST_SECOND)
+#define GOP_HISTOGRAM_SIZE 32
+
+typedef struct _GstMultiSourceGop
+{
+  GMutex lock;
+
+  /* configuration */
+  GstClockTime max_key_interval;
+
+  /* streaming thread only */
+  GstClockTime window_start;
+  guint64 window_bytes;
+  guint window_frames;
+  GstClockTime last_key;
+  guint frames_since_key;
+
+  /* statistics, protected by lock */
+  gchar *codec;
+  gint width;
+  gint height;
+  gint fps_n;
+  gint fps_d;
+  guint64 frames;
+  guint64 keyframes;
+  guint64 key_bytes;
+  guint64 delta_bytes;
+  guint64 max_size;
+  guint64 histogram[GOP_HISTOGRAM_SIZE];
+  guint64 bitrate;
+  gdouble framerate;
+  guint gop_length;
+  GstClockTime key_interval;
+  gboolean misconfigured;
+} GstMultiSourceGop;
+
+void gop_init (GstMultiSourceGop * gop, GstClockTime max_key_interval);
+void gop_clear (GstMultiSourceGop * gop);
+void gop_set_caps (GstMultiSourceGop * gop, GstCaps * caps);
+void gop_flush (GstMultiSourceGop * gop);
+gboolean gop_process (GstMultiSourceGop * gop, GstBuffer * buffer);
+gdouble gop_estimate_cost (const gchar * codec, gint width, gint height,
+    gdouble fps);
+gdouble gop_get_cost (GstMultiSourceGop * gop);
+GstStructure *gop_get_stats (GstMultiSourceGop * gop);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_GOP_H__ */
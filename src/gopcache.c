@@ -0,0 +1,125 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "gopcache.h"
+
+void
+gopcache_init (GstMultiSourceGopCache * cache, guint64 max_bytes)
+{
+  memset (cache, 0, sizeof (GstMultiSourceGopCache));
+  g_mutex_init (&cache->lock);
+  g_queue_init (&cache->frames);
+  cache->max_bytes = max_bytes;
+}
+
+static void
+reset (GstMultiSourceGopCache * cache)
+{
+  GstBuffer *buffer;
+
+  while ((buffer = g_queue_pop_head (&cache->frames)))
+    gst_buffer_unref (buffer);
+  cache->bytes = 0;
+  cache->complete = FALSE;
+}
+
+void
+gopcache_clear (GstMultiSourceGopCache * cache)
+{
+  reset (cache);
+  g_mutex_clear (&cache->lock);
+}
+
+/* Forget the cached frames, after a flush or a caps change */
+void
+gopcache_flush (GstMultiSourceGopCache * cache)
+{
+  g_mutex_lock (&cache->lock);
+  reset (cache);
+  g_mutex_unlock (&cache->lock);
+}
+
+/* Keep a reference on a compressed frame. A keyframe starts a new GOP, a
+ * GOP going over the limit is forgotten until the next keyframe. */
+void
+gopcache_push (GstMultiSourceGopCache * cache, GstBuffer * buffer)
+{
+  gsize size = gst_buffer_get_size (buffer);
+
+  if (!cache->max_bytes)
+    return;
+
+  g_mutex_lock (&cache->lock);
+  if (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    reset (cache);
+    cache->complete = TRUE;
+  }
+  if (cache->complete) {
+    if (cache->bytes + size > cache->max_bytes) {
+      reset (cache);
+      cache->overflows++;
+    } else {
+      g_queue_push_tail (&cache->frames, gst_buffer_ref (buffer));
+      cache->bytes += size;
+      cache->peak_bytes = MAX (cache->peak_bytes, cache->bytes);
+    }
+  }
+  g_mutex_unlock (&cache->lock);
+}
+
+/* The frames cached before the last one pushed, starting with a keyframe,
+ * or NULL when there is no complete GOP. */
+GList *
+gopcache_get_frames (GstMultiSourceGopCache * cache)
+{
+  GList *frames = NULL, *l;
+
+  g_mutex_lock (&cache->lock);
+  if (cache->complete && cache->frames.length > 1) {
+    for (l = cache->frames.tail->prev; l; l = l->prev)
+      frames = g_list_prepend (frames, gst_buffer_ref (l->data));
+    cache->replays++;
+    cache->replayed += cache->frames.length - 1;
+  }
+  g_mutex_unlock (&cache->lock);
+
+  return frames;
+}
+
+GstStructure *
+gopcache_get_stats (GstMultiSourceGopCache * cache)
+{
+  GstStructure *s;
+
+  g_mutex_lock (&cache->lock);
+  s = gst_structure_new ("gop-cache",
+      "max-bytes", G_TYPE_UINT64, cache->max_bytes,
+      "frames", G_TYPE_UINT, cache->frames.length,
+      "bytes", G_TYPE_UINT64, cache->bytes,
+      "peak-bytes", G_TYPE_UINT64, cache->peak_bytes,
+      "replays", G_TYPE_UINT64, cache->replays,
+      "replayed", G_TYPE_UINT64, cache->replayed,
+      "overflows", G_TYPE_UINT64, cache->overflows, NULL);
+  g_mutex_unlock (&cache->lock);
+
+  return s;
+}
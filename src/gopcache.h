@@ -0,0 +1,59 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_GOP_CACHE_H__
+#define __GST_MULTI_SOURCE_GOP_CACHE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Retained by the branches decoded on demand when no size is configured */
+#define GOPCACHE_DEFAULT_BYTES (4 * 1024 * 1024)
+
+typedef struct _GstMultiSourceGopCache
+{
+  GMutex lock;
+
+  /* configuration, 0 disables the cache */
+  guint64 max_bytes;
+
+  /* compressed frames since the last keyframe, protected by lock */
+  GQueue frames;
+  guint64 bytes;
+  gboolean complete;
+
+  /* statistics, protected by lock */
+  guint64 peak_bytes;
+  guint64 replays;
+  guint64 replayed;
+  guint64 overflows;
+} GstMultiSourceGopCache;
+
+void gopcache_init (GstMultiSourceGopCache * cache, guint64 max_bytes);
+void gopcache_clear (GstMultiSourceGopCache * cache);
+void gopcache_flush (GstMultiSourceGopCache * cache);
+void gopcache_push (GstMultiSourceGopCache * cache, GstBuffer * buffer);
+GList *gopcache_get_frames (GstMultiSourceGopCache * cache);
+GstStructure *gopcache_get_stats (GstMultiSourceGopCache * cache);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_GOP_CACHE_H__ */
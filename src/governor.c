@@ -0,0 +1,212 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "governor.h"
+#include "sysinfo.h"
+
+#define GST_CAT_DEFAULT multisource_launch_debug
+
+typedef struct
+{
+  GstMultiSourceBranch *branch;
+  GstMultiSourceGateLevel previous;
+} GovernorAction;
+
+/* Degrade the least important branch first and finish degrading it before
+ * moving to another one. Among equals, the most expensive goes first. */
+static GstMultiSourceBranch *
+select_victim (GstMultiSourceGovernor * governor)
+{
+  GstMultiSourceBranch *victim = NULL;
+  GstMultiSourceGateLevel victim_level = GATE_LEVEL_FULL;
+  gdouble victim_cost = 0.0;
+  guint i;
+
+  for (i = 0; i < governor->branches->len; i++) {
+    GstMultiSourceBranch *branch = g_ptr_array_index (governor->branches, i);
+    GstMultiSourceGateLevel level =
+        gate_get_requested (&branch->gate, GATE_OWNER_GOVERNOR);
+    gdouble cost;
+
+    /* Critical branches keep their full frame rate */
+    if (level == GATE_LEVEL_PAUSED
+        || branch->priority == BRANCH_PRIORITY_CRITICAL)
+      continue;
+
+    cost = gop_get_cost (&branch->gop);
+    if (victim && branch->priority > victim->priority)
+      continue;
+    if (victim && branch->priority == victim->priority) {
+      if (level < victim_level)
+        continue;
+      if (level == victim_level && cost <= victim_cost)
+        continue;
+    }
+    victim = branch;
+    victim_level = level;
+    victim_cost = cost;
+  }
+
+  return victim;
+}
+
+static void
+governor_degrade (GstMultiSourceGovernor * governor)
+{
+  GstMultiSourceBranch *branch = select_victim (governor);
+  GovernorAction action;
+
+  if (!branch) {
+    GST_DEBUG ("Every branch is already paused");
+    return;
+  }
+
+  action.branch = branch;
+  action.previous = gate_get_requested (&branch->gate, GATE_OWNER_GOVERNOR);
+  g_array_append_val (governor->actions, action);
+  gate_request (&branch->gate, GATE_OWNER_GOVERNOR, action.previous + 1);
+  governor->degraded++;
+
+  PRINT ("governor: load %.1f%%, degrading %s branch %u from %s to %s",
+      governor->load, branch_priority_get_name (branch->priority), branch->id,
+      gate_level_get_name (action.previous),
+      gate_level_get_name (action.previous + 1));
+}
+
+static void
+governor_restore (GstMultiSourceGovernor * governor)
+{
+  GovernorAction *action;
+
+  if (governor->actions->len == 0)
+    return;
+
+  action = &g_array_index (governor->actions, GovernorAction,
+      governor->actions->len - 1);
+  gate_request (&action->branch->gate, GATE_OWNER_GOVERNOR, action->previous);
+  governor->restored++;
+
+  PRINT ("governor: load %.1f%%, restoring branch %u to %s", governor->load,
+      action->branch->id, gate_level_get_name (action->previous));
+  g_array_set_size (governor->actions, governor->actions->len - 1);
+}
+
+static gboolean
+governor_tick (gpointer user_data)
+{
+  GstMultiSourceGovernor *governor = user_data;
+  gint64 wall = g_get_monotonic_time ();
+  gint64 cpu = sysinfo_get_process_cpu_time ();
+  gint qos = g_atomic_int_get (&governor->qos);
+  gint pressure = g_atomic_int_get (&governor->pressure);
+
+  g_atomic_int_add (&governor->qos, -qos);
+  g_atomic_int_add (&governor->pressure, -pressure);
+  if (wall > governor->last_wall)
+    governor->load = 100.0 * (cpu - governor->last_cpu) /
+        ((wall - governor->last_wall) * governor->config->cpus);
+  governor->last_wall = wall;
+  governor->last_cpu = cpu;
+
+  /* The kernel already waited for the stall to be sustained, shed work
+   * right away before it throttles or OOM-kills the process. */
+  if (pressure > 0) {
+    governor->above = GOVERNOR_DEGRADE_SAMPLES;
+    governor->below = 0;
+  } else if (governor->load > governor->high || qos > 0) {
+    /* Late frames reported by the sinks count as overload too */
+    governor->above++;
+    governor->below = 0;
+  } else if (governor->load < governor->low) {
+    governor->below++;
+    governor->above = 0;
+  } else {
+    governor->above = 0;
+    governor->below = 0;
+  }
+
+  GST_LOG ("load %.1f%%, %d QoS messages, %d pressure events",
+      governor->load, qos, pressure);
+
+  if (governor->above >= GOVERNOR_DEGRADE_SAMPLES) {
+    governor_degrade (governor);
+    governor->above = 0;
+  } else if (governor->below >= GOVERNOR_RESTORE_SAMPLES) {
+    governor_restore (governor);
+    governor->below = 0;
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Degrade branches when the process CPU load goes over high percent of the
+ * CPUs granted to it and restore them once it has been under low for a
+ * while. */
+GstMultiSourceGovernor *
+governor_new (GPtrArray * branches, const GstMultiSourceConfig * config,
+    gdouble high, gdouble low)
+{
+  GstMultiSourceGovernor *governor = g_new0 (GstMultiSourceGovernor, 1);
+
+  governor->branches = branches;
+  governor->config = config;
+  governor->high = high;
+  governor->low = low;
+  governor->actions = g_array_new (FALSE, FALSE, sizeof (GovernorAction));
+  governor->last_wall = g_get_monotonic_time ();
+  governor->last_cpu = sysinfo_get_process_cpu_time ();
+  governor->source_id =
+      g_timeout_add (GOVERNOR_INTERVAL, governor_tick, governor);
+
+  return governor;
+}
+
+void
+governor_free (GstMultiSourceGovernor * governor)
+{
+  if (governor->source_id)
+    g_source_remove (governor->source_id);
+  g_array_free (governor->actions, TRUE);
+  g_free (governor);
+}
+
+void
+governor_notify_qos (GstMultiSourceGovernor * governor)
+{
+  g_atomic_int_inc (&governor->qos);
+}
+
+void
+governor_notify_pressure (GstMultiSourceGovernor * governor)
+{
+  g_atomic_int_inc (&governor->pressure);
+}
+
+GstStructure *
+governor_get_stats (GstMultiSourceGovernor * governor)
+{
+  return gst_structure_new ("governor",
+      "load", G_TYPE_DOUBLE, governor->load,
+      "high", G_TYPE_DOUBLE, governor->high,
+      "low", G_TYPE_DOUBLE, governor->low,
+      "pending-actions", G_TYPE_UINT, governor->actions->len,
+      "degraded", G_TYPE_UINT, governor->degraded,
+      "restored", G_TYPE_UINT, governor->restored, NULL);
+}
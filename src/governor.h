@@ -0,0 +1,65 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_GOVERNOR_H__
+#define __GST_MULTI_SOURCE_GOVERNOR_H__
+
+#include <gst/gst.h>
+
+#include "branch.h"
+
+G_BEGIN_DECLS
+
+#define GOVERNOR_INTERVAL 1000
+#define GOVERNOR_DEGRADE_SAMPLES 2
+#define GOVERNOR_RESTORE_SAMPLES 5
+
+typedef struct _GstMultiSourceGovernor
+{
+  GPtrArray *branches;
+  const GstMultiSourceConfig *config;
+  gdouble high;
+  gdouble low;
+  guint source_id;
+
+  gint64 last_wall;
+  gint64 last_cpu;
+  gint qos;
+  gint pressure;
+  guint above;
+  guint below;
+  gdouble load;
+
+  /* actions taken, undone in reverse order */
+  GArray *actions;
+  guint degraded;
+  guint restored;
+} GstMultiSourceGovernor;
+
+GstMultiSourceGovernor *governor_new (GPtrArray * branches,
+    const GstMultiSourceConfig * config, gdouble high, gdouble low);
+void governor_free (GstMultiSourceGovernor * governor);
+void governor_notify_qos (GstMultiSourceGovernor * governor);
+void governor_notify_pressure (GstMultiSourceGovernor * governor);
+GstStructure *governor_get_stats (GstMultiSourceGovernor * governor);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_GOVERNOR_H__ */
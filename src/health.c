@@ -0,0 +1,200 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "health.h"
+
+#define FNV_PRIME 16777619
+
+void
+health_init (GstMultiSourceHealth * health, GstClockTime timeout)
+{
+  memset (health, 0, sizeof (GstMultiSourceHealth));
+  g_mutex_init (&health->lock);
+  health->frozen_timeout = timeout;
+  health->blank_timeout = timeout;
+  health->black_level = HEALTH_DEFAULT_BLACK_LEVEL;
+  health->blank_spread = HEALTH_DEFAULT_BLANK_SPREAD;
+  health->frozen_since = GST_CLOCK_TIME_NONE;
+  health->blank_since = GST_CLOCK_TIME_NONE;
+}
+
+void
+health_clear (GstMultiSourceHealth * health)
+{
+  g_mutex_clear (&health->lock);
+}
+
+/* Sum and hash a block of luma samples. Every column gets its own
+ * accumulator so the inner loop has no dependency between iterations and
+ * the compiler can turn it into SIMD adds and multiplies. */
+static void
+sample_block (const guint8 * data, gint stride, gint width, gint height,
+    guint32 * sum, guint32 * hash)
+{
+  guint32 lane_sum[HEALTH_BLOCK_WIDTH] = { 0, };
+  guint32 lane_hash[HEALTH_BLOCK_WIDTH] = { 0, };
+  guint32 s = 0;
+  guint32 h = *hash;
+  gint x, y;
+
+  for (y = 0; y < height; y++) {
+    const guint8 *row = data + y * stride;
+
+    for (x = 0; x < width; x++) {
+      lane_sum[x] += row[x];
+      lane_hash[x] = lane_hash[x] * 31 + row[x];
+    }
+  }
+
+  for (x = 0; x < width; x++) {
+    s += lane_sum[x];
+    h = (h ^ lane_hash[x]) * FNV_PRIME;
+  }
+
+  *sum = s;
+  *hash = h;
+}
+
+static gboolean
+update_state (GstClockTime now, gboolean condition, GstClockTime * since,
+    GstClockTime timeout)
+{
+  if (!condition) {
+    *since = GST_CLOCK_TIME_NONE;
+    return FALSE;
+  }
+  if (!GST_CLOCK_TIME_IS_VALID (*since))
+    *since = now;
+
+  return now - *since >= timeout;
+}
+
+/* Check a mapped frame in place. Only 8 bits planar luma is supported, other
+ * formats are counted as skipped. Returns which of the frozen/blank states
+ * toggled with this frame. */
+GstMultiSourceHealthChange
+health_check_frame (GstMultiSourceHealth * health, const GstVideoFrame * frame)
+{
+  const GstVideoFormatInfo *finfo = frame->info.finfo;
+  GstMultiSourceHealthChange changed = HEALTH_CHANGED_NONE;
+  const guint8 *luma;
+  gint width, height, stride;
+  gint block_width, block_height;
+  guint32 hash = 2166136261u;
+  guint32 block_sum, block_mean;
+  guint32 total = 0, min_mean = G_MAXUINT32, max_mean = 0;
+  gboolean frozen, blank;
+  GstClockTime start, now;
+  gint col, row;
+
+  if (!(GST_VIDEO_FORMAT_INFO_IS_YUV (finfo)
+          || GST_VIDEO_FORMAT_INFO_IS_GRAY (finfo))
+      || GST_VIDEO_FORMAT_INFO_IS_TILED (finfo)
+      || GST_VIDEO_FORMAT_INFO_DEPTH (finfo, 0) != 8
+      || GST_VIDEO_FRAME_COMP_PSTRIDE (frame, 0) != 1)
+    goto skip;
+
+  width = GST_VIDEO_FRAME_COMP_WIDTH (frame, 0);
+  height = GST_VIDEO_FRAME_COMP_HEIGHT (frame, 0);
+  stride = GST_VIDEO_FRAME_COMP_STRIDE (frame, 0);
+  luma = GST_VIDEO_FRAME_COMP_DATA (frame, 0);
+
+  block_width = MIN (HEALTH_BLOCK_WIDTH, width / HEALTH_GRID);
+  block_height = MIN (HEALTH_BLOCK_HEIGHT, height / HEALTH_GRID);
+  if (block_width == 0 || block_height == 0)
+    goto skip;
+
+  start = gst_util_get_timestamp ();
+
+  for (row = 0; row < HEALTH_GRID; row++) {
+    gint y = row * (height / HEALTH_GRID);
+
+    for (col = 0; col < HEALTH_GRID; col++) {
+      gint x = col * (width / HEALTH_GRID);
+
+      sample_block (luma + y * stride + x, stride, block_width, block_height,
+          &block_sum, &hash);
+      block_mean = block_sum / (block_width * block_height);
+      total += block_mean;
+      min_mean = MIN (min_mean, block_mean);
+      max_mean = MAX (max_mean, block_mean);
+    }
+  }
+
+  now = gst_util_get_timestamp ();
+
+  frozen = update_state (now, health->have_hash && hash == health->last_hash,
+      &health->frozen_since, health->frozen_timeout);
+  blank = update_state (now, max_mean - min_mean <= health->blank_spread,
+      &health->blank_since, health->blank_timeout);
+  health->have_hash = TRUE;
+  health->last_hash = hash;
+
+  g_mutex_lock (&health->lock);
+  health->frames++;
+  if (GST_CLOCK_TIME_IS_VALID (health->frozen_since))
+    health->repeated++;
+  if (GST_CLOCK_TIME_IS_VALID (health->blank_since))
+    health->blank_frames++;
+  health->check_time += now - start;
+  health->luma = total / (HEALTH_GRID * HEALTH_GRID);
+  health->spread = max_mean - min_mean;
+  if (frozen != health->frozen)
+    changed |= HEALTH_CHANGED_FROZEN;
+  if (blank != health->blank)
+    changed |= HEALTH_CHANGED_BLANK;
+  health->frozen = frozen;
+  health->blank = blank;
+  g_mutex_unlock (&health->lock);
+
+  return changed;
+
+skip:
+  g_mutex_lock (&health->lock);
+  health->skipped++;
+  g_mutex_unlock (&health->lock);
+  return HEALTH_CHANGED_NONE;
+}
+
+GstStructure *
+health_get_stats (GstMultiSourceHealth * health)
+{
+  GstStructure *s;
+
+  g_mutex_lock (&health->lock);
+  s = gst_structure_new ("health",
+      "frames", G_TYPE_UINT64, health->frames,
+      "skipped", G_TYPE_UINT64, health->skipped,
+      "repeated", G_TYPE_UINT64, health->repeated,
+      "blank-frames", G_TYPE_UINT64, health->blank_frames,
+      "frozen", G_TYPE_BOOLEAN, health->frozen,
+      "blank", G_TYPE_BOOLEAN, health->blank,
+      "black", G_TYPE_BOOLEAN, health->blank
+      && health->luma <= health->black_level,
+      "luma", G_TYPE_UINT, health->luma,
+      "spread", G_TYPE_UINT, health->spread,
+      "check-time-avg", G_TYPE_UINT64,
+      health->frames ? health->check_time / health->frames : 0, NULL);
+  g_mutex_unlock (&health->lock);
+
+  return s;
+}
@@ -0,0 +1,81 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_HEALTH_H__
+#define __GST_MULTI_SOURCE_HEALTH_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+/* The luma plane is sampled on a HEALTH_GRID x HEALTH_GRID grid of blocks. */
+#define HEALTH_GRID 8
+#define HEALTH_BLOCK_WIDTH 32
+#define HEALTH_BLOCK_HEIGHT 8
+
+#define HEALTH_DEFAULT_TIMEOUT (2 * GST_SECOND)
+#define HEALTH_DEFAULT_BLACK_LEVEL 32
+#define HEALTH_DEFAULT_BLANK_SPREAD 8
+
+typedef enum
+{
+  HEALTH_CHANGED_NONE = 0,
+  HEALTH_CHANGED_FROZEN = (1 << 0),
+  HEALTH_CHANGED_BLANK = (1 << 1),
+} GstMultiSourceHealthChange;
+
+typedef struct _GstMultiSourceHealth
+{
+  GMutex lock;
+
+  /* configuration */
+  GstClockTime frozen_timeout;
+  GstClockTime blank_timeout;
+  guint black_level;
+  guint blank_spread;
+
+  /* streaming thread only */
+  gboolean have_hash;
+  guint32 last_hash;
+  GstClockTime frozen_since;
+  GstClockTime blank_since;
+
+  /* statistics, protected by lock */
+  guint64 frames;
+  guint64 skipped;
+  guint64 repeated;
+  guint64 blank_frames;
+  guint64 check_time;
+  guint luma;
+  guint spread;
+  gboolean frozen;
+  gboolean blank;
+} GstMultiSourceHealth;
+
+void health_init (GstMultiSourceHealth * health, GstClockTime timeout);
+void health_clear (GstMultiSourceHealth * health);
+GstMultiSourceHealthChange health_check_frame (GstMultiSourceHealth * health,
+    const GstVideoFrame * frame);
+GstStructure *health_get_stats (GstMultiSourceHealth * health);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_HEALTH_H__ */
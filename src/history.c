@@ -0,0 +1,245 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "multisource.h"
+#include "history.h"
+
+#define GST_CAT_DEFAULT multisource_launch_debug
+
+void
+history_init (GstMultiSourceHistory * history, GstClockTime preroll)
+{
+  memset (history, 0, sizeof (GstMultiSourceHistory));
+  g_mutex_init (&history->lock);
+  g_queue_init (&history->frames);
+  history->preroll = preroll;
+}
+
+static void
+reset (GstMultiSourceHistory * history)
+{
+  GstBuffer *buffer;
+
+  while ((buffer = g_queue_pop_head (&history->frames)))
+    gst_buffer_unref (buffer);
+  history->bytes = 0;
+}
+
+/* The clips end early when the stream they are cut from is interrupted */
+static void
+finish_clips (GstMultiSourceHistory * history)
+{
+  g_list_free_full (history->clips, (GDestroyNotify) clip_finish);
+  history->clips = NULL;
+}
+
+void
+history_clear (GstMultiSourceHistory * history)
+{
+  finish_clips (history);
+  reset (history);
+  gst_clear_caps (&history->caps);
+  g_mutex_clear (&history->lock);
+}
+
+void
+history_set_caps (GstMultiSourceHistory * history, GstCaps * caps)
+{
+  g_mutex_lock (&history->lock);
+  finish_clips (history);
+  reset (history);
+  gst_caps_replace (&history->caps, caps);
+  g_mutex_unlock (&history->lock);
+}
+
+void
+history_flush (GstMultiSourceHistory * history)
+{
+  g_mutex_lock (&history->lock);
+  finish_clips (history);
+  reset (history);
+  g_mutex_unlock (&history->lock);
+}
+
+/* Drop the first GOP when the next one alone covers the pre-roll, or when
+ * over the size limit. Returns FALSE when there is a single GOP left. */
+static gboolean
+drop_gop (GstMultiSourceHistory * history, GstClockTime pts)
+{
+  GList *l;
+  GstBuffer *next = NULL;
+
+  for (l = history->frames.head ? history->frames.head->next : NULL; l;
+      l = l->next) {
+    if (!GST_BUFFER_FLAG_IS_SET (l->data, GST_BUFFER_FLAG_DELTA_UNIT)) {
+      next = l->data;
+      break;
+    }
+  }
+  if (!next || (history->bytes <= HISTORY_MAX_BYTES
+          && GST_BUFFER_PTS (next) + history->preroll > pts))
+    return FALSE;
+
+  while (g_queue_peek_head (&history->frames) != next) {
+    GstBuffer *buffer = g_queue_pop_head (&history->frames);
+
+    history->bytes -= gst_buffer_get_size (buffer);
+    gst_buffer_unref (buffer);
+  }
+
+  return TRUE;
+}
+
+/* Keep a reference on a compressed frame and hand it to the clips being
+ * written. Old GOPs are only dropped when a keyframe arrives, so the work
+ * done per frame does not depend on the length of the history. */
+void
+history_push (GstMultiSourceHistory * history, GstBuffer * buffer)
+{
+  GstClockTime pts = GST_BUFFER_PTS (buffer);
+  GList *l, *next;
+
+  if (!history->preroll || !GST_CLOCK_TIME_IS_VALID (pts))
+    return;
+
+  g_mutex_lock (&history->lock);
+  for (l = history->clips; l; l = next) {
+    next = l->next;
+    if (!clip_push (l->data, buffer)) {
+      clip_finish (l->data);
+      history->clips = g_list_delete_link (history->clips, l);
+    }
+  }
+
+  if (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    while (drop_gop (history, pts));
+  } else if (g_queue_is_empty (&history->frames)) {
+    goto done;
+  }
+
+  g_queue_push_tail (&history->frames, gst_buffer_ref (buffer));
+  history->bytes += gst_buffer_get_size (buffer);
+  if (history->bytes > HISTORY_MAX_BYTES) {
+    /* not even a keyframe in the limit, start again from the next one */
+    reset (history);
+    history->overflows++;
+  }
+  history->peak_bytes = MAX (history->peak_bytes, history->bytes);
+
+done:
+  g_mutex_unlock (&history->lock);
+}
+
+/* Start writing a clip from the last keyframe at least pre-roll before the
+ * event, ago before the last frame received, until postroll after it. The
+ * history is written right away, the rest as it is received. The clip is
+ * set up and handed the history without the lock, which only covers taking
+ * the frames, so the streaming thread is not held back meanwhile. */
+gboolean
+history_export (GstMultiSourceHistory * history, GstClockTime ago,
+    GstClockTime postroll, const gchar * muxer, const gchar * location)
+{
+  GstMultiSourceClip *clip;
+  GstClockTime last, event;
+  GstCaps *caps;
+  GstBuffer *tail;
+  GList *l, *start = NULL, *frames = NULL;
+
+  g_mutex_lock (&history->lock);
+  if (!history->caps || g_queue_is_empty (&history->frames)) {
+    g_mutex_unlock (&history->lock);
+    return FALSE;
+  }
+
+  last = GST_BUFFER_PTS (g_queue_peek_tail (&history->frames));
+  event = last > ago ? last - ago : 0;
+  for (l = history->frames.head; l; l = l->next) {
+    GstBuffer *buffer = l->data;
+
+    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+      continue;
+    if (start && GST_BUFFER_PTS (buffer) + history->preroll > event)
+      break;
+    start = l;
+  }
+
+  for (l = start; l; l = l->next)
+    frames = g_list_prepend (frames, gst_buffer_ref (l->data));
+  frames = g_list_reverse (frames);
+  tail = gst_buffer_ref (g_queue_peek_tail (&history->frames));
+  caps = gst_caps_ref (history->caps);
+  g_mutex_unlock (&history->lock);
+
+  clip = clip_new (caps, frames->data, event + postroll, muxer, location);
+  gst_caps_unref (caps);
+  for (l = frames; clip && l; l = l->next)
+    clip_push (clip, l->data);
+  g_list_free_full (frames, (GDestroyNotify) gst_buffer_unref);
+  if (!clip) {
+    gst_buffer_unref (tail);
+    return FALSE;
+  }
+
+  /* Catch up with the frames received meanwhile. When the history moved
+   * past the frames taken, the clip ends there as if interrupted. */
+  g_mutex_lock (&history->lock);
+  l = g_queue_find (&history->frames, tail);
+  if (l) {
+    for (l = l->next; l; l = l->next)
+      clip_push (clip, l->data);
+    history->clips = g_list_prepend (history->clips, clip);
+  } else {
+    GST_WARNING ("History moved on while starting the clip %s", location);
+    clip_finish (clip);
+  }
+  history->clips_started++;
+  g_mutex_unlock (&history->lock);
+  gst_buffer_unref (tail);
+
+  return TRUE;
+}
+
+GstStructure *
+history_get_stats (GstMultiSourceHistory * history)
+{
+  GstStructure *s;
+  GstClockTime first, last, duration = 0;
+
+  g_mutex_lock (&history->lock);
+  if (!g_queue_is_empty (&history->frames)) {
+    first = GST_BUFFER_PTS (g_queue_peek_head (&history->frames));
+    last = GST_BUFFER_PTS (g_queue_peek_tail (&history->frames));
+    duration = last > first ? last - first : 0;
+  }
+  s = gst_structure_new ("history",
+      "preroll", G_TYPE_UINT64, history->preroll,
+      "duration", G_TYPE_UINT64, duration,
+      "frames", G_TYPE_UINT, history->frames.length,
+      "bytes", G_TYPE_UINT64, history->bytes,
+      "peak-bytes", G_TYPE_UINT64, history->peak_bytes,
+      "clips", G_TYPE_UINT64, history->clips_started,
+      "writing", G_TYPE_UINT, g_list_length (history->clips),
+      "overflows", G_TYPE_UINT64, history->overflows, NULL);
+  g_mutex_unlock (&history->lock);
+
+  return s;
+}
@@ -0,0 +1,61 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_HISTORY_H__
+#define __GST_MULTI_SOURCE_HISTORY_H__
+
+#include <gst/gst.h>
+
+#include "clip.h"
+
+G_BEGIN_DECLS
+
+/* Bound on the history of a branch whatever its pre-roll */
+#define HISTORY_MAX_BYTES (64 * 1024 * 1024)
+
+/* The compressed frames of a branch over the last pre-roll, starting with a
+ * keyframe, and the clips being written from them. */
+typedef struct _GstMultiSourceHistory
+{
+  GMutex lock;
+  GstClockTime preroll;
+  GstCaps *caps;
+  GQueue frames;
+  guint64 bytes;
+  GList *clips;
+
+  /* statistics, protected by lock */
+  guint64 peak_bytes;
+  guint64 clips_started;
+  guint64 overflows;
+} GstMultiSourceHistory;
+
+void history_init (GstMultiSourceHistory * history, GstClockTime preroll);
+void history_clear (GstMultiSourceHistory * history);
+void history_set_caps (GstMultiSourceHistory * history, GstCaps * caps);
+void history_flush (GstMultiSourceHistory * history);
+void history_push (GstMultiSourceHistory * history, GstBuffer * buffer);
+gboolean history_export (GstMultiSourceHistory * history, GstClockTime ago,
+    GstClockTime postroll, const gchar * muxer, const gchar * location);
+GstStructure *history_get_stats (GstMultiSourceHistory * history);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_HISTORY_H__ */
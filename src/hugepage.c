@@ -0,0 +1,397 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <string.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "multisource.h"
+#include "hugepage.h"
+
+#define GST_CAT_DEFAULT multisource_launch_debug
+
+#define HUGEPAGE_ALLOCATOR_NAME "multisource-hugepage"
+
+/* A block of whole huge pages, or the share of one */
+typedef struct
+{
+  GstMemory mem;
+  guint8 *data;
+  GstMultiSourceHugepageKind kind;
+} HugepageMemory;
+
+/* A freed block waiting to be reused */
+typedef struct
+{
+  guint8 *data;
+  gsize length;
+  GstMultiSourceHugepageKind kind;
+} HugepageBlock;
+
+G_DEFINE_TYPE (GstMultiSourceHugepageAllocator, hugepage_allocator,
+    GST_TYPE_ALLOCATOR);
+
+const gchar *
+hugepage_kind_get_name (GstMultiSourceHugepageKind kind)
+{
+  switch (kind) {
+    case HUGEPAGE_KIND_HUGETLB:
+      return "hugetlb";
+    case HUGEPAGE_KIND_TRANSPARENT:
+      return "transparent";
+    case HUGEPAGE_KIND_REGULAR:
+    case HUGEPAGE_KIND_LAST:
+      break;
+  }
+
+  return "regular";
+}
+
+#ifdef __linux__
+/* Back a block with pages of the hugetlbfs pool. The pages are reserved
+ * right away so that running out of them fails here and not with a SIGBUS
+ * when the decoder first writes to the frame. */
+static guint8 *
+map_hugetlb (gsize length)
+{
+#ifdef MFD_HUGETLB
+  guint8 *data;
+  gint fd;
+
+  fd = memfd_create (HUGEPAGE_ALLOCATOR_NAME, MFD_HUGETLB | MFD_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+
+  if (ftruncate (fd, length) < 0 || fallocate (fd, 0, 0, length) < 0) {
+    close (fd);
+    return NULL;
+  }
+  data = mmap (NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+
+  return data == MAP_FAILED ? NULL : data;
+#else
+  return NULL;
+#endif
+}
+
+/* Anonymous memory aligned on a huge page so that the kernel can back it
+ * with transparent huge pages, or regular ones if it cannot. */
+static guint8 *
+map_anonymous (gsize length, gboolean transparent)
+{
+  guint8 *data, *aligned;
+  gsize extra = HUGEPAGE_SIZE;
+
+  data = mmap (NULL, length + extra, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (data == MAP_FAILED)
+    return NULL;
+
+  aligned = (guint8 *) GST_ROUND_UP_N ((guintptr) data, HUGEPAGE_SIZE);
+  if (aligned > data)
+    munmap (data, aligned - data);
+  if (aligned + length < data + length + extra)
+    munmap (aligned + length, data + length + extra - (aligned + length));
+
+#ifdef MADV_HUGEPAGE
+  if (transparent)
+    madvise (aligned, length, MADV_HUGEPAGE);
+#endif
+
+  return aligned;
+}
+
+static guint8 *
+map_block (GstMultiSourceHugepageKind * kind, gsize length)
+{
+  guint8 *data = NULL;
+
+  if (*kind == HUGEPAGE_KIND_HUGETLB) {
+    data = map_hugetlb (length);
+    if (!data)
+      *kind = HUGEPAGE_KIND_TRANSPARENT;
+  }
+  if (!data)
+    data = map_anonymous (length, *kind == HUGEPAGE_KIND_TRANSPARENT);
+
+  return data;
+}
+
+/* Which kind of huge pages can be had on this system */
+static GstMultiSourceHugepageKind
+probe_kind (void)
+{
+  gchar *contents = NULL;
+  GstMultiSourceHugepageKind kind = HUGEPAGE_KIND_REGULAR;
+  guint8 *data = map_hugetlb (HUGEPAGE_SIZE);
+
+  if (data) {
+    munmap (data, HUGEPAGE_SIZE);
+    return HUGEPAGE_KIND_HUGETLB;
+  }
+
+  /* "always [madvise] never" */
+  if (g_file_get_contents ("/sys/kernel/mm/transparent_hugepage/enabled",
+          &contents, NULL, NULL) && !strstr (contents, "[never]"))
+    kind = HUGEPAGE_KIND_TRANSPARENT;
+  g_free (contents);
+
+  return kind;
+}
+#endif
+
+static HugepageMemory *
+hugepage_memory_new (GstAllocator * allocator, GstMemoryFlags flags,
+    GstMemory * parent, guint8 * data, GstMultiSourceHugepageKind kind,
+    gsize maxsize, gsize align, gsize offset, gsize size)
+{
+  HugepageMemory *mem = g_new0 (HugepageMemory, 1);
+
+  gst_memory_init (GST_MEMORY_CAST (mem), flags, allocator, parent, maxsize,
+      align, offset, size);
+  mem->data = data;
+  mem->kind = kind;
+
+  return mem;
+}
+
+static GstMemory *
+hugepage_alloc (GstAllocator * allocator, gsize size,
+    GstAllocationParams * params)
+{
+  GstMultiSourceHugepageAllocator *self =
+      GST_MULTI_SOURCE_HUGEPAGE_ALLOCATOR (allocator);
+  gsize maxsize = size + params->prefix + params->padding;
+  gsize length = GST_ROUND_UP_N (maxsize, HUGEPAGE_SIZE);
+  GstMultiSourceHugepageKind kind;
+  HugepageBlock *block = NULL;
+  guint8 *data = NULL;
+  GList *l;
+
+  /* Rounding small buffers up to a huge page would waste most of it */
+  if (maxsize < HUGEPAGE_SIZE / 2 || params->align >= HUGEPAGE_SIZE) {
+    g_mutex_lock (&self->lock);
+    self->small++;
+    g_mutex_unlock (&self->lock);
+    return gst_allocator_alloc (NULL, size, params);
+  }
+
+  g_mutex_lock (&self->lock);
+  for (l = self->cache.head; l; l = l->next) {
+    block = l->data;
+    if (block->length == length) {
+      g_queue_delete_link (&self->cache, l);
+      break;
+    }
+    block = NULL;
+  }
+  kind = self->kind;
+  g_mutex_unlock (&self->lock);
+
+  if (block) {
+    data = block->data;
+    kind = block->kind;
+    g_free (block);
+  } else {
+#ifdef __linux__
+    data = map_block (&kind, length);
+#endif
+    if (!data)
+      return gst_allocator_alloc (NULL, size, params);
+  }
+
+  if ((params->flags & GST_MEMORY_FLAG_ZERO_PREFIXED) && params->prefix)
+    memset (data, 0, params->prefix);
+  if ((params->flags & GST_MEMORY_FLAG_ZERO_PADDED) && params->padding)
+    memset (data + params->prefix + size, 0, params->padding);
+
+  g_mutex_lock (&self->lock);
+  if (block)
+    self->reused++;
+  else
+    self->allocated[kind]++;
+  /* Stop trying hugetlb once its pool is exhausted */
+  if (kind > self->kind)
+    self->kind = kind;
+  self->bytes += length;
+  self->peak_bytes = MAX (self->peak_bytes, self->bytes);
+  g_mutex_unlock (&self->lock);
+
+  return GST_MEMORY_CAST (hugepage_memory_new (allocator, params->flags,
+          NULL, data, kind, length, params->align, params->prefix, size));
+}
+
+static void
+hugepage_free (GstAllocator * allocator, GstMemory * memory)
+{
+  GstMultiSourceHugepageAllocator *self =
+      GST_MULTI_SOURCE_HUGEPAGE_ALLOCATOR (allocator);
+  HugepageMemory *mem = (HugepageMemory *) memory;
+  HugepageBlock *block;
+
+  /* Shares point into the block of their parent */
+  if (memory->parent) {
+    g_free (mem);
+    return;
+  }
+
+  g_mutex_lock (&self->lock);
+  self->bytes -= memory->maxsize;
+  if (g_queue_get_length (&self->cache) < HUGEPAGE_CACHE_SIZE) {
+    block = g_new (HugepageBlock, 1);
+    block->data = mem->data;
+    block->length = memory->maxsize;
+    block->kind = mem->kind;
+    g_queue_push_tail (&self->cache, block);
+    mem->data = NULL;
+  }
+  g_mutex_unlock (&self->lock);
+
+#ifdef __linux__
+  if (mem->data)
+    munmap (mem->data, memory->maxsize);
+#endif
+  g_free (mem);
+}
+
+static gpointer
+hugepage_mem_map (GstMemory * memory, gsize maxsize, GstMapFlags flags)
+{
+  return ((HugepageMemory *) memory)->data;
+}
+
+static void
+hugepage_mem_unmap (GstMemory * memory)
+{
+}
+
+static GstMemory *
+hugepage_mem_share (GstMemory * memory, gssize offset, gssize size)
+{
+  HugepageMemory *mem = (HugepageMemory *) memory;
+  GstMemory *parent = memory->parent ? memory->parent : memory;
+
+  if (size == -1)
+    size = memory->size - offset;
+
+  return GST_MEMORY_CAST (hugepage_memory_new (memory->allocator,
+          GST_MINI_OBJECT_FLAGS (parent) | GST_MINI_OBJECT_FLAG_LOCK_READONLY,
+          parent, mem->data, mem->kind, memory->maxsize, memory->align,
+          memory->offset + offset, size));
+}
+
+static void
+hugepage_allocator_finalize (GObject * object)
+{
+  GstMultiSourceHugepageAllocator *self =
+      GST_MULTI_SOURCE_HUGEPAGE_ALLOCATOR (object);
+  HugepageBlock *block;
+
+  while ((block = g_queue_pop_head (&self->cache))) {
+#ifdef __linux__
+    munmap (block->data, block->length);
+#endif
+    g_free (block);
+  }
+  g_mutex_clear (&self->lock);
+
+  G_OBJECT_CLASS (hugepage_allocator_parent_class)->finalize (object);
+}
+
+static void
+hugepage_allocator_class_init (GstMultiSourceHugepageAllocatorClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstAllocatorClass *allocator_class = GST_ALLOCATOR_CLASS (klass);
+
+  gobject_class->finalize = hugepage_allocator_finalize;
+  allocator_class->alloc = hugepage_alloc;
+  allocator_class->free = hugepage_free;
+}
+
+static void
+hugepage_allocator_init (GstMultiSourceHugepageAllocator * self)
+{
+  GstAllocator *allocator = GST_ALLOCATOR_CAST (self);
+
+  g_mutex_init (&self->lock);
+  g_queue_init (&self->cache);
+  self->kind = HUGEPAGE_KIND_REGULAR;
+
+  allocator->mem_type = HUGEPAGE_ALLOCATOR_NAME;
+  allocator->mem_map = hugepage_mem_map;
+  allocator->mem_unmap = hugepage_mem_unmap;
+  allocator->mem_share = hugepage_mem_share;
+}
+
+/* Returns NULL when neither hugetlbfs nor transparent huge pages are
+ * available, the default allocator is then used as before. */
+GstAllocator *
+hugepage_allocator_new (void)
+{
+  GstMultiSourceHugepageAllocator *self;
+  GstMultiSourceHugepageKind kind = HUGEPAGE_KIND_REGULAR;
+
+#ifdef __linux__
+  kind = probe_kind ();
+#endif
+  if (kind == HUGEPAGE_KIND_REGULAR)
+    return NULL;
+
+  self = g_object_new (GST_TYPE_MULTI_SOURCE_HUGEPAGE_ALLOCATOR, NULL);
+  gst_object_ref_sink (self);
+  self->kind = kind;
+  GST_DEBUG ("Frames allocated from %s huge pages",
+      hugepage_kind_get_name (kind));
+
+  return GST_ALLOCATOR_CAST (self);
+}
+
+GstStructure *
+hugepage_allocator_get_stats (GstAllocator * allocator)
+{
+  GstMultiSourceHugepageAllocator *self =
+      GST_MULTI_SOURCE_HUGEPAGE_ALLOCATOR (allocator);
+  GstStructure *s;
+
+  g_mutex_lock (&self->lock);
+  s = gst_structure_new ("hugepages",
+      "kind", G_TYPE_STRING, hugepage_kind_get_name (self->kind),
+      "hugetlb", G_TYPE_UINT64, self->allocated[HUGEPAGE_KIND_HUGETLB],
+      "transparent", G_TYPE_UINT64,
+      self->allocated[HUGEPAGE_KIND_TRANSPARENT],
+      "regular", G_TYPE_UINT64, self->allocated[HUGEPAGE_KIND_REGULAR],
+      "reused", G_TYPE_UINT64, self->reused,
+      "small", G_TYPE_UINT64, self->small,
+      "bytes", G_TYPE_UINT64, self->bytes,
+      "peak-bytes", G_TYPE_UINT64, self->peak_bytes,
+      "cached", G_TYPE_UINT, g_queue_get_length (&self->cache), NULL);
+  g_mutex_unlock (&self->lock);
+
+  return s;
+}
@@ -0,0 +1,75 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_HUGEPAGE_H__
+#define __GST_MULTI_SOURCE_HUGEPAGE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define HUGEPAGE_SIZE (2 * 1024 * 1024)
+/* Freed blocks kept around for the next frames of the same size */
+#define HUGEPAGE_CACHE_SIZE 64
+
+#define GST_TYPE_MULTI_SOURCE_HUGEPAGE_ALLOCATOR (hugepage_allocator_get_type ())
+#define GST_MULTI_SOURCE_HUGEPAGE_ALLOCATOR(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+    GST_TYPE_MULTI_SOURCE_HUGEPAGE_ALLOCATOR, GstMultiSourceHugepageAllocator))
+
+/* Where the pages of a block come from, from best to worst */
+typedef enum
+{
+  HUGEPAGE_KIND_HUGETLB,
+  HUGEPAGE_KIND_TRANSPARENT,
+  HUGEPAGE_KIND_REGULAR,
+  HUGEPAGE_KIND_LAST
+} GstMultiSourceHugepageKind;
+
+typedef struct _GstMultiSourceHugepageAllocator
+{
+  GstAllocator parent;
+
+  GMutex lock;
+  GstMultiSourceHugepageKind kind;
+  /* freed blocks, protected by lock */
+  GQueue cache;
+
+  /* statistics, protected by lock */
+  guint64 allocated[HUGEPAGE_KIND_LAST];
+  guint64 reused;
+  guint64 small;
+  guint64 bytes;
+  guint64 peak_bytes;
+} GstMultiSourceHugepageAllocator;
+
+typedef struct _GstMultiSourceHugepageAllocatorClass
+{
+  GstAllocatorClass parent_class;
+} GstMultiSourceHugepageAllocatorClass;
+
+GType hugepage_allocator_get_type (void);
+
+const gchar *hugepage_kind_get_name (GstMultiSourceHugepageKind kind);
+GstAllocator *hugepage_allocator_new (void);
+GstStructure *hugepage_allocator_get_stats (GstAllocator * allocator);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_HUGEPAGE_H__ */
@@ -0,0 +1,101 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * gst-multisource-index: print the keyframes indexed by recordsink, or look
+ * up where to start reading a recording to reach a time:
+ *
+ * gst-multisource-index --stream=1 out.mkv.idx 3600.5
+ */
+
+#include <stdlib.h>
+
+#include "keyindex.h"
+
+static void
+print_entry (const GstMultiSourceKeyEntry * entry)
+{
+  g_print ("%u %" GST_TIME_FORMAT " %" G_GUINT64_FORMAT "\n", entry->stream,
+      GST_TIME_ARGS (entry->pts), entry->offset);
+}
+
+int
+main (int argc, char **argv)
+{
+  int res = EXIT_SUCCESS;
+  GError *err = NULL;
+  GOptionContext *ctx;
+  GstMultiSourceKeyIndex *index;
+  GstMultiSourceKeyEntry entry;
+  gint stream = -1;
+  gsize n;
+  gint i;
+
+  GOptionEntry options[] = {
+    {"stream", 0, 0, G_OPTION_ARG_INT, &stream,
+        ("Only look up the keyframes of this stream"), "ID"}
+    ,
+    {NULL}
+  };
+
+  ctx = g_option_context_new ("INDEX [SECONDS...]");
+  g_option_context_set_summary (ctx, "Without SECONDS, print every entry. "
+      "Otherwise print the last keyframe at or before each time, as\n"
+      "stream, pts and byte offset in the recording.");
+  g_option_context_add_main_entries (ctx, options, NULL);
+  if (!g_option_context_parse (ctx, &argc, &argv, &err) || argc < 2) {
+    g_printerr ("%s\n", err ? err->message : "No index given");
+    g_clear_error (&err);
+    g_option_context_free (ctx);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free (ctx);
+
+  index = key_index_open (argv[1], &err);
+  if (!index) {
+    g_printerr ("%s\n", err->message);
+    g_error_free (err);
+    return EXIT_FAILURE;
+  }
+
+  if (argc == 2) {
+    for (n = 0; n < key_index_get_size (index); n++) {
+      key_index_get_entry (index, n, &entry);
+      if (stream < 0 || entry.stream == (guint32) stream)
+        print_entry (&entry);
+    }
+  }
+
+  for (i = 2; i < argc; i++) {
+    GstClockTime pts = g_ascii_strtod (argv[i], NULL) * GST_SECOND;
+
+    if (key_index_lookup (index, pts, stream < 0 ? KEY_INDEX_STREAM_ANY :
+            (guint32) stream, &entry)) {
+      print_entry (&entry);
+    } else {
+      g_printerr ("No keyframe before %s s\n", argv[i]);
+      res = EXIT_FAILURE;
+    }
+  }
+
+  key_index_close (index);
+
+  return res;
+}
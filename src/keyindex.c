@@ -0,0 +1,251 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include "keyindex.h"
+
+/* Entries are written every time this many are pending, and when the
+ * recording sink writes its data. */
+#define KEY_INDEX_WRITE_ENTRIES 128
+
+/* How far back, in entries, a keyframe of the requested stream is looked
+ * for once the time has been found. */
+#define KEY_INDEX_MAX_SCAN 4096
+
+struct _GstMultiSourceKeyIndexWriter
+{
+  gint fd;
+  guint8 *pending;
+  guint n_pending;
+  guint64 entries;
+};
+
+struct _GstMultiSourceKeyIndex
+{
+  GMappedFile *file;
+  const guint8 *entries;
+  gsize size;
+};
+
+static gboolean
+write_all (gint fd, const guint8 * data, gsize len)
+{
+  while (len > 0) {
+    gssize res = write (fd, data, len);
+
+    if (res < 0 && errno == EINTR)
+      continue;
+    if (res <= 0)
+      return FALSE;
+    data += res;
+    len -= res;
+  }
+
+  return TRUE;
+}
+
+void
+key_index_write_entry (guint8 * data, const GstMultiSourceKeyEntry * entry)
+{
+  GST_WRITE_UINT64_LE (data, entry->offset);
+  GST_WRITE_UINT64_LE (data + 8, entry->pts);
+  GST_WRITE_UINT32_LE (data + 16, entry->stream);
+  GST_WRITE_UINT32_LE (data + 20, entry->flags);
+}
+
+void
+key_index_read_entry (const guint8 * data, GstMultiSourceKeyEntry * entry)
+{
+  entry->offset = GST_READ_UINT64_LE (data);
+  entry->pts = GST_READ_UINT64_LE (data + 8);
+  entry->stream = GST_READ_UINT32_LE (data + 16);
+  entry->flags = GST_READ_UINT32_LE (data + 20);
+}
+
+/* Find the last keyframe of the stream at or before pts in n entries: a
+ * binary search for the first entry past pts, then a bounded scan back to
+ * the stream. */
+gboolean
+key_index_search (const guint8 * entries, gsize n, GstClockTime pts,
+    guint32 stream, GstMultiSourceKeyEntry * entry)
+{
+  gsize low = 0, high = n, scanned = 0;
+
+  while (low < high) {
+    gsize mid = low + (high - low) / 2;
+
+    if (GST_READ_UINT64_LE (entries + mid * KEY_INDEX_ENTRY_SIZE + 8) <= pts)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  while (low > 0 && scanned++ < KEY_INDEX_MAX_SCAN) {
+    low--;
+    key_index_read_entry (entries + low * KEY_INDEX_ENTRY_SIZE, entry);
+    if (entry->pts <= pts && (stream == KEY_INDEX_STREAM_ANY
+            || entry->stream == stream))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+GstMultiSourceKeyIndexWriter *
+key_index_writer_new (const gchar * location, GError ** error)
+{
+  GstMultiSourceKeyIndexWriter *writer;
+  guint8 header[KEY_INDEX_HEADER_SIZE] = { 0, };
+  gint fd;
+
+  fd = g_open (location, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    goto error;
+
+  memcpy (header, KEY_INDEX_MAGIC, 4);
+  GST_WRITE_UINT32_LE (header + 4, KEY_INDEX_VERSION);
+  GST_WRITE_UINT32_LE (header + 8, KEY_INDEX_ENTRY_SIZE);
+  if (!write_all (fd, header, sizeof (header))) {
+    close (fd);
+    goto error;
+  }
+
+  writer = g_new0 (GstMultiSourceKeyIndexWriter, 1);
+  writer->fd = fd;
+  writer->pending = g_malloc (KEY_INDEX_WRITE_ENTRIES * KEY_INDEX_ENTRY_SIZE);
+
+  return writer;
+
+error:
+  g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+      "Could not create index \"%s\": %s", location, g_strerror (errno));
+  return NULL;
+}
+
+void
+key_index_writer_add (GstMultiSourceKeyIndexWriter * writer, guint64 offset,
+    GstClockTime pts, guint32 stream)
+{
+  GstMultiSourceKeyEntry entry = { offset, pts, stream, 0 };
+
+  key_index_write_entry (writer->pending +
+      writer->n_pending * KEY_INDEX_ENTRY_SIZE, &entry);
+
+  if (++writer->n_pending == KEY_INDEX_WRITE_ENTRIES)
+    key_index_writer_flush (writer);
+}
+
+/* Append the pending entries. A reader mapping the index meanwhile sees
+ * it up to the last complete entry. */
+gboolean
+key_index_writer_flush (GstMultiSourceKeyIndexWriter * writer)
+{
+  gboolean res;
+
+  if (writer->n_pending == 0)
+    return TRUE;
+
+  res = write_all (writer->fd, writer->pending,
+      writer->n_pending * KEY_INDEX_ENTRY_SIZE);
+  if (res)
+    writer->entries += writer->n_pending;
+  writer->n_pending = 0;
+
+  return res;
+}
+
+guint64
+key_index_writer_get_entries (GstMultiSourceKeyIndexWriter * writer)
+{
+  return writer->entries + writer->n_pending;
+}
+
+void
+key_index_writer_free (GstMultiSourceKeyIndexWriter * writer)
+{
+  key_index_writer_flush (writer);
+  close (writer->fd);
+  g_free (writer->pending);
+  g_free (writer);
+}
+
+GstMultiSourceKeyIndex *
+key_index_open (const gchar * location, GError ** error)
+{
+  GstMultiSourceKeyIndex *index;
+  GMappedFile *file;
+  const guint8 *data;
+  gsize length;
+
+  file = g_mapped_file_new (location, FALSE, error);
+  if (!file)
+    return NULL;
+
+  data = (const guint8 *) g_mapped_file_get_contents (file);
+  length = g_mapped_file_get_length (file);
+  if (length < KEY_INDEX_HEADER_SIZE || memcmp (data, KEY_INDEX_MAGIC, 4)
+      || GST_READ_UINT32_LE (data + 4) != KEY_INDEX_VERSION
+      || GST_READ_UINT32_LE (data + 8) != KEY_INDEX_ENTRY_SIZE) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+        "\"%s\" is not a keyframe index", location);
+    g_mapped_file_unref (file);
+    return NULL;
+  }
+
+  index = g_new0 (GstMultiSourceKeyIndex, 1);
+  index->file = file;
+  index->entries = data + KEY_INDEX_HEADER_SIZE;
+  index->size = (length - KEY_INDEX_HEADER_SIZE) / KEY_INDEX_ENTRY_SIZE;
+
+  return index;
+}
+
+gsize
+key_index_get_size (GstMultiSourceKeyIndex * index)
+{
+  return index->size;
+}
+
+void
+key_index_get_entry (GstMultiSourceKeyIndex * index, gsize n,
+    GstMultiSourceKeyEntry * entry)
+{
+  key_index_read_entry (index->entries + n * KEY_INDEX_ENTRY_SIZE, entry);
+}
+
+gboolean
+key_index_lookup (GstMultiSourceKeyIndex * index, GstClockTime pts,
+    guint32 stream, GstMultiSourceKeyEntry * entry)
+{
+  return key_index_search (index->entries, index->size, pts, stream, entry);
+}
+
+void
+key_index_close (GstMultiSourceKeyIndex * index)
+{
+  g_mapped_file_unref (index->file);
+  g_free (index);
+}
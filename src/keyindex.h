@@ -0,0 +1,81 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_KEY_INDEX_H__
+#define __GST_MULTI_SOURCE_KEY_INDEX_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* A keyframe index is a 16 bytes header followed by fixed size entries in
+ * the order of the data in the recording, all little endian:
+ *
+ *   header: "MSKI" | version (u32) | entry size (u32) | reserved (u32)
+ *   entry:  offset (u64) | pts in ns (u64) | stream (u32) | flags (u32)
+ *
+ * The muxer interleaves its streams by time so the pts are in order up to
+ * that interleave, which the lookup tolerates. */
+#define KEY_INDEX_MAGIC "MSKI"
+#define KEY_INDEX_VERSION 1
+#define KEY_INDEX_HEADER_SIZE 16
+#define KEY_INDEX_ENTRY_SIZE 24
+#define KEY_INDEX_SUFFIX ".idx"
+
+#define KEY_INDEX_STREAM_ANY G_MAXUINT32
+
+typedef struct
+{
+  guint64 offset;
+  GstClockTime pts;
+  guint32 stream;
+  guint32 flags;
+} GstMultiSourceKeyEntry;
+
+void key_index_write_entry (guint8 * data,
+    const GstMultiSourceKeyEntry * entry);
+void key_index_read_entry (const guint8 * data,
+    GstMultiSourceKeyEntry * entry);
+gboolean key_index_search (const guint8 * entries, gsize n, GstClockTime pts,
+    guint32 stream, GstMultiSourceKeyEntry * entry);
+
+typedef struct _GstMultiSourceKeyIndexWriter GstMultiSourceKeyIndexWriter;
+typedef struct _GstMultiSourceKeyIndex GstMultiSourceKeyIndex;
+
+GstMultiSourceKeyIndexWriter *key_index_writer_new (const gchar * location,
+    GError ** error);
+void key_index_writer_add (GstMultiSourceKeyIndexWriter * writer,
+    guint64 offset, GstClockTime pts, guint32 stream);
+gboolean key_index_writer_flush (GstMultiSourceKeyIndexWriter * writer);
+guint64 key_index_writer_get_entries (GstMultiSourceKeyIndexWriter * writer);
+void key_index_writer_free (GstMultiSourceKeyIndexWriter * writer);
+
+GstMultiSourceKeyIndex *key_index_open (const gchar * location,
+    GError ** error);
+gsize key_index_get_size (GstMultiSourceKeyIndex * index);
+void key_index_get_entry (GstMultiSourceKeyIndex * index, gsize n,
+    GstMultiSourceKeyEntry * entry);
+gboolean key_index_lookup (GstMultiSourceKeyIndex * index, GstClockTime pts,
+    guint32 stream, GstMultiSourceKeyEntry * entry);
+void key_index_close (GstMultiSourceKeyIndex * index);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_KEY_INDEX_H__ */
@@ -21,17 +21,36 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <gst/gst.h>
 #ifdef G_OS_UNIX
 #include <glib-unix.h>
 #endif
 
+#include "multisource.h"
+#include "branch.h"
+#include "governor.h"
+#include "admission.h"
+#include "pressure.h"
+#include "sysinfo.h"
+#include "budget.h"
+#include "hugepage.h"
+#include "rotation.h"
+#include "demand.h"
+#include "clip.h"
+#include "retention.h"
+#include "plugin.h"
+
 GST_DEBUG_CATEGORY (multisource_launch_debug);
 #define GST_CAT_DEFAULT multisource_launch_debug
 
 #define DEFAULT_MUXER "multipartmux"
 #define DEFAULT_SINK "fakesink"
 
+/* Default share of the memory limit the branch queues may take altogether */
+#define QUEUE_MEMORY_SHARE 4
+#define LIMITS_INTERVAL 10
+
 #define SKIP(c) \
   while (*c) { \
     if ((*c == ' ') || (*c == '\n') || (*c == '\t') || (*c == '\r')) \
@@ -57,13 +76,20 @@ typedef struct _GstMultiSource
   GstElement *pipeline;
   gboolean buffering;
   gboolean is_live;
+  GstMultiSourceConfig config;
+  GPtrArray *branches;
+  GstMultiSourceGovernor *governor;
+  GstMultiSourceAdmission *admission;
+  GstMultiSourcePressure *pressure;
+  GstMultiSourceBudget *budget;
+  GstMultiSourceRotation *rotation;
+  GstMultiSourceDemand *demand;
+  GstMultiSourceRetention *retention;
+  guint64 memory_ceiling;
+  guint limits_id;
+  gint tlb_counter;
 } GstMultiSource;
 
-
-#define PRINT(FMT, ARGS...) do { \
-        gst_print (FMT "\n", ## ARGS); \
-    } while (0)
-
 void
 quit_app (GstMultiSource * thiz)
 {
@@ -233,6 +259,22 @@ message_cb (GstBus * bus, GstMessage * message, gpointer user_data)
 
       break;
     }
+    case GST_MESSAGE_ELEMENT:
+    {
+      const GstStructure *s = gst_message_get_structure (message);
+
+      /* Events posted by the branch probes */
+      if (s && g_str_has_prefix (gst_structure_get_name (s), "multisource-")) {
+        gchar *str = gst_structure_to_string (s);
+        PRINT ("%s", str);
+        g_free (str);
+      }
+      break;
+    }
+    case GST_MESSAGE_QOS:
+      if (thiz->governor)
+        governor_notify_qos (thiz->governor);
+      break;
     case GST_MESSAGE_EOS:
       g_main_loop_quit (thiz->loop);
       break;
@@ -335,22 +377,168 @@ message_cb (GstBus * bus, GstMessage * message, gpointer user_data)
   return TRUE;
 }
 
+static void
+pressure_cb (GstMultiSourcePressureResource resource, gpointer user_data)
+{
+  GstMultiSource *thiz = (GstMultiSource *) user_data;
+
+  PRINT ("pressure: sustained %s stall, shedding work",
+      pressure_resource_get_name (resource));
+  governor_notify_pressure (thiz->governor);
+}
+
+/* The ceiling set on the command line, or else a share of the memory
+ * limit of the cgroup */
+static void
+update_memory_ceiling (GstMultiSource * thiz)
+{
+  GstMultiSourceConfig *config = &thiz->config;
+
+  if (thiz->memory_ceiling)
+    config->memory_ceiling = thiz->memory_ceiling;
+  else if (config->memory_limit == G_MAXUINT64)
+    config->memory_ceiling = 0;
+  else
+    config->memory_ceiling = config->memory_limit / QUEUE_MEMORY_SHARE;
+}
+
+/* The cgroup limits can be changed while running, by an orchestrator
+ * resizing the container for instance. */
+static gboolean
+limits_cb (gpointer user_data)
+{
+  GstMultiSource *thiz = (GstMultiSource *) user_data;
+  gdouble cpus;
+  guint64 memory;
+
+  sysinfo_read_limits (&cpus, &memory);
+  if (cpus == thiz->config.cpus && memory == thiz->config.memory_limit)
+    return G_SOURCE_CONTINUE;
+
+  PRINT ("limits: %.2f cpus, %" G_GUINT64_FORMAT " MB of memory", cpus,
+      memory == G_MAXUINT64 ? 0 : memory >> 20);
+  thiz->config.cpus = cpus;
+  thiz->config.memory_limit = memory;
+  update_memory_ceiling (thiz);
+  if (thiz->budget)
+    budget_update (thiz->budget);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Stream status messages are posted synchronously from the threads they
+ * announce, which lets each branch set up its own streaming threads. */
+static GstBusSyncReply
+bus_sync_handler (GstBus * bus, GstMessage * message, gpointer user_data)
+{
+  GstMultiSource *thiz = (GstMultiSource *) user_data;
+  GstStreamStatusType type;
+  GstElement *owner;
+  guint i;
+
+  if (GST_MESSAGE_TYPE (message) != GST_MESSAGE_STREAM_STATUS)
+    return GST_BUS_PASS;
+
+  gst_message_parse_stream_status (message, &type, &owner);
+  if (type != GST_STREAM_STATUS_TYPE_ENTER)
+    return GST_BUS_PASS;
+
+  for (i = 0; i < thiz->branches->len; i++) {
+    GstMultiSourceBranch *branch = g_ptr_array_index (thiz->branches, i);
+
+    if (branch_owns_object (branch, GST_OBJECT_CAST (owner))) {
+      branch_enter_thread (branch);
+      break;
+    }
+  }
+
+  return GST_BUS_PASS;
+}
+
 void
-add_branch (GstMultiSource * thiz, gchar * src_uri)
+add_branch (GstMultiSource * thiz, gchar * src_desc)
 {
-  GST_DEBUG ("Add branch with src %s with muxer %s", src_uri, thiz->muxer);
+  GstMultiSourceBranch *branch;
+  gchar *branch_description;
+
+  GST_DEBUG ("Add branch with src %s with muxer %s", src_desc, thiz->muxer);
+  branch = branch_new (thiz->branches->len, src_desc, &thiz->config);
+  if (admission_check (thiz->admission, branch) == ADMISSION_REJECTED) {
+    branch_free (branch);
+    return;
+  }
+  g_ptr_array_add (thiz->branches, branch);
+  branch_description = branch_get_description (branch);
+
   if (!thiz->pipeline_description)
     thiz->pipeline_description =
-        g_strdup_printf
-        ("urisourcebin uri=%s ! decodebin3 ! %s name=muxer ! %s", src_uri,
+        g_strdup_printf ("%s ! %s name=muxer ! %s", branch_description,
         thiz->muxer, thiz->sink);
   else {
     gchar *old_pipeline_description = thiz->pipeline_description;
     thiz->pipeline_description =
-        g_strdup_printf ("%s urisourcebin uri=%s ! decodebin3 ! muxer.",
-        old_pipeline_description, src_uri);
+        g_strdup_printf ("%s %s ! muxer.", old_pipeline_description,
+        branch_description);
     g_free (old_pipeline_description);
   }
+  g_free (branch_description);
+}
+
+/* What the memory layout costs the process, to compare allocators */
+static GstStructure *
+get_memory_stats (GstMultiSource * thiz)
+{
+  guint64 minor, major;
+  GstStructure *s;
+
+  sysinfo_get_page_faults (&minor, &major);
+  s = gst_structure_new ("memory",
+      "minor-faults", G_TYPE_UINT64, minor,
+      "major-faults", G_TYPE_UINT64, major, NULL);
+  if (thiz->tlb_counter >= 0)
+    gst_structure_set (s, "dtlb-misses", G_TYPE_UINT64,
+        sysinfo_read_counter (thiz->tlb_counter), NULL);
+  if (thiz->config.frame_allocator) {
+    GstStructure *hugepages =
+        hugepage_allocator_get_stats (thiz->config.frame_allocator);
+
+    gst_structure_set (s, "hugepages", GST_TYPE_STRUCTURE, hugepages, NULL);
+    gst_structure_free (hugepages);
+  }
+  if (thiz->config.frame_pools) {
+    GstStructure *pools = pools_get_stats (thiz->config.frame_pools);
+
+    gst_structure_set (s, "pools", GST_TYPE_STRUCTURE, pools, NULL);
+    gst_structure_free (pools);
+  }
+
+  return s;
+}
+
+static void
+print_stats (GstStructure * s)
+{
+  gchar *str = gst_structure_to_string (s);
+
+  PRINT ("%s", str);
+  g_free (str);
+  gst_structure_free (s);
+}
+
+/* The in-tree sinks report how their writes went */
+static void
+print_sink_stats (const GValue * item, gpointer user_data)
+{
+  GstElement *sink = g_value_get_object (item);
+  GstStructure *s = NULL;
+
+  if (!g_object_class_find_property (G_OBJECT_GET_CLASS (sink),
+          "write-stats"))
+    return;
+
+  g_object_get (sink, "write-stats", &s, NULL);
+  if (s)
+    print_stats (s);
 }
 
 /* Process keyboard input */
@@ -358,6 +546,7 @@ static gboolean
 handle_keyboard (GIOChannel * source, GIOCondition cond, GstMultiSource * thiz)
 {
   gchar *str = NULL;
+  GstIterator *it;
   char op;
 
   if (g_io_channel_read_line (source, &str, NULL, NULL,
@@ -381,6 +570,67 @@ handle_keyboard (GIOChannel * source, GIOCondition cond, GstMultiSource * thiz)
         GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS (GST_BIN (thiz->pipeline),
                       GST_DEBUG_GRAPH_SHOW_ALL, "gst-multisource-launch.snap");
         break;
+      case 'i':
+        g_ptr_array_foreach (thiz->branches, (GFunc) branch_print_stats, NULL);
+        if (thiz->governor)
+          print_stats (governor_get_stats (thiz->governor));
+        print_stats (admission_get_stats (thiz->admission));
+        if (thiz->pressure)
+          print_stats (pressure_get_stats (thiz->pressure));
+        if (thiz->budget)
+          print_stats (budget_get_stats (thiz->budget));
+        if (thiz->rotation)
+          print_stats (rotation_get_stats (thiz->rotation));
+        if (thiz->demand)
+          print_stats (demand_get_stats (thiz->demand));
+        if (thiz->retention)
+          print_stats (retention_get_stats (thiz->retention));
+        print_stats (get_memory_stats (thiz));
+        it = gst_bin_iterate_sinks (GST_BIN (thiz->pipeline));
+        gst_iterator_foreach (it, print_sink_stats, NULL);
+        gst_iterator_free (it);
+        break;
+      case 'c':
+      {
+        gchar *end;
+        guint64 id;
+        gdouble ago = 0.0;
+
+        SKIP (cmd)
+            id = g_ascii_strtoull (cmd, &end, 10);
+        if (end == cmd) {
+          PRINT ("Usage: c <branch> [seconds ago]");
+          break;
+        }
+        cmd = end;
+        SKIP (cmd)
+            if (*cmd)
+          ago = MAX (g_ascii_strtod (cmd, NULL), 0.0);
+        if (!thiz->config.clip_preroll)
+          PRINT ("Clips need a history, see --clip-preroll");
+        else if (id >= thiz->branches->len
+            || !branch_export_clip (g_ptr_array_index (thiz->branches, id),
+                ago * GST_SECOND))
+          PRINT ("No video received yet on branch %" G_GUINT64_FORMAT, id);
+        break;
+      }
+      case 'w':
+      case 'u':
+      {
+        gchar *end;
+        guint64 id;
+
+        SKIP (cmd)
+            id = g_ascii_strtoull (cmd, &end, 10);
+        if (end == cmd)
+          PRINT ("Usage: %c <branch>", op);
+        else if (!thiz->demand || !(op == 'w' ?
+                demand_watch (thiz->demand, id) :
+                demand_unwatch (thiz->demand, id)))
+          PRINT ("Branch %" G_GUINT64_FORMAT " is not %s on demand", id,
+              op == 'w' ? "decoded" : "watched");
+        break;
+      }
     }
   }
   g_free (str);
@@ -391,7 +641,11 @@ void
 usage ()
 {
   PRINT ("Available commands:\n"
-      "  p - Toggle between Play and Pause\n" "  q - Quit\n  s - Snapshot dot");
+      "  p - Toggle between Play and Pause\n" "  q - Quit\n  s - Snapshot dot\n"
+      "  i - Print branch statistics\n"
+      "  w <branch> - Decode a branch kept compressed until asked for\n"
+      "  u <branch> - Release a branch asked for with w\n"
+      "  c <branch> [seconds ago] - Export a clip around an event");
 }
 
 int
@@ -410,6 +664,33 @@ main (int argc, char **argv)
   gboolean audio_only = FALSE;
   gboolean video_only = FALSE;
   gboolean interactive = FALSE;
+  gboolean health_check = FALSE;
+  gint health_timeout = HEALTH_DEFAULT_TIMEOUT / GST_MSECOND;
+  gboolean audio_level = FALSE;
+  gboolean suppress_silence = FALSE;
+  gdouble silence_threshold = SILENCE_DEFAULT_THRESHOLD;
+  gint max_key_interval = GOP_DEFAULT_MAX_KEY_INTERVAL / GST_MSECOND;
+  gint gop_cache = 0;
+  gint clip_preroll = 0;
+  gint clip_postroll = CLIP_DEFAULT_POSTROLL / GST_MSECOND;
+  gchar *clip_muxer = NULL;
+  gchar *clip_dir = NULL;
+  gchar **retention = NULL;
+  gint retention_rate = RETENTION_DEFAULT_RATE;
+  gint rotate = 0;
+  gboolean on_demand = FALSE;
+  gint demand_timeout = DEMAND_DEFAULT_TIMEOUT / GST_MSECOND;
+  gint rotate_dwell = ROTATION_DEFAULT_DWELL / GST_MSECOND;
+  gdouble cpu_high = 0.0;
+  gdouble cpu_low = 0.0;
+  gchar *admission = NULL;
+  gchar *cost_cache = NULL;
+  gint memory_ceiling = 0;
+  gboolean hugepages = FALSE;
+  gboolean share_pools = FALSE;
+  gchar *overflow = NULL;
+  GstMultiSourceAdmissionPolicy admission_policy = ADMISSION_POLICY_OFF;
+  gboolean pressure = FALSE;
   gint repeat = 1;
   gint i = 0;
 
@@ -435,11 +716,106 @@ main (int argc, char **argv)
     {"interactive", 'i', 0, G_OPTION_ARG_NONE, &interactive,
         ("Put on interactive mode with branches in GST_STATE_READY"), NULL}
     ,
+    {"health-check", 'H', 0, G_OPTION_ARG_NONE, &health_check,
+        ("Detect frozen and blank video on the decoded frames"), NULL}
+    ,
+    {"health-timeout", 0, 0, G_OPTION_ARG_INT, &health_timeout,
+        ("Time in ms a branch must stay frozen or blank to be reported"),
+        "MS"}
+    ,
+    {"audio-level", 'L', 0, G_OPTION_ARG_NONE, &audio_level,
+        ("Measure the decoded audio level and report silent branches"), NULL}
+    ,
+    {"silence-threshold", 0, 0, G_OPTION_ARG_DOUBLE, &silence_threshold,
+        ("Peak level in dB under which audio is considered silent"), "DB"}
+    ,
+    {"suppress-silence", 'Z', 0, G_OPTION_ARG_NONE, &suppress_silence,
+        ("Replace silent audio spans by gaps toward the muxer"), NULL}
+    ,
+    {"max-keyframe-interval", 0, 0, G_OPTION_ARG_INT, &max_key_interval,
+        ("Keyframe interval in ms over which a branch is reported"), "MS"}
+    ,
+    {"gop-cache", 0, 0, G_OPTION_ARG_INT, &gop_cache,
+        ("Kilobytes of the last GOP each branch keeps to resume decoding "
+            "without waiting for a keyframe (default: 0, disabled)"), "KB"}
+    ,
+    {"clip-preroll", 0, 0, G_OPTION_ARG_INT, &clip_preroll,
+        ("Time in ms of compressed video each branch keeps to export clips "
+            "with the c command (default: 0, disabled)"), "MS"}
+    ,
+    {"clip-postroll", 0, 0, G_OPTION_ARG_INT, &clip_postroll,
+        ("Time in ms a clip goes on after its event (default: 10000)"), "MS"}
+    ,
+    {"clip-muxer", 0, 0, G_OPTION_ARG_STRING, &clip_muxer,
+        ("Muxer of the clips (default: " CLIP_DEFAULT_MUXER ")"), NULL}
+    ,
+    {"clip-dir", 0, 0, G_OPTION_ARG_STRING, &clip_dir,
+        ("Directory the clips are written to (default: current)"), "DIR"}
+    ,
+    {"retention", 0, 0, G_OPTION_ARG_STRING_ARRAY, &retention,
+        ("Delete the oldest files of a directory to keep it under MB"),
+        "DIR:MB"}
+    ,
+    {"retention-rate", 0, 0, G_OPTION_ARG_INT, &retention_rate,
+        ("Files truncated or deleted per second at most (default: 4)"), "N"}
+    ,
+    {"on-demand", 0, 0, G_OPTION_ARG_NONE, &on_demand,
+        ("Keep the branches compressed until decoded output is asked for "
+            "with the w command"), NULL}
+    ,
+    {"demand-timeout", 0, 0, G_OPTION_ARG_INT, &demand_timeout,
+        ("Time in ms a branch stays decoded without consumer "
+            "(default: 10000)"), "MS"}
+    ,
+    {"rotate", 0, 0, G_OPTION_ARG_INT, &rotate,
+        ("Only decode that many background branches at once, in turn"),
+        "N"}
+    ,
+    {"rotate-dwell", 0, 0, G_OPTION_ARG_INT, &rotate_dwell,
+        ("Time in ms each rotating branch is decoded for (default: 2000)"),
+        "MS"}
+    ,
+    {"cpu-high", 0, 0, G_OPTION_ARG_DOUBLE, &cpu_high,
+        ("CPU load in percent over which low priority branches are degraded"),
+        "PERCENT"}
+    ,
+    {"cpu-low", 0, 0, G_OPTION_ARG_DOUBLE, &cpu_low,
+        ("CPU load in percent under which degraded branches are restored "
+            "(default: cpu-high - 20)"), "PERCENT"}
+    ,
+    {"pressure", 'P', 0, G_OPTION_ARG_NONE, &pressure,
+        ("Shed work when the kernel reports sustained CPU or memory "
+            "pressure (Linux PSI)"), NULL}
+    ,
+    {"admission", 0, 0, G_OPTION_ARG_STRING, &admission,
+        ("What to do with branches the host has no capacity for: "
+            "off, reject or queue (default: off)"), "POLICY"}
+    ,
+    {"cost-cache", 0, 0, G_OPTION_ARG_FILENAME, &cost_cache,
+        ("File remembering the measured cost of the branches between runs"),
+        "FILE"}
+    ,
+    {"memory-ceiling", 0, 0, G_OPTION_ARG_INT, &memory_ceiling,
+        ("Megabytes the queues of all the branches may hold together "
+            "(default: a quarter of the cgroup memory limit)"), "MB"}
+    ,
+    {"overflow", 0, 0, G_OPTION_ARG_STRING, &overflow,
+        ("What a branch does once its queues hold its share of the memory "
+            "ceiling: block or drop (default: block)"), "POLICY"}
+    ,
+    {"hugepages", 0, 0, G_OPTION_ARG_NONE, &hugepages,
+        ("Allocate the decoded video frames from huge pages"), NULL}
+    ,
+    {"share-pools", 0, 0, G_OPTION_ARG_NONE, &share_pools,
+        ("Share the decoded video frames between the branches with the "
+            "same caps"), NULL}
+    ,
     {NULL}
   };
 
 
   thiz = g_new0 (GstMultiSource, 1);
+  thiz->tlb_counter = -1;
 
   ctx = g_option_context_new ("[ADDITIONAL ARGUMENTS]");
   g_option_context_add_main_entries (ctx, options, NULL);
@@ -451,8 +827,36 @@ main (int argc, char **argv)
     goto done;
   }
   g_option_context_free (ctx);
+  multisource_plugin_register ();
   thiz->interactive = interactive;
   thiz->verbose = verbose;
+  thiz->config.health_check = health_check;
+  thiz->config.health_timeout = health_timeout * GST_MSECOND;
+  thiz->config.audio_level = audio_level || suppress_silence;
+  thiz->config.silence_threshold = silence_threshold;
+  thiz->config.suppress_silence = suppress_silence;
+  thiz->config.max_key_interval = max_key_interval * GST_MSECOND;
+  thiz->config.gop_cache_bytes = (guint64) MAX (gop_cache, 0) << 10;
+  thiz->config.clip_preroll = MAX (clip_preroll, 0) * GST_MSECOND;
+  thiz->config.clip_postroll = MAX (clip_postroll, 0) * GST_MSECOND;
+  thiz->config.clip_muxer = clip_muxer ? clip_muxer :
+      g_strdup (CLIP_DEFAULT_MUXER);
+  thiz->config.clip_dir = clip_dir ? clip_dir : g_strdup (".");
+  thiz->config.on_demand = on_demand;
+  thiz->config.rotate = MAX (rotate, 0);
+  thiz->branches = g_ptr_array_new_with_free_func ((GDestroyNotify) branch_free);
+  sysinfo_read_limits (&thiz->config.cpus, &thiz->config.memory_limit);
+  thiz->memory_ceiling = (guint64) MAX (memory_ceiling, 0) << 20;
+  update_memory_ceiling (thiz);
+  /* Before any streaming thread exists so that they are all counted */
+  thiz->tlb_counter = sysinfo_open_tlb_counter ();
+  if (hugepages) {
+    thiz->config.frame_allocator = hugepage_allocator_new ();
+    if (!thiz->config.frame_allocator)
+      PRINT ("Huge pages are not available, using the default allocator");
+  }
+  if (share_pools)
+    thiz->config.frame_pools = pools_new ();
   GST_DEBUG_CATEGORY_INIT (multisource_launch_debug, "multisource-launch", 0,
       "gst-multisource-launch");
 
@@ -465,6 +869,24 @@ main (int argc, char **argv)
     PRINT ("Usage: %s -s rtsp_source \n", argv[0]);
     goto done;
   }
+  if (admission && !admission_parse_policy (admission, &admission_policy)) {
+    PRINT ("Unknown admission policy %s", admission);
+    goto done;
+  }
+  if (overflow && !quota_parse_overflow (overflow, &thiz->config.overflow)) {
+    PRINT ("Unknown overflow policy %s", overflow);
+    goto done;
+  }
+  thiz->admission =
+      admission_new (admission_policy, &thiz->config, cost_cache);
+  if (retention) {
+    thiz->retention = retention_new (retention, MAX (retention_rate, 1));
+    if (!thiz->retention) {
+      PRINT ("Unable to manage the retention of the output directories");
+      goto done;
+    }
+  }
+
   if (muxer)
     thiz->muxer = g_strdup (muxer);
   else
@@ -483,6 +905,11 @@ main (int argc, char **argv)
     }
   }
 
+  if (!thiz->pipeline_description) {
+    PRINT ("No branch could be admitted");
+    goto done;
+  }
+
   thiz->pipeline =
       gst_parse_launch_full (thiz->pipeline_description, NULL,
       GST_PARSE_FLAG_NONE, &err);
@@ -493,8 +920,36 @@ main (int argc, char **argv)
     goto done;
   }
 
+  for (i = 0; i < thiz->branches->len; i++) {
+    if (!branch_attach (g_ptr_array_index (thiz->branches, i),
+            GST_BIN (thiz->pipeline)))
+      goto done;
+  }
+
+  admission_start (thiz->admission);
+  thiz->budget = budget_new (thiz->branches, &thiz->config);
+  thiz->demand = demand_new (thiz->branches,
+      MAX (demand_timeout, 0) * GST_MSECOND);
+  if (rotate > 0)
+    thiz->rotation = rotation_new (thiz->branches, rotate,
+        MAX (rotate_dwell, 1) * GST_MSECOND);
+  if (cpu_high > 0.0)
+    thiz->governor = governor_new (thiz->branches, &thiz->config, cpu_high,
+        cpu_low > 0.0 ? cpu_low : MAX (cpu_high - 20.0, 0.0));
+  if (pressure) {
+    /* Without a CPU threshold, only the pressure drives the governor */
+    if (!thiz->governor)
+      thiz->governor = governor_new (thiz->branches, &thiz->config,
+          G_MAXDOUBLE, cpu_low > 0.0 ? cpu_low : 100.0);
+    thiz->pressure = pressure_new (pressure_cb, thiz);
+    if (!thiz->pressure)
+      PRINT ("Pressure stall information is not available on this system");
+  }
+  thiz->limits_id = g_timeout_add_seconds (LIMITS_INTERVAL, limits_cb, thiz);
+
   bus = gst_pipeline_get_bus (GST_PIPELINE (thiz->pipeline));
   g_signal_connect (G_OBJECT (bus), "message", G_CALLBACK (message_cb), thiz);
+  gst_bus_set_sync_handler (bus, bus_sync_handler, thiz, NULL);
   gst_bus_add_signal_watch (bus);
   gst_object_unref (GST_OBJECT (bus));
 
@@ -522,6 +977,8 @@ main (int argc, char **argv)
   g_main_loop_run (thiz->loop);
 
 done:
+  if (thiz->limits_id)
+    g_source_remove (thiz->limits_id);
   if (thiz->loop)
     g_main_loop_unref (thiz->loop);
   if (thiz->pipeline) {
@@ -532,8 +989,39 @@ done:
   if (thiz->deep_notify_id != 0)
     g_signal_handler_disconnect (thiz->pipeline, thiz->deep_notify_id);
 
+  if (thiz->rotation)
+    rotation_free (thiz->rotation);
+  if (thiz->demand)
+    demand_free (thiz->demand);
+  if (thiz->retention)
+    retention_free (thiz->retention);
+  if (thiz->budget)
+    budget_free (thiz->budget);
+  if (thiz->pressure)
+    pressure_free (thiz->pressure);
+  if (thiz->governor)
+    governor_free (thiz->governor);
+  if (thiz->admission) {
+    if (thiz->branches)
+      admission_save (thiz->admission, thiz->branches);
+    admission_free (thiz->admission);
+  }
+  if (thiz->branches)
+    g_ptr_array_free (thiz->branches, TRUE);
+  if (thiz->config.frame_pools)
+    pools_free (thiz->config.frame_pools);
+  if (thiz->config.frame_allocator)
+    gst_object_unref (thiz->config.frame_allocator);
+  if (thiz->tlb_counter >= 0)
+    close (thiz->tlb_counter);
   g_strfreev (full_branch_desc_array);
+  g_free (admission);
+  g_free (cost_cache);
+  g_free (overflow);
+  g_strfreev (retention);
   g_free (thiz->muxer);
+  g_free (thiz->config.clip_muxer);
+  g_free (thiz->config.clip_dir);
   g_free (thiz->pipeline_description);
   g_free (thiz);
 
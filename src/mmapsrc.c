@@ -0,0 +1,564 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-mmapsrc
+ *
+ * Read a local file from a mapping of it: every buffer wraps part of the
+ * mapping in a read only memory instead of copying it into a freshly
+ * allocated one. The kernel is told the file is read sequentially and
+ * asked to read ahead of the buffers. A file still being recorded is
+ * mapped again as it grows, but the pages of a file truncated after being
+ * mapped fault with SIGBUS, so a file that shrinks is read with pread from
+ * then on. With follow=true the source also waits for the file to grow,
+ * until follow-timeout.
+ *
+ * It handles file:// URIs with a rank above filesrc, so the file branches
+ * of the launcher use it.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include "multisource.h"
+#include "mmapsrc.h"
+
+#define GST_CAT_DEFAULT multisource_launch_debug
+
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_FOLLOW,
+  PROP_FOLLOW_TIMEOUT,
+  PROP_READ_STATS,
+};
+
+struct _MmapRegion
+{
+  gint refcount;
+  guint8 *data;
+  gsize size;
+};
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+static void mmap_src_uri_handler_init (gpointer g_iface, gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (GstMultiSourceMmapSrc, mmap_src, GST_TYPE_BASE_SRC,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_URI_HANDLER, mmap_src_uri_handler_init));
+
+static MmapRegion *
+region_ref (MmapRegion * region)
+{
+  g_atomic_int_inc (&region->refcount);
+  return region;
+}
+
+static void
+region_unref (MmapRegion * region)
+{
+  if (!g_atomic_int_dec_and_test (&region->refcount))
+    return;
+
+  munmap (region->data, region->size);
+  g_free (region);
+}
+
+/* Map the file at its current size. The previous mapping stays alive for
+ * as long as buffers use it. */
+static gboolean
+remap (GstMultiSourceMmapSrc * self, gsize size)
+{
+  MmapRegion *region;
+  gpointer data;
+
+  data = mmap (NULL, size, PROT_READ, MAP_SHARED, self->fd, 0);
+  if (data == MAP_FAILED) {
+    GST_ELEMENT_ERROR (self, RESOURCE, READ, (NULL),
+        ("Could not map \"%s\": %s", self->location, g_strerror (errno)));
+    return FALSE;
+  }
+#ifdef MADV_SEQUENTIAL
+  madvise (data, size, MADV_SEQUENTIAL);
+#endif
+
+  region = g_new0 (MmapRegion, 1);
+  region->refcount = 1;
+  region->data = data;
+  region->size = size;
+  if (self->region)
+    region_unref (self->region);
+  self->region = region;
+  self->advised = 0;
+
+  GST_OBJECT_LOCK (self);
+  self->remaps++;
+  GST_OBJECT_UNLOCK (self);
+
+  return TRUE;
+}
+
+static gboolean
+get_file_size (GstMultiSourceMmapSrc * self, guint64 * size)
+{
+  struct stat st;
+
+  if (fstat (self->fd, &st) < 0)
+    return FALSE;
+  *size = st.st_size;
+
+  return TRUE;
+}
+
+/* Make sure offset is mapped, mapping the file again when it grew past it
+ * and, when following it, waiting for it to. Returns FALSE at the end. */
+static gboolean
+wait_data (GstMultiSourceMmapSrc * self, guint64 offset, GstFlowReturn * ret)
+{
+  gint64 deadline = g_get_monotonic_time () +
+      GST_TIME_AS_USECONDS (self->follow_timeout);
+  guint64 size;
+
+  *ret = GST_FLOW_EOS;
+  while (TRUE) {
+    if (!get_file_size (self, &size))
+      return FALSE;
+    if (size > offset)
+      break;
+    if (!self->follow)
+      return FALSE;
+
+    GST_OBJECT_LOCK (self);
+    if (!self->flushing)
+      g_cond_wait_until (&self->cond, GST_OBJECT_GET_LOCK (self),
+          MIN (deadline, g_get_monotonic_time () +
+              GST_TIME_AS_USECONDS (MMAP_SRC_FOLLOW_POLL)));
+    if (self->flushing) {
+      GST_OBJECT_UNLOCK (self);
+      *ret = GST_FLOW_FLUSHING;
+      return FALSE;
+    }
+    GST_OBJECT_UNLOCK (self);
+    if (g_get_monotonic_time () >= deadline)
+      return FALSE;
+  }
+
+  *ret = GST_FLOW_OK;
+  if (!self->region || size > self->region->size) {
+    GST_DEBUG_OBJECT (self, "File grew to %" G_GUINT64_FORMAT " bytes",
+        size);
+    if (!remap (self, size)) {
+      *ret = GST_FLOW_ERROR;
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Copy a range of a file that may change under the mapping */
+static GstFlowReturn
+read_range (GstMultiSourceMmapSrc * self, guint64 offset, gsize len,
+    GstBuffer ** buffer)
+{
+  GstMapInfo map;
+  gsize done = 0;
+
+  *buffer = gst_buffer_new_allocate (NULL, len, NULL);
+  gst_buffer_map (*buffer, &map, GST_MAP_WRITE);
+  while (done < len) {
+    gssize res = pread (self->fd, map.data + done, len - done, offset + done);
+
+    if (res < 0 && errno == EINTR)
+      continue;
+    if (res < 0) {
+      gst_buffer_unmap (*buffer, &map);
+      gst_clear_buffer (buffer);
+      GST_ELEMENT_ERROR (self, RESOURCE, READ, (NULL),
+          ("Could not read \"%s\": %s", self->location, g_strerror (errno)));
+      return GST_FLOW_ERROR;
+    }
+    if (res == 0)
+      break;
+    done += res;
+  }
+  gst_buffer_unmap (*buffer, &map);
+
+  if (done == 0) {
+    gst_clear_buffer (buffer);
+    return GST_FLOW_EOS;
+  }
+  gst_buffer_set_size (*buffer, done);
+
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+mmap_src_create (GstBaseSrc * src, guint64 offset, guint size,
+    GstBuffer ** buffer)
+{
+  GstMultiSourceMmapSrc *self = GST_MULTI_SOURCE_MMAP_SRC (src);
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint64 file_size;
+  gsize len;
+
+  if ((!self->region || offset >= self->region->size)
+      && !wait_data (self, offset, &ret))
+    return ret;
+
+  len = MIN (size, self->region->size - offset);
+
+  /* The read ahead window starts again from a read going backwards */
+  if (offset < self->position)
+    self->advised = 0;
+  self->position = offset + len;
+
+  if (!get_file_size (self, &file_size)) {
+    GST_ELEMENT_ERROR (self, RESOURCE, READ, (NULL),
+        ("Could not stat \"%s\": %s", self->location, g_strerror (errno)));
+    return GST_FLOW_ERROR;
+  }
+  /* Growing is handled by remapping, only a cut file can fault */
+  if (file_size < self->region->size)
+    self->changing = TRUE;
+
+#ifdef MADV_WILLNEED
+  /* Keep the read ahead window in front of the reads of the mapping */
+  if (!self->changing && offset + len > self->advised
+      && self->advised < self->region->size) {
+    guint64 start = GST_ROUND_DOWN_N (MAX (self->advised, offset),
+        (guint64) getpagesize ());
+    guint64 end = MIN (offset + len + MMAP_SRC_READAHEAD, self->region->size);
+
+    madvise (self->region->data + start, end - start, MADV_WILLNEED);
+    self->advised = end;
+  }
+#endif
+
+  if (self->changing) {
+    ret = read_range (self, offset, len, buffer);
+    if (ret != GST_FLOW_OK)
+      return ret;
+    len = gst_buffer_get_size (*buffer);
+  } else {
+    *buffer = gst_buffer_new ();
+    gst_buffer_append_memory (*buffer,
+        gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY,
+            self->region->data, self->region->size, offset, len,
+            region_ref (self->region), (GDestroyNotify) region_unref));
+  }
+  GST_BUFFER_OFFSET (*buffer) = offset;
+  GST_BUFFER_OFFSET_END (*buffer) = offset + len;
+
+  GST_OBJECT_LOCK (self);
+  self->bytes += len;
+  GST_OBJECT_UNLOCK (self);
+
+  return GST_FLOW_OK;
+}
+
+/* The size grows with the file, followed or not */
+static gboolean
+mmap_src_get_size (GstBaseSrc * src, guint64 * size)
+{
+  GstMultiSourceMmapSrc *self = GST_MULTI_SOURCE_MMAP_SRC (src);
+
+  return !self->follow && get_file_size (self, size);
+}
+
+static gboolean
+mmap_src_is_seekable (GstBaseSrc * src)
+{
+  return TRUE;
+}
+
+static gboolean
+mmap_src_start (GstBaseSrc * src)
+{
+  GstMultiSourceMmapSrc *self = GST_MULTI_SOURCE_MMAP_SRC (src);
+  guint64 size;
+
+  if (!self->location) {
+    GST_ELEMENT_ERROR (self, RESOURCE, NOT_FOUND,
+        ("No file name specified for reading."), (NULL));
+    return FALSE;
+  }
+
+  self->fd = g_open (self->location, O_RDONLY | O_CLOEXEC, 0);
+  if (self->fd < 0) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ,
+        ("Could not open file \"%s\" for reading.", self->location),
+        GST_ERROR_SYSTEM);
+    return FALSE;
+  }
+  self->position = 0;
+  self->changing = FALSE;
+  /* An empty file cannot be mapped, it is once it has grown */
+  if (get_file_size (self, &size) && size > 0 && !remap (self, size)) {
+    close (self->fd);
+    self->fd = -1;
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+mmap_src_stop (GstBaseSrc * src)
+{
+  GstMultiSourceMmapSrc *self = GST_MULTI_SOURCE_MMAP_SRC (src);
+
+  if (self->region) {
+    region_unref (self->region);
+    self->region = NULL;
+  }
+  if (self->fd >= 0) {
+    close (self->fd);
+    self->fd = -1;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+mmap_src_unlock (GstBaseSrc * src)
+{
+  GstMultiSourceMmapSrc *self = GST_MULTI_SOURCE_MMAP_SRC (src);
+
+  GST_OBJECT_LOCK (self);
+  self->flushing = TRUE;
+  g_cond_signal (&self->cond);
+  GST_OBJECT_UNLOCK (self);
+
+  return TRUE;
+}
+
+static gboolean
+mmap_src_unlock_stop (GstBaseSrc * src)
+{
+  GstMultiSourceMmapSrc *self = GST_MULTI_SOURCE_MMAP_SRC (src);
+
+  GST_OBJECT_LOCK (self);
+  self->flushing = FALSE;
+  GST_OBJECT_UNLOCK (self);
+
+  return TRUE;
+}
+
+static gboolean
+set_location (GstMultiSourceMmapSrc * self, const gchar * location,
+    GError ** error)
+{
+  GstState state;
+
+  GST_OBJECT_LOCK (self);
+  state = GST_STATE (self);
+  if (state != GST_STATE_READY && state != GST_STATE_NULL) {
+    GST_OBJECT_UNLOCK (self);
+    g_set_error (error, GST_URI_ERROR, GST_URI_ERROR_BAD_STATE,
+        "Changing the location of mmapsrc when it is open is not supported");
+    return FALSE;
+  }
+  g_free (self->location);
+  self->location = g_strdup (location);
+  GST_OBJECT_UNLOCK (self);
+
+  return TRUE;
+}
+
+static void
+mmap_src_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMultiSourceMmapSrc *self = GST_MULTI_SOURCE_MMAP_SRC (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      set_location (self, g_value_get_string (value), NULL);
+      break;
+    case PROP_FOLLOW:
+      self->follow = g_value_get_boolean (value);
+      break;
+    case PROP_FOLLOW_TIMEOUT:
+      self->follow_timeout = g_value_get_uint64 (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+mmap_src_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstMultiSourceMmapSrc *self = GST_MULTI_SOURCE_MMAP_SRC (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      GST_OBJECT_LOCK (self);
+      g_value_set_string (value, self->location);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_FOLLOW:
+      g_value_set_boolean (value, self->follow);
+      break;
+    case PROP_FOLLOW_TIMEOUT:
+      g_value_set_uint64 (value, self->follow_timeout);
+      break;
+    case PROP_READ_STATS:
+      GST_OBJECT_LOCK (self);
+      g_value_take_boxed (value, gst_structure_new ("mmapsrc",
+              "bytes", G_TYPE_UINT64, self->bytes,
+              "remaps", G_TYPE_UINT64, self->remaps, NULL));
+      GST_OBJECT_UNLOCK (self);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+mmap_src_finalize (GObject * object)
+{
+  GstMultiSourceMmapSrc *self = GST_MULTI_SOURCE_MMAP_SRC (object);
+
+  g_free (self->location);
+  g_cond_clear (&self->cond);
+
+  G_OBJECT_CLASS (mmap_src_parent_class)->finalize (object);
+}
+
+static void
+mmap_src_class_init (GstMultiSourceMmapSrcClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS (klass);
+
+  gobject_class->set_property = mmap_src_set_property;
+  gobject_class->get_property = mmap_src_get_property;
+  gobject_class->finalize = mmap_src_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_LOCATION,
+      g_param_spec_string ("location", "File Location",
+          "Location of the file to read", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_FOLLOW,
+      g_param_spec_boolean ("follow", "Follow",
+          "Wait for the file to grow at its end, as it is recorded", FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_FOLLOW_TIMEOUT,
+      g_param_spec_uint64 ("follow-timeout", "Follow timeout",
+          "Time the file may not grow before the end of the stream", 0,
+          G_MAXUINT64, MMAP_SRC_DEFAULT_FOLLOW_TIMEOUT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_READ_STATS,
+      g_param_spec_boxed ("read-stats", "Read statistics",
+          "Bytes read and number of mappings", GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+  gst_element_class_set_static_metadata (element_class,
+      "Mapped File Source", "Source/File",
+      "Read a file from a mapping of it, without copy",
+      "gst-multisource-launch");
+
+  basesrc_class->start = mmap_src_start;
+  basesrc_class->stop = mmap_src_stop;
+  basesrc_class->create = mmap_src_create;
+  basesrc_class->get_size = mmap_src_get_size;
+  basesrc_class->is_seekable = mmap_src_is_seekable;
+  basesrc_class->unlock = mmap_src_unlock;
+  basesrc_class->unlock_stop = mmap_src_unlock_stop;
+}
+
+static void
+mmap_src_init (GstMultiSourceMmapSrc * self)
+{
+  self->fd = -1;
+  self->follow_timeout = MMAP_SRC_DEFAULT_FOLLOW_TIMEOUT;
+  g_cond_init (&self->cond);
+  gst_base_src_set_blocksize (GST_BASE_SRC (self), MMAP_SRC_DEFAULT_BLOCKSIZE);
+}
+
+static GstURIType
+mmap_src_uri_get_type (GType type)
+{
+  return GST_URI_SRC;
+}
+
+static const gchar *const *
+mmap_src_uri_get_protocols (GType type)
+{
+  static const gchar *protocols[] = { "file", NULL };
+
+  return protocols;
+}
+
+static gchar *
+mmap_src_uri_get_uri (GstURIHandler * handler)
+{
+  GstMultiSourceMmapSrc *self = GST_MULTI_SOURCE_MMAP_SRC (handler);
+  gchar *uri = NULL;
+
+  GST_OBJECT_LOCK (self);
+  if (self->location)
+    uri = gst_filename_to_uri (self->location, NULL);
+  GST_OBJECT_UNLOCK (self);
+
+  return uri;
+}
+
+static gboolean
+mmap_src_uri_set_uri (GstURIHandler * handler, const gchar * uri,
+    GError ** error)
+{
+  GstMultiSourceMmapSrc *self = GST_MULTI_SOURCE_MMAP_SRC (handler);
+  gchar *location = g_filename_from_uri (uri, NULL, error);
+  gboolean res;
+
+  if (!location)
+    return FALSE;
+  res = set_location (self, location, error);
+  g_free (location);
+
+  return res;
+}
+
+static void
+mmap_src_uri_handler_init (gpointer g_iface, gpointer iface_data)
+{
+  GstURIHandlerInterface *iface = (GstURIHandlerInterface *) g_iface;
+
+  iface->get_type = mmap_src_uri_get_type;
+  iface->get_protocols = mmap_src_uri_get_protocols;
+  iface->get_uri = mmap_src_uri_get_uri;
+  iface->set_uri = mmap_src_uri_set_uri;
+}
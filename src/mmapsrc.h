@@ -0,0 +1,78 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_MMAP_SRC_H__
+#define __GST_MULTI_SOURCE_MMAP_SRC_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesrc.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MULTI_SOURCE_MMAP_SRC (mmap_src_get_type ())
+#define GST_MULTI_SOURCE_MMAP_SRC(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+    GST_TYPE_MULTI_SOURCE_MMAP_SRC, GstMultiSourceMmapSrc))
+
+#define MMAP_SRC_DEFAULT_BLOCKSIZE (256 * 1024)
+/* How far ahead of the reads the kernel is asked to read the file */
+#define MMAP_SRC_READAHEAD (8 * 1024 * 1024)
+#define MMAP_SRC_FOLLOW_POLL (100 * GST_MSECOND)
+#define MMAP_SRC_DEFAULT_FOLLOW_TIMEOUT (5 * GST_SECOND)
+
+/* A mapping of the file, unmapped once no buffer refers to it anymore */
+typedef struct _MmapRegion MmapRegion;
+
+typedef struct _GstMultiSourceMmapSrc
+{
+  GstBaseSrc parent;
+
+  /* properties */
+  gchar *location;
+  gboolean follow;
+  GstClockTime follow_timeout;
+
+  gint fd;
+  MmapRegion *region;
+  guint64 advised;
+  /* end of the last read, to see the reads going backwards */
+  guint64 position;
+  /* the file was truncated since it was mapped, it is read with copies */
+  gboolean changing;
+
+  /* wakes up a read waiting for the file to grow, protected by the object
+   * lock */
+  GCond cond;
+  gboolean flushing;
+
+  /* statistics, protected by the object lock */
+  guint64 bytes;
+  guint64 remaps;
+} GstMultiSourceMmapSrc;
+
+typedef struct _GstMultiSourceMmapSrcClass
+{
+  GstBaseSrcClass parent_class;
+} GstMultiSourceMmapSrcClass;
+
+GType mmap_src_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_MMAP_SRC_H__ */
@@ -0,0 +1,73 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_H__
+#define __GST_MULTI_SOURCE_H__
+
+#include <gst/gst.h>
+
+#include "quota.h"
+#include "pools.h"
+
+G_BEGIN_DECLS
+
+GST_DEBUG_CATEGORY_EXTERN (multisource_launch_debug);
+
+#define PRINT(FMT, ARGS...) do { \
+        gst_print (FMT "\n", ## ARGS); \
+    } while (0)
+
+/* Settings shared by every branch, filled from the command line */
+typedef struct _GstMultiSourceConfig
+{
+  gboolean health_check;
+  GstClockTime health_timeout;
+  gboolean audio_level;
+  gdouble silence_threshold;
+  gboolean suppress_silence;
+  GstClockTime max_key_interval;
+  guint64 gop_cache_bytes;
+  gboolean on_demand;
+  /* background branches decoded at once, 0 when they do not rotate */
+  guint rotate;
+
+  /* resources granted to the process, refreshed from its cgroup */
+  gdouble cpus;
+  guint64 memory_limit;
+
+  /* bytes all the branch queues may hold together, 0 when not limited */
+  guint64 memory_ceiling;
+  GstMultiSourceOverflow overflow;
+
+  /* offered to the video decoders for their frames, NULL for the default */
+  GstAllocator *frame_allocator;
+  /* frames shared between the branches with the same caps, or NULL */
+  GstMultiSourcePools *frame_pools;
+
+  /* compressed history kept for the clips, 0 when not exporting any */
+  GstClockTime clip_preroll;
+  GstClockTime clip_postroll;
+  gchar *clip_muxer;
+  gchar *clip_dir;
+} GstMultiSourceConfig;
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_H__ */
@@ -0,0 +1,76 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "plugin.h"
+#include "recordsink.h"
+#include "chunkmux.h"
+#include "chunksrc.h"
+#include "mmapsrc.h"
+#include "testsrc.h"
+#include "batchudpsrc.h"
+#include "rtpsdpsrc.h"
+#include "shmpubsink.h"
+#include "shmsubsrc.h"
+#ifdef HAVE_LIBURING
+#include "uringsink.h"
+#endif
+
+static gboolean
+plugin_init (GstPlugin * plugin)
+{
+  gboolean res = TRUE;
+
+  res &= gst_element_register (plugin, "recordsink", GST_RANK_NONE,
+      GST_TYPE_MULTI_SOURCE_RECORD_SINK);
+  res &= gst_element_register (plugin, "chunkmux", GST_RANK_NONE,
+      GST_TYPE_MULTI_SOURCE_CHUNK_MUX);
+  res &= gst_element_register (plugin, "chunksrc", GST_RANK_NONE,
+      GST_TYPE_MULTI_SOURCE_CHUNK_SRC);
+  /* Ranked above filesrc so urisourcebin picks it for file:// URIs */
+  res &= gst_element_register (plugin, "mmapsrc", GST_RANK_PRIMARY + 1,
+      GST_TYPE_MULTI_SOURCE_MMAP_SRC);
+  res &= gst_element_register (plugin, "testsrc", GST_RANK_PRIMARY,
+      GST_TYPE_MULTI_SOURCE_TEST_SRC);
+  res &= gst_element_register (plugin, "batchudpsrc", GST_RANK_NONE,
+      GST_TYPE_MULTI_SOURCE_BATCH_UDP_SRC);
+  res &= gst_element_register (plugin, "rtpsdpsrc", GST_RANK_NONE,
+      GST_TYPE_MULTI_SOURCE_RTP_SDP_SRC);
+  res &= gst_element_register (plugin, "shmpubsink", GST_RANK_NONE,
+      GST_TYPE_MULTI_SOURCE_SHM_PUB_SINK);
+  res &= gst_element_register (plugin, "shmsubsrc", GST_RANK_PRIMARY,
+      GST_TYPE_MULTI_SOURCE_SHM_SUB_SRC);
+#ifdef HAVE_LIBURING
+  res &= gst_element_register (plugin, "uringsink", GST_RANK_NONE,
+      GST_TYPE_MULTI_SOURCE_URING_SINK);
+#endif
+
+  return res;
+}
+
+/* Make the elements of the application available to gst_parse_launch, as
+ * if they came from an installed plugin. */
+gboolean
+multisource_plugin_register (void)
+{
+  return gst_plugin_register_static (GST_VERSION_MAJOR, GST_VERSION_MINOR,
+      "multisource", "Elements of gst-multisource-launch", plugin_init,
+      PACKAGE_VERSION, "LGPL", "gst-multisource-launch",
+      "gst-multisource-launch", "https://gstreamer.freedesktop.org");
+}
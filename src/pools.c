@@ -0,0 +1,309 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "multisource.h"
+#include "pools.h"
+
+#define GST_CAT_DEFAULT multisource_launch_debug
+
+G_DEFINE_TYPE (GstMultiSourceSharedPool, shared_pool,
+    GST_TYPE_VIDEO_BUFFER_POOL);
+
+static void
+share_free (GstMultiSourcePoolShare * share)
+{
+  GstBuffer *buffer;
+
+  while ((buffer = g_queue_pop_head (&share->spare)))
+    gst_buffer_unref (buffer);
+  g_free (share->key);
+  g_free (share->caps);
+  g_free (share);
+}
+
+/* Frames can only move between pools allocating them the same way, from
+ * the same allocator with the same parameters */
+static gchar *
+make_key (GstCaps * caps, guint size, GstStructure * config)
+{
+  GstVideoAlignment align;
+  GstAllocator *allocator = NULL;
+  GstAllocationParams params;
+  gchar *str = gst_caps_to_string (caps);
+  gchar *key;
+
+  gst_video_alignment_reset (&align);
+  if (gst_buffer_pool_config_has_option (config,
+          GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT))
+    gst_buffer_pool_config_get_video_alignment (config, &align);
+  gst_allocation_params_init (&params);
+  gst_buffer_pool_config_get_allocator (config, &allocator, &params);
+
+  key = g_strdup_printf ("%s|%u|%u,%u,%u,%u|%u,%u,%u,%u|%p|%u,%"
+      G_GSIZE_FORMAT ",%" G_GSIZE_FORMAT ",%" G_GSIZE_FORMAT, str, size,
+      align.padding_top, align.padding_bottom, align.padding_left,
+      align.padding_right, align.stride_align[0], align.stride_align[1],
+      align.stride_align[2], align.stride_align[3], allocator, params.flags,
+      params.align, params.prefix, params.padding);
+  g_free (str);
+
+  return key;
+}
+
+static GstMultiSourcePoolShare *
+get_share (GstMultiSourcePools * pools, GstCaps * caps, guint size,
+    GstStructure * config)
+{
+  gchar *key = make_key (caps, size, config);
+  GstMultiSourcePoolShare *share;
+
+  g_mutex_lock (&pools->lock);
+  share = g_hash_table_lookup (pools->shares, key);
+  if (!share) {
+    GstVideoInfo info;
+
+    share = g_new0 (GstMultiSourcePoolShare, 1);
+    share->key = key;
+    share->size = size;
+    if (gst_video_info_from_caps (&info, caps))
+      share->caps = g_strdup_printf ("%s %dx%d",
+          gst_video_format_to_string (GST_VIDEO_INFO_FORMAT (&info)),
+          GST_VIDEO_INFO_WIDTH (&info), GST_VIDEO_INFO_HEIGHT (&info));
+    else
+      share->caps = gst_caps_to_string (caps);
+    g_queue_init (&share->spare);
+    g_hash_table_insert (pools->shares, share->key, share);
+  } else {
+    g_free (key);
+  }
+  g_mutex_unlock (&pools->lock);
+
+  return share;
+}
+
+static gboolean
+shared_pool_set_config (GstBufferPool * pool, GstStructure * config)
+{
+  GstMultiSourceSharedPool *self = GST_MULTI_SOURCE_SHARED_POOL (pool);
+  GstCaps *caps;
+  guint size;
+
+  /* The video pool fixes the size for the alignment in the config */
+  if (!GST_BUFFER_POOL_CLASS (shared_pool_parent_class)->set_config (pool,
+          config))
+    return FALSE;
+
+  if (!gst_buffer_pool_config_get_params (config, &caps, &size, NULL, NULL)
+      || !caps)
+    return FALSE;
+
+  self->share = get_share (self->pools, caps, size, config);
+  GST_DEBUG ("Branch %u sharing %s frames", self->branch, self->share->caps);
+
+  return TRUE;
+}
+
+/* No frame is allocated up front, they come from the share on demand */
+static gboolean
+shared_pool_start (GstBufferPool * pool)
+{
+  GstMultiSourceSharedPool *self = GST_MULTI_SOURCE_SHARED_POOL (pool);
+
+  g_mutex_lock (&self->pools->lock);
+  self->share->pools++;
+  self->active = TRUE;
+  g_mutex_unlock (&self->pools->lock);
+
+  return TRUE;
+}
+
+static gboolean
+shared_pool_stop (GstBufferPool * pool)
+{
+  GstMultiSourceSharedPool *self = GST_MULTI_SOURCE_SHARED_POOL (pool);
+
+  g_mutex_lock (&self->pools->lock);
+  if (self->active)
+    self->share->pools--;
+  self->active = FALSE;
+  g_mutex_unlock (&self->pools->lock);
+
+  return TRUE;
+}
+
+static GstFlowReturn
+shared_pool_acquire_buffer (GstBufferPool * pool, GstBuffer ** buffer,
+    GstBufferPoolAcquireParams * params)
+{
+  GstMultiSourceSharedPool *self = GST_MULTI_SOURCE_SHARED_POOL (pool);
+  GstMultiSourcePoolShare *share = self->share;
+  GstFlowReturn res;
+
+  if (GST_BUFFER_POOL_IS_FLUSHING (pool))
+    return GST_FLOW_FLUSHING;
+
+  g_mutex_lock (&self->pools->lock);
+  *buffer = g_queue_pop_head (&share->spare);
+  if (*buffer) {
+    share->hits++;
+  } else {
+    share->misses++;
+    share->frames++;
+    share->peak_frames = MAX (share->peak_frames, share->frames);
+  }
+  g_mutex_unlock (&self->pools->lock);
+
+  if (*buffer)
+    return GST_FLOW_OK;
+
+  res = GST_BUFFER_POOL_CLASS (shared_pool_parent_class)->alloc_buffer (pool,
+      buffer, params);
+  if (res != GST_FLOW_OK) {
+    g_mutex_lock (&self->pools->lock);
+    share->frames--;
+    g_mutex_unlock (&self->pools->lock);
+  }
+
+  return res;
+}
+
+/* Frames go back to the share, which only keeps a few spare ones for each
+ * branch using it and frees the others. As in the default pool, a frame
+ * whose memory was replaced, resized or is still shared is freed too. */
+static void
+shared_pool_release_buffer (GstBufferPool * pool, GstBuffer * buffer)
+{
+  GstMultiSourceSharedPool *self = GST_MULTI_SOURCE_SHARED_POOL (pool);
+  GstMultiSourcePoolShare *share = self->share;
+  gboolean keep = !GST_BUFFER_FLAG_IS_SET (buffer,
+      GST_BUFFER_FLAG_TAG_MEMORY) && gst_buffer_n_memory (buffer) == 1
+      && gst_buffer_get_size (buffer) == share->size
+      && gst_buffer_is_all_memory_writable (buffer);
+
+  g_mutex_lock (&self->pools->lock);
+  keep = keep && g_queue_get_length (&share->spare) <
+      share->pools * POOLS_BRANCH_SPARE;
+  if (keep)
+    g_queue_push_tail (&share->spare, buffer);
+  else
+    share->frames--;
+  g_mutex_unlock (&self->pools->lock);
+
+  if (!keep)
+    GST_BUFFER_POOL_CLASS (shared_pool_parent_class)->free_buffer (pool,
+        buffer);
+}
+
+static void
+shared_pool_class_init (GstMultiSourceSharedPoolClass * klass)
+{
+  GstBufferPoolClass *pool_class = GST_BUFFER_POOL_CLASS (klass);
+
+  pool_class->set_config = shared_pool_set_config;
+  pool_class->start = shared_pool_start;
+  pool_class->stop = shared_pool_stop;
+  pool_class->acquire_buffer = shared_pool_acquire_buffer;
+  pool_class->release_buffer = shared_pool_release_buffer;
+}
+
+static void
+shared_pool_init (GstMultiSourceSharedPool * self)
+{
+}
+
+GstMultiSourcePools *
+pools_new (void)
+{
+  GstMultiSourcePools *pools = g_new0 (GstMultiSourcePools, 1);
+
+  g_mutex_init (&pools->lock);
+  pools->shares = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+      (GDestroyNotify) share_free);
+
+  return pools;
+}
+
+void
+pools_free (GstMultiSourcePools * pools)
+{
+  g_hash_table_destroy (pools->shares);
+  g_mutex_clear (&pools->lock);
+  g_free (pools);
+}
+
+/* A pool for the decoder of a branch, sharing its frames with the other
+ * branches once configured. The registry must outlive it. */
+GstBufferPool *
+pools_new_branch_pool (GstMultiSourcePools * pools, guint branch)
+{
+  GstMultiSourceSharedPool *self =
+      g_object_new (GST_TYPE_MULTI_SOURCE_SHARED_POOL, NULL);
+
+  gst_object_ref_sink (self);
+  self->pools = pools;
+  self->branch = branch;
+
+  return GST_BUFFER_POOL_CAST (self);
+}
+
+GstStructure *
+pools_get_stats (GstMultiSourcePools * pools)
+{
+  GstStructure *s = gst_structure_new_empty ("pools");
+  guint64 frames = 0, peak = 0, hits = 0, misses = 0, bytes = 0;
+  GHashTableIter iter;
+  gpointer value;
+  guint i = 0;
+
+  g_mutex_lock (&pools->lock);
+  g_hash_table_iter_init (&iter, pools->shares);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    GstMultiSourcePoolShare *share = value;
+    gchar *name = g_strdup_printf ("share-%u", i++);
+    GstStructure *stats = gst_structure_new ("share",
+        "caps", G_TYPE_STRING, share->caps,
+        "size", G_TYPE_UINT64, (guint64) share->size,
+        "pools", G_TYPE_UINT, share->pools,
+        "frames", G_TYPE_UINT64, share->frames,
+        "peak-frames", G_TYPE_UINT64, share->peak_frames,
+        "spare", G_TYPE_UINT, g_queue_get_length (&share->spare),
+        "hits", G_TYPE_UINT64, share->hits,
+        "misses", G_TYPE_UINT64, share->misses,
+        "hit-rate", G_TYPE_DOUBLE, share->hits + share->misses ?
+        (gdouble) share->hits / (share->hits + share->misses) : 0.0, NULL);
+
+    gst_structure_set (s, name, GST_TYPE_STRUCTURE, stats, NULL);
+    gst_structure_free (stats);
+    g_free (name);
+    frames += share->frames;
+    peak += share->peak_frames * share->size;
+    bytes += share->frames * share->size;
+    hits += share->hits;
+    misses += share->misses;
+  }
+  g_mutex_unlock (&pools->lock);
+
+  gst_structure_set (s, "frames", G_TYPE_UINT64, frames,
+      "bytes", G_TYPE_UINT64, bytes,
+      "peak-bytes", G_TYPE_UINT64, peak,
+      "hits", G_TYPE_UINT64, hits, "misses", G_TYPE_UINT64, misses, NULL);
+
+  return s;
+}
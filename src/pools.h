@@ -0,0 +1,87 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_POOLS_H__
+#define __GST_MULTI_SOURCE_POOLS_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+/* Spare frames kept per branch using a share */
+#define POOLS_BRANCH_SPARE 1
+
+#define GST_TYPE_MULTI_SOURCE_SHARED_POOL (shared_pool_get_type ())
+#define GST_MULTI_SOURCE_SHARED_POOL(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+    GST_TYPE_MULTI_SOURCE_SHARED_POOL, GstMultiSourceSharedPool))
+
+typedef struct _GstMultiSourcePools GstMultiSourcePools;
+typedef struct _GstMultiSourcePoolShare GstMultiSourcePoolShare;
+
+/* The frames of every branch producing the same caps, size and layout */
+struct _GstMultiSourcePoolShare
+{
+  gchar *key;
+  gchar *caps;
+  gsize size;
+
+  /* protected by the lock of the registry */
+  GQueue spare;
+  guint pools;
+  guint64 frames;
+  guint64 peak_frames;
+  guint64 hits;
+  guint64 misses;
+};
+
+struct _GstMultiSourcePools
+{
+  GMutex lock;
+  GHashTable *shares;
+};
+
+/* The pool of a branch, drawing its frames from a share */
+typedef struct _GstMultiSourceSharedPool
+{
+  GstVideoBufferPool parent;
+
+  GstMultiSourcePools *pools;
+  guint branch;
+  GstMultiSourcePoolShare *share;
+  gboolean active;
+} GstMultiSourceSharedPool;
+
+typedef struct _GstMultiSourceSharedPoolClass
+{
+  GstVideoBufferPoolClass parent_class;
+} GstMultiSourceSharedPoolClass;
+
+GType shared_pool_get_type (void);
+
+GstMultiSourcePools *pools_new (void);
+void pools_free (GstMultiSourcePools * pools);
+GstBufferPool *pools_new_branch_pool (GstMultiSourcePools * pools,
+    guint branch);
+GstStructure *pools_get_stats (GstMultiSourcePools * pools);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_POOLS_H__ */
@@ -0,0 +1,271 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib-unix.h>
+#include <glib/gstdio.h>
+
+#include "pressure.h"
+#include "sysinfo.h"
+#include "multisource.h"
+
+#define GST_CAT_DEFAULT multisource_launch_debug
+
+/* When triggers cannot be registered, the averages are polled instead */
+#define PRESSURE_CPU_AVG10 15.0
+#define PRESSURE_MEMORY_AVG10 5.0
+
+static const struct
+{
+  const gchar *name;
+  const gchar *cgroup_file;
+  GTimeSpan stall;
+  gdouble avg10;
+} resources[] = {
+  [PRESSURE_CPU] = {"cpu", "cpu.pressure", PRESSURE_CPU_STALL,
+      PRESSURE_CPU_AVG10},
+  [PRESSURE_MEMORY] = {"memory", "memory.pressure", PRESSURE_MEMORY_STALL,
+      PRESSURE_MEMORY_AVG10},
+};
+
+const gchar *
+pressure_resource_get_name (GstMultiSourcePressureResource resource)
+{
+  return resources[resource].name;
+}
+
+/* Prefer the pressure of our own cgroup, which is what gets throttled in a
+ * container, over the system wide one. */
+static gchar *
+find_pressure_file (GstMultiSourcePressureResource resource)
+{
+  gchar *cgroup = sysinfo_get_cgroup_dir ();
+  gchar *path;
+
+  if (cgroup) {
+    path = g_build_filename (cgroup, resources[resource].cgroup_file, NULL);
+    g_free (cgroup);
+    if (g_file_test (path, G_FILE_TEST_EXISTS))
+      return path;
+    g_free (path);
+  }
+
+  path = g_build_filename ("/proc/pressure", resources[resource].name, NULL);
+  if (g_file_test (path, G_FILE_TEST_EXISTS))
+    return path;
+  g_free (path);
+
+  return NULL;
+}
+
+static void
+read_averages (GstMultiSourcePressureFile * file)
+{
+  gchar *contents = NULL;
+  gchar *line;
+
+  if (!g_file_get_contents (file->path, &contents, NULL, NULL))
+    return;
+
+  line = strstr (contents, "some ");
+  if (line)
+    sscanf (line, "some avg10=%lf avg60=%lf", &file->some_avg10,
+        &file->some_avg60);
+  line = strstr (contents, "full ");
+  if (line)
+    sscanf (line, "full avg10=%lf", &file->full_avg10);
+  g_free (contents);
+}
+
+static void
+notify (GstMultiSourcePressure * pressure,
+    GstMultiSourcePressureResource resource)
+{
+  GstMultiSourcePressureFile *file = &pressure->files[resource];
+
+  file->events++;
+  read_averages (file);
+  GST_INFO ("Sustained %s pressure, some avg10 %.2f%%",
+      resources[resource].name, file->some_avg10);
+  pressure->func (resource, pressure->user_data);
+}
+
+static gboolean
+trigger_cb (gint fd, GIOCondition condition, gpointer user_data)
+{
+  GstMultiSourcePressure *pressure = user_data;
+  guint i;
+
+  for (i = 0; i < PRESSURE_LAST; i++) {
+    GstMultiSourcePressureFile *file = &pressure->files[i];
+
+    if (file->fd != fd)
+      continue;
+
+    if (condition & G_IO_ERR) {
+      GST_WARNING ("%s pressure trigger went away", resources[i].name);
+      file->source_id = 0;
+      file->triggered = FALSE;
+      return G_SOURCE_REMOVE;
+    }
+    notify (pressure, i);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Ask the kernel to wake us up when the tasks of the cgroup were stalled on
+ * the resource for more than the given time within the window. */
+static gboolean
+register_trigger (GstMultiSourcePressure * pressure,
+    GstMultiSourcePressureResource resource)
+{
+  GstMultiSourcePressureFile *file = &pressure->files[resource];
+  gchar *trigger;
+  gboolean res;
+
+  file->fd = g_open (file->path, O_RDWR | O_NONBLOCK, 0);
+  if (file->fd < 0)
+    return FALSE;
+
+  trigger = g_strdup_printf ("some %" G_GINT64_FORMAT " %" G_GINT64_FORMAT,
+      resources[resource].stall, (gint64) PRESSURE_WINDOW);
+  res = write (file->fd, trigger, strlen (trigger) + 1) >= 0;
+  if (!res) {
+    GST_DEBUG ("Unable to register the %s trigger on %s: %s",
+        resources[resource].name, file->path, g_strerror (errno));
+    close (file->fd);
+    file->fd = -1;
+  } else {
+    file->source_id = g_unix_fd_add (file->fd, G_IO_PRI | G_IO_ERR,
+        trigger_cb, pressure);
+    file->triggered = TRUE;
+  }
+  g_free (trigger);
+
+  return res;
+}
+
+static gboolean
+poll_cb (gpointer user_data)
+{
+  GstMultiSourcePressure *pressure = user_data;
+  guint i;
+
+  for (i = 0; i < PRESSURE_LAST; i++) {
+    GstMultiSourcePressureFile *file = &pressure->files[i];
+
+    if (!file->path)
+      continue;
+
+    read_averages (file);
+    if (!file->triggered && file->some_avg10 >= resources[i].avg10)
+      notify (pressure, i);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Watch the CPU and memory pressure stall information. func is called from
+ * the main loop whenever one of them is under sustained pressure. Returns
+ * NULL when the kernel does not expose PSI. */
+GstMultiSourcePressure *
+pressure_new (GstMultiSourcePressureFunc func, gpointer user_data)
+{
+  GstMultiSourcePressure *pressure = g_new0 (GstMultiSourcePressure, 1);
+  gboolean found = FALSE;
+  guint i;
+
+  pressure->func = func;
+  pressure->user_data = user_data;
+
+  for (i = 0; i < PRESSURE_LAST; i++) {
+    GstMultiSourcePressureFile *file = &pressure->files[i];
+
+    file->fd = -1;
+    file->path = find_pressure_file (i);
+    if (!file->path)
+      continue;
+
+    found = TRUE;
+    if (!register_trigger (pressure, i))
+      GST_INFO ("Polling %s for %s pressure", file->path, resources[i].name);
+    read_averages (file);
+  }
+
+  if (!found) {
+    g_free (pressure);
+    return NULL;
+  }
+
+  pressure->source_id = g_timeout_add (PRESSURE_INTERVAL, poll_cb, pressure);
+
+  return pressure;
+}
+
+void
+pressure_free (GstMultiSourcePressure * pressure)
+{
+  guint i;
+
+  for (i = 0; i < PRESSURE_LAST; i++) {
+    GstMultiSourcePressureFile *file = &pressure->files[i];
+
+    if (file->source_id)
+      g_source_remove (file->source_id);
+    if (file->fd >= 0)
+      close (file->fd);
+    g_free (file->path);
+  }
+  if (pressure->source_id)
+    g_source_remove (pressure->source_id);
+  g_free (pressure);
+}
+
+GstStructure *
+pressure_get_stats (GstMultiSourcePressure * pressure)
+{
+  GstStructure *s = gst_structure_new_empty ("pressure");
+  guint i;
+
+  for (i = 0; i < PRESSURE_LAST; i++) {
+    GstMultiSourcePressureFile *file = &pressure->files[i];
+    GstStructure *r;
+
+    if (!file->path)
+      continue;
+
+    r = gst_structure_new (resources[i].name,
+        "path", G_TYPE_STRING, file->path,
+        "trigger", G_TYPE_BOOLEAN, file->triggered,
+        "some-avg10", G_TYPE_DOUBLE, file->some_avg10,
+        "some-avg60", G_TYPE_DOUBLE, file->some_avg60,
+        "full-avg10", G_TYPE_DOUBLE, file->full_avg10,
+        "events", G_TYPE_UINT, file->events, NULL);
+    gst_structure_set (s, resources[i].name, GST_TYPE_STRUCTURE, r, NULL);
+    gst_structure_free (r);
+  }
+
+  return s;
+}
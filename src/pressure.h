@@ -0,0 +1,73 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_PRESSURE_H__
+#define __GST_MULTI_SOURCE_PRESSURE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define PRESSURE_INTERVAL 2000
+/* Unprivileged triggers need a window multiple of 2 s */
+#define PRESSURE_WINDOW (2 * G_USEC_PER_SEC)
+#define PRESSURE_CPU_STALL (300 * G_TIME_SPAN_MILLISECOND)
+#define PRESSURE_MEMORY_STALL (100 * G_TIME_SPAN_MILLISECOND)
+
+typedef enum
+{
+  PRESSURE_CPU,
+  PRESSURE_MEMORY,
+  PRESSURE_LAST
+} GstMultiSourcePressureResource;
+
+typedef void (*GstMultiSourcePressureFunc) (GstMultiSourcePressureResource
+    resource, gpointer user_data);
+
+typedef struct
+{
+  gchar *path;
+  gint fd;
+  guint source_id;
+  gboolean triggered;
+  gdouble some_avg10;
+  gdouble some_avg60;
+  gdouble full_avg10;
+  guint events;
+} GstMultiSourcePressureFile;
+
+typedef struct _GstMultiSourcePressure
+{
+  GstMultiSourcePressureFile files[PRESSURE_LAST];
+  GstMultiSourcePressureFunc func;
+  gpointer user_data;
+  guint source_id;
+} GstMultiSourcePressure;
+
+GstMultiSourcePressure *pressure_new (GstMultiSourcePressureFunc func,
+    gpointer user_data);
+void pressure_free (GstMultiSourcePressure * pressure);
+const gchar *pressure_resource_get_name (GstMultiSourcePressureResource
+    resource);
+GstStructure *pressure_get_stats (GstMultiSourcePressure * pressure);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_PRESSURE_H__ */
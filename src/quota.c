@@ -0,0 +1,147 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "quota.h"
+
+static const gchar *overflow_names[] = {
+  [QUOTA_OVERFLOW_BLOCK] = "block",
+  [QUOTA_OVERFLOW_DROP] = "drop",
+};
+
+const gchar *
+quota_overflow_get_name (GstMultiSourceOverflow overflow)
+{
+  return overflow_names[overflow];
+}
+
+gboolean
+quota_parse_overflow (const gchar * name, GstMultiSourceOverflow * overflow)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (overflow_names); i++) {
+    if (!strcmp (name, overflow_names[i])) {
+      *overflow = i;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+void
+quota_init (GstMultiSourceQuota * quota, GstMultiSourceOverflow overflow)
+{
+  memset (quota, 0, sizeof (GstMultiSourceQuota));
+  g_mutex_init (&quota->lock);
+  quota->overflow = overflow;
+}
+
+void
+quota_clear (GstMultiSourceQuota * quota)
+{
+  g_mutex_clear (&quota->lock);
+}
+
+void
+quota_set_limit (GstMultiSourceQuota * quota, guint64 limit)
+{
+  g_mutex_lock (&quota->lock);
+  quota->limit = limit;
+  g_mutex_unlock (&quota->lock);
+}
+
+guint64
+quota_get_limit (GstMultiSourceQuota * quota)
+{
+  guint64 limit;
+
+  g_mutex_lock (&quota->lock);
+  limit = quota->limit;
+  g_mutex_unlock (&quota->lock);
+
+  return limit;
+}
+
+void
+quota_update_level (GstMultiSourceQuota * quota, guint64 level)
+{
+  g_mutex_lock (&quota->lock);
+  quota->level = level;
+  quota->peak = MAX (quota->peak, level);
+  g_mutex_unlock (&quota->lock);
+}
+
+/* Decide whether a buffer entering the queues of a branch is kept, against
+ * the level last sampled plus what was admitted since. With the drop
+ * policy, a buffer over the quota is dropped along with the following delta
+ * units of its stream, which resumes on the next keyframe that fits.
+ * dropping is the state of that stream. */
+gboolean
+quota_admit (GstMultiSourceQuota * quota, GstBuffer * buffer,
+    gboolean * dropping)
+{
+  gsize size = gst_buffer_get_size (buffer);
+  gboolean admit;
+
+  g_mutex_lock (&quota->lock);
+  if (quota->overflow == QUOTA_OVERFLOW_BLOCK)
+    admit = TRUE;
+  else if (*dropping && GST_BUFFER_FLAG_IS_SET (buffer,
+          GST_BUFFER_FLAG_DELTA_UNIT))
+    admit = FALSE;
+  else
+    admit = quota->limit == 0 || quota->level + size <= quota->limit;
+
+  if (admit) {
+    quota->level += size;
+    quota->peak = MAX (quota->peak, quota->level);
+  } else {
+    if (!*dropping)
+      quota->overflows++;
+    quota->dropped++;
+    quota->dropped_bytes += size;
+  }
+  *dropping = !admit;
+  g_mutex_unlock (&quota->lock);
+
+  return admit;
+}
+
+GstStructure *
+quota_get_stats (GstMultiSourceQuota * quota)
+{
+  GstStructure *s;
+
+  g_mutex_lock (&quota->lock);
+  s = gst_structure_new ("quota",
+      "overflow", G_TYPE_STRING, quota_overflow_get_name (quota->overflow),
+      "limit", G_TYPE_UINT64, quota->limit,
+      "level", G_TYPE_UINT64, quota->level,
+      "peak", G_TYPE_UINT64, quota->peak,
+      "overflows", G_TYPE_UINT, quota->overflows,
+      "dropped", G_TYPE_UINT64, quota->dropped,
+      "dropped-bytes", G_TYPE_UINT64, quota->dropped_bytes, NULL);
+  g_mutex_unlock (&quota->lock);
+
+  return s;
+}
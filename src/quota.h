@@ -0,0 +1,67 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_QUOTA_H__
+#define __GST_MULTI_SOURCE_QUOTA_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* What happens to the data of a branch once its queues hold its quota */
+typedef enum
+{
+  QUOTA_OVERFLOW_BLOCK,
+  QUOTA_OVERFLOW_DROP,
+} GstMultiSourceOverflow;
+
+typedef struct _GstMultiSourceQuota
+{
+  GMutex lock;
+  GstMultiSourceOverflow overflow;
+
+  /* bytes the branch queues may hold, 0 when not limited */
+  guint64 limit;
+
+  /* statistics, protected by lock. level is the one sampled on the budget
+   * tick plus the bytes admitted since. */
+  guint64 level;
+  guint64 peak;
+  guint64 dropped;
+  guint64 dropped_bytes;
+  guint overflows;
+} GstMultiSourceQuota;
+
+const gchar *quota_overflow_get_name (GstMultiSourceOverflow overflow);
+gboolean quota_parse_overflow (const gchar * name,
+    GstMultiSourceOverflow * overflow);
+
+void quota_init (GstMultiSourceQuota * quota, GstMultiSourceOverflow overflow);
+void quota_clear (GstMultiSourceQuota * quota);
+void quota_set_limit (GstMultiSourceQuota * quota, guint64 limit);
+guint64 quota_get_limit (GstMultiSourceQuota * quota);
+void quota_update_level (GstMultiSourceQuota * quota, guint64 level);
+gboolean quota_admit (GstMultiSourceQuota * quota, GstBuffer * buffer,
+    gboolean * dropping);
+GstStructure *quota_get_stats (GstMultiSourceQuota * quota);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_QUOTA_H__ */
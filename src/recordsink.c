@@ -0,0 +1,728 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-recordsink
+ *
+ * Write a recording to a file in large aligned chunks instead of one
+ * write per muxer buffer. The file is preallocated ahead of the data so
+ * that it does not fragment, the data can bypass the page cache with
+ * O_DIRECT, and it is synced to the disk on a schedule rather than on
+ * every write.
+ *
+ * With index=true, the offset and pts of every video keyframe is appended
+ * to location.idx, see keyindex.h. The stream of a keyframe is found by
+ * matching its pts with the keyframes entering the upstream muxer.
+ *
+ * gst-multisource-launch --sink "recordsink location=out.mkv direct=true" ...
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include "multisource.h"
+#include "recordsink.h"
+
+#define GST_CAT_DEFAULT multisource_launch_debug
+
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_CHUNK_SIZE,
+  PROP_PREALLOCATE,
+  PROP_DIRECT,
+  PROP_SYNC_INTERVAL,
+  PROP_INDEX,
+  PROP_WRITE_STATS,
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+/* Keyframes seen on the muxer input and not yet found in its output */
+#define RECORD_SINK_MAX_KEYFRAMES 256
+
+typedef struct
+{
+  GstClockTime pts;
+  guint32 stream;
+} Keyframe;
+
+typedef struct
+{
+  GstPad *pad;
+  gulong id;
+} MuxerProbe;
+
+G_DEFINE_TYPE (GstMultiSourceRecordSink, record_sink, GST_TYPE_BASE_SINK);
+
+static gboolean
+write_all (gint fd, const guint8 * data, gsize len, guint64 offset)
+{
+  while (len > 0) {
+    gssize res = pwrite (fd, data, len, offset);
+
+    if (res < 0 && errno == EINTR)
+      continue;
+    if (res <= 0)
+      return FALSE;
+    data += res;
+    len -= res;
+    offset += res;
+  }
+
+  return TRUE;
+}
+
+/* Reserve the blocks ahead of the data in large extents without changing
+ * the size of the file. */
+static void
+preallocate (GstMultiSourceRecordSink * self, guint64 end)
+{
+#ifdef FALLOC_FL_KEEP_SIZE
+  guint64 len;
+
+  if (!self->preallocate || end <= self->allocated)
+    return;
+
+  len = GST_ROUND_UP_N (end - self->allocated, self->preallocate);
+  if (fallocate (self->fd, FALLOC_FL_KEEP_SIZE, self->allocated, len) < 0) {
+    GST_DEBUG_OBJECT (self, "Unable to preallocate: %s", g_strerror (errno));
+    self->preallocate = 0;
+    return;
+  }
+  self->allocated += len;
+
+  GST_OBJECT_LOCK (self);
+  self->preallocations++;
+  GST_OBJECT_UNLOCK (self);
+#endif
+}
+
+/* Write the chunk, padded to the alignment when it is not full, which is
+ * only done when closing the file. */
+static gboolean
+write_chunk (GstMultiSourceRecordSink * self)
+{
+  gsize len = self->filled;
+
+  if (len == 0)
+    return TRUE;
+
+  if (self->opened_direct) {
+    len = GST_ROUND_UP_N (len, RECORD_SINK_ALIGN);
+    memset (self->chunk + self->filled, 0, len - self->filled);
+  }
+  preallocate (self, self->chunk_offset + len);
+  if (!write_all (self->fd, self->chunk, len, self->chunk_offset))
+    return FALSE;
+
+  GST_OBJECT_LOCK (self);
+  self->writes++;
+  self->bytes += self->filled;
+  GST_OBJECT_UNLOCK (self);
+
+  self->chunk_offset += self->filled;
+  self->filled = 0;
+
+  if (self->index_writer && !key_index_writer_flush (self->index_writer))
+    GST_WARNING_OBJECT (self, "Could not write the index: %s",
+        g_strerror (errno));
+
+  return TRUE;
+}
+
+/* Flush what is written to the disk, along with the chunk being filled,
+ * and, without O_DIRECT, drop it from the page cache where it would evict
+ * more useful pages. With O_DIRECT the partial chunk cannot be written at
+ * an aligned size, so it goes through the page cache and stays in the
+ * chunk to be written again once full. */
+static gboolean
+sync_file (GstMultiSourceRecordSink * self)
+{
+  gint64 start = g_get_monotonic_time ();
+  guint64 duration;
+
+  if (!self->opened_direct) {
+    if (!write_chunk (self))
+      return FALSE;
+  } else if (self->filled && !write_all (self->buffered_fd, self->chunk,
+          self->filled, self->chunk_offset)) {
+    return FALSE;
+  }
+
+  if (fdatasync (self->fd) < 0)
+    GST_WARNING_OBJECT (self, "fdatasync failed: %s", g_strerror (errno));
+#ifdef POSIX_FADV_DONTNEED
+  if (!self->opened_direct && self->chunk_offset > self->synced)
+    posix_fadvise (self->fd, self->synced, self->chunk_offset - self->synced,
+        POSIX_FADV_DONTNEED);
+#endif
+  self->synced = self->chunk_offset;
+  self->last_sync = g_get_monotonic_time ();
+  duration = self->last_sync - start;
+
+  GST_OBJECT_LOCK (self);
+  self->syncs++;
+  self->sync_time_max = MAX (self->sync_time_max, duration);
+  GST_OBJECT_UNLOCK (self);
+
+  return TRUE;
+}
+
+/* Data that does not follow the chunk, a header rewritten by the muxer
+ * for instance. What falls in the chunk is patched there, the rest goes
+ * straight to the file through the page cache. */
+static gboolean
+rewrite (GstMultiSourceRecordSink * self, const guint8 * data, gsize len)
+{
+  guint64 start = self->position, end = self->position + len;
+  guint64 chunk_end = self->chunk_offset + self->filled;
+
+  GST_OBJECT_LOCK (self);
+  self->rewrites++;
+  GST_OBJECT_UNLOCK (self);
+
+  if (start < chunk_end && end > self->chunk_offset) {
+    guint64 from = MAX (start, self->chunk_offset);
+    guint64 to = MIN (end, chunk_end);
+
+    memcpy (self->chunk + (from - self->chunk_offset), data + (from - start),
+        to - from);
+  }
+  if (start < self->chunk_offset && !write_all (self->buffered_fd, data,
+          MIN (end, self->chunk_offset) - start, start))
+    return FALSE;
+  if (end > chunk_end && !write_all (self->buffered_fd,
+          data + (MAX (start, chunk_end) - start),
+          end - MAX (start, chunk_end), MAX (start, chunk_end)))
+    return FALSE;
+
+  self->position = end;
+  self->size = MAX (self->size, end);
+
+  return TRUE;
+}
+
+/* The muxer sink pads are named after their stream, sink_0, video_1... */
+static guint32
+get_stream_id (GstPad * pad)
+{
+  const gchar *name = GST_PAD_NAME (pad);
+  const gchar *sep = strrchr (name, '_');
+
+  return sep ? (guint32) g_ascii_strtoull (sep + 1, NULL, 10) : 0;
+}
+
+static GstPadProbeReturn
+muxer_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstMultiSourceRecordSink *self = user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  GstCaps *caps;
+  Keyframe *keyframe;
+  gboolean video;
+
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)
+      || !GST_BUFFER_PTS_IS_VALID (buffer))
+    return GST_PAD_PROBE_OK;
+
+  /* Every audio buffer is a keyframe, seeking only needs the video ones */
+  caps = gst_pad_get_current_caps (pad);
+  video = caps && (g_str_has_prefix (gst_structure_get_name
+          (gst_caps_get_structure (caps, 0)), "video/")
+      || g_str_has_prefix (gst_structure_get_name
+          (gst_caps_get_structure (caps, 0)), "image/"));
+  if (caps)
+    gst_caps_unref (caps);
+  if (!video)
+    return GST_PAD_PROBE_OK;
+
+  keyframe = g_new (Keyframe, 1);
+  keyframe->pts = GST_BUFFER_PTS (buffer);
+  keyframe->stream = get_stream_id (pad);
+
+  GST_OBJECT_LOCK (self);
+  g_queue_push_tail (&self->keyframes, keyframe);
+  if (g_queue_get_length (&self->keyframes) > RECORD_SINK_MAX_KEYFRAMES)
+    g_free (g_queue_pop_head (&self->keyframes));
+  GST_OBJECT_UNLOCK (self);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+watch_muxer_pad (GstMultiSourceRecordSink * self, GstPad * pad)
+{
+  MuxerProbe probe;
+
+  if (GST_PAD_DIRECTION (pad) != GST_PAD_SINK)
+    return;
+
+  probe.pad = gst_object_ref (pad);
+  probe.id = gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, muxer_probe,
+      gst_object_ref (self), gst_object_unref);
+  g_array_append_val (self->muxer_probes, probe);
+}
+
+static void
+muxer_pad_added (GstElement * muxer, GstPad * pad, gpointer user_data)
+{
+  GstMultiSourceRecordSink *self = user_data;
+
+  GST_OBJECT_LOCK (self);
+  watch_muxer_pad (self, pad);
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+watch_muxer_foreach (const GValue * value, gpointer user_data)
+{
+  watch_muxer_pad (user_data, g_value_get_object (value));
+}
+
+/* Follow the keyframes entering the element upstream, usually the muxer,
+ * to know the stream of the keyframes it outputs. */
+static void
+watch_muxer (GstMultiSourceRecordSink * self)
+{
+  GstPad *peer = gst_pad_get_peer (GST_BASE_SINK_PAD (self));
+  GstIterator *it;
+
+  if (!peer)
+    return;
+  self->muxer = gst_pad_get_parent_element (peer);
+  gst_object_unref (peer);
+  if (!self->muxer)
+    return;
+
+  GST_OBJECT_LOCK (self);
+  it = gst_element_iterate_sink_pads (self->muxer);
+  while (gst_iterator_foreach (it, watch_muxer_foreach, self) ==
+      GST_ITERATOR_RESYNC)
+    gst_iterator_resync (it);
+  gst_iterator_free (it);
+  GST_OBJECT_UNLOCK (self);
+  g_signal_connect (self->muxer, "pad-added", G_CALLBACK (muxer_pad_added),
+      self);
+}
+
+static void
+unwatch_muxer (GstMultiSourceRecordSink * self)
+{
+  guint i;
+
+  if (self->muxer) {
+    g_signal_handlers_disconnect_by_data (self->muxer, self);
+    gst_clear_object (&self->muxer);
+  }
+  for (i = 0; i < self->muxer_probes->len; i++) {
+    MuxerProbe *probe = &g_array_index (self->muxer_probes, MuxerProbe, i);
+
+    gst_pad_remove_probe (probe->pad, probe->id);
+    gst_object_unref (probe->pad);
+  }
+  g_array_set_size (self->muxer_probes, 0);
+  g_queue_clear_full (&self->keyframes, g_free);
+}
+
+/* Index a keyframe of the muxer output. Without a muxer every keyframe is
+ * indexed as stream 0, otherwise only those matching a video keyframe of
+ * its input. */
+static void
+index_buffer (GstMultiSourceRecordSink * self, GstBuffer * buffer)
+{
+  GstClockTime pts = GST_BUFFER_PTS (buffer);
+  guint32 stream = 0;
+  gboolean found;
+  GList *l;
+
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)
+      || GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_HEADER)
+      || !GST_CLOCK_TIME_IS_VALID (pts))
+    return;
+
+  GST_OBJECT_LOCK (self);
+  found = self->muxer_probes->len == 0;
+  for (l = self->keyframes.head; l && !found; l = l->next) {
+    Keyframe *keyframe = l->data;
+
+    found = keyframe->pts == pts;
+    if (found)
+      stream = keyframe->stream;
+  }
+  /* drop it with the keyframes before, which were not output as such */
+  while (found && l != self->keyframes.head)
+    g_free (g_queue_pop_head (&self->keyframes));
+  GST_OBJECT_UNLOCK (self);
+
+  if (found)
+    key_index_writer_add (self->index_writer, self->position, pts, stream);
+}
+
+static GstFlowReturn
+record_sink_render (GstBaseSink * sink, GstBuffer * buffer)
+{
+  GstMultiSourceRecordSink *self = GST_MULTI_SOURCE_RECORD_SINK (sink);
+  GstMapInfo map;
+  gsize pos = 0;
+  gboolean ok = TRUE;
+  gint err;
+
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ))
+    return GST_FLOW_ERROR;
+
+  if (self->index_writer)
+    index_buffer (self, buffer);
+
+  if (self->position != self->chunk_offset + self->filled) {
+    ok = rewrite (self, map.data, map.size);
+  } else {
+    while (ok && pos < map.size) {
+      gsize len = MIN (map.size - pos, self->chunk_size - self->filled);
+
+      memcpy (self->chunk + self->filled, map.data + pos, len);
+      self->filled += len;
+      pos += len;
+      if (self->filled == self->chunk_size)
+        ok = write_chunk (self);
+    }
+    self->position = self->chunk_offset + self->filled;
+    self->size = MAX (self->size, self->position);
+  }
+  err = errno;
+  gst_buffer_unmap (buffer, &map);
+
+  if (ok && self->sync_interval && g_get_monotonic_time () - self->last_sync >
+      GST_TIME_AS_USECONDS (self->sync_interval)) {
+    ok = sync_file (self);
+    err = errno;
+  }
+
+  if (!ok) {
+    GST_ELEMENT_ERROR (self, RESOURCE, WRITE, (NULL),
+        ("Error while writing to file \"%s\": %s", self->location,
+            g_strerror (err)));
+    return GST_FLOW_ERROR;
+  }
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+record_sink_event (GstBaseSink * sink, GstEvent * event)
+{
+  GstMultiSourceRecordSink *self = GST_MULTI_SOURCE_RECORD_SINK (sink);
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT) {
+    const GstSegment *segment;
+
+    gst_event_parse_segment (event, &segment);
+    if (segment->format == GST_FORMAT_BYTES)
+      self->position = segment->start;
+  }
+
+  return GST_BASE_SINK_CLASS (record_sink_parent_class)->event (sink, event);
+}
+
+static gboolean
+record_sink_start (GstBaseSink * sink)
+{
+  GstMultiSourceRecordSink *self = GST_MULTI_SOURCE_RECORD_SINK (sink);
+  gint flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+  if (!self->location) {
+    GST_ELEMENT_ERROR (self, RESOURCE, NOT_FOUND,
+        ("No file name specified for writing."), (NULL));
+    return FALSE;
+  }
+
+  self->fd = -1;
+  self->opened_direct = FALSE;
+#ifdef O_DIRECT
+  if (self->direct) {
+    self->fd = g_open (self->location, flags | O_DIRECT, 0644);
+    if (self->fd < 0)
+      GST_WARNING_OBJECT (self, "O_DIRECT not supported for \"%s\": %s",
+          self->location, g_strerror (errno));
+    self->opened_direct = self->fd >= 0;
+  }
+#endif
+  if (self->fd < 0)
+    self->fd = g_open (self->location, flags, 0644);
+  if (self->fd >= 0)
+    self->buffered_fd = self->opened_direct ?
+        g_open (self->location, O_WRONLY | O_CLOEXEC, 0) : dup (self->fd);
+  if (self->fd < 0 || self->buffered_fd < 0) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_WRITE,
+        ("Could not open file \"%s\" for writing.", self->location),
+        GST_ERROR_SYSTEM);
+    if (self->fd >= 0)
+      close (self->fd);
+    self->fd = -1;
+    return FALSE;
+  }
+
+  self->chunk_size = GST_ROUND_UP_N (self->chunk_size, RECORD_SINK_ALIGN);
+  if (posix_memalign ((void **) &self->chunk, RECORD_SINK_ALIGN,
+          self->chunk_size) != 0) {
+    self->chunk = NULL;
+    GST_ELEMENT_ERROR (self, RESOURCE, NO_SPACE_LEFT, (NULL),
+        ("Could not allocate a %u bytes chunk", self->chunk_size));
+    return FALSE;
+  }
+  self->filled = 0;
+  self->chunk_offset = self->position = self->size = 0;
+  self->allocated = self->synced = 0;
+  self->last_sync = g_get_monotonic_time ();
+
+  if (self->index) {
+    gchar *location = g_strconcat (self->location, KEY_INDEX_SUFFIX, NULL);
+    GError *error = NULL;
+
+    self->index_writer = key_index_writer_new (location, &error);
+    g_free (location);
+    if (!self->index_writer) {
+      GST_ELEMENT_WARNING (self, RESOURCE, OPEN_WRITE, (NULL),
+          ("%s", error->message));
+      g_error_free (error);
+    } else {
+      watch_muxer (self);
+    }
+  }
+
+  return TRUE;
+}
+
+/* Write what is left, sync and give back the blocks preallocated past the
+ * end of the recording. */
+static gboolean
+record_sink_stop (GstBaseSink * sink)
+{
+  GstMultiSourceRecordSink *self = GST_MULTI_SOURCE_RECORD_SINK (sink);
+
+  if (self->fd >= 0) {
+    if (!write_chunk (self))
+      GST_WARNING_OBJECT (self, "Could not write the end of \"%s\": %s",
+          self->location, g_strerror (errno));
+    if (!sync_file (self))
+      GST_WARNING_OBJECT (self, "Could not sync \"%s\": %s",
+          self->location, g_strerror (errno));
+    if (ftruncate (self->fd, self->size) < 0)
+      GST_WARNING_OBJECT (self, "Could not truncate \"%s\": %s",
+          self->location, g_strerror (errno));
+    close (self->fd);
+    self->fd = -1;
+  }
+  if (self->buffered_fd >= 0) {
+    close (self->buffered_fd);
+    self->buffered_fd = -1;
+  }
+  free (self->chunk);
+  self->chunk = NULL;
+
+  if (self->index_writer) {
+    GstMultiSourceKeyIndexWriter *writer = self->index_writer;
+
+    unwatch_muxer (self);
+    GST_OBJECT_LOCK (self);
+    self->index_writer = NULL;
+    GST_OBJECT_UNLOCK (self);
+    key_index_writer_free (writer);
+  }
+
+  return TRUE;
+}
+
+static GstStructure *
+get_stats (GstMultiSourceRecordSink * self)
+{
+  GstStructure *s;
+
+  GST_OBJECT_LOCK (self);
+  s = gst_structure_new ("recordsink",
+      "bytes", G_TYPE_UINT64, self->bytes,
+      "writes", G_TYPE_UINT64, self->writes,
+      "rewrites", G_TYPE_UINT64, self->rewrites,
+      "syncs", G_TYPE_UINT64, self->syncs,
+      "sync-time-max", G_TYPE_UINT64, self->sync_time_max,
+      "preallocations", G_TYPE_UINT64, self->preallocations,
+      "index-entries", G_TYPE_UINT64, self->index_writer ?
+      key_index_writer_get_entries (self->index_writer) : 0,
+      "direct", G_TYPE_BOOLEAN, self->opened_direct, NULL);
+  GST_OBJECT_UNLOCK (self);
+
+  return s;
+}
+
+static void
+record_sink_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMultiSourceRecordSink *self = GST_MULTI_SOURCE_RECORD_SINK (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_free (self->location);
+      self->location = g_value_dup_string (value);
+      break;
+    case PROP_CHUNK_SIZE:
+      self->chunk_size = g_value_get_uint (value);
+      break;
+    case PROP_PREALLOCATE:
+      self->preallocate = g_value_get_uint64 (value);
+      break;
+    case PROP_DIRECT:
+      self->direct = g_value_get_boolean (value);
+      break;
+    case PROP_SYNC_INTERVAL:
+      self->sync_interval = g_value_get_uint64 (value);
+      break;
+    case PROP_INDEX:
+      self->index = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+record_sink_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstMultiSourceRecordSink *self = GST_MULTI_SOURCE_RECORD_SINK (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_value_set_string (value, self->location);
+      break;
+    case PROP_CHUNK_SIZE:
+      g_value_set_uint (value, self->chunk_size);
+      break;
+    case PROP_PREALLOCATE:
+      g_value_set_uint64 (value, self->preallocate);
+      break;
+    case PROP_DIRECT:
+      g_value_set_boolean (value, self->direct);
+      break;
+    case PROP_SYNC_INTERVAL:
+      g_value_set_uint64 (value, self->sync_interval);
+      break;
+    case PROP_INDEX:
+      g_value_set_boolean (value, self->index);
+      break;
+    case PROP_WRITE_STATS:
+      g_value_take_boxed (value, get_stats (self));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+record_sink_finalize (GObject * object)
+{
+  GstMultiSourceRecordSink *self = GST_MULTI_SOURCE_RECORD_SINK (object);
+
+  g_free (self->location);
+  g_array_free (self->muxer_probes, TRUE);
+
+  G_OBJECT_CLASS (record_sink_parent_class)->finalize (object);
+}
+
+static void
+record_sink_class_init (GstMultiSourceRecordSinkClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSinkClass *basesink_class = GST_BASE_SINK_CLASS (klass);
+
+  gobject_class->set_property = record_sink_set_property;
+  gobject_class->get_property = record_sink_get_property;
+  gobject_class->finalize = record_sink_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_LOCATION,
+      g_param_spec_string ("location", "File Location",
+          "Location of the file to write", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_CHUNK_SIZE,
+      g_param_spec_uint ("chunk-size", "Chunk size",
+          "Size of each write in bytes, rounded up to 4096",
+          RECORD_SINK_ALIGN, G_MAXINT, RECORD_SINK_DEFAULT_CHUNK_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PREALLOCATE,
+      g_param_spec_uint64 ("preallocate", "Preallocate",
+          "Bytes reserved at once ahead of the data, 0 to disable", 0,
+          G_MAXUINT64, RECORD_SINK_DEFAULT_PREALLOCATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_DIRECT,
+      g_param_spec_boolean ("direct", "Direct",
+          "Bypass the page cache with O_DIRECT", FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_SYNC_INTERVAL,
+      g_param_spec_uint64 ("sync-interval", "Sync interval",
+          "Time between two fdatasync, 0 to only sync when closing", 0,
+          G_MAXUINT64, RECORD_SINK_DEFAULT_SYNC_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_INDEX,
+      g_param_spec_boolean ("index", "Index",
+          "Write the keyframes offsets to location.idx", FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_WRITE_STATS,
+      g_param_spec_boxed ("write-stats", "Write statistics",
+          "Bytes, writes, rewrites, syncs and preallocations",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &sink_template);
+  gst_element_class_set_static_metadata (element_class,
+      "Recording File Sink", "Sink/File",
+      "Write data to a file in large preallocated chunks",
+      "gst-multisource-launch");
+
+  basesink_class->start = record_sink_start;
+  basesink_class->stop = record_sink_stop;
+  basesink_class->render = record_sink_render;
+  basesink_class->event = record_sink_event;
+}
+
+static void
+record_sink_init (GstMultiSourceRecordSink * self)
+{
+  self->fd = -1;
+  self->buffered_fd = -1;
+  self->chunk_size = RECORD_SINK_DEFAULT_CHUNK_SIZE;
+  self->preallocate = RECORD_SINK_DEFAULT_PREALLOCATE;
+  self->sync_interval = RECORD_SINK_DEFAULT_SYNC_INTERVAL;
+  self->muxer_probes = g_array_new (FALSE, FALSE, sizeof (MuxerProbe));
+  g_queue_init (&self->keyframes);
+  gst_base_sink_set_sync (GST_BASE_SINK (self), FALSE);
+}
@@ -0,0 +1,94 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_RECORD_SINK_H__
+#define __GST_MULTI_SOURCE_RECORD_SINK_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+
+#include "keyindex.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MULTI_SOURCE_RECORD_SINK (record_sink_get_type ())
+#define GST_MULTI_SOURCE_RECORD_SINK(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+    GST_TYPE_MULTI_SOURCE_RECORD_SINK, GstMultiSourceRecordSink))
+
+/* Offsets and sizes of O_DIRECT writes are multiples of this */
+#define RECORD_SINK_ALIGN 4096
+#define RECORD_SINK_DEFAULT_CHUNK_SIZE (4 * 1024 * 1024)
+#define RECORD_SINK_DEFAULT_PREALLOCATE (256 * 1024 * 1024)
+#define RECORD_SINK_DEFAULT_SYNC_INTERVAL (5 * GST_SECOND)
+
+typedef struct _GstMultiSourceRecordSink
+{
+  GstBaseSink parent;
+
+  /* properties */
+  gchar *location;
+  guint chunk_size;
+  guint64 preallocate;
+  gboolean direct;
+  GstClockTime sync_interval;
+  gboolean index;
+
+  /* fd writes the chunks, O_DIRECT when opened_direct; buffered_fd the
+   * rest */
+  gint fd;
+  gboolean opened_direct;
+  gint buffered_fd;
+  guint8 *chunk;
+  gsize filled;
+  /* file offset of the chunk, always aligned with O_DIRECT */
+  guint64 chunk_offset;
+  /* where the next data goes when it is not appended */
+  guint64 position;
+  guint64 size;
+  guint64 allocated;
+  guint64 synced;
+  gint64 last_sync;
+
+  /* keyframe index, location.idx */
+  GstMultiSourceKeyIndexWriter *index_writer;
+  GstElement *muxer;
+  GArray *muxer_probes;
+  /* keyframes entering the muxer, protected by the object lock */
+  GQueue keyframes;
+
+  /* statistics, protected by the object lock */
+  guint64 bytes;
+  guint64 writes;
+  guint64 rewrites;
+  guint64 syncs;
+  guint64 sync_time_max;
+  guint64 preallocations;
+} GstMultiSourceRecordSink;
+
+typedef struct _GstMultiSourceRecordSinkClass
+{
+  GstBaseSinkClass parent_class;
+} GstMultiSourceRecordSinkClass;
+
+GType record_sink_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_RECORD_SINK_H__ */
@@ -0,0 +1,475 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <string.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "multisource.h"
+#include "keyindex.h"
+#include "retention.h"
+
+#define GST_CAT_DEFAULT multisource_launch_debug
+
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
+
+typedef struct
+{
+  gchar *name;
+  guint64 size;
+  /* still being written, not in the queue of the files to delete */
+  gboolean active;
+  GList *link;
+} RetentionFile;
+
+typedef struct
+{
+  gchar *path;
+  guint64 budget;
+  gint wd;
+  /* name to RetentionFile, and the closed files, oldest first */
+  GHashTable *files;
+  GQueue closed;
+  gboolean cleaning;
+
+  /* protected by the retention lock */
+  guint64 bytes;
+  guint64 deleted;
+  guint64 truncated;
+  guint64 freed;
+} RetentionDir;
+
+struct _GstMultiSourceRetention
+{
+  GMutex lock;
+  GPtrArray *dirs;
+  guint rate;
+  gint fd;
+  GThread *thread;
+  gint running;
+};
+
+static void
+file_free (RetentionFile * file)
+{
+  g_free (file->name);
+  g_free (file);
+}
+
+static void
+dir_free (RetentionDir * dir)
+{
+  g_hash_table_destroy (dir->files);
+  g_queue_clear (&dir->closed);
+  g_free (dir->path);
+  g_free (dir);
+}
+
+#ifdef __linux__
+static gboolean
+stat_file (RetentionDir * dir, const gchar * name, guint64 * size)
+{
+  gchar *path = g_build_filename (dir->path, name, NULL);
+  struct stat st;
+  gboolean res;
+
+  res = stat (path, &st) == 0 && S_ISREG (st.st_mode);
+  if (res)
+    *size = st.st_blocks * 512;
+  g_free (path);
+
+  return res;
+}
+
+static void
+remove_file (RetentionDir * dir, const gchar * name)
+{
+  RetentionFile *file = g_hash_table_lookup (dir->files, name);
+
+  if (!file)
+    return;
+  if (file->link)
+    g_queue_delete_link (&dir->closed, file->link);
+  dir->bytes -= file->size;
+  g_hash_table_remove (dir->files, name);
+}
+
+/* A file written or moved in the directory, closed files go at the end of
+ * the queue of those to delete. */
+static void
+update_file (RetentionDir * dir, const gchar * name, gboolean active)
+{
+  RetentionFile *file = g_hash_table_lookup (dir->files, name);
+  guint64 size;
+
+  if (!stat_file (dir, name, &size)) {
+    remove_file (dir, name);
+    return;
+  }
+  if (!file) {
+    file = g_new0 (RetentionFile, 1);
+    file->name = g_strdup (name);
+    g_hash_table_insert (dir->files, file->name, file);
+  }
+  if (file->link) {
+    g_queue_delete_link (&dir->closed, file->link);
+    file->link = NULL;
+  }
+  dir->bytes += size - file->size;
+  file->size = size;
+  file->active = active;
+  if (!active) {
+    g_queue_push_tail (&dir->closed, file);
+    file->link = dir->closed.tail;
+  }
+}
+
+static gint
+compare_mtime (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  GHashTable *mtimes = user_data;
+  gint64 ta = *(gint64 *) g_hash_table_lookup (mtimes, a);
+  gint64 tb = *(gint64 *) g_hash_table_lookup (mtimes, b);
+
+  return ta < tb ? -1 : ta > tb;
+}
+
+/* The only time the directory is listed, afterwards inotify tells what
+ * changed. */
+static void
+scan_dir (RetentionDir * dir)
+{
+  GDir *gdir = g_dir_open (dir->path, 0, NULL);
+  GHashTable *mtimes = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+      g_free);
+  GList *names = NULL, *l;
+  const gchar *name;
+
+  if (!gdir)
+    return;
+
+  while ((name = g_dir_read_name (gdir))) {
+    gchar *path = g_build_filename (dir->path, name, NULL);
+    struct stat st;
+
+    if (stat (path, &st) == 0 && S_ISREG (st.st_mode)) {
+      gint64 *mtime = g_new (gint64, 1);
+
+      *mtime = st.st_mtime;
+      names = g_list_prepend (names, g_strdup (name));
+      g_hash_table_insert (mtimes, names->data, mtime);
+    }
+    g_free (path);
+  }
+  g_dir_close (gdir);
+
+  names = g_list_sort_with_data (names, compare_mtime, mtimes);
+  for (l = names; l; l = l->next)
+    update_file (dir, l->data, FALSE);
+  g_hash_table_destroy (mtimes);
+  g_list_free_full (names, g_free);
+}
+
+static RetentionDir *
+find_dir (GstMultiSourceRetention * retention, gint wd)
+{
+  guint i;
+
+  for (i = 0; i < retention->dirs->len; i++) {
+    RetentionDir *dir = g_ptr_array_index (retention->dirs, i);
+
+    if (dir->wd == wd)
+      return dir;
+  }
+
+  return NULL;
+}
+
+static void
+read_events (GstMultiSourceRetention * retention)
+{
+  gchar buf[4096]
+      __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+  gssize len;
+
+  while ((len = read (retention->fd, buf, sizeof (buf))) > 0) {
+    gchar *ptr;
+
+    g_mutex_lock (&retention->lock);
+    for (ptr = buf; ptr < buf + len;) {
+      struct inotify_event *event = (struct inotify_event *) ptr;
+      RetentionDir *dir = find_dir (retention, event->wd);
+
+      ptr += sizeof (struct inotify_event) + event->len;
+      if (!dir || !event->len)
+        continue;
+      if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+        remove_file (dir, event->name);
+      else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+        update_file (dir, event->name, FALSE);
+      else if (event->mask & IN_CREATE)
+        update_file (dir, event->name, TRUE);
+    }
+    g_mutex_unlock (&retention->lock);
+  }
+}
+
+/* The files being written grow without event, their size is refreshed on
+ * every tick. */
+static gboolean
+refresh_active (gpointer key, gpointer value, gpointer user_data)
+{
+  RetentionDir *dir = user_data;
+  RetentionFile *file = value;
+  guint64 size;
+
+  if (!file->active)
+    return FALSE;
+  if (!stat_file (dir, file->name, &size)) {
+    dir->bytes -= file->size;
+    return TRUE;
+  }
+  dir->bytes += size - file->size;
+  file->size = size;
+
+  return FALSE;
+}
+
+/* Free some space in the directory: one truncation of the oldest file, or
+ * its removal once it is small enough. Returns FALSE when within budget. */
+static gboolean
+clean_dir (RetentionDir * dir)
+{
+  RetentionFile *file;
+  gchar *path;
+  guint64 freed;
+
+  if (dir->bytes > dir->budget)
+    dir->cleaning = TRUE;
+  else if (dir->bytes <= dir->budget / 100 * RETENTION_LOW_WATERMARK)
+    dir->cleaning = FALSE;
+  if (!dir->cleaning || !(file = g_queue_peek_head (&dir->closed)))
+    return FALSE;
+
+  path = g_build_filename (dir->path, file->name, NULL);
+  if (file->size > RETENTION_TRUNCATE_STEP) {
+    freed = RETENTION_TRUNCATE_STEP;
+    if (truncate (path, file->size - freed) < 0) {
+      GST_WARNING ("Unable to truncate %s: %s", path, g_strerror (errno));
+      freed = file->size;
+      unlink (path);
+    } else {
+      dir->truncated++;
+    }
+  } else {
+    freed = file->size;
+    if (unlink (path) < 0 && errno != ENOENT)
+      GST_WARNING ("Unable to delete %s: %s", path, g_strerror (errno));
+    dir->deleted++;
+    GST_DEBUG ("Deleted %s to stay within %" G_GUINT64_FORMAT " bytes", path,
+        dir->budget);
+  }
+  g_free (path);
+
+  dir->freed += freed;
+  if (freed == file->size) {
+    gchar *index = g_strconcat (file->name, KEY_INDEX_SUFFIX, NULL);
+    RetentionFile *sidecar = g_hash_table_lookup (dir->files, index);
+
+    /* The keyframe index of a recording goes with it */
+    if (sidecar) {
+      path = g_build_filename (dir->path, index, NULL);
+      if (unlink (path) < 0 && errno != ENOENT)
+        GST_WARNING ("Unable to delete %s: %s", path, g_strerror (errno));
+      g_free (path);
+      dir->freed += sidecar->size;
+      remove_file (dir, index);
+    }
+    g_free (index);
+    remove_file (dir, file->name);
+  } else {
+    file->size -= freed;
+    dir->bytes -= freed;
+  }
+
+  return TRUE;
+}
+
+/* Runs in the idle I/O class and at the lowest CPU priority, so that the
+ * recordings always come first. The ticks are paced on the clock, inotify
+ * events waking the thread in between do not let it act more often. */
+static gpointer
+retention_thread (gpointer user_data)
+{
+  GstMultiSourceRetention *retention = user_data;
+  pid_t tid = syscall (SYS_gettid);
+  gint64 interval = G_USEC_PER_SEC / retention->rate;
+  gint64 next_tick = g_get_monotonic_time () + interval;
+  guint i;
+
+#ifdef SYS_ioprio_set
+  if (syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid,
+          IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) < 0)
+    GST_DEBUG ("Unable to set the idle I/O class: %s", g_strerror (errno));
+#endif
+  setpriority (PRIO_PROCESS, tid, 19);
+
+  g_mutex_lock (&retention->lock);
+  for (i = 0; i < retention->dirs->len; i++)
+    scan_dir (g_ptr_array_index (retention->dirs, i));
+  g_mutex_unlock (&retention->lock);
+
+  while (g_atomic_int_get (&retention->running)) {
+    struct pollfd pfd = { retention->fd, POLLIN, 0 };
+    gboolean acted = FALSE;
+    gint64 now = g_get_monotonic_time ();
+
+    if (now < next_tick) {
+      /* rounded up, so that waking up early does not spin */
+      if (poll (&pfd, 1, (next_tick - now + 999) / 1000) > 0)
+        read_events (retention);
+      continue;
+    }
+    next_tick = now + interval;
+    read_events (retention);
+
+    /* At most one truncation or unlink per tick over all directories */
+    g_mutex_lock (&retention->lock);
+    for (i = 0; i < retention->dirs->len; i++) {
+      RetentionDir *dir = g_ptr_array_index (retention->dirs, i);
+
+      g_hash_table_foreach_remove (dir->files, refresh_active, dir);
+      if (!acted)
+        acted = clean_dir (dir);
+    }
+    g_mutex_unlock (&retention->lock);
+  }
+
+  return NULL;
+}
+#endif
+
+/* Each spec is DIR:MB, the budget of a directory. rate is the number of
+ * truncations or unlinks done per second at most. */
+GstMultiSourceRetention *
+retention_new (gchar ** specs, guint rate)
+{
+#ifdef __linux__
+  GstMultiSourceRetention *retention;
+  gchar **spec;
+
+  retention = g_new0 (GstMultiSourceRetention, 1);
+  g_mutex_init (&retention->lock);
+  retention->dirs = g_ptr_array_new_with_free_func ((GDestroyNotify) dir_free);
+  retention->rate = CLAMP (rate, 1, G_USEC_PER_SEC);
+  retention->fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+  if (retention->fd < 0) {
+    GST_WARNING ("Unable to watch the output directories: %s",
+        g_strerror (errno));
+    goto error;
+  }
+
+  for (spec = specs; *spec; spec++) {
+    gchar *sep = strrchr (*spec, ':');
+    RetentionDir *dir;
+
+    if (!sep || sep == *spec) {
+      GST_WARNING ("Invalid retention %s, expecting DIR:MB", *spec);
+      goto error;
+    }
+    dir = g_new0 (RetentionDir, 1);
+    dir->path = g_strndup (*spec, sep - *spec);
+    dir->budget = g_ascii_strtoull (sep + 1, NULL, 10) << 20;
+    dir->files = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+        (GDestroyNotify) file_free);
+    g_queue_init (&dir->closed);
+    g_ptr_array_add (retention->dirs, dir);
+    dir->wd = inotify_add_watch (retention->fd, dir->path, IN_CREATE |
+        IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE);
+    if (dir->wd < 0) {
+      GST_WARNING ("Unable to watch %s: %s", dir->path, g_strerror (errno));
+      goto error;
+    }
+  }
+
+  retention->running = TRUE;
+  retention->thread = g_thread_new ("retention", retention_thread, retention);
+
+  return retention;
+
+error:
+  retention_free (retention);
+#endif
+  return NULL;
+}
+
+void
+retention_free (GstMultiSourceRetention * retention)
+{
+  if (retention->thread) {
+    g_atomic_int_set (&retention->running, FALSE);
+    g_thread_join (retention->thread);
+  }
+#ifdef __linux__
+  if (retention->fd >= 0)
+    close (retention->fd);
+#endif
+  g_ptr_array_free (retention->dirs, TRUE);
+  g_mutex_clear (&retention->lock);
+  g_free (retention);
+}
+
+GstStructure *
+retention_get_stats (GstMultiSourceRetention * retention)
+{
+  GstStructure *s = gst_structure_new ("retention",
+      "rate", G_TYPE_UINT, retention->rate, NULL);
+  guint i;
+
+  g_mutex_lock (&retention->lock);
+  for (i = 0; i < retention->dirs->len; i++) {
+    RetentionDir *dir = g_ptr_array_index (retention->dirs, i);
+    gchar *name = g_strdup_printf ("dir%u", i);
+    GstStructure *d = gst_structure_new (name,
+        "path", G_TYPE_STRING, dir->path,
+        "budget", G_TYPE_UINT64, dir->budget,
+        "bytes", G_TYPE_UINT64, dir->bytes,
+        "files", G_TYPE_UINT, g_hash_table_size (dir->files),
+        "deleted", G_TYPE_UINT64, dir->deleted,
+        "truncated", G_TYPE_UINT64, dir->truncated,
+        "freed", G_TYPE_UINT64, dir->freed, NULL);
+
+    gst_structure_set (s, name, GST_TYPE_STRUCTURE, d, NULL);
+    gst_structure_free (d);
+    g_free (name);
+  }
+  g_mutex_unlock (&retention->lock);
+
+  return s;
+}
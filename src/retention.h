@@ -0,0 +1,42 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_RETENTION_H__
+#define __GST_MULTI_SOURCE_RETENTION_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Once over its budget, a directory is cleaned down to this percentage */
+#define RETENTION_LOW_WATERMARK 90
+/* Files are truncated by this much at a time before being unlinked */
+#define RETENTION_TRUNCATE_STEP (256 * 1024 * 1024)
+#define RETENTION_DEFAULT_RATE 4
+
+typedef struct _GstMultiSourceRetention GstMultiSourceRetention;
+
+GstMultiSourceRetention *retention_new (gchar ** specs, guint rate);
+void retention_free (GstMultiSourceRetention * retention);
+GstStructure *retention_get_stats (GstMultiSourceRetention * retention);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_RETENTION_H__ */
@@ -0,0 +1,121 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "rotation.h"
+
+/* Let the next member in, then pause the one decoded for the longest time.
+ * A member entering the window resumes from its cached GOP when there is
+ * one, or else from its next keyframe. */
+static void
+rotation_advance (GstMultiSourceRotation * rotation)
+{
+  GstMultiSourceBranch *branch =
+      g_ptr_array_index (rotation->members, rotation->next);
+
+  gate_request (&branch->gate, GATE_OWNER_ROTATION, GATE_LEVEL_FULL);
+  g_queue_push_tail (&rotation->active, branch);
+
+  if (++rotation->next == rotation->members->len) {
+    rotation->next = 0;
+    rotation->cycles++;
+  }
+
+  if (g_queue_get_length (&rotation->active) > rotation->window) {
+    branch = g_queue_pop_head (&rotation->active);
+    gate_request (&branch->gate, GATE_OWNER_ROTATION, GATE_LEVEL_PAUSED);
+    rotation->swaps++;
+  }
+}
+
+static gboolean
+rotation_tick (gpointer user_data)
+{
+  rotation_advance (user_data);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* Only decode window background branches at once. The window slides one
+ * branch at a time so that each one is decoded for dwell every cycle. The
+ * frames of a paused member turn into GAP events on its muxer pad, so a
+ * muxer collecting all its pads such as multipartmux does not wait for
+ * it.
+ * Returns NULL when there are not more background branches than that. */
+GstMultiSourceRotation *
+rotation_new (GPtrArray * branches, guint window, GstClockTime dwell)
+{
+  GstMultiSourceRotation *rotation;
+  GPtrArray *members = g_ptr_array_new ();
+  guint i;
+
+  for (i = 0; i < branches->len; i++) {
+    GstMultiSourceBranch *branch = g_ptr_array_index (branches, i);
+
+    if (branch->priority == BRANCH_PRIORITY_BACKGROUND)
+      g_ptr_array_add (members, branch);
+  }
+  if (window == 0 || members->len <= window) {
+    g_ptr_array_free (members, TRUE);
+    return NULL;
+  }
+
+  rotation = g_new0 (GstMultiSourceRotation, 1);
+  rotation->members = members;
+  rotation->window = window;
+  rotation->dwell = dwell;
+  g_queue_init (&rotation->active);
+
+  for (i = 0; i < members->len; i++)
+    gate_request (&((GstMultiSourceBranch *)
+            g_ptr_array_index (members, i))->gate, GATE_OWNER_ROTATION,
+        GATE_LEVEL_PAUSED);
+  for (i = 0; i < window; i++)
+    rotation_advance (rotation);
+
+  rotation->source_id =
+      g_timeout_add (MAX (1, GST_TIME_AS_MSECONDS (dwell) / window),
+      rotation_tick, rotation);
+
+  return rotation;
+}
+
+void
+rotation_free (GstMultiSourceRotation * rotation)
+{
+  if (rotation->source_id)
+    g_source_remove (rotation->source_id);
+  g_queue_clear (&rotation->active);
+  g_ptr_array_free (rotation->members, TRUE);
+  g_free (rotation);
+}
+
+GstStructure *
+rotation_get_stats (GstMultiSourceRotation * rotation)
+{
+  return gst_structure_new ("rotation",
+      "members", G_TYPE_UINT, rotation->members->len,
+      "window", G_TYPE_UINT, rotation->window,
+      "dwell", G_TYPE_UINT64, rotation->dwell,
+      "cycle", G_TYPE_UINT64, rotation->dwell * rotation->members->len /
+      rotation->window,
+      "next", G_TYPE_UINT, rotation->next,
+      "swaps", G_TYPE_UINT64, rotation->swaps,
+      "cycles", G_TYPE_UINT64, rotation->cycles, NULL);
+}
@@ -0,0 +1,56 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_ROTATION_H__
+#define __GST_MULTI_SOURCE_ROTATION_H__
+
+#include <gst/gst.h>
+
+#include "branch.h"
+
+G_BEGIN_DECLS
+
+#define ROTATION_DEFAULT_DWELL (2 * GST_SECOND)
+
+typedef struct _GstMultiSourceRotation
+{
+  /* the background branches, decoded in turn */
+  GPtrArray *members;
+  guint window;
+  GstClockTime dwell;
+  guint source_id;
+
+  /* index of the next member to enter the window */
+  guint next;
+  /* members being decoded, oldest first */
+  GQueue active;
+
+  guint64 swaps;
+  guint64 cycles;
+} GstMultiSourceRotation;
+
+GstMultiSourceRotation *rotation_new (GPtrArray * branches, guint window,
+    GstClockTime dwell);
+void rotation_free (GstMultiSourceRotation * rotation);
+GstStructure *rotation_get_stats (GstMultiSourceRotation * rotation);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_ROTATION_H__ */
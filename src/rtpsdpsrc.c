@@ -0,0 +1,398 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-rtpsdpsrc
+ *
+ * Receive the RTP streams described by an SDP file without going through
+ * a demuxer: a UDP source per media, with the caps of the SDP and a large
+ * socket receive buffer, feeds an rtpbin whose output pads are exposed as
+ * src_%u. The first media can be received on another address and port
+ * than the SDP's with a udp:// URI. With batch > 1, the datagrams are
+ * received with batchudpsrc rather than udpsrc.
+ *
+ * gst-multisource-launch -s "udp://239.1.1.1:5004 sdp=cam1.sdp batch=32"
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gio/gio.h>
+#include <gst/sdp/sdp.h>
+
+#include "multisource.h"
+#include "rtpsdpsrc.h"
+
+#define GST_CAT_DEFAULT multisource_launch_debug
+
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_URI,
+  PROP_BUFFER_SIZE,
+  PROP_BATCH,
+  PROP_LATENCY,
+};
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src_%u",
+    GST_PAD_SRC, GST_PAD_SOMETIMES, GST_STATIC_CAPS ("application/x-rtp"));
+
+G_DEFINE_TYPE (GstMultiSourceRtpSdpSrc, rtp_sdp_src, GST_TYPE_BIN);
+
+static void
+rtpbin_pad_added (GstElement * rtpbin, GstPad * pad, gpointer user_data)
+{
+  GstMultiSourceRtpSdpSrc *self = user_data;
+  GstPad *ghost;
+  gchar *name;
+
+  if (!g_str_has_prefix (GST_PAD_NAME (pad), "recv_rtp_src_"))
+    return;
+
+  name = g_strdup_printf ("src_%d", g_atomic_int_add (&self->n_pads, 1));
+  ghost = gst_ghost_pad_new_from_template (name, pad,
+      gst_element_class_get_pad_template (GST_ELEMENT_GET_CLASS (self),
+          "src_%u"));
+  g_free (name);
+  g_object_set_data (G_OBJECT (pad), "rtpsdpsrc-ghost", ghost);
+  gst_pad_set_active (ghost, TRUE);
+  gst_element_add_pad (GST_ELEMENT (self), ghost);
+}
+
+static void
+rtpbin_pad_removed (GstElement * rtpbin, GstPad * pad, gpointer user_data)
+{
+  GstMultiSourceRtpSdpSrc *self = user_data;
+  GstPad *ghost = g_object_get_data (G_OBJECT (pad), "rtpsdpsrc-ghost");
+
+  if (ghost)
+    gst_element_remove_pad (GST_ELEMENT (self), ghost);
+}
+
+/* The connection address of a media is where it is received when it is a
+ * multicast group. A unicast one is the sender's, receive on any. */
+static const gchar *
+get_receive_address (const GstSDPMessage * sdp, const GstSDPMedia * media)
+{
+  const GstSDPConnection *conn = NULL;
+  GInetAddress *addr;
+  gboolean multicast;
+
+  if (gst_sdp_media_connections_len (media) > 0)
+    conn = gst_sdp_media_get_connection (media, 0);
+  else
+    conn = gst_sdp_message_get_connection (sdp);
+  if (!conn || !conn->address)
+    return "0.0.0.0";
+
+  addr = g_inet_address_new_from_string (conn->address);
+  if (!addr)
+    return "0.0.0.0";
+  multicast = g_inet_address_get_is_multicast (addr);
+  g_object_unref (addr);
+
+  return multicast ? conn->address : "0.0.0.0";
+}
+
+static GstElement *
+add_udp_source (GstMultiSourceRtpSdpSrc * self, const gchar * factory,
+    const gchar * address, guint port, GstCaps * caps, const gchar * sink)
+{
+  GstElement *src = gst_element_factory_make (factory, NULL);
+
+  if (!src)
+    return NULL;
+  g_object_set (src, "address", address, "port", port, "caps", caps,
+      "buffer-size", self->buffer_size, NULL);
+  if (g_str_equal (factory, "batchudpsrc"))
+    g_object_set (src, "batch", self->batch, NULL);
+
+  gst_bin_add (GST_BIN (self), src);
+  if (!gst_element_link_pads (src, "src", self->rtpbin, sink)) {
+    gst_bin_remove (GST_BIN (self), src);
+    return NULL;
+  }
+
+  return src;
+}
+
+/* Add the receive chain of one RTP media, and its RTCP on the next port */
+static gboolean
+add_media (GstMultiSourceRtpSdpSrc * self, const GstSDPMessage * sdp,
+    const GstSDPMedia * media, guint id, const gchar * address, guint port)
+{
+  GstCaps *caps, *rtcp_caps;
+  gchar *rtp_sink, *rtcp_sink;
+  gboolean res;
+  gint pt;
+
+  pt = atoi (gst_sdp_media_get_format (media, 0));
+  caps = gst_sdp_media_get_caps_from_media (media, pt);
+  if (!caps)
+    return FALSE;
+  gst_structure_set_name (gst_caps_get_structure (caps, 0),
+      "application/x-rtp");
+  gst_sdp_media_attributes_to_caps (media, caps);
+  gst_sdp_message_attributes_to_caps (sdp, caps);
+  GST_DEBUG_OBJECT (self, "Receiving %" GST_PTR_FORMAT " on %s:%u", caps,
+      address, port);
+
+  rtp_sink = g_strdup_printf ("recv_rtp_sink_%u", id);
+  rtcp_sink = g_strdup_printf ("recv_rtcp_sink_%u", id);
+  rtcp_caps = gst_caps_new_empty_simple ("application/x-rtcp");
+  res = add_udp_source (self, self->batch > 1 ? "batchudpsrc" : "udpsrc",
+      address, port, caps, rtp_sink) != NULL;
+  /* A few packets a second, not worth batching */
+  if (res && !add_udp_source (self, "udpsrc", address, port + 1, rtcp_caps,
+          rtcp_sink))
+    GST_WARNING_OBJECT (self, "Could not receive RTCP on port %u", port + 1);
+  gst_caps_unref (rtcp_caps);
+  gst_caps_unref (caps);
+  g_free (rtcp_sink);
+  g_free (rtp_sink);
+
+  return res;
+}
+
+static gboolean
+build (GstMultiSourceRtpSdpSrc * self)
+{
+  GstSDPMessage *sdp = NULL;
+  GstUri *override = NULL;
+  GError *err = NULL;
+  gchar *contents = NULL;
+  gsize length;
+  guint i, id = 0;
+
+  if (!self->location || !g_file_get_contents (self->location, &contents,
+          &length, &err)) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ,
+        ("Could not read SDP file \"%s\".", GST_STR_NULL (self->location)),
+        ("%s", err ? err->message : "no location"));
+    g_clear_error (&err);
+    return FALSE;
+  }
+  gst_sdp_message_new (&sdp);
+  if (gst_sdp_message_parse_buffer ((const guint8 *) contents, length,
+          sdp) != GST_SDP_OK) {
+    GST_ELEMENT_ERROR (self, STREAM, DECODE,
+        ("Invalid SDP file \"%s\".", self->location), (NULL));
+    goto error;
+  }
+
+  self->rtpbin = gst_element_factory_make ("rtpbin", NULL);
+  if (!self->rtpbin) {
+    GST_ELEMENT_ERROR (self, CORE, MISSING_PLUGIN,
+        ("rtpbin is not available."), (NULL));
+    goto error;
+  }
+  g_object_set (self->rtpbin, "latency", self->latency, NULL);
+  g_signal_connect (self->rtpbin, "pad-added",
+      G_CALLBACK (rtpbin_pad_added), self);
+  g_signal_connect (self->rtpbin, "pad-removed",
+      G_CALLBACK (rtpbin_pad_removed), self);
+  gst_bin_add (GST_BIN (self), self->rtpbin);
+
+  if (self->uri)
+    override = gst_uri_from_string (self->uri);
+
+  for (i = 0; i < gst_sdp_message_medias_len (sdp); i++) {
+    const GstSDPMedia *media = gst_sdp_message_get_media (sdp, i);
+    const gchar *address = get_receive_address (sdp, media);
+    guint port = gst_sdp_media_get_port (media);
+
+    if (!g_str_has_prefix (gst_sdp_media_get_proto (media), "RTP/")
+        || gst_sdp_media_formats_len (media) == 0)
+      continue;
+
+    if (id == 0 && override) {
+      if (gst_uri_get_host (override) && *gst_uri_get_host (override))
+        address = gst_uri_get_host (override);
+      if (gst_uri_get_port (override) != GST_URI_NO_PORT)
+        port = gst_uri_get_port (override);
+    }
+
+    if (add_media (self, sdp, media, id, address, port))
+      id++;
+    else
+      GST_WARNING_OBJECT (self, "Could not receive media %u of %s", i,
+          self->location);
+  }
+
+  if (override)
+    gst_uri_unref (override);
+  if (id == 0) {
+    GST_ELEMENT_ERROR (self, STREAM, WRONG_TYPE,
+        ("No RTP stream could be received from \"%s\".", self->location),
+        (NULL));
+    goto error;
+  }
+  gst_sdp_message_free (sdp);
+  g_free (contents);
+
+  return TRUE;
+
+error:
+  /* Start over at the next attempt */
+  if (self->rtpbin) {
+    GList *children = g_list_copy (GST_BIN_CHILDREN (self)), *l;
+
+    for (l = children; l; l = l->next)
+      gst_bin_remove (GST_BIN (self), l->data);
+    g_list_free (children);
+    self->rtpbin = NULL;
+  }
+  gst_sdp_message_free (sdp);
+  g_free (contents);
+  return FALSE;
+}
+
+static GstStateChangeReturn
+rtp_sdp_src_change_state (GstElement * element, GstStateChange transition)
+{
+  GstMultiSourceRtpSdpSrc *self = GST_MULTI_SOURCE_RTP_SDP_SRC (element);
+
+  if (transition == GST_STATE_CHANGE_NULL_TO_READY && !self->rtpbin
+      && !build (self))
+    return GST_STATE_CHANGE_FAILURE;
+
+  return GST_ELEMENT_CLASS (rtp_sdp_src_parent_class)->change_state (element,
+      transition);
+}
+
+static void
+rtp_sdp_src_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMultiSourceRtpSdpSrc *self = GST_MULTI_SOURCE_RTP_SDP_SRC (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_free (self->location);
+      self->location = g_value_dup_string (value);
+      break;
+    case PROP_URI:
+      g_free (self->uri);
+      self->uri = g_value_dup_string (value);
+      break;
+    case PROP_BUFFER_SIZE:
+      self->buffer_size = g_value_get_int (value);
+      break;
+    case PROP_BATCH:
+      self->batch = g_value_get_uint (value);
+      break;
+    case PROP_LATENCY:
+      self->latency = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+rtp_sdp_src_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstMultiSourceRtpSdpSrc *self = GST_MULTI_SOURCE_RTP_SDP_SRC (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_value_set_string (value, self->location);
+      break;
+    case PROP_URI:
+      g_value_set_string (value, self->uri);
+      break;
+    case PROP_BUFFER_SIZE:
+      g_value_set_int (value, self->buffer_size);
+      break;
+    case PROP_BATCH:
+      g_value_set_uint (value, self->batch);
+      break;
+    case PROP_LATENCY:
+      g_value_set_uint (value, self->latency);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+rtp_sdp_src_finalize (GObject * object)
+{
+  GstMultiSourceRtpSdpSrc *self = GST_MULTI_SOURCE_RTP_SDP_SRC (object);
+
+  g_free (self->location);
+  g_free (self->uri);
+
+  G_OBJECT_CLASS (rtp_sdp_src_parent_class)->finalize (object);
+}
+
+static void
+rtp_sdp_src_class_init (GstMultiSourceRtpSdpSrcClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  gobject_class->set_property = rtp_sdp_src_set_property;
+  gobject_class->get_property = rtp_sdp_src_get_property;
+  gobject_class->finalize = rtp_sdp_src_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_LOCATION,
+      g_param_spec_string ("location", "SDP location",
+          "SDP file describing the streams", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_URI,
+      g_param_spec_string ("uri", "URI",
+          "udp:// URI overriding the address and port of the first stream",
+          NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_BUFFER_SIZE,
+      g_param_spec_int ("buffer-size", "Buffer size",
+          "Socket receive buffer size", 0, G_MAXINT,
+          RTP_SDP_SRC_DEFAULT_BUFFER_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_BATCH,
+      g_param_spec_uint ("batch", "Batch",
+          "Datagrams received per system call (1 = udpsrc)", 1, 1024, 1,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_LATENCY,
+      g_param_spec_uint ("latency", "Latency",
+          "Jitter buffer latency in milliseconds", 0, G_MAXUINT,
+          RTP_SDP_SRC_DEFAULT_LATENCY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+  gst_element_class_set_static_metadata (element_class,
+      "RTP SDP Source", "Source/Network/RTP",
+      "Receive the RTP streams described by an SDP file",
+      "gst-multisource-launch");
+
+  element_class->change_state = rtp_sdp_src_change_state;
+}
+
+static void
+rtp_sdp_src_init (GstMultiSourceRtpSdpSrc * self)
+{
+  self->buffer_size = RTP_SDP_SRC_DEFAULT_BUFFER_SIZE;
+  self->batch = 1;
+  self->latency = RTP_SDP_SRC_DEFAULT_LATENCY;
+}
@@ -0,0 +1,159 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * gst-multisource-shm-producer: publish a test stream with shmpubsink, to
+ * feed shm:// branches without a second launcher:
+ *
+ * gst-multisource-shm-producer /tmp/ingest
+ * gst-multisource-launch -s shm:///tmp/ingest
+ *
+ * --pipeline replaces the default encoded test pattern, and --restart
+ * stops and starts the producer every so often, giving it a new segment,
+ * to check that the consumers come back by themselves.
+ */
+
+#include <stdlib.h>
+
+#include <glib-unix.h>
+#include <gst/gst.h>
+
+#include "multisource.h"
+#include "shmpubsink.h"
+
+#define SHM_PRODUCER_DEFAULT_PIPELINE "videotestsrc is-live=true " \
+    "pattern=ball ! video/x-raw,width=1280,height=720,framerate=30/1 ! " \
+    "x264enc tune=zerolatency speed-preset=ultrafast key-int-max=30 ! " \
+    "h264parse config-interval=-1"
+
+GST_DEBUG_CATEGORY (multisource_launch_debug);
+
+static GMainLoop *loop;
+
+static gboolean
+bus_cb (GstBus * bus, GstMessage * message, gpointer user_data)
+{
+  GError *err = NULL;
+
+  switch (GST_MESSAGE_TYPE (message)) {
+    case GST_MESSAGE_ERROR:
+      gst_message_parse_error (message, &err, NULL);
+      g_printerr ("%s\n", err->message);
+      g_error_free (err);
+      g_main_loop_quit (loop);
+      break;
+    case GST_MESSAGE_EOS:
+      g_main_loop_quit (loop);
+      break;
+    default:
+      break;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+restart_cb (gpointer user_data)
+{
+  GstElement *pipeline = user_data;
+
+  g_print ("Restarting the producer\n");
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+intr_cb (gpointer user_data)
+{
+  g_main_loop_quit (loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+int
+main (int argc, char **argv)
+{
+  GError *err = NULL;
+  GOptionContext *ctx;
+  GstElement *pipeline;
+  GstBus *bus;
+  gchar *upstream = NULL;
+  gchar *desc;
+  guint restart = 0;
+
+  GOptionEntry options[] = {
+    {"pipeline", 'p', 0, G_OPTION_ARG_STRING, &upstream,
+        ("Pipeline producing the published stream"), "DESCRIPTION"}
+    ,
+    {"restart", 0, 0, G_OPTION_ARG_INT, &restart,
+        ("Restart the producer every SECONDS (default: never)"), "SECONDS"}
+    ,
+    {NULL}
+  };
+
+  ctx = g_option_context_new ("SOCKET");
+  g_option_context_add_main_entries (ctx, options, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err) || argc != 2) {
+    g_printerr ("%s\n", err ? err->message : "Expecting a socket path");
+    g_clear_error (&err);
+    g_option_context_free (ctx);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free (ctx);
+
+  GST_DEBUG_CATEGORY_INIT (multisource_launch_debug, "multisource-launch", 0,
+      "gst-multisource-shm-producer");
+  gst_element_register (NULL, "shmpubsink", GST_RANK_NONE,
+      GST_TYPE_MULTI_SOURCE_SHM_PUB_SINK);
+
+  desc = g_strdup_printf ("%s ! shmpubsink socket-path=\"%s\" sync=false",
+      upstream ? upstream : SHM_PRODUCER_DEFAULT_PIPELINE, argv[1]);
+  pipeline = gst_parse_launch (desc, &err);
+  g_free (desc);
+  g_free (upstream);
+  if (!pipeline || err) {
+    g_printerr ("%s\n", err ? err->message : "Invalid pipeline");
+    g_clear_error (&err);
+    if (pipeline)
+      gst_object_unref (pipeline);
+    return EXIT_FAILURE;
+  }
+
+  loop = g_main_loop_new (NULL, FALSE);
+  bus = gst_element_get_bus (pipeline);
+  gst_bus_add_watch (bus, bus_cb, NULL);
+  gst_object_unref (bus);
+  g_unix_signal_add (SIGINT, intr_cb, NULL);
+  if (restart)
+    g_timeout_add_seconds (restart, restart_cb, pipeline);
+
+  g_print ("Publishing on %s\n", argv[1]);
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  g_main_loop_run (loop);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+  g_main_loop_unref (loop);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,128 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "shmproto.h"
+
+/* Send a message without blocking, its payload of msg->size bytes and fd
+ * if not -1. A consumer too slow to drain its socket misses messages
+ * rather than slowing the producer down. */
+gboolean
+shm_proto_send (gint sock, const GstMultiSourceShmMessage * msg,
+    const gchar * payload, gint fd)
+{
+  union
+  {
+    struct cmsghdr header;
+    guint8 data[CMSG_SPACE (sizeof (gint))];
+  } control;
+  struct iovec iov[2];
+  struct msghdr hdr;
+
+  memset (&hdr, 0, sizeof (hdr));
+  iov[0].iov_base = (gpointer) msg;
+  iov[0].iov_len = sizeof (*msg);
+  iov[1].iov_base = (gpointer) payload;
+  iov[1].iov_len = payload ? msg->size : 0;
+  hdr.msg_iov = iov;
+  hdr.msg_iovlen = payload ? 2 : 1;
+
+  if (fd >= 0) {
+    struct cmsghdr *cmsg;
+
+    memset (&control, 0, sizeof (control));
+    hdr.msg_control = control.data;
+    hdr.msg_controllen = sizeof (control.data);
+    cmsg = CMSG_FIRSTHDR (&hdr);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN (sizeof (gint));
+    memcpy (CMSG_DATA (cmsg), &fd, sizeof (gint));
+  }
+
+  return sendmsg (sock, &hdr, MSG_DONTWAIT | MSG_NOSIGNAL) >= 0;
+}
+
+/* Receive a message waiting on the socket. Returns the size of its
+ * payload, NUL terminated in payload, or -1 with errno set, to
+ * ECONNRESET when the peer closed the socket. A passed fd is returned in
+ * fd, when not NULL, and closed otherwise. */
+gssize
+shm_proto_receive (gint sock, GstMultiSourceShmMessage * msg,
+    gchar * payload, gsize max_payload, gint * fd)
+{
+  union
+  {
+    struct cmsghdr header;
+    guint8 data[CMSG_SPACE (sizeof (gint))];
+  } control;
+  struct cmsghdr *cmsg;
+  struct iovec iov[2];
+  struct msghdr hdr;
+  gssize len;
+
+  if (fd)
+    *fd = -1;
+  memset (&hdr, 0, sizeof (hdr));
+  iov[0].iov_base = msg;
+  iov[0].iov_len = sizeof (*msg);
+  iov[1].iov_base = payload;
+  iov[1].iov_len = payload ? max_payload - 1 : 0;
+  hdr.msg_iov = iov;
+  hdr.msg_iovlen = payload ? 2 : 1;
+  hdr.msg_control = control.data;
+  hdr.msg_controllen = sizeof (control.data);
+
+  len = recvmsg (sock, &hdr, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+  if (len == 0)
+    errno = ECONNRESET;
+  if (len <= 0)
+    return -1;
+
+  for (cmsg = CMSG_FIRSTHDR (&hdr); cmsg; cmsg = CMSG_NXTHDR (&hdr, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      gint passed;
+
+      memcpy (&passed, CMSG_DATA (cmsg), sizeof (gint));
+      if (fd && *fd < 0)
+        *fd = passed;
+      else
+        close (passed);
+    }
+  }
+
+  if (len < (gssize) sizeof (*msg) || (hdr.msg_flags & MSG_TRUNC)) {
+    if (fd && *fd >= 0) {
+      close (*fd);
+      *fd = -1;
+    }
+    errno = EPROTO;
+    return -1;
+  }
+  len -= sizeof (*msg);
+  if (payload)
+    payload[len] = '\0';
+
+  return len;
+}
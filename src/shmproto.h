@@ -0,0 +1,71 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_SHM_PROTO_H__
+#define __GST_MULTI_SOURCE_SHM_PROTO_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Messages between shmpubsink and shmsubsrc, one per datagram of a
+ * SOCK_SEQPACKET Unix socket, in host byte order as both ends run on the
+ * same host:
+ *
+ *   HELLO, to a consumer that just connected, with the memfd of the shared
+ *     segment attached: offset is the size of the segment, flags the
+ *     version of the protocol
+ *   CAPS, followed by the caps as a NUL terminated string of size bytes
+ *   BUFFER, size bytes at offset in the segment, with the timestamps and
+ *     the buffer flags. The producer leaves them untouched until
+ *   RELEASE, from the consumer, with the offset of the buffer it is done
+ *     with.
+ */
+#define SHM_PROTO_VERSION 1
+#define SHM_PROTO_MAX_PAYLOAD 65536
+
+typedef enum
+{
+  SHM_MSG_HELLO,
+  SHM_MSG_CAPS,
+  SHM_MSG_BUFFER,
+  SHM_MSG_RELEASE,
+} GstMultiSourceShmMessageType;
+
+typedef struct
+{
+  guint32 type;
+  guint32 size;
+  guint64 offset;
+  guint64 pts;
+  guint64 dts;
+  guint64 duration;
+  guint32 flags;
+  guint32 reserved;
+} GstMultiSourceShmMessage;
+
+gboolean shm_proto_send (gint sock, const GstMultiSourceShmMessage * msg,
+    const gchar * payload, gint fd);
+gssize shm_proto_receive (gint sock, GstMultiSourceShmMessage * msg,
+    gchar * payload, gsize max_payload, gint * fd);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_SHM_PROTO_H__ */
@@ -0,0 +1,500 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-shmpubsink
+ *
+ * Publish a stream to other processes of the host through shared memory:
+ * the buffers are copied into a memfd segment, which consumers connected
+ * to socket-path receive once and map, then only their offsets and
+ * timestamps go through the socket, see shmproto.h. A region of the
+ * segment is reused once every consumer it was sent to released it. The
+ * producer never waits for its consumers: a buffer that does not fit in
+ * the segment, or that a consumer has no room for in its socket, is
+ * dropped for it. A consumer missing a buffer then skips to the next
+ * keyframe, flagged DISCONT, as does one that just connected. The segment
+ * is sealed at its size so that no consumer faults on a shrunk mapping.
+ *
+ * gst-multisource-launch --sink "shmpubsink socket-path=/tmp/ingest" ...
+ * gst-multisource-launch -s shm:///tmp/ingest
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include "multisource.h"
+#include "shmproto.h"
+#include "shmpubsink.h"
+
+#define GST_CAT_DEFAULT multisource_launch_debug
+
+enum
+{
+  PROP_0,
+  PROP_SOCKET_PATH,
+  PROP_SIZE,
+  PROP_WRITE_STATS,
+};
+
+typedef struct
+{
+  guint64 offset;
+  guint64 size;
+  /* consumers still holding it */
+  guint refs;
+} ShmBlock;
+
+typedef struct
+{
+  gint fd;
+  /* blocks sent and not released yet */
+  GPtrArray *held;
+  /* missed a buffer, waiting for a keyframe to go on */
+  gboolean dropping;
+} ShmClient;
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+G_DEFINE_TYPE (GstMultiSourceShmPubSink, shm_pub_sink, GST_TYPE_BASE_SINK);
+
+static void
+block_unref (GstMultiSourceShmPubSink * self, ShmBlock * block)
+{
+  block->refs--;
+
+  /* Regions are reused in order, free the released ones at the front */
+  while ((block = g_queue_peek_head (&self->blocks)) && block->refs == 0)
+    g_free (g_queue_pop_head (&self->blocks));
+}
+
+static void
+client_free (GstMultiSourceShmPubSink * self, ShmClient * client)
+{
+  guint i;
+
+  for (i = 0; i < client->held->len; i++)
+    block_unref (self, g_ptr_array_index (client->held, i));
+  g_ptr_array_free (client->held, TRUE);
+  close (client->fd);
+  g_free (client);
+}
+
+static void
+remove_client (GstMultiSourceShmPubSink * self, GList * link)
+{
+  GST_INFO_OBJECT (self, "Consumer %d left", ((ShmClient *) link->data)->fd);
+  client_free (self, link->data);
+  self->clients = g_list_delete_link (self->clients, link);
+
+  GST_OBJECT_LOCK (self);
+  self->n_clients--;
+  GST_OBJECT_UNLOCK (self);
+}
+
+static gboolean
+send_caps (GstMultiSourceShmPubSink * self, ShmClient * client)
+{
+  GstMultiSourceShmMessage msg = { SHM_MSG_CAPS, };
+
+  msg.size = strlen (self->caps) + 1;
+
+  return shm_proto_send (client->fd, &msg, self->caps, -1);
+}
+
+/* Take the consumers waiting on the socket, handing them the segment */
+static void
+accept_clients (GstMultiSourceShmPubSink * self)
+{
+  GstMultiSourceShmMessage msg = { SHM_MSG_HELLO, };
+  ShmClient *client;
+  gint fd;
+
+  msg.offset = self->size;
+  msg.flags = SHM_PROTO_VERSION;
+  while ((fd = accept4 (self->listen_fd, NULL, NULL,
+              SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    if (!shm_proto_send (fd, &msg, NULL, self->memfd)) {
+      close (fd);
+      continue;
+    }
+    client = g_new0 (ShmClient, 1);
+    client->fd = fd;
+    client->held = g_ptr_array_new ();
+    client->dropping = TRUE;
+    if (self->caps && !send_caps (self, client)) {
+      client_free (self, client);
+      continue;
+    }
+    GST_INFO_OBJECT (self, "Consumer %d joined", fd);
+    self->clients = g_list_prepend (self->clients, client);
+
+    GST_OBJECT_LOCK (self);
+    self->n_clients++;
+    GST_OBJECT_UNLOCK (self);
+  }
+}
+
+/* Read the releases of a consumer. Returns FALSE once it has gone. */
+static gboolean
+read_releases (GstMultiSourceShmPubSink * self, ShmClient * client)
+{
+  GstMultiSourceShmMessage msg;
+  guint i;
+
+  while (shm_proto_receive (client->fd, &msg, NULL, 0, NULL) >= 0) {
+    if (msg.type != SHM_MSG_RELEASE)
+      continue;
+    for (i = 0; i < client->held->len; i++) {
+      ShmBlock *block = g_ptr_array_index (client->held, i);
+
+      if (block->offset == msg.offset) {
+        g_ptr_array_remove_index_fast (client->held, i);
+        block_unref (self, block);
+        break;
+      }
+    }
+  }
+
+  return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+static void
+poll_clients (GstMultiSourceShmPubSink * self)
+{
+  GList *l, *next;
+
+  accept_clients (self);
+  for (l = self->clients; l; l = next) {
+    next = l->next;
+    if (!read_releases (self, l->data))
+      remove_client (self, l);
+  }
+}
+
+/* Find room for size bytes after the newest block, or at the start of the
+ * segment, without reaching the oldest one still in use */
+static ShmBlock *
+alloc_block (GstMultiSourceShmPubSink * self, gsize size)
+{
+  ShmBlock *first = g_queue_peek_head (&self->blocks);
+  ShmBlock *last = g_queue_peek_tail (&self->blocks);
+  ShmBlock *block;
+  guint64 head, tail, offset;
+
+  size = GST_ROUND_UP_N (size, SHM_PUB_SINK_ALIGN);
+  if (!first) {
+    offset = 0;
+    if (size > self->size)
+      return NULL;
+  } else {
+    tail = first->offset;
+    head = last->offset + last->size;
+    if (head > tail && self->size - head >= size)
+      offset = head;
+    else if (head > tail && tail >= size)
+      offset = 0;
+    else if (head < tail && tail - head >= size)
+      offset = head;
+    else
+      return NULL;
+  }
+
+  block = g_new0 (ShmBlock, 1);
+  block->offset = offset;
+  block->size = size;
+  g_queue_push_tail (&self->blocks, block);
+
+  return block;
+}
+
+/* Whether a consumer can take the buffer: one that missed some only goes
+ * on from a keyframe */
+static gboolean
+client_wants (ShmClient * client, GstBuffer * buffer)
+{
+  return !client->dropping
+      || !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+}
+
+static GstFlowReturn
+shm_pub_sink_render (GstBaseSink * sink, GstBuffer * buffer)
+{
+  GstMultiSourceShmPubSink *self = GST_MULTI_SOURCE_SHM_PUB_SINK (sink);
+  GstMultiSourceShmMessage msg = { SHM_MSG_BUFFER, };
+  gsize size = gst_buffer_get_size (buffer);
+  gboolean wanted = FALSE;
+  ShmBlock *block;
+  GList *l, *next;
+
+  poll_clients (self);
+  for (l = self->clients; l && !wanted; l = l->next)
+    wanted = client_wants (l->data, buffer);
+  /* Nobody to copy it for */
+  if (!wanted)
+    return GST_FLOW_OK;
+
+  block = alloc_block (self, MAX (size, 1));
+  if (!block) {
+    GST_LOG_OBJECT (self, "No room for %" G_GSIZE_FORMAT " bytes", size);
+    for (l = self->clients; l; l = l->next)
+      ((ShmClient *) l->data)->dropping = TRUE;
+    GST_OBJECT_LOCK (self);
+    self->dropped++;
+    GST_OBJECT_UNLOCK (self);
+    return GST_FLOW_OK;
+  }
+  gst_buffer_extract (buffer, 0, self->data + block->offset, size);
+
+  msg.size = size;
+  msg.offset = block->offset;
+  msg.pts = GST_BUFFER_PTS (buffer);
+  msg.dts = GST_BUFFER_DTS (buffer);
+  msg.duration = GST_BUFFER_DURATION (buffer);
+  for (l = self->clients; l; l = next) {
+    ShmClient *client = l->data;
+
+    next = l->next;
+    if (!client_wants (client, buffer))
+      continue;
+    msg.flags = GST_BUFFER_FLAGS (buffer);
+    if (client->dropping)
+      msg.flags |= GST_BUFFER_FLAG_DISCONT;
+    if (shm_proto_send (client->fd, &msg, NULL, -1)) {
+      block->refs++;
+      g_ptr_array_add (client->held, block);
+      client->dropping = FALSE;
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      remove_client (self, l);
+    } else {
+      client->dropping = TRUE;
+    }
+  }
+  /* Sent to nobody, make the region available again */
+  block->refs++;
+  block_unref (self, block);
+
+  GST_OBJECT_LOCK (self);
+  self->buffers++;
+  GST_OBJECT_UNLOCK (self);
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+shm_pub_sink_set_caps (GstBaseSink * sink, GstCaps * caps)
+{
+  GstMultiSourceShmPubSink *self = GST_MULTI_SOURCE_SHM_PUB_SINK (sink);
+  GList *l, *next;
+
+  g_free (self->caps);
+  self->caps = gst_caps_to_string (caps);
+  for (l = self->clients; l; l = next) {
+    next = l->next;
+    if (!send_caps (self, l->data))
+      remove_client (self, l);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+shm_pub_sink_start (GstBaseSink * sink)
+{
+  GstMultiSourceShmPubSink *self = GST_MULTI_SOURCE_SHM_PUB_SINK (sink);
+  struct sockaddr_un addr = { AF_UNIX, };
+
+  if (!self->socket_path
+      || strlen (self->socket_path) >= sizeof (addr.sun_path)) {
+    GST_ELEMENT_ERROR (self, RESOURCE, SETTINGS,
+        ("Invalid socket path \"%s\".", GST_STR_NULL (self->socket_path)),
+        (NULL));
+    return FALSE;
+  }
+  strcpy (addr.sun_path, self->socket_path);
+
+  self->memfd = memfd_create ("gst-multisource-shm",
+      MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (self->memfd < 0 || ftruncate (self->memfd, self->size) < 0
+      || fcntl (self->memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) < 0)
+    goto error;
+  self->data = mmap (NULL, self->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+      self->memfd, 0);
+  if (self->data == MAP_FAILED) {
+    self->data = NULL;
+    goto error;
+  }
+
+  /* A producer restarting takes the socket of the previous one over */
+  g_unlink (self->socket_path);
+  self->listen_fd = socket (AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK
+      | SOCK_CLOEXEC, 0);
+  if (self->listen_fd < 0
+      || bind (self->listen_fd, (struct sockaddr *) &addr, sizeof (addr)) < 0
+      || listen (self->listen_fd, 16) < 0)
+    goto error;
+
+  return TRUE;
+
+error:
+  GST_ELEMENT_ERROR (self, RESOURCE, OPEN_WRITE,
+      ("Could not publish on \"%s\".", self->socket_path), GST_ERROR_SYSTEM);
+  return FALSE;
+}
+
+static gboolean
+shm_pub_sink_stop (GstBaseSink * sink)
+{
+  GstMultiSourceShmPubSink *self = GST_MULTI_SOURCE_SHM_PUB_SINK (sink);
+
+  while (self->clients)
+    remove_client (self, self->clients);
+  g_queue_clear_full (&self->blocks, g_free);
+  if (self->listen_fd >= 0) {
+    close (self->listen_fd);
+    self->listen_fd = -1;
+    g_unlink (self->socket_path);
+  }
+  if (self->data) {
+    munmap (self->data, self->size);
+    self->data = NULL;
+  }
+  if (self->memfd >= 0) {
+    close (self->memfd);
+    self->memfd = -1;
+  }
+  g_clear_pointer (&self->caps, g_free);
+
+  return TRUE;
+}
+
+static void
+shm_pub_sink_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMultiSourceShmPubSink *self = GST_MULTI_SOURCE_SHM_PUB_SINK (object);
+
+  switch (prop_id) {
+    case PROP_SOCKET_PATH:
+      g_free (self->socket_path);
+      self->socket_path = g_value_dup_string (value);
+      break;
+    case PROP_SIZE:
+      self->size = g_value_get_uint64 (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+shm_pub_sink_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstMultiSourceShmPubSink *self = GST_MULTI_SOURCE_SHM_PUB_SINK (object);
+
+  switch (prop_id) {
+    case PROP_SOCKET_PATH:
+      g_value_set_string (value, self->socket_path);
+      break;
+    case PROP_SIZE:
+      g_value_set_uint64 (value, self->size);
+      break;
+    case PROP_WRITE_STATS:
+      GST_OBJECT_LOCK (self);
+      g_value_take_boxed (value, gst_structure_new ("shmpubsink",
+              "buffers", G_TYPE_UINT64, self->buffers,
+              "dropped", G_TYPE_UINT64, self->dropped,
+              "consumers", G_TYPE_UINT, self->n_clients, NULL));
+      GST_OBJECT_UNLOCK (self);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+shm_pub_sink_finalize (GObject * object)
+{
+  GstMultiSourceShmPubSink *self = GST_MULTI_SOURCE_SHM_PUB_SINK (object);
+
+  g_free (self->socket_path);
+
+  G_OBJECT_CLASS (shm_pub_sink_parent_class)->finalize (object);
+}
+
+static void
+shm_pub_sink_class_init (GstMultiSourceShmPubSinkClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSinkClass *basesink_class = GST_BASE_SINK_CLASS (klass);
+
+  gobject_class->set_property = shm_pub_sink_set_property;
+  gobject_class->get_property = shm_pub_sink_get_property;
+  gobject_class->finalize = shm_pub_sink_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_SOCKET_PATH,
+      g_param_spec_string ("socket-path", "Socket path",
+          "Unix socket the consumers connect to", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_SIZE,
+      g_param_spec_uint64 ("size", "Size",
+          "Size of the shared memory segment", 4096, G_MAXUINT64,
+          SHM_PUB_SINK_DEFAULT_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_WRITE_STATS,
+      g_param_spec_boxed ("write-stats", "Write statistics",
+          "Buffers published and dropped, and connected consumers",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &sink_template);
+  gst_element_class_set_static_metadata (element_class,
+      "Shared Memory Publisher", "Sink",
+      "Publish buffers to other processes through shared memory",
+      "gst-multisource-launch");
+
+  basesink_class->start = shm_pub_sink_start;
+  basesink_class->stop = shm_pub_sink_stop;
+  basesink_class->set_caps = shm_pub_sink_set_caps;
+  basesink_class->render = shm_pub_sink_render;
+}
+
+static void
+shm_pub_sink_init (GstMultiSourceShmPubSink * self)
+{
+  self->size = SHM_PUB_SINK_DEFAULT_SIZE;
+  self->memfd = -1;
+  self->listen_fd = -1;
+  g_queue_init (&self->blocks);
+}
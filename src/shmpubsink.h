@@ -0,0 +1,70 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_SHM_PUB_SINK_H__
+#define __GST_MULTI_SOURCE_SHM_PUB_SINK_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MULTI_SOURCE_SHM_PUB_SINK (shm_pub_sink_get_type ())
+#define GST_MULTI_SOURCE_SHM_PUB_SINK(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_MULTI_SOURCE_SHM_PUB_SINK, \
+        GstMultiSourceShmPubSink))
+
+#define SHM_PUB_SINK_DEFAULT_SIZE (64 * 1024 * 1024)
+/* Buffers start at this alignment in the segment */
+#define SHM_PUB_SINK_ALIGN 64
+
+typedef struct _GstMultiSourceShmPubSink
+{
+  GstBaseSink parent;
+
+  /* properties */
+  gchar *socket_path;
+  guint64 size;
+
+  gint memfd;
+  guint8 *data;
+  gint listen_fd;
+  gchar *caps;
+  /* connected consumers */
+  GList *clients;
+  /* regions of the segment in use, oldest first */
+  GQueue blocks;
+
+  /* statistics, protected by the object lock */
+  guint64 buffers;
+  guint64 dropped;
+  guint n_clients;
+} GstMultiSourceShmPubSink;
+
+typedef struct _GstMultiSourceShmPubSinkClass
+{
+  GstBaseSinkClass parent_class;
+} GstMultiSourceShmPubSinkClass;
+
+GType shm_pub_sink_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_SHM_PUB_SINK_H__ */
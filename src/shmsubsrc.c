@@ -0,0 +1,581 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-shmsubsrc
+ *
+ * Receive the stream published by shmpubsink in another process: the
+ * segment passed when connecting to socket-path is mapped read only, and
+ * every buffer wraps its region of the mapping, released to the producer
+ * once it is freed. When the producer goes away, the source keeps waiting
+ * for it to come back and goes on with a discontinuity, so a producer
+ * restart does not stop the branch. The timestamps are moved from the
+ * running time of the producer to ours at the first buffer of each
+ * connection. The releases the socket has no room for are queued and sent
+ * again, and only a segment sealed against shrinking is mapped.
+ *
+ * It handles shm:// URIs, the path being the socket of the producer:
+ * gst-multisource-launch -s shm:///tmp/ingest
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "multisource.h"
+#include "shmproto.h"
+#include "shmsubsrc.h"
+
+#define GST_CAT_DEFAULT multisource_launch_debug
+
+/* The buffer flags kept from the producer */
+#define SHM_SUB_SRC_FLAGS_MASK (GST_BUFFER_FLAG_DELTA_UNIT \
+    | GST_BUFFER_FLAG_HEADER | GST_BUFFER_FLAG_GAP \
+    | GST_BUFFER_FLAG_DROPPABLE | GST_BUFFER_FLAG_DISCONT)
+
+enum
+{
+  PROP_0,
+  PROP_SOCKET_PATH,
+  PROP_RECONNECT_INTERVAL,
+  PROP_READ_STATS,
+};
+
+struct _ShmConnection
+{
+  gint refcount;
+  gint sock;
+  guint8 *data;
+  gsize size;
+  /* offsets whose release the socket had no room for, oldest first */
+  GMutex lock;
+  GArray *pending;
+};
+
+typedef struct
+{
+  ShmConnection *conn;
+  guint64 offset;
+} ShmRelease;
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+static void shm_sub_src_uri_handler_init (gpointer g_iface,
+    gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (GstMultiSourceShmSubSrc, shm_sub_src,
+    GST_TYPE_PUSH_SRC, G_IMPLEMENT_INTERFACE (GST_TYPE_URI_HANDLER,
+        shm_sub_src_uri_handler_init));
+
+static ShmConnection *
+connection_ref (ShmConnection * conn)
+{
+  g_atomic_int_inc (&conn->refcount);
+  return conn;
+}
+
+static void
+connection_unref (ShmConnection * conn)
+{
+  if (!g_atomic_int_dec_and_test (&conn->refcount))
+    return;
+
+  munmap (conn->data, conn->size);
+  close (conn->sock);
+  g_array_free (conn->pending, TRUE);
+  g_mutex_clear (&conn->lock);
+  g_free (conn);
+}
+
+/* Send the queued releases, in order, until the socket is full. Returns
+ * TRUE when some are still queued. Called with the connection lock. */
+static gboolean
+flush_releases (ShmConnection * conn)
+{
+  GstMultiSourceShmMessage msg = { SHM_MSG_RELEASE, };
+  guint sent = 0;
+
+  while (sent < conn->pending->len) {
+    msg.offset = g_array_index (conn->pending, guint64, sent);
+    if (!shm_proto_send (conn->sock, &msg, NULL, -1)) {
+      /* The producer has gone, its segment goes with our last buffer */
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        sent = conn->pending->len;
+      break;
+    }
+    sent++;
+  }
+  g_array_remove_range (conn->pending, 0, sent);
+
+  return conn->pending->len > 0;
+}
+
+/* Hand a region back to the producer, after those not sent yet. A release
+ * lost would keep the region from the producer until we disconnect. */
+static void
+release_region (ShmRelease * release)
+{
+  ShmConnection *conn = release->conn;
+
+  g_mutex_lock (&conn->lock);
+  g_array_append_val (conn->pending, release->offset);
+  flush_releases (conn);
+  g_mutex_unlock (&conn->lock);
+  connection_unref (conn);
+  g_free (release);
+}
+
+/* Wait for fd to be readable, or only for timeout when fd is -1. Returns
+ * 1 when it is, 0 on timeout and -1 when unlocked. */
+static gint
+wait_readable (GstMultiSourceShmSubSrc * self, gint fd, gint timeout)
+{
+  GPollFD fds[2] = { {fd, G_IO_IN, 0}, };
+  gint n;
+
+  g_cancellable_make_pollfd (self->cancellable, &fds[1]);
+  n = g_poll (fds, 2, timeout);
+  g_cancellable_release_fd (self->cancellable);
+  if (g_cancellable_is_cancelled (self->cancellable))
+    return -1;
+
+  return n > 0 && fds[0].revents ? 1 : 0;
+}
+
+static gboolean
+connect_producer (GstMultiSourceShmSubSrc * self)
+{
+  struct sockaddr_un addr = { AF_UNIX, };
+  GstMultiSourceShmMessage msg;
+  ShmConnection *conn;
+  gpointer data;
+  gint sock, memfd = -1;
+
+  if (strlen (self->socket_path) >= sizeof (addr.sun_path))
+    return FALSE;
+  strcpy (addr.sun_path, self->socket_path);
+
+  sock = socket (AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (sock < 0)
+    return FALSE;
+  if (connect (sock, (struct sockaddr *) &addr, sizeof (addr)) < 0
+      || wait_readable (self, sock, SHM_SUB_SRC_HELLO_TIMEOUT) <= 0
+      || shm_proto_receive (sock, &msg, NULL, 0, &memfd) < 0
+      || msg.type != SHM_MSG_HELLO || msg.flags != SHM_PROTO_VERSION
+      || memfd < 0 || msg.offset == 0)
+    goto error;
+#ifdef F_GET_SEALS
+  /* A segment shrunk under the mapping would fault on our buffers */
+  if (!(fcntl (memfd, F_GET_SEALS) & F_SEAL_SHRINK)) {
+    GST_WARNING_OBJECT (self, "The segment of %s is not sealed",
+        self->socket_path);
+    goto error;
+  }
+#endif
+
+  data = mmap (NULL, msg.offset, PROT_READ, MAP_SHARED, memfd, 0);
+  if (data == MAP_FAILED)
+    goto error;
+  close (memfd);
+
+  conn = g_new0 (ShmConnection, 1);
+  conn->refcount = 1;
+  conn->sock = sock;
+  conn->data = data;
+  conn->size = msg.offset;
+  g_mutex_init (&conn->lock);
+  conn->pending = g_array_new (FALSE, FALSE, sizeof (guint64));
+  self->conn = conn;
+  self->have_offset = FALSE;
+  self->discont = TRUE;
+  GST_INFO_OBJECT (self, "Connected to %s, %" G_GSIZE_FORMAT " bytes shared",
+      self->socket_path, conn->size);
+
+  return TRUE;
+
+error:
+  if (memfd >= 0)
+    close (memfd);
+  close (sock);
+  return FALSE;
+}
+
+static void
+disconnect_producer (GstMultiSourceShmSubSrc * self)
+{
+  connection_unref (self->conn);
+  self->conn = NULL;
+}
+
+static GstClockTime
+get_running_time (GstMultiSourceShmSubSrc * self)
+{
+  GstClock *clock = gst_element_get_clock (GST_ELEMENT (self));
+  GstClockTime now;
+
+  if (!clock)
+    return GST_CLOCK_TIME_NONE;
+  now = gst_clock_get_time (clock) - gst_element_get_base_time (GST_ELEMENT
+      (self));
+  gst_object_unref (clock);
+
+  return now;
+}
+
+static GstClockTime
+rebase (GstMultiSourceShmSubSrc * self, GstClockTime ts)
+{
+  if (!GST_CLOCK_TIME_IS_VALID (ts) || !self->have_offset)
+    return GST_CLOCK_TIME_NONE;
+
+  return (GstClockTimeDiff) ts + self->ts_offset < 0 ? 0 :
+      ts + self->ts_offset;
+}
+
+static GstBuffer *
+wrap_buffer (GstMultiSourceShmSubSrc * self,
+    const GstMultiSourceShmMessage * msg)
+{
+  ShmRelease *release = g_new0 (ShmRelease, 1);
+  GstClockTime ts = GST_CLOCK_TIME_IS_VALID (msg->dts) ? msg->dts : msg->pts;
+  GstClockTime now;
+  GstBuffer *buffer;
+
+  if (!self->have_offset && GST_CLOCK_TIME_IS_VALID (ts)
+      && GST_CLOCK_TIME_IS_VALID (now = get_running_time (self))) {
+    self->ts_offset = GST_CLOCK_DIFF (ts, now);
+    self->have_offset = TRUE;
+  }
+
+  release->conn = connection_ref (self->conn);
+  release->offset = msg->offset;
+  buffer = gst_buffer_new ();
+  gst_buffer_append_memory (buffer,
+      gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY, self->conn->data,
+          self->conn->size, msg->offset, msg->size, release,
+          (GDestroyNotify) release_region));
+  GST_BUFFER_PTS (buffer) = rebase (self, msg->pts);
+  GST_BUFFER_DTS (buffer) = rebase (self, msg->dts);
+  GST_BUFFER_DURATION (buffer) = msg->duration;
+  GST_BUFFER_FLAGS (buffer) = msg->flags & SHM_SUB_SRC_FLAGS_MASK;
+  if (self->discont) {
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+    self->discont = FALSE;
+  }
+
+  return buffer;
+}
+
+static void
+update_caps (GstMultiSourceShmSubSrc * self, const gchar * str)
+{
+  GstCaps *caps = gst_caps_from_string (str);
+
+  if (!caps) {
+    GST_WARNING_OBJECT (self, "Invalid caps %s", str);
+    return;
+  }
+  if (!self->caps || !gst_caps_is_equal (caps, self->caps)) {
+    gst_caps_replace (&self->caps, caps);
+    gst_base_src_set_caps (GST_BASE_SRC (self), caps);
+  }
+  gst_caps_unref (caps);
+}
+
+static GstFlowReturn
+shm_sub_src_create (GstPushSrc * src, GstBuffer ** buffer)
+{
+  GstMultiSourceShmSubSrc *self = GST_MULTI_SOURCE_SHM_SUB_SRC (src);
+  GstMultiSourceShmMessage msg;
+  gboolean pending;
+  gssize len;
+
+  while (TRUE) {
+    if (!self->conn && !connect_producer (self)) {
+      if (wait_readable (self, -1,
+              GST_TIME_AS_MSECONDS (self->reconnect_interval)) < 0)
+        return GST_FLOW_FLUSHING;
+      continue;
+    }
+
+    /* Retry the releases left over until the producer makes room */
+    g_mutex_lock (&self->conn->lock);
+    pending = flush_releases (self->conn);
+    g_mutex_unlock (&self->conn->lock);
+    if (wait_readable (self, self->conn->sock,
+            pending ? SHM_SUB_SRC_RELEASE_RETRY : -1) < 0)
+      return GST_FLOW_FLUSHING;
+    len = shm_proto_receive (self->conn->sock, &msg, self->payload,
+        SHM_PROTO_MAX_PAYLOAD, NULL);
+    if (len < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        continue;
+      GST_INFO_OBJECT (self, "Producer on %s went away, waiting for it",
+          self->socket_path);
+      disconnect_producer (self);
+      GST_OBJECT_LOCK (self);
+      self->reconnects++;
+      GST_OBJECT_UNLOCK (self);
+      continue;
+    }
+
+    if (msg.type == SHM_MSG_CAPS && len > 0) {
+      update_caps (self, self->payload);
+    } else if (msg.type == SHM_MSG_BUFFER) {
+      if (msg.offset > self->conn->size
+          || msg.size > self->conn->size - msg.offset) {
+        GST_OBJECT_LOCK (self);
+        self->invalid++;
+        GST_OBJECT_UNLOCK (self);
+        continue;
+      }
+      *buffer = wrap_buffer (self, &msg);
+      GST_OBJECT_LOCK (self);
+      self->buffers++;
+      GST_OBJECT_UNLOCK (self);
+      return GST_FLOW_OK;
+    }
+  }
+}
+
+static gboolean
+shm_sub_src_start (GstBaseSrc * src)
+{
+  GstMultiSourceShmSubSrc *self = GST_MULTI_SOURCE_SHM_SUB_SRC (src);
+
+  if (!self->socket_path) {
+    GST_ELEMENT_ERROR (self, RESOURCE, NOT_FOUND,
+        ("No socket path specified."), (NULL));
+    return FALSE;
+  }
+  self->payload = g_malloc (SHM_PROTO_MAX_PAYLOAD);
+
+  return TRUE;
+}
+
+static gboolean
+shm_sub_src_stop (GstBaseSrc * src)
+{
+  GstMultiSourceShmSubSrc *self = GST_MULTI_SOURCE_SHM_SUB_SRC (src);
+
+  if (self->conn)
+    disconnect_producer (self);
+  gst_clear_caps (&self->caps);
+  g_clear_pointer (&self->payload, g_free);
+
+  return TRUE;
+}
+
+static gboolean
+shm_sub_src_unlock (GstBaseSrc * src)
+{
+  GstMultiSourceShmSubSrc *self = GST_MULTI_SOURCE_SHM_SUB_SRC (src);
+
+  g_cancellable_cancel (self->cancellable);
+
+  return TRUE;
+}
+
+static gboolean
+shm_sub_src_unlock_stop (GstBaseSrc * src)
+{
+  GstMultiSourceShmSubSrc *self = GST_MULTI_SOURCE_SHM_SUB_SRC (src);
+
+  g_cancellable_reset (self->cancellable);
+
+  return TRUE;
+}
+
+static void
+shm_sub_src_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMultiSourceShmSubSrc *self = GST_MULTI_SOURCE_SHM_SUB_SRC (object);
+
+  switch (prop_id) {
+    case PROP_SOCKET_PATH:
+      GST_OBJECT_LOCK (self);
+      g_free (self->socket_path);
+      self->socket_path = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_RECONNECT_INTERVAL:
+      self->reconnect_interval = g_value_get_uint64 (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+shm_sub_src_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstMultiSourceShmSubSrc *self = GST_MULTI_SOURCE_SHM_SUB_SRC (object);
+
+  switch (prop_id) {
+    case PROP_SOCKET_PATH:
+      GST_OBJECT_LOCK (self);
+      g_value_set_string (value, self->socket_path);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_RECONNECT_INTERVAL:
+      g_value_set_uint64 (value, self->reconnect_interval);
+      break;
+    case PROP_READ_STATS:
+      GST_OBJECT_LOCK (self);
+      g_value_take_boxed (value, gst_structure_new ("shmsubsrc",
+              "buffers", G_TYPE_UINT64, self->buffers,
+              "reconnects", G_TYPE_UINT64, self->reconnects,
+              "invalid", G_TYPE_UINT64, self->invalid, NULL));
+      GST_OBJECT_UNLOCK (self);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+shm_sub_src_finalize (GObject * object)
+{
+  GstMultiSourceShmSubSrc *self = GST_MULTI_SOURCE_SHM_SUB_SRC (object);
+
+  g_free (self->socket_path);
+  g_object_unref (self->cancellable);
+
+  G_OBJECT_CLASS (shm_sub_src_parent_class)->finalize (object);
+}
+
+static void
+shm_sub_src_class_init (GstMultiSourceShmSubSrcClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS (klass);
+  GstPushSrcClass *pushsrc_class = GST_PUSH_SRC_CLASS (klass);
+
+  gobject_class->set_property = shm_sub_src_set_property;
+  gobject_class->get_property = shm_sub_src_get_property;
+  gobject_class->finalize = shm_sub_src_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_SOCKET_PATH,
+      g_param_spec_string ("socket-path", "Socket path",
+          "Unix socket of the producer", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_RECONNECT_INTERVAL,
+      g_param_spec_uint64 ("reconnect-interval", "Reconnect interval",
+          "Time between attempts to connect to the producer", 0,
+          G_MAXUINT64, SHM_SUB_SRC_DEFAULT_RECONNECT_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_READ_STATS,
+      g_param_spec_boxed ("read-stats", "Read statistics",
+          "Buffers received, reconnections and invalid messages",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+  gst_element_class_set_static_metadata (element_class,
+      "Shared Memory Subscriber", "Source",
+      "Receive the buffers published by shmpubsink in another process",
+      "gst-multisource-launch");
+
+  basesrc_class->start = shm_sub_src_start;
+  basesrc_class->stop = shm_sub_src_stop;
+  basesrc_class->unlock = shm_sub_src_unlock;
+  basesrc_class->unlock_stop = shm_sub_src_unlock_stop;
+  pushsrc_class->create = shm_sub_src_create;
+}
+
+static void
+shm_sub_src_init (GstMultiSourceShmSubSrc * self)
+{
+  self->reconnect_interval = SHM_SUB_SRC_DEFAULT_RECONNECT_INTERVAL;
+  self->cancellable = g_cancellable_new ();
+  gst_base_src_set_live (GST_BASE_SRC (self), TRUE);
+  gst_base_src_set_format (GST_BASE_SRC (self), GST_FORMAT_TIME);
+}
+
+static GstURIType
+shm_sub_src_uri_get_type (GType type)
+{
+  return GST_URI_SRC;
+}
+
+static const gchar *const *
+shm_sub_src_uri_get_protocols (GType type)
+{
+  static const gchar *protocols[] = { "shm", NULL };
+
+  return protocols;
+}
+
+static gchar *
+shm_sub_src_uri_get_uri (GstURIHandler * handler)
+{
+  GstMultiSourceShmSubSrc *self = GST_MULTI_SOURCE_SHM_SUB_SRC (handler);
+  gchar *uri = NULL;
+
+  GST_OBJECT_LOCK (self);
+  if (self->socket_path)
+    uri = g_strdup_printf ("shm://%s", self->socket_path);
+  GST_OBJECT_UNLOCK (self);
+
+  return uri;
+}
+
+static gboolean
+shm_sub_src_uri_set_uri (GstURIHandler * handler, const gchar * uri,
+    GError ** error)
+{
+  GstMultiSourceShmSubSrc *self = GST_MULTI_SOURCE_SHM_SUB_SRC (handler);
+  gchar *path = gst_uri_get_location (uri);
+
+  if (!path || *path == '\0') {
+    g_set_error (error, GST_URI_ERROR, GST_URI_ERROR_BAD_URI,
+        "Invalid URI %s, expected shm://SOCKET_PATH", uri);
+    g_free (path);
+    return FALSE;
+  }
+  g_object_set (self, "socket-path", path, NULL);
+  g_free (path);
+
+  return TRUE;
+}
+
+static void
+shm_sub_src_uri_handler_init (gpointer g_iface, gpointer iface_data)
+{
+  GstURIHandlerInterface *iface = (GstURIHandlerInterface *) g_iface;
+
+  iface->get_type = shm_sub_src_uri_get_type;
+  iface->get_protocols = shm_sub_src_uri_get_protocols;
+  iface->get_uri = shm_sub_src_uri_get_uri;
+  iface->set_uri = shm_sub_src_uri_set_uri;
+}
@@ -0,0 +1,79 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_SHM_SUB_SRC_H__
+#define __GST_MULTI_SOURCE_SHM_SUB_SRC_H__
+
+#include <gio/gio.h>
+#include <gst/gst.h>
+#include <gst/base/gstpushsrc.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MULTI_SOURCE_SHM_SUB_SRC (shm_sub_src_get_type ())
+#define GST_MULTI_SOURCE_SHM_SUB_SRC(obj) \
+    (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_MULTI_SOURCE_SHM_SUB_SRC, \
+        GstMultiSourceShmSubSrc))
+
+#define SHM_SUB_SRC_DEFAULT_RECONNECT_INTERVAL (500 * GST_MSECOND)
+/* Time a producer has to greet a consumer that connected */
+#define SHM_SUB_SRC_HELLO_TIMEOUT 1000
+/* Time between two attempts to send the releases the socket had no room
+ * for, in ms */
+#define SHM_SUB_SRC_RELEASE_RETRY 10
+
+/* A connection to a producer and the mapping of its segment, alive until
+ * the last buffer wrapping the mapping is released */
+typedef struct _ShmConnection ShmConnection;
+
+typedef struct _GstMultiSourceShmSubSrc
+{
+  GstPushSrc parent;
+
+  /* properties */
+  gchar *socket_path;
+  GstClockTime reconnect_interval;
+
+  ShmConnection *conn;
+  GCancellable *cancellable;
+  gchar *payload;
+  GstCaps *caps;
+  /* from the clock of the producer to ours, set by the first buffer of
+   * every connection */
+  GstClockTimeDiff ts_offset;
+  gboolean have_offset;
+  gboolean discont;
+
+  /* statistics, protected by the object lock */
+  guint64 buffers;
+  guint64 reconnects;
+  guint64 invalid;
+} GstMultiSourceShmSubSrc;
+
+typedef struct _GstMultiSourceShmSubSrcClass
+{
+  GstPushSrcClass parent_class;
+} GstMultiSourceShmSubSrcClass;
+
+GType shm_sub_src_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_SHM_SUB_SRC_H__ */
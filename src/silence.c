@@ -0,0 +1,172 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "silence.h"
+
+#define METER_LANES 8
+#define METER_FLOOR -200.0
+
+void
+silence_init (GstMultiSourceSilence * silence, gdouble threshold,
+    GstClockTime hold)
+{
+  memset (silence, 0, sizeof (GstMultiSourceSilence));
+  g_mutex_init (&silence->lock);
+  silence->threshold = threshold;
+  silence->hold = hold;
+  silence->rms = METER_FLOOR;
+  silence->peak = METER_FLOOR;
+}
+
+void
+silence_clear (GstMultiSourceSilence * silence)
+{
+  g_mutex_clear (&silence->lock);
+}
+
+/* Accumulate the sum of squares and the peak of normalized samples. The
+ * samples are spread over METER_LANES accumulators so the fixed size inner
+ * loop vectorizes without reassociating float additions. */
+#define DEFINE_METER(type, scale) \
+static void \
+meter_##type (const g##type * samples, guint n, gfloat * sumsq, \
+    gfloat * peak) \
+{ \
+  gfloat acc[METER_LANES] = { 0, }; \
+  gfloat top[METER_LANES] = { 0, }; \
+  guint i, j; \
+  \
+  for (i = 0; i + METER_LANES <= n; i += METER_LANES) { \
+    for (j = 0; j < METER_LANES; j++) { \
+      gfloat v = samples[i + j] * (scale); \
+      acc[j] += v * v; \
+      top[j] = MAX (top[j], ABS (v)); \
+    } \
+  } \
+  for (; i < n; i++) { \
+    gfloat v = samples[i] * (scale); \
+    acc[0] += v * v; \
+    top[0] = MAX (top[0], ABS (v)); \
+  } \
+  for (j = 0; j < METER_LANES; j++) { \
+    *sumsq += acc[j]; \
+    *peak = MAX (*peak, top[j]); \
+  } \
+}
+
+DEFINE_METER (int16, 1.0f / 32768.0f);
+DEFINE_METER (float, 1.0f);
+
+static gdouble
+to_db (gdouble value)
+{
+  return value > 0.0 ? MAX (20.0 * log10 (value), METER_FLOOR) : METER_FLOOR;
+}
+
+/* Measure one decoded buffer. Returns SILENCE_SUPPRESS once the branch has
+ * been below the threshold for longer than the hold time, and sets changed
+ * when the silent state toggles. */
+GstMultiSourceSilenceResult
+silence_process (GstMultiSourceSilence * silence, const GstAudioInfo * info,
+    GstBuffer * buffer, gboolean * changed)
+{
+  GstAudioFormat format = GST_AUDIO_INFO_FORMAT (info);
+  GstAudioBuffer abuf;
+  GstClockTime duration;
+  gfloat sumsq = 0.0f, peak = 0.0f;
+  gdouble rms_db, peak_db;
+  gboolean silent;
+  guint n, per_plane, i;
+
+  *changed = FALSE;
+
+  /* Planar buffers, from most libav audio decoders, are mapped plane by
+   * plane through their GstAudioMeta; the levels do not depend on the
+   * layout. */
+  if ((format != GST_AUDIO_FORMAT_S16 && format != GST_AUDIO_FORMAT_F32)
+      || !gst_audio_buffer_map (&abuf, info, buffer, GST_MAP_READ)) {
+    g_mutex_lock (&silence->lock);
+    silence->skipped++;
+    g_mutex_unlock (&silence->lock);
+    return SILENCE_PASS;
+  }
+
+  n = abuf.n_samples * GST_AUDIO_INFO_CHANNELS (info);
+  per_plane = n / abuf.n_planes;
+  for (i = 0; i < abuf.n_planes; i++) {
+    if (format == GST_AUDIO_FORMAT_S16)
+      meter_int16 ((const gint16 *) abuf.planes[i], per_plane, &sumsq, &peak);
+    else
+      meter_float ((const gfloat *) abuf.planes[i], per_plane, &sumsq, &peak);
+  }
+  gst_audio_buffer_unmap (&abuf);
+
+  rms_db = to_db (n ? sqrt (sumsq / n) : 0.0);
+  peak_db = to_db (peak);
+
+  if (GST_BUFFER_DURATION_IS_VALID (buffer))
+    duration = GST_BUFFER_DURATION (buffer);
+  else
+    duration = gst_util_uint64_scale (n / GST_AUDIO_INFO_CHANNELS (info),
+        GST_SECOND, GST_AUDIO_INFO_RATE (info));
+
+  /* A span is silent when no sample goes over the threshold */
+  if (peak_db < silence->threshold)
+    silence->silent_duration += duration;
+  else
+    silence->silent_duration = 0;
+  silent = silence->silent_duration >= silence->hold;
+
+  g_mutex_lock (&silence->lock);
+  silence->buffers++;
+  silence->rms = rms_db;
+  silence->peak = peak_db;
+  if (silent) {
+    silence->suppressed++;
+    silence->suppressed_time += duration;
+  }
+  *changed = silent != silence->silent;
+  silence->silent = silent;
+  g_mutex_unlock (&silence->lock);
+
+  return silent ? SILENCE_SUPPRESS : SILENCE_PASS;
+}
+
+GstStructure *
+silence_get_stats (GstMultiSourceSilence * silence)
+{
+  GstStructure *s;
+
+  g_mutex_lock (&silence->lock);
+  s = gst_structure_new ("silence",
+      "buffers", G_TYPE_UINT64, silence->buffers,
+      "skipped", G_TYPE_UINT64, silence->skipped,
+      "silent-buffers", G_TYPE_UINT64, silence->suppressed,
+      "silent-time", G_TYPE_UINT64, silence->suppressed_time,
+      "rms", G_TYPE_DOUBLE, silence->rms,
+      "peak", G_TYPE_DOUBLE, silence->peak,
+      "silent", G_TYPE_BOOLEAN, silence->silent, NULL);
+  g_mutex_unlock (&silence->lock);
+
+  return s;
+}
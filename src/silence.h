@@ -0,0 +1,68 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_SILENCE_H__
+#define __GST_MULTI_SOURCE_SILENCE_H__
+
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+
+G_BEGIN_DECLS
+
+#define SILENCE_DEFAULT_THRESHOLD -60.0
+#define SILENCE_DEFAULT_HOLD (500 * GST_MSECOND)
+
+typedef enum
+{
+  SILENCE_PASS,
+  SILENCE_SUPPRESS,
+} GstMultiSourceSilenceResult;
+
+typedef struct _GstMultiSourceSilence
+{
+  GMutex lock;
+
+  /* configuration */
+  gdouble threshold;
+  GstClockTime hold;
+
+  /* streaming thread only */
+  GstClockTime silent_duration;
+
+  /* statistics, protected by lock */
+  guint64 buffers;
+  guint64 skipped;
+  guint64 suppressed;
+  GstClockTime suppressed_time;
+  gdouble rms;
+  gdouble peak;
+  gboolean silent;
+} GstMultiSourceSilence;
+
+void silence_init (GstMultiSourceSilence * silence, gdouble threshold,
+    GstClockTime hold);
+void silence_clear (GstMultiSourceSilence * silence);
+GstMultiSourceSilenceResult silence_process (GstMultiSourceSilence * silence,
+    const GstAudioInfo * info, GstBuffer * buffer, gboolean * changed);
+GstStructure *silence_get_stats (GstMultiSourceSilence * silence);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_SILENCE_H__ */
@@ -0,0 +1,263 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "sysinfo.h"
+
+/* User and system CPU time consumed by the process, in microseconds */
+gint64
+sysinfo_get_process_cpu_time (void)
+{
+  struct rusage usage;
+
+  if (getrusage (RUSAGE_SELF, &usage) < 0)
+    return 0;
+
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * G_USEC_PER_SEC
+      + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/* Read the aggregated jiffies of every core from /proc/stat */
+gboolean
+sysinfo_read_cpu_times (guint64 * total, guint64 * idle)
+{
+  gchar *contents = NULL;
+  guint64 v[8] = { 0, };
+  gboolean res = FALSE;
+
+  if (!g_file_get_contents ("/proc/stat", &contents, NULL, NULL))
+    return FALSE;
+
+  if (sscanf (contents, "cpu %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT
+          " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT
+          " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT,
+          &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) >= 4) {
+    *total = v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7];
+    *idle = v[3] + v[4];
+    res = TRUE;
+  }
+  g_free (contents);
+
+  return res;
+}
+
+/* MemAvailable from /proc/meminfo in bytes, G_MAXUINT64 when unknown */
+guint64
+sysinfo_read_available_memory (void)
+{
+  gchar *contents = NULL;
+  gchar *line;
+  guint64 kb = 0;
+
+  if (!g_file_get_contents ("/proc/meminfo", &contents, NULL, NULL))
+    return G_MAXUINT64;
+
+  line = strstr (contents, "MemAvailable:");
+  if (line)
+    kb = g_ascii_strtoull (line + strlen ("MemAvailable:"), NULL, 10);
+  g_free (contents);
+
+  return line ? kb * 1024 : G_MAXUINT64;
+}
+
+/* Directory of the cgroup v2 the process belongs to, NULL when the unified
+ * hierarchy is not mounted */
+gchar *
+sysinfo_get_cgroup_dir (void)
+{
+  gchar *contents = NULL;
+  gchar **lines, **line;
+  gchar *dir = NULL;
+
+  if (!g_file_get_contents ("/proc/self/cgroup", &contents, NULL, NULL))
+    return NULL;
+
+  lines = g_strsplit (contents, "\n", -1);
+  for (line = lines; *line; line++) {
+    if (g_str_has_prefix (*line, "0::")) {
+      dir = g_build_filename ("/sys/fs/cgroup", *line + 3, NULL);
+      break;
+    }
+  }
+  g_strfreev (lines);
+  g_free (contents);
+
+  if (dir && !g_file_test (dir, G_FILE_TEST_IS_DIR)) {
+    g_free (dir);
+    dir = NULL;
+  }
+
+  return dir;
+}
+
+static gchar *
+read_cgroup_file (const gchar * dir, const gchar * name)
+{
+  gchar *path = g_build_filename (dir, name, NULL);
+  gchar *contents = NULL;
+
+  if (g_file_get_contents (path, &contents, NULL, NULL))
+    g_strstrip (contents);
+  g_free (path);
+
+  return contents;
+}
+
+/* Number of CPUs in a cpuset list such as "0-3,8,10-11" */
+static guint
+count_cpus (const gchar * list)
+{
+  gchar **ranges = g_strsplit (list, ",", -1);
+  gchar **range;
+  guint count = 0;
+
+  for (range = ranges; *range; range++) {
+    guint first, last;
+
+    if (sscanf (*range, "%u-%u", &first, &last) == 2 && last >= first)
+      count += last - first + 1;
+    else if (sscanf (*range, "%u", &first) == 1)
+      count++;
+  }
+  g_strfreev (ranges);
+
+  return count;
+}
+
+/* CPUs and memory the process may use. The limits of every cgroup up to
+ * the root apply, so the smallest one wins. cpus may be fractional when
+ * it comes from a CFS quota; memory is G_MAXUINT64 when not limited. */
+void
+sysinfo_read_limits (gdouble * cpus, guint64 * memory)
+{
+  gchar *dir = sysinfo_get_cgroup_dir ();
+
+  *cpus = g_get_num_processors ();
+  *memory = G_MAXUINT64;
+
+  while (dir) {
+    gchar *value, *parent;
+    guint64 quota, period;
+
+    value = read_cgroup_file (dir, "cpu.max");
+    if (value && sscanf (value, "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT,
+            &quota, &period) == 2 && period > 0)
+      *cpus = MIN (*cpus, (gdouble) quota / period);
+    g_free (value);
+
+    value = read_cgroup_file (dir, "cpuset.cpus.effective");
+    if (value && *value)
+      *cpus = MIN (*cpus, count_cpus (value));
+    g_free (value);
+
+    value = read_cgroup_file (dir, "memory.max");
+    if (value && g_ascii_isdigit (*value))
+      *memory = MIN (*memory, g_ascii_strtoull (value, NULL, 10));
+    g_free (value);
+
+    if (!strcmp (dir, "/sys/fs/cgroup")
+        || !g_str_has_prefix (dir, "/sys/fs/cgroup")) {
+      g_free (dir);
+      break;
+    }
+    parent = g_path_get_dirname (dir);
+    g_free (dir);
+    dir = parent;
+  }
+}
+
+/* Memory charged to the cgroup of the process, 0 when unknown */
+guint64
+sysinfo_read_cgroup_memory_usage (void)
+{
+  gchar *dir = sysinfo_get_cgroup_dir ();
+  gchar *value;
+  guint64 usage = 0;
+
+  if (!dir)
+    return 0;
+
+  value = read_cgroup_file (dir, "memory.current");
+  if (value)
+    usage = g_ascii_strtoull (value, NULL, 10);
+  g_free (value);
+  g_free (dir);
+
+  return usage;
+}
+
+/* Page faults of the process since it started */
+void
+sysinfo_get_page_faults (guint64 * minor, guint64 * major)
+{
+  struct rusage usage;
+
+  *minor = *major = 0;
+  if (getrusage (RUSAGE_SELF, &usage) < 0)
+    return;
+
+  *minor = usage.ru_minflt;
+  *major = usage.ru_majflt;
+}
+
+/* Count the data TLB misses of the process in user space, including the
+ * threads created after this call. Returns -1 when the kernel does not let
+ * us, perf_event_paranoid being too strict for instance. */
+gint
+sysinfo_open_tlb_counter (void)
+{
+#ifdef __linux__
+  struct perf_event_attr attr;
+
+  memset (&attr, 0, sizeof (attr));
+  attr.size = sizeof (attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config = PERF_COUNT_HW_CACHE_DTLB |
+      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.inherit = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  return syscall (SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+  return -1;
+#endif
+}
+
+guint64
+sysinfo_read_counter (gint fd)
+{
+#ifdef __linux__
+  guint64 value;
+
+  if (fd >= 0 && read (fd, &value, sizeof (value)) == sizeof (value))
+    return value;
+#endif
+  return 0;
+}
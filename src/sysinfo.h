@@ -0,0 +1,40 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_SYSINFO_H__
+#define __GST_MULTI_SOURCE_SYSINFO_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+gint64 sysinfo_get_process_cpu_time (void);
+gboolean sysinfo_read_cpu_times (guint64 * total, guint64 * idle);
+guint64 sysinfo_read_available_memory (void);
+gchar *sysinfo_get_cgroup_dir (void);
+void sysinfo_read_limits (gdouble * cpus, guint64 * memory);
+guint64 sysinfo_read_cgroup_memory_usage (void);
+void sysinfo_get_page_faults (guint64 * minor, guint64 * major);
+gint sysinfo_open_tlb_counter (void);
+guint64 sysinfo_read_counter (gint fd);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_SYSINFO_H__ */
@@ -0,0 +1,563 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-testsrc
+ *
+ * Generate a compressed video stream for load tests at almost no CPU
+ * cost. One GOP is encoded when the source starts, with videotestsrc and
+ * the encoder of the codec, then its packets are pushed again and again
+ * with new timestamps. The encoded GOP is kept for the lifetime of the
+ * process and shared by all the sources with the same settings, so a
+ * hundred branches encode it once.
+ *
+ * It handles testsrc:// URIs, e.g. testsrc://h264/1080p30?gop=60, so it
+ * can stand for any branch source:
+ * testsrc://CODEC/[WIDTHx]HEIGHTpFPS[?gop=N&bitrate=KBPS&pattern=P&live=B]
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <gst/app/gstappsink.h>
+
+#include "multisource.h"
+#include "testsrc.h"
+
+#define GST_CAT_DEFAULT multisource_launch_debug
+
+enum
+{
+  PROP_0,
+  PROP_CODEC,
+  PROP_WIDTH,
+  PROP_HEIGHT,
+  PROP_FRAMERATE,
+  PROP_GOP,
+  PROP_BITRATE,
+  PROP_PATTERN,
+  PROP_IS_LIVE,
+};
+
+struct _TestSrcGop
+{
+  GstCaps *caps;
+  /* starts with a keyframe carrying the codec headers */
+  GPtrArray *buffers;
+};
+
+/* The encoders take the GOP length then the bitrate, scaled from kbit/s
+ * to their unit */
+static const struct
+{
+  const gchar *codec;
+  const gchar *encoder;
+  guint bitrate_scale;
+  const gchar *parser;
+} codecs[] = {
+  {"h264", "x264enc key-int-max=%u bitrate=%u bframes=0 "
+        "speed-preset=ultrafast tune=zerolatency", 1,
+      "h264parse config-interval=-1 ! "
+        "video/x-h264,stream-format=byte-stream,alignment=au"},
+  {"h265", "x265enc key-int-max=%u bitrate=%u speed-preset=ultrafast "
+        "tune=zerolatency", 1,
+      "h265parse config-interval=-1 ! "
+        "video/x-h265,stream-format=byte-stream,alignment=au"},
+  {"vp8", "vp8enc keyframe-max-dist=%u target-bitrate=%u deadline=1", 1000,
+      "identity"},
+  {"vp9", "vp9enc keyframe-max-dist=%u target-bitrate=%u deadline=1", 1000,
+      "identity"},
+};
+
+static GMutex gops_lock;
+static GHashTable *gops;
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+static void test_src_uri_handler_init (gpointer g_iface, gpointer iface_data);
+
+G_DEFINE_TYPE_WITH_CODE (GstMultiSourceTestSrc, test_src, GST_TYPE_PUSH_SRC,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_URI_HANDLER, test_src_uri_handler_init));
+
+static guint
+get_gop_length (GstMultiSourceTestSrc * self)
+{
+  return self->gop ? self->gop : 2 * self->framerate;
+}
+
+static gint
+find_codec (const gchar * codec)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (codecs); i++)
+    if (g_strcmp0 (codec, codecs[i].codec) == 0)
+      return i;
+
+  return -1;
+}
+
+/* Run a short encoding pipeline and collect the packets of one GOP */
+static TestSrcGop *
+encode_gop (GstMultiSourceTestSrc * self, gint codec, GError ** error)
+{
+  TestSrcGop *packets;
+  GstElement *pipeline, *sink;
+  GstSample *sample;
+  GstMessage *msg;
+  GstBus *bus;
+  GError *err = NULL;
+  gchar *encoder, *desc;
+
+  encoder = g_strdup_printf (codecs[codec].encoder, get_gop_length (self),
+      self->bitrate * codecs[codec].bitrate_scale);
+  desc = g_strdup_printf ("videotestsrc num-buffers=%u pattern=%s ! "
+      "video/x-raw,format=I420,width=%u,height=%u,framerate=%u/1 ! "
+      "%s ! %s ! appsink name=sink sync=false", get_gop_length (self),
+      self->pattern, self->width, self->height, self->framerate, encoder,
+      codecs[codec].parser);
+  GST_DEBUG_OBJECT (self, "Encoding the test GOP with %s", desc);
+  pipeline = gst_parse_launch_full (desc, NULL, GST_PARSE_FLAG_FATAL_ERRORS,
+      error);
+  g_free (desc);
+  g_free (encoder);
+  if (!pipeline)
+    return NULL;
+
+  packets = g_new0 (TestSrcGop, 1);
+  packets->buffers =
+      g_ptr_array_new_with_free_func ((GDestroyNotify) gst_buffer_unref);
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  while ((sample = gst_app_sink_pull_sample (GST_APP_SINK (sink)))) {
+    if (!packets->caps)
+      packets->caps = gst_caps_ref (gst_sample_get_caps (sample));
+    g_ptr_array_add (packets->buffers,
+        gst_buffer_ref (gst_sample_get_buffer (sample)));
+    gst_sample_unref (sample);
+  }
+
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_pop_filtered (bus, GST_MESSAGE_ERROR);
+  if (msg) {
+    gst_message_parse_error (msg, &err, NULL);
+    gst_message_unref (msg);
+  } else if (!packets->caps || GST_BUFFER_FLAG_IS_SET (g_ptr_array_index
+          (packets->buffers, 0), GST_BUFFER_FLAG_DELTA_UNIT)) {
+    g_set_error (&err, GST_STREAM_ERROR, GST_STREAM_ERROR_ENCODE,
+        "The encoder did not start with a keyframe");
+  }
+  gst_object_unref (bus);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (sink);
+  gst_object_unref (pipeline);
+
+  if (err) {
+    g_propagate_error (error, err);
+    gst_clear_caps (&packets->caps);
+    g_ptr_array_free (packets->buffers, TRUE);
+    g_free (packets);
+    return NULL;
+  }
+
+  return packets;
+}
+
+static const TestSrcGop *
+get_gop (GstMultiSourceTestSrc * self, gint codec, GError ** error)
+{
+  TestSrcGop *packets;
+  gchar *key;
+
+  key = g_strdup_printf ("%s/%ux%u/%u/%u/%u/%s", self->codec, self->width,
+      self->height, self->framerate, get_gop_length (self), self->bitrate,
+      self->pattern);
+
+  /* Held while encoding, so that the sources starting together wait for
+   * the first one rather than all encoding the same GOP */
+  g_mutex_lock (&gops_lock);
+  if (!gops)
+    gops = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  packets = g_hash_table_lookup (gops, key);
+  if (!packets) {
+    packets = encode_gop (self, codec, error);
+    if (packets) {
+      GST_INFO_OBJECT (self, "Encoded %s in %u packets", key,
+          packets->buffers->len);
+      g_hash_table_insert (gops, key, packets);
+      key = NULL;
+    }
+  }
+  g_mutex_unlock (&gops_lock);
+  g_free (key);
+
+  return packets;
+}
+
+static gboolean
+test_src_start (GstBaseSrc * src)
+{
+  GstMultiSourceTestSrc *self = GST_MULTI_SOURCE_TEST_SRC (src);
+  GError *err = NULL;
+  gint codec;
+
+  codec = find_codec (self->codec);
+  if (codec < 0) {
+    GST_ELEMENT_ERROR (self, RESOURCE, SETTINGS,
+        ("Unknown test codec \"%s\".", GST_STR_NULL (self->codec)), (NULL));
+    return FALSE;
+  }
+  if (self->width == 0 || self->height == 0 || self->framerate == 0) {
+    GST_ELEMENT_ERROR (self, RESOURCE, SETTINGS,
+        ("Invalid test video size or framerate."), (NULL));
+    return FALSE;
+  }
+
+  self->packets = get_gop (self, codec, &err);
+  if (!self->packets) {
+    GST_ELEMENT_ERROR (self, RESOURCE, FAILED,
+        ("Could not encode the %s test stream.", self->codec),
+        ("%s", err ? err->message : "unknown error"));
+    g_clear_error (&err);
+    return FALSE;
+  }
+  self->frame = 0;
+
+  return TRUE;
+}
+
+static gboolean
+test_src_stop (GstBaseSrc * src)
+{
+  GstMultiSourceTestSrc *self = GST_MULTI_SOURCE_TEST_SRC (src);
+
+  self->packets = NULL;
+
+  return TRUE;
+}
+
+static GstCaps *
+test_src_get_caps (GstBaseSrc * src, GstCaps * filter)
+{
+  GstMultiSourceTestSrc *self = GST_MULTI_SOURCE_TEST_SRC (src);
+  GstCaps *caps;
+
+  if (self->packets)
+    caps = gst_caps_ref (self->packets->caps);
+  else
+    caps = gst_pad_get_pad_template_caps (GST_BASE_SRC_PAD (src));
+
+  if (filter) {
+    GstCaps *intersection = gst_caps_intersect_full (filter, caps,
+        GST_CAPS_INTERSECT_FIRST);
+
+    gst_caps_unref (caps);
+    caps = intersection;
+  }
+
+  return caps;
+}
+
+/* Let the base class wait for the clock to push in real time when live */
+static void
+test_src_get_times (GstBaseSrc * src, GstBuffer * buffer,
+    GstClockTime * start, GstClockTime * end)
+{
+  *start = GST_CLOCK_TIME_NONE;
+  *end = GST_CLOCK_TIME_NONE;
+  if (gst_base_src_is_live (src)) {
+    *start = GST_BUFFER_PTS (buffer);
+    *end = *start + GST_BUFFER_DURATION (buffer);
+  }
+}
+
+static GstFlowReturn
+test_src_create (GstPushSrc * src, GstBuffer ** buffer)
+{
+  GstMultiSourceTestSrc *self = GST_MULTI_SOURCE_TEST_SRC (src);
+  GPtrArray *buffers = self->packets->buffers;
+  guint64 frame = self->frame++;
+  GstClockTime pts;
+
+  /* Only the metadata is copied, the memories are shared */
+  *buffer = gst_buffer_copy (g_ptr_array_index (buffers,
+          frame % buffers->len));
+  pts = gst_util_uint64_scale (frame, GST_SECOND, self->framerate);
+  GST_BUFFER_PTS (*buffer) = pts;
+  GST_BUFFER_DTS (*buffer) = pts;
+  GST_BUFFER_DURATION (*buffer) =
+      gst_util_uint64_scale (frame + 1, GST_SECOND, self->framerate) - pts;
+  GST_BUFFER_OFFSET (*buffer) = frame;
+  GST_BUFFER_OFFSET_END (*buffer) = frame + 1;
+  GST_BUFFER_FLAG_UNSET (*buffer, GST_BUFFER_FLAG_DISCONT);
+
+  return GST_FLOW_OK;
+}
+
+static void
+test_src_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMultiSourceTestSrc *self = GST_MULTI_SOURCE_TEST_SRC (object);
+
+  switch (prop_id) {
+    case PROP_CODEC:
+      g_free (self->codec);
+      self->codec = g_value_dup_string (value);
+      break;
+    case PROP_WIDTH:
+      self->width = g_value_get_uint (value);
+      break;
+    case PROP_HEIGHT:
+      self->height = g_value_get_uint (value);
+      break;
+    case PROP_FRAMERATE:
+      self->framerate = g_value_get_uint (value);
+      break;
+    case PROP_GOP:
+      self->gop = g_value_get_uint (value);
+      break;
+    case PROP_BITRATE:
+      self->bitrate = g_value_get_uint (value);
+      break;
+    case PROP_PATTERN:
+      g_free (self->pattern);
+      self->pattern = g_value_dup_string (value);
+      break;
+    case PROP_IS_LIVE:
+      self->live = g_value_get_boolean (value);
+      /* Before the state change, for it to return NO_PREROLL */
+      gst_base_src_set_live (GST_BASE_SRC (object), self->live);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+test_src_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstMultiSourceTestSrc *self = GST_MULTI_SOURCE_TEST_SRC (object);
+
+  switch (prop_id) {
+    case PROP_CODEC:
+      g_value_set_string (value, self->codec);
+      break;
+    case PROP_WIDTH:
+      g_value_set_uint (value, self->width);
+      break;
+    case PROP_HEIGHT:
+      g_value_set_uint (value, self->height);
+      break;
+    case PROP_FRAMERATE:
+      g_value_set_uint (value, self->framerate);
+      break;
+    case PROP_GOP:
+      g_value_set_uint (value, self->gop);
+      break;
+    case PROP_BITRATE:
+      g_value_set_uint (value, self->bitrate);
+      break;
+    case PROP_PATTERN:
+      g_value_set_string (value, self->pattern);
+      break;
+    case PROP_IS_LIVE:
+      g_value_set_boolean (value, self->live);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+test_src_finalize (GObject * object)
+{
+  GstMultiSourceTestSrc *self = GST_MULTI_SOURCE_TEST_SRC (object);
+
+  g_free (self->codec);
+  g_free (self->pattern);
+
+  G_OBJECT_CLASS (test_src_parent_class)->finalize (object);
+}
+
+static void
+test_src_class_init (GstMultiSourceTestSrcClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS (klass);
+  GstPushSrcClass *pushsrc_class = GST_PUSH_SRC_CLASS (klass);
+
+  gobject_class->set_property = test_src_set_property;
+  gobject_class->get_property = test_src_get_property;
+  gobject_class->finalize = test_src_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_CODEC,
+      g_param_spec_string ("codec", "Codec",
+          "Codec of the stream: h264, h265, vp8 or vp9",
+          TEST_SRC_DEFAULT_CODEC, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_WIDTH,
+      g_param_spec_uint ("width", "Width", "Width of the video", 1,
+          G_MAXUINT, TEST_SRC_DEFAULT_WIDTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_HEIGHT,
+      g_param_spec_uint ("height", "Height", "Height of the video", 1,
+          G_MAXUINT, TEST_SRC_DEFAULT_HEIGHT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_FRAMERATE,
+      g_param_spec_uint ("framerate", "Framerate", "Frames per second", 1,
+          G_MAXUINT, TEST_SRC_DEFAULT_FRAMERATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_GOP,
+      g_param_spec_uint ("gop", "GOP length",
+          "Frames between keyframes (0 = two seconds)", 0, G_MAXUINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_BITRATE,
+      g_param_spec_uint ("bitrate", "Bitrate", "Bitrate in kbit/s", 1,
+          G_MAXUINT / 1000, TEST_SRC_DEFAULT_BITRATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PATTERN,
+      g_param_spec_string ("pattern", "Pattern",
+          "videotestsrc pattern encoded", TEST_SRC_DEFAULT_PATTERN,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_IS_LIVE,
+      g_param_spec_boolean ("is-live", "Is live",
+          "Push in real time rather than as fast as possible", TRUE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &src_template);
+  gst_element_class_set_static_metadata (element_class,
+      "Test Stream Source", "Source/Video",
+      "Loop the packets of a GOP encoded once, for load tests",
+      "gst-multisource-launch");
+
+  basesrc_class->start = test_src_start;
+  basesrc_class->stop = test_src_stop;
+  basesrc_class->get_caps = test_src_get_caps;
+  basesrc_class->get_times = test_src_get_times;
+  pushsrc_class->create = test_src_create;
+}
+
+static void
+test_src_init (GstMultiSourceTestSrc * self)
+{
+  self->codec = g_strdup (TEST_SRC_DEFAULT_CODEC);
+  self->width = TEST_SRC_DEFAULT_WIDTH;
+  self->height = TEST_SRC_DEFAULT_HEIGHT;
+  self->framerate = TEST_SRC_DEFAULT_FRAMERATE;
+  self->bitrate = TEST_SRC_DEFAULT_BITRATE;
+  self->pattern = g_strdup (TEST_SRC_DEFAULT_PATTERN);
+  self->live = TRUE;
+  gst_base_src_set_live (GST_BASE_SRC (self), self->live);
+  gst_base_src_set_format (GST_BASE_SRC (self), GST_FORMAT_TIME);
+}
+
+static GstURIType
+test_src_uri_get_type (GType type)
+{
+  return GST_URI_SRC;
+}
+
+static const gchar *const *
+test_src_uri_get_protocols (GType type)
+{
+  static const gchar *protocols[] = { "testsrc", NULL };
+
+  return protocols;
+}
+
+static gchar *
+test_src_uri_get_uri (GstURIHandler * handler)
+{
+  GstMultiSourceTestSrc *self = GST_MULTI_SOURCE_TEST_SRC (handler);
+
+  return g_strdup_printf ("testsrc://%s/%ux%up%u?gop=%u&bitrate=%u"
+      "&pattern=%s&live=%s", self->codec, self->width, self->height,
+      self->framerate, self->gop, self->bitrate, self->pattern,
+      self->live ? "true" : "false");
+}
+
+/* Parse testsrc://CODEC/[WIDTHx]HEIGHTpFPS, the width defaulting to a 16:9
+ * picture, and the query settings */
+static gboolean
+test_src_uri_set_uri (GstURIHandler * handler, const gchar * uri,
+    GError ** error)
+{
+  GstMultiSourceTestSrc *self = GST_MULTI_SOURCE_TEST_SRC (handler);
+  guint width = 0, height = TEST_SRC_DEFAULT_HEIGHT;
+  guint framerate = TEST_SRC_DEFAULT_FRAMERATE;
+  const gchar *value;
+  gchar *path;
+  GstUri *parsed;
+
+  parsed = gst_uri_from_string (uri);
+  if (!parsed || find_codec (gst_uri_get_host (parsed)) < 0) {
+    g_set_error (error, GST_URI_ERROR, GST_URI_ERROR_BAD_URI,
+        "Invalid test URI %s, expected testsrc://CODEC/HEIGHTpFPS", uri);
+    if (parsed)
+      gst_uri_unref (parsed);
+    return FALSE;
+  }
+
+  path = gst_uri_get_path (parsed);
+  if (path && *path && strcmp (path, "/") != 0
+      && sscanf (path, "/%ux%up%u", &width, &height, &framerate) != 3
+      && sscanf (path, "/%up%u", &height, &framerate) != 2) {
+    g_set_error (error, GST_URI_ERROR, GST_URI_ERROR_BAD_URI,
+        "Invalid test video format %s, expected [WIDTHx]HEIGHTpFPS", path);
+    g_free (path);
+    gst_uri_unref (parsed);
+    return FALSE;
+  }
+  g_free (path);
+
+  g_object_set (self, "codec", gst_uri_get_host (parsed), "width",
+      width ? width : GST_ROUND_UP_2 (height * 16 / 9), "height", height,
+      "framerate", framerate, NULL);
+  if ((value = gst_uri_get_query_value (parsed, "gop")))
+    g_object_set (self, "gop", (guint) g_ascii_strtoull (value, NULL, 10),
+        NULL);
+  if ((value = gst_uri_get_query_value (parsed, "bitrate")))
+    g_object_set (self, "bitrate",
+        (guint) g_ascii_strtoull (value, NULL, 10), NULL);
+  if ((value = gst_uri_get_query_value (parsed, "pattern")))
+    g_object_set (self, "pattern", value, NULL);
+  if ((value = gst_uri_get_query_value (parsed, "live")))
+    g_object_set (self, "is-live", g_ascii_strcasecmp (value, "false") != 0
+        && strcmp (value, "0") != 0, NULL);
+  gst_uri_unref (parsed);
+
+  return TRUE;
+}
+
+static void
+test_src_uri_handler_init (gpointer g_iface, gpointer iface_data)
+{
+  GstURIHandlerInterface *iface = (GstURIHandlerInterface *) g_iface;
+
+  iface->get_type = test_src_uri_get_type;
+  iface->get_protocols = test_src_uri_get_protocols;
+  iface->get_uri = test_src_uri_get_uri;
+  iface->set_uri = test_src_uri_set_uri;
+}
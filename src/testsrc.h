@@ -0,0 +1,72 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_TEST_SRC_H__
+#define __GST_MULTI_SOURCE_TEST_SRC_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstpushsrc.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MULTI_SOURCE_TEST_SRC (test_src_get_type ())
+#define GST_MULTI_SOURCE_TEST_SRC(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+    GST_TYPE_MULTI_SOURCE_TEST_SRC, GstMultiSourceTestSrc))
+
+#define TEST_SRC_DEFAULT_CODEC "h264"
+#define TEST_SRC_DEFAULT_WIDTH 1920
+#define TEST_SRC_DEFAULT_HEIGHT 1080
+#define TEST_SRC_DEFAULT_FRAMERATE 30
+#define TEST_SRC_DEFAULT_BITRATE 4000
+#define TEST_SRC_DEFAULT_PATTERN "ball"
+
+/* The packets of one encoded GOP, shared by all the sources with the same
+ * settings */
+typedef struct _TestSrcGop TestSrcGop;
+
+typedef struct _GstMultiSourceTestSrc
+{
+  GstPushSrc parent;
+
+  /* properties */
+  gchar *codec;
+  guint width;
+  guint height;
+  guint framerate;
+  /* 0 for two seconds of frames */
+  guint gop;
+  guint bitrate;
+  gchar *pattern;
+  gboolean live;
+
+  const TestSrcGop *packets;
+  guint64 frame;
+} GstMultiSourceTestSrc;
+
+typedef struct _GstMultiSourceTestSrcClass
+{
+  GstPushSrcClass parent_class;
+} GstMultiSourceTestSrcClass;
+
+GType test_src_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_TEST_SRC_H__ */
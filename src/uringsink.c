@@ -0,0 +1,503 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-uringsink
+ *
+ * Write incoming data to a file without ever blocking the streaming thread
+ * on storage. The data is copied into a ring of buffers registered with
+ * io_uring, each full buffer being written asynchronously in one go. When
+ * every buffer is being written the incoming data is dropped, counted and
+ * warned about rather than waited for. The buffers are written unregistered
+ * when they do not fit in RLIMIT_MEMLOCK.
+ *
+ * gst-multisource-launch --sink "uringsink location=out.mkv" ...
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include "multisource.h"
+#include "uringsink.h"
+
+#define GST_CAT_DEFAULT multisource_launch_debug
+
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_CHUNKS,
+  PROP_CHUNK_SIZE,
+  PROP_FLUSH_INTERVAL,
+  PROP_WRITE_STATS,
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+G_DEFINE_TYPE (GstMultiSourceUringSink, uring_sink, GST_TYPE_BASE_SINK);
+
+static void
+record_completion (GstMultiSourceUringSink * self, UringChunk * chunk)
+{
+  guint64 latency = g_get_monotonic_time () - chunk->submitted;
+
+  GST_OBJECT_LOCK (self);
+  self->writes++;
+  self->bytes += chunk->filled;
+  self->latency_sum += latency;
+  self->latency_max = MAX (self->latency_max, latency);
+  self->latency[MIN (g_bit_storage (latency),
+          URING_SINK_LATENCY_BUCKETS - 1)]++;
+  GST_OBJECT_UNLOCK (self);
+}
+
+static gboolean
+submit_chunk (GstMultiSourceUringSink * self, UringChunk * chunk)
+{
+  struct io_uring_sqe *sqe = io_uring_get_sqe (&self->ring);
+
+  if (!sqe)
+    return FALSE;
+
+  if (self->registered)
+    io_uring_prep_write_fixed (sqe, self->fd, chunk->data + chunk->written,
+        chunk->filled - chunk->written, chunk->offset + chunk->written,
+        chunk->index);
+  else
+    io_uring_prep_write (sqe, self->fd, chunk->data + chunk->written,
+        chunk->filled - chunk->written, chunk->offset + chunk->written);
+  io_uring_sqe_set_data (sqe, chunk);
+  if (io_uring_submit (&self->ring) < 0)
+    return FALSE;
+
+  return TRUE;
+}
+
+/* Collect the finished writes, waiting for them only when asked to. A short
+ * write is submitted again for what is left. */
+static void
+reap (GstMultiSourceUringSink * self, gboolean wait)
+{
+  struct io_uring_cqe *cqe;
+
+  while (self->in_flight > 0) {
+    UringChunk *chunk;
+    gint res;
+
+    if (wait) {
+      if (io_uring_wait_cqe (&self->ring, &cqe) < 0)
+        break;
+    } else if (io_uring_peek_cqe (&self->ring, &cqe) != 0) {
+      break;
+    }
+
+    chunk = io_uring_cqe_get_data (cqe);
+    res = cqe->res;
+    io_uring_cqe_seen (&self->ring, cqe);
+
+    if (res < 0) {
+      self->error = -res;
+    } else {
+      chunk->written += res;
+      if (res > 0 && chunk->written < chunk->filled
+          && submit_chunk (self, chunk))
+        continue;
+      if (chunk->written < chunk->filled)
+        self->error = EIO;
+    }
+
+    record_completion (self, chunk);
+    chunk->filled = chunk->written = 0;
+    g_queue_push_tail (&self->free, chunk);
+    self->in_flight--;
+  }
+}
+
+/* Hand the chunk being filled over to the kernel */
+static void
+flush_chunk (GstMultiSourceUringSink * self)
+{
+  UringChunk *chunk = g_queue_peek_head (&self->free);
+
+  if (!chunk || chunk->filled == 0)
+    return;
+
+  chunk->offset = self->offset;
+  chunk->submitted = g_get_monotonic_time ();
+  if (!submit_chunk (self, chunk)) {
+    self->error = EAGAIN;
+    return;
+  }
+  g_queue_pop_head (&self->free);
+  self->offset += chunk->filled;
+  self->in_flight++;
+
+  GST_OBJECT_LOCK (self);
+  self->max_in_flight = MAX (self->max_in_flight, self->in_flight);
+  GST_OBJECT_UNLOCK (self);
+}
+
+static GstFlowReturn
+uring_sink_render (GstBaseSink * sink, GstBuffer * buffer)
+{
+  GstMultiSourceUringSink *self = GST_MULTI_SOURCE_URING_SINK (sink);
+  GstMapInfo map;
+  gsize pos = 0;
+
+  reap (self, FALSE);
+  if (self->error) {
+    GST_ELEMENT_ERROR (self, RESOURCE, WRITE, (NULL),
+        ("Error while writing to file \"%s\": %s", self->location,
+            g_strerror (self->error)));
+    return GST_FLOW_ERROR;
+  }
+
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ))
+    return GST_FLOW_ERROR;
+
+  while (pos < map.size) {
+    UringChunk *chunk = g_queue_peek_head (&self->free);
+    gsize len;
+
+    if (!chunk) {
+      GST_OBJECT_LOCK (self);
+      self->dropped_bytes += map.size - pos;
+      GST_OBJECT_UNLOCK (self);
+      /* The file misses data from now on, tell the application once */
+      if (!self->dropping)
+        GST_ELEMENT_WARNING (self, RESOURCE, WRITE,
+            ("Writing to \"%s\" falls behind, data is lost.",
+                self->location), ("All %u chunks are being written, "
+                "dropping %" G_GSIZE_FORMAT " bytes", self->n_chunks,
+                map.size - pos));
+      self->dropping = TRUE;
+      break;
+    }
+    self->dropping = FALSE;
+
+    if (chunk->filled == 0)
+      self->filling_since = g_get_monotonic_time ();
+    len = MIN (map.size - pos, self->chunk_size - chunk->filled);
+    memcpy (chunk->data + chunk->filled, map.data + pos, len);
+    chunk->filled += len;
+    pos += len;
+
+    if (chunk->filled == self->chunk_size)
+      flush_chunk (self);
+  }
+  gst_buffer_unmap (buffer, &map);
+
+  /* Do not keep the data of a slow stream in memory for too long */
+  if (self->flush_interval && self->filling_since
+      && g_get_monotonic_time () - self->filling_since >
+      GST_TIME_AS_USECONDS (self->flush_interval)) {
+    flush_chunk (self);
+    self->filling_since = 0;
+  }
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+uring_sink_event (GstBaseSink * sink, GstEvent * event)
+{
+  GstMultiSourceUringSink *self = GST_MULTI_SOURCE_URING_SINK (sink);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_SEGMENT:
+    {
+      const GstSegment *segment;
+      UringChunk *chunk = g_queue_peek_head (&self->free);
+      guint64 position = self->offset + (chunk ? chunk->filled : 0);
+
+      /* Muxers seek back to rewrite their headers, usually when they are
+       * done. The data gathered so far is written where it belongs first,
+       * and the writes in flight, which can complete in any order, are
+       * waited for before overwriting what they cover. */
+      gst_event_parse_segment (event, &segment);
+      if (segment->format == GST_FORMAT_BYTES && segment->start != position) {
+        flush_chunk (self);
+        if (segment->start < self->offset)
+          reap (self, TRUE);
+        self->offset = segment->start;
+        self->filling_since = 0;
+      }
+      break;
+    }
+    case GST_EVENT_EOS:
+      flush_chunk (self);
+      reap (self, TRUE);
+      break;
+    default:
+      break;
+  }
+
+  return GST_BASE_SINK_CLASS (uring_sink_parent_class)->event (sink, event);
+}
+
+static gboolean
+uring_sink_start (GstBaseSink * sink)
+{
+  GstMultiSourceUringSink *self = GST_MULTI_SOURCE_URING_SINK (sink);
+  struct iovec *iov;
+  guint i;
+  gint res;
+
+  if (!self->location) {
+    GST_ELEMENT_ERROR (self, RESOURCE, NOT_FOUND,
+        ("No file name specified for writing."), (NULL));
+    return FALSE;
+  }
+
+  self->fd = g_open (self->location, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+      0644);
+  if (self->fd < 0) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_WRITE,
+        ("Could not open file \"%s\" for writing.", self->location),
+        GST_ERROR_SYSTEM);
+    return FALSE;
+  }
+
+  res = io_uring_queue_init (self->n_chunks, &self->ring, 0);
+  if (res < 0) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_WRITE,
+        ("Could not set up io_uring."), ("%s", g_strerror (-res)));
+    close (self->fd);
+    self->fd = -1;
+    return FALSE;
+  }
+  self->have_ring = TRUE;
+
+  self->chunks = g_new0 (UringChunk, self->n_chunks);
+  iov = g_new (struct iovec, self->n_chunks);
+  for (i = 0; i < self->n_chunks; i++) {
+    self->chunks[i].index = i;
+    self->chunks[i].data = g_malloc (self->chunk_size);
+    iov[i].iov_base = self->chunks[i].data;
+    iov[i].iov_len = self->chunk_size;
+    g_queue_push_tail (&self->free, &self->chunks[i]);
+  }
+  /* Pinning the buffers once saves mapping them on every write. They are
+   * locked in memory, so beyond RLIMIT_MEMLOCK they are written as plain
+   * buffers instead. */
+  res = io_uring_register_buffers (&self->ring, iov, self->n_chunks);
+  g_free (iov);
+  self->registered = res >= 0;
+  if (!self->registered)
+    GST_WARNING_OBJECT (self, "Could not register %u buffers of %u bytes, "
+        "writing them unregistered: %s", self->n_chunks, self->chunk_size,
+        g_strerror (-res));
+
+  self->offset = 0;
+  self->in_flight = 0;
+  self->error = 0;
+  self->dropping = FALSE;
+  self->filling_since = 0;
+
+  return TRUE;
+}
+
+static gboolean
+uring_sink_stop (GstBaseSink * sink)
+{
+  GstMultiSourceUringSink *self = GST_MULTI_SOURCE_URING_SINK (sink);
+  guint i;
+
+  if (self->have_ring) {
+    /* The launcher stops without EOS on SIGINT, write the tail here too */
+    flush_chunk (self);
+    reap (self, TRUE);
+    io_uring_queue_exit (&self->ring);
+    self->have_ring = FALSE;
+  }
+  if (self->chunks) {
+    for (i = 0; i < self->n_chunks; i++)
+      g_free (self->chunks[i].data);
+    g_clear_pointer (&self->chunks, g_free);
+  }
+  g_queue_clear (&self->free);
+  if (self->fd >= 0) {
+    close (self->fd);
+    self->fd = -1;
+  }
+
+  return TRUE;
+}
+
+static GstStructure *
+get_stats (GstMultiSourceUringSink * self)
+{
+  GstStructure *s;
+  guint64 count = 0, p50 = 0, p99 = 0, seen = 0;
+  guint i;
+
+  GST_OBJECT_LOCK (self);
+  for (i = 0; i < URING_SINK_LATENCY_BUCKETS; i++)
+    count += self->latency[i];
+  /* Upper bound of the bucket each percentile falls in */
+  for (i = 0; i < URING_SINK_LATENCY_BUCKETS && count; i++) {
+    seen += self->latency[i];
+    if (!p50 && seen * 2 >= count)
+      p50 = G_GUINT64_CONSTANT (1) << i;
+    if (!p99 && seen * 100 >= count * 99)
+      p99 = G_GUINT64_CONSTANT (1) << i;
+  }
+  s = gst_structure_new ("uringsink",
+      "bytes", G_TYPE_UINT64, self->bytes,
+      "writes", G_TYPE_UINT64, self->writes,
+      "dropped-bytes", G_TYPE_UINT64, self->dropped_bytes,
+      "max-in-flight", G_TYPE_UINT, self->max_in_flight,
+      "latency-avg", G_TYPE_UINT64,
+      self->writes ? self->latency_sum / self->writes : 0,
+      "latency-p50", G_TYPE_UINT64, p50,
+      "latency-p99", G_TYPE_UINT64, p99,
+      "latency-max", G_TYPE_UINT64, self->latency_max, NULL);
+  GST_OBJECT_UNLOCK (self);
+
+  return s;
+}
+
+static void
+uring_sink_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMultiSourceUringSink *self = GST_MULTI_SOURCE_URING_SINK (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_free (self->location);
+      self->location = g_value_dup_string (value);
+      break;
+    case PROP_CHUNKS:
+      self->n_chunks = g_value_get_uint (value);
+      break;
+    case PROP_CHUNK_SIZE:
+      self->chunk_size = g_value_get_uint (value);
+      break;
+    case PROP_FLUSH_INTERVAL:
+      self->flush_interval = g_value_get_uint64 (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+uring_sink_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstMultiSourceUringSink *self = GST_MULTI_SOURCE_URING_SINK (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      g_value_set_string (value, self->location);
+      break;
+    case PROP_CHUNKS:
+      g_value_set_uint (value, self->n_chunks);
+      break;
+    case PROP_CHUNK_SIZE:
+      g_value_set_uint (value, self->chunk_size);
+      break;
+    case PROP_FLUSH_INTERVAL:
+      g_value_set_uint64 (value, self->flush_interval);
+      break;
+    case PROP_WRITE_STATS:
+      g_value_take_boxed (value, get_stats (self));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+uring_sink_finalize (GObject * object)
+{
+  GstMultiSourceUringSink *self = GST_MULTI_SOURCE_URING_SINK (object);
+
+  g_free (self->location);
+
+  G_OBJECT_CLASS (uring_sink_parent_class)->finalize (object);
+}
+
+static void
+uring_sink_class_init (GstMultiSourceUringSinkClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSinkClass *basesink_class = GST_BASE_SINK_CLASS (klass);
+
+  gobject_class->set_property = uring_sink_set_property;
+  gobject_class->get_property = uring_sink_get_property;
+  gobject_class->finalize = uring_sink_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_LOCATION,
+      g_param_spec_string ("location", "File Location",
+          "Location of the file to write", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_CHUNKS,
+      g_param_spec_uint ("chunks", "Chunks",
+          "Number of registered buffers, the most writes in flight", 1, 4096,
+          URING_SINK_DEFAULT_CHUNKS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_CHUNK_SIZE,
+      g_param_spec_uint ("chunk-size", "Chunk size",
+          "Size of each write in bytes", 4096, G_MAXINT,
+          URING_SINK_DEFAULT_CHUNK_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_FLUSH_INTERVAL,
+      g_param_spec_uint64 ("flush-interval", "Flush interval",
+          "Longest time data waits for its chunk to fill, 0 to wait",
+          0, G_MAXUINT64, URING_SINK_DEFAULT_FLUSH_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_WRITE_STATS,
+      g_param_spec_boxed ("write-stats", "Write statistics",
+          "Bytes, writes, drops and completion latency in microseconds",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (element_class, &sink_template);
+  gst_element_class_set_static_metadata (element_class,
+      "io_uring File Sink", "Sink/File",
+      "Write data to a file asynchronously with io_uring",
+      "gst-multisource-launch");
+
+  basesink_class->start = uring_sink_start;
+  basesink_class->stop = uring_sink_stop;
+  basesink_class->render = uring_sink_render;
+  basesink_class->event = uring_sink_event;
+}
+
+static void
+uring_sink_init (GstMultiSourceUringSink * self)
+{
+  self->fd = -1;
+  self->n_chunks = URING_SINK_DEFAULT_CHUNKS;
+  self->chunk_size = URING_SINK_DEFAULT_CHUNK_SIZE;
+  self->flush_interval = URING_SINK_DEFAULT_FLUSH_INTERVAL;
+  g_queue_init (&self->free);
+  gst_base_sink_set_sync (GST_BASE_SINK (self), FALSE);
+}
@@ -0,0 +1,94 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_MULTI_SOURCE_URING_SINK_H__
+#define __GST_MULTI_SOURCE_URING_SINK_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+#include <liburing.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MULTI_SOURCE_URING_SINK (uring_sink_get_type ())
+#define GST_MULTI_SOURCE_URING_SINK(obj) (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+    GST_TYPE_MULTI_SOURCE_URING_SINK, GstMultiSourceUringSink))
+
+#define URING_SINK_DEFAULT_CHUNKS 32
+#define URING_SINK_DEFAULT_CHUNK_SIZE (1024 * 1024)
+#define URING_SINK_DEFAULT_FLUSH_INTERVAL GST_SECOND
+#define URING_SINK_LATENCY_BUCKETS 32
+
+/* A registered buffer collecting the data of one write */
+typedef struct
+{
+  guint index;
+  guint8 *data;
+  gsize filled;
+  gsize written;
+  guint64 offset;
+  gint64 submitted;
+} UringChunk;
+
+typedef struct _GstMultiSourceUringSink
+{
+  GstBaseSink parent;
+
+  /* properties */
+  gchar *location;
+  guint n_chunks;
+  guint chunk_size;
+  GstClockTime flush_interval;
+
+  gint fd;
+  struct io_uring ring;
+  gboolean have_ring;
+  /* the chunks could be registered, within RLIMIT_MEMLOCK */
+  gboolean registered;
+  UringChunk *chunks;
+  /* chunks free to be filled, the first one being filled */
+  GQueue free;
+  gint64 filling_since;
+  guint64 offset;
+  guint in_flight;
+  gint error;
+  /* dropping incoming data, warned about once per overrun */
+  gboolean dropping;
+
+  /* statistics, protected by the object lock */
+  guint64 bytes;
+  guint64 writes;
+  guint64 dropped_bytes;
+  guint max_in_flight;
+  guint64 latency_max;
+  guint64 latency_sum;
+  guint64 latency[URING_SINK_LATENCY_BUCKETS];
+} GstMultiSourceUringSink;
+
+typedef struct _GstMultiSourceUringSinkClass
+{
+  GstBaseSinkClass parent_class;
+} GstMultiSourceUringSinkClass;
+
+GType uring_sink_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_MULTI_SOURCE_URING_SINK_H__ */
@@ -0,0 +1,98 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "chunkformat.h"
+
+static void
+test_file_header (void)
+{
+  guint8 data[CHUNK_FILE_HEADER_SIZE];
+
+  chunk_write_file_header (data);
+  g_assert_true (chunk_check_file_header (data, sizeof (data)));
+  g_assert_false (chunk_check_file_header (data, sizeof (data) - 1));
+  data[0] ^= 0xff;
+  g_assert_false (chunk_check_file_header (data, sizeof (data)));
+}
+
+static void
+test_header (void)
+{
+  GstMultiSourceChunkHeader in = { CHUNK_TYPE_DATA,
+    CHUNK_FLAG_KEYFRAME | CHUNK_FLAG_DISCONT, 2, 1000,
+    3 * GST_SECOND, GST_CLOCK_TIME_NONE
+  };
+  GstMultiSourceChunkHeader out;
+  guint8 data[CHUNK_HEADER_SIZE];
+
+  chunk_write_header (data, &in);
+  g_assert_true (chunk_read_header (data, &out));
+  g_assert_cmpint (out.type, ==, in.type);
+  g_assert_cmpint (out.flags, ==, in.flags);
+  g_assert_cmpuint (out.stream, ==, in.stream);
+  g_assert_cmpuint (out.size, ==, in.size);
+  g_assert_cmpuint (out.pts, ==, in.pts);
+  g_assert_cmpuint (out.dts, ==, in.dts);
+
+  memset (data, 0, 4);
+  g_assert_false (chunk_read_header (data, &out));
+}
+
+static void
+test_size (void)
+{
+  g_assert_cmpuint (chunk_get_size (0), ==, CHUNK_HEADER_SIZE);
+  g_assert_cmpuint (chunk_get_size (1), ==, CHUNK_HEADER_SIZE + CHUNK_ALIGN);
+  g_assert_cmpuint (chunk_get_size (CHUNK_ALIGN), ==,
+      CHUNK_HEADER_SIZE + CHUNK_ALIGN);
+  g_assert_cmpuint (chunk_get_size (G_MAXUINT32) % CHUNK_ALIGN, ==, 0);
+}
+
+static void
+test_trailer (void)
+{
+  guint8 data[CHUNK_FILE_HEADER_SIZE + CHUNK_TRAILER_SIZE];
+
+  chunk_write_file_header (data);
+  chunk_write_trailer (data + CHUNK_FILE_HEADER_SIZE, 4096);
+  g_assert_cmpuint (chunk_read_trailer (data, sizeof (data)), ==, 4096);
+
+  /* A file still being written has no trailer */
+  memset (data + CHUNK_FILE_HEADER_SIZE, 0, CHUNK_TRAILER_SIZE);
+  g_assert_cmpuint (chunk_read_trailer (data, sizeof (data)), ==,
+      CHUNK_NO_INDEX);
+  g_assert_cmpuint (chunk_read_trailer (data, CHUNK_FILE_HEADER_SIZE), ==,
+      CHUNK_NO_INDEX);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/chunkformat/file-header", test_file_header);
+  g_test_add_func ("/chunkformat/header", test_header);
+  g_test_add_func ("/chunkformat/size", test_size);
+  g_test_add_func ("/chunkformat/trailer", test_trailer);
+
+  return g_test_run ();
+}
@@ -0,0 +1,99 @@
+/* GStreamer command line scalable application
+ *
+ * Copyright (C) 2019 Stéphane Cerveau <scerveau@collabora.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <glib/gstdio.h>
+
+#include "keyindex.h"
+
+#define N_ENTRIES 1000
+
+/* More entries than one write batch, two interleaved streams */
+static void
+test_round_trip (void)
+{
+  GstMultiSourceKeyIndexWriter *writer;
+  GstMultiSourceKeyIndex *index;
+  GstMultiSourceKeyEntry entry;
+  GError *err = NULL;
+  gchar *location;
+  gint fd;
+  gsize i;
+
+  fd = g_file_open_tmp ("keyindex-XXXXXX.idx", &location, &err);
+  g_assert_no_error (err);
+  g_close (fd, NULL);
+
+  writer = key_index_writer_new (location, &err);
+  g_assert_no_error (err);
+  for (i = 0; i < N_ENTRIES; i++)
+    key_index_writer_add (writer, i * 4096, i * GST_SECOND, i % 2);
+  g_assert_cmpuint (key_index_writer_get_entries (writer), ==, N_ENTRIES);
+  key_index_writer_free (writer);
+
+  index = key_index_open (location, &err);
+  g_assert_no_error (err);
+  g_assert_cmpuint (key_index_get_size (index), ==, N_ENTRIES);
+  for (i = 0; i < N_ENTRIES; i++) {
+    key_index_get_entry (index, i, &entry);
+    g_assert_cmpuint (entry.offset, ==, i * 4096);
+    g_assert_cmpuint (entry.pts, ==, i * GST_SECOND);
+    g_assert_cmpuint (entry.stream, ==, i % 2);
+  }
+
+  /* The last keyframe at or before the position, of the asked stream */
+  g_assert_true (key_index_lookup (index, 10 * GST_SECOND + 1,
+          KEY_INDEX_STREAM_ANY, &entry));
+  g_assert_cmpuint (entry.pts, ==, 10 * GST_SECOND);
+  g_assert_true (key_index_lookup (index, 10 * GST_SECOND, 1, &entry));
+  g_assert_cmpuint (entry.pts, ==, 9 * GST_SECOND);
+  g_assert_true (key_index_lookup (index, G_MAXUINT64 - 1, 0, &entry));
+  g_assert_cmpuint (entry.pts, ==, (N_ENTRIES - 2) * GST_SECOND);
+  g_assert_false (key_index_lookup (index, 0, 1, &entry));
+  key_index_close (index);
+
+  g_unlink (location);
+  g_free (location);
+}
+
+static void
+test_entry (void)
+{
+  GstMultiSourceKeyEntry in = { G_GUINT64_CONSTANT (0x123456789a), 42, 3, 1 };
+  GstMultiSourceKeyEntry out;
+  guint8 data[KEY_INDEX_ENTRY_SIZE];
+
+  key_index_write_entry (data, &in);
+  key_index_read_entry (data, &out);
+  g_assert_cmpuint (out.offset, ==, in.offset);
+  g_assert_cmpuint (out.pts, ==, in.pts);
+  g_assert_cmpuint (out.stream, ==, in.stream);
+  g_assert_cmpuint (out.flags, ==, in.flags);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/keyindex/entry", test_entry);
+  g_test_add_func ("/keyindex/round-trip", test_round_trip);
+
+  return g_test_run ();
+}
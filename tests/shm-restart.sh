@@ -0,0 +1,42 @@
+#!/bin/sh
+# Check that a shm:// branch survives its producer restarting: the launcher
+# must still be running at the end and have connected more than once.
+#
+# Usage: shm-restart.sh PRODUCER LAUNCHER
+
+PRODUCER=$1
+LAUNCHER=$2
+DIR=$(mktemp -d) || exit 99
+SOCKET="$DIR/test"
+
+trap 'kill -INT $PRODUCER_PID 2>/dev/null; wait; rm -rf "$DIR"' EXIT
+
+# Raw video so that no encoder or decoder plugin is needed
+"$PRODUCER" --restart=2 \
+    -p "videotestsrc is-live=true ! video/x-raw,width=160,height=120" \
+    "$SOCKET" > "$DIR/producer.log" 2>&1 &
+PRODUCER_PID=$!
+
+i=0
+while [ ! -S "$SOCKET" ]; do
+  i=$((i + 1))
+  if [ $i -gt 50 ] || ! kill -0 $PRODUCER_PID 2>/dev/null; then
+    echo "Producer did not start:"
+    cat "$DIR/producer.log"
+    exit 77
+  fi
+  sleep 0.1
+done
+
+GST_DEBUG=multisource-launch:4 GST_DEBUG_NO_COLOR=1 \
+    timeout 7 "$LAUNCHER" -s "shm://$SOCKET" > "$DIR/launcher.log" 2>&1
+STATUS=$?
+
+CONNECTIONS=$(grep -c "Connected to" "$DIR/launcher.log")
+if [ $STATUS -ne 124 ] || [ "$CONNECTIONS" -lt 2 ]; then
+  echo "Launcher exited with $STATUS after $CONNECTIONS connections:"
+  cat "$DIR/launcher.log"
+  exit 1
+fi
+
+exit 0